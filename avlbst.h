@@ -6,7 +6,12 @@
 #include <cstdlib>
 #include <cstdint>
 #include <algorithm>
+#include <iterator>
+#include <stdexcept>
+#include <thread>
+#include <vector>
 #include "bst.h"
+#include "parallel_sort.h"
 
 struct KeyError { };
 
@@ -21,19 +26,20 @@ class AVLNode : public Node<Key, Value>
 public:
     // Constructor/destructor.
     AVLNode(const Key& key, const Value& value, AVLNode<Key, Value>* parent);
-    virtual ~AVLNode();
+    AVLNode(Key&& key, Value&& value, AVLNode<Key, Value>* parent);
+    ~AVLNode();
 
     // Getter/setter for the node's height.
     int8_t getBalance () const;
     void setBalance (int8_t balance);
     void updateBalance(int8_t diff);
 
-    // Getters for parent, left, and right. These need to be redefined since they
+    // Getters for parent, left, and right. These hide the Node versions since they
     // return pointers to AVLNodes - not plain Nodes. See the Node class in bst.h
     // for more information.
-    virtual AVLNode<Key, Value>* getParent() const override;
-    virtual AVLNode<Key, Value>* getLeft() const override;
-    virtual AVLNode<Key, Value>* getRight() const override;
+    AVLNode<Key, Value>* getParent() const;
+    AVLNode<Key, Value>* getLeft() const;
+    AVLNode<Key, Value>* getRight() const;
 
 protected:
     int8_t balance_;    // effectively a signed char
@@ -55,266 +61,1854 @@ AVLNode<Key, Value>::AVLNode(const Key& key, const Value& value, AVLNode<Key, Va
 
 }
 
+/**
+* A constructor that moves the key and value into the node.
+*/
+template<class Key, class Value>
+AVLNode<Key, Value>::AVLNode(Key&& key, Value&& value, AVLNode<Key, Value> *parent) :
+    Node<Key, Value>(std::move(key), std::move(value), parent), balance_(0)
+{
+
+}
+
+/**
+* A destructor which does nothing.
+*/
+template<class Key, class Value>
+AVLNode<Key, Value>::~AVLNode()
+{
+
+}
+
+/**
+* A getter for the balance of a AVLNode.
+*/
+template<class Key, class Value>
+int8_t AVLNode<Key, Value>::getBalance() const
+{
+    return balance_;
+}
+
+/**
+* A setter for the balance of a AVLNode.
+*/
+template<class Key, class Value>
+void AVLNode<Key, Value>::setBalance(int8_t balance)
+{
+    balance_ = balance;
+}
+
+/**
+* Adds diff to the balance of a AVLNode.
+*/
+template<class Key, class Value>
+void AVLNode<Key, Value>::updateBalance(int8_t diff)
+{
+    balance_ += diff;
+}
+
+/**
+* A getter for the parent that hides Node::getParent(), since a static_cast is necessary to
+* make sure that our node is a AVLNode. The cast is free at runtime.
+*/
+template<class Key, class Value>
+AVLNode<Key, Value> *AVLNode<Key, Value>::getParent() const
+{
+    return static_cast<AVLNode<Key, Value>*>(Node<Key, Value>::getParent());
+}
+
+/**
+* Hidden for the same reasons as above.
+*/
+template<class Key, class Value>
+AVLNode<Key, Value> *AVLNode<Key, Value>::getLeft() const
+{
+    return static_cast<AVLNode<Key, Value>*>(this->left_);
+}
+
+/**
+* Hidden for the same reasons as above.
+*/
+template<class Key, class Value>
+AVLNode<Key, Value> *AVLNode<Key, Value>::getRight() const
+{
+    return static_cast<AVLNode<Key, Value>*>(this->right_);
+}
+
+
+/*
+  -----------------------------------------------
+  End implementations for the AVLNode class.
+  -----------------------------------------------
+*/
+
+/**
+* An AVL node with the same interface as AVLNode that stores its balance in the
+* low bits of the parent link instead of a separate byte. An AVLNode pays a full
+* word of padding for its balance, so this layout is one word smaller per node.
+* The balance is kept as balance + 2, since insertFix briefly stores -2 or +2.
+*/
+template <typename Key, typename Value>
+class CompactAVLNode : public Node<Key, Value>
+{
+public:
+    CompactAVLNode(const Key& key, const Value& value, CompactAVLNode<Key, Value>* parent);
+    CompactAVLNode(Key&& key, Value&& value, CompactAVLNode<Key, Value>* parent);
+    ~CompactAVLNode();
+
+    int8_t getBalance () const;
+    void setBalance (int8_t balance);
+    void updateBalance(int8_t diff);
+
+    CompactAVLNode<Key, Value>* getParent() const;
+    CompactAVLNode<Key, Value>* getLeft() const;
+    CompactAVLNode<Key, Value>* getRight() const;
+};
+
+/*
+  -------------------------------------------------
+  Begin implementations for the CompactAVLNode class.
+  -------------------------------------------------
+*/
+
+/**
+* An explicit constructor, which starts the node with a balance of 0.
+*/
+template<class Key, class Value>
+CompactAVLNode<Key, Value>::CompactAVLNode(const Key& key, const Value& value, CompactAVLNode<Key, Value> *parent) :
+    Node<Key, Value>(key, value, parent)
+{
+    static_assert(alignof(Node<Key, Value>) >= 8, "balance needs three free bits in the parent link");
+    setBalance(0);
+}
+
+/**
+* A constructor that moves the key and value into the node.
+*/
+template<class Key, class Value>
+CompactAVLNode<Key, Value>::CompactAVLNode(Key&& key, Value&& value, CompactAVLNode<Key, Value> *parent) :
+    Node<Key, Value>(std::move(key), std::move(value), parent)
+{
+    setBalance(0);
+}
+
+/**
+* A destructor which does nothing.
+*/
+template<class Key, class Value>
+CompactAVLNode<Key, Value>::~CompactAVLNode()
+{
+
+}
+
+/**
+* A getter for the balance, decoded from the parent link.
+*/
+template<class Key, class Value>
+int8_t CompactAVLNode<Key, Value>::getBalance() const
+{
+    return static_cast<int8_t>(this->getParentTag()) - 2;
+}
+
+/**
+* A setter for the balance, encoded into the parent link.
+*/
+template<class Key, class Value>
+void CompactAVLNode<Key, Value>::setBalance(int8_t balance)
+{
+    this->setParentTag(static_cast<std::uintptr_t>(balance + 2));
+}
+
+/**
+* Adds diff to the balance.
+*/
+template<class Key, class Value>
+void CompactAVLNode<Key, Value>::updateBalance(int8_t diff)
+{
+    setBalance(getBalance() + diff);
+}
+
+/**
+* A getter for the parent, with the balance bits masked off by Node.
+*/
+template<class Key, class Value>
+CompactAVLNode<Key, Value> *CompactAVLNode<Key, Value>::getParent() const
+{
+    return static_cast<CompactAVLNode<Key, Value>*>(Node<Key, Value>::getParent());
+}
+
+/**
+* Hidden for the same reasons as in AVLNode.
+*/
+template<class Key, class Value>
+CompactAVLNode<Key, Value> *CompactAVLNode<Key, Value>::getLeft() const
+{
+    return static_cast<CompactAVLNode<Key, Value>*>(this->left_);
+}
+
+/**
+* Hidden for the same reasons as in AVLNode.
+*/
+template<class Key, class Value>
+CompactAVLNode<Key, Value> *CompactAVLNode<Key, Value>::getRight() const
+{
+    return static_cast<CompactAVLNode<Key, Value>*>(this->right_);
+}
+
+/*
+  -----------------------------------------------
+  End implementations for the CompactAVLNode class.
+  -----------------------------------------------
+*/
+
+/**
+* A CompactAVLNode that also keeps the number of nodes in its subtree,
+* which lets an AVLTree answer rank and select queries in O(log n).
+*/
+template <typename Key, typename Value>
+class RankedAVLNode : public CompactAVLNode<Key, Value>
+{
+public:
+    RankedAVLNode(const Key& key, const Value& value, RankedAVLNode<Key, Value>* parent);
+    RankedAVLNode(Key&& key, Value&& value, RankedAVLNode<Key, Value>* parent);
+    ~RankedAVLNode();
+
+    std::size_t getSubtreeSize() const;
+    void setSubtreeSize(std::size_t size);
+
+    RankedAVLNode<Key, Value>* getParent() const;
+    RankedAVLNode<Key, Value>* getLeft() const;
+    RankedAVLNode<Key, Value>* getRight() const;
+
+protected:
+    std::size_t subtreeSize_;
+};
+
+/*
+  -------------------------------------------------
+  Begin implementations for the RankedAVLNode class.
+  -------------------------------------------------
+*/
+
+/**
+* An explicit constructor for a new leaf, whose subtree holds just itself.
+*/
+template<class Key, class Value>
+RankedAVLNode<Key, Value>::RankedAVLNode(const Key& key, const Value& value, RankedAVLNode<Key, Value> *parent) :
+    CompactAVLNode<Key, Value>(key, value, parent), subtreeSize_(1)
+{
+
+}
+
+/**
+* A constructor that moves the key and value into the node.
+*/
+template<class Key, class Value>
+RankedAVLNode<Key, Value>::RankedAVLNode(Key&& key, Value&& value, RankedAVLNode<Key, Value> *parent) :
+    CompactAVLNode<Key, Value>(std::move(key), std::move(value), parent), subtreeSize_(1)
+{
+
+}
+
 /**
 * A destructor which does nothing.
 */
-template<class Key, class Value>
-AVLNode<Key, Value>::~AVLNode()
+template<class Key, class Value>
+RankedAVLNode<Key, Value>::~RankedAVLNode()
+{
+
+}
+
+/**
+* A getter for the number of nodes in this node's subtree.
+*/
+template<class Key, class Value>
+std::size_t RankedAVLNode<Key, Value>::getSubtreeSize() const
+{
+    return subtreeSize_;
+}
+
+/**
+* A setter for the number of nodes in this node's subtree.
+*/
+template<class Key, class Value>
+void RankedAVLNode<Key, Value>::setSubtreeSize(std::size_t size)
+{
+    subtreeSize_ = size;
+}
+
+/**
+* Hidden for the same reasons as in AVLNode.
+*/
+template<class Key, class Value>
+RankedAVLNode<Key, Value> *RankedAVLNode<Key, Value>::getParent() const
+{
+    return static_cast<RankedAVLNode<Key, Value>*>(Node<Key, Value>::getParent());
+}
+
+/**
+* Hidden for the same reasons as in AVLNode.
+*/
+template<class Key, class Value>
+RankedAVLNode<Key, Value> *RankedAVLNode<Key, Value>::getLeft() const
+{
+    return static_cast<RankedAVLNode<Key, Value>*>(this->left_);
+}
+
+/**
+* Hidden for the same reasons as in AVLNode.
+*/
+template<class Key, class Value>
+RankedAVLNode<Key, Value> *RankedAVLNode<Key, Value>::getRight() const
+{
+    return static_cast<RankedAVLNode<Key, Value>*>(this->right_);
+}
+
+/*
+  -----------------------------------------------
+  End implementations for the RankedAVLNode class.
+  -----------------------------------------------
+*/
+
+/**
+* Tells AVLTree whether a node type keeps subtree sizes. The default is
+* for layouts that do not; every hook is a no-op and compiles away.
+*/
+template <typename NodeT>
+struct SubtreeSizeTraits
+{
+    static const bool enabled = false;
+    static std::size_t get(const NodeT*) { return 0; }
+    static void add(NodeT*, long) { }
+    static void update(NodeT*) { }
+    static void swap(NodeT*, NodeT*) { }
+};
+
+/**
+* Subtree sizes for RankedAVLNode.
+*/
+template <typename Key, typename Value>
+struct SubtreeSizeTraits<RankedAVLNode<Key, Value> >
+{
+    typedef RankedAVLNode<Key, Value> NodeT;
+    static const bool enabled = true;
+
+    // size of a possibly empty subtree
+    static std::size_t get(const NodeT* node)
+    {
+        return node == NULL ? 0 : node->getSubtreeSize();
+    }
+    static void add(NodeT* node, long delta)
+    {
+        node->setSubtreeSize(node->getSubtreeSize() + delta);
+    }
+    // recompute from the children, which must already be correct
+    static void update(NodeT* node)
+    {
+        node->setSubtreeSize(1 + get(node->getLeft()) + get(node->getRight()));
+    }
+    // sizes belong to positions, so they move back when nodeSwap moves nodes
+    static void swap(NodeT* n1, NodeT* n2)
+    {
+        std::size_t temp = n1->getSubtreeSize();
+        n1->setSubtreeSize(n2->getSubtreeSize());
+        n2->setSubtreeSize(temp);
+    }
+};
+
+
+/**
+* The default way AVLTree::setUnion() and setIntersection() combine the
+* values of a key found in both trees: keep the first tree's value.
+*/
+struct KeepFirstValue
+{
+    template<typename V>
+    const V& operator()(const V& first, const V&) const
+    {
+        return first;
+    }
+};
+
+/**
+* A self-balancing AVL tree. NodeT selects the node layout: AVLNode keeps the
+* balance in its own byte, CompactAVLNode packs it into the parent link.
+* Both expose the same getters and setters, so the rebalancing code is shared.
+*/
+template <class Key, class Value,
+          class Compare = std::less<Key>,
+          class Alloc = std::allocator<std::pair<const Key, Value> >,
+          class NodeT = AVLNode<Key, Value>,
+          class Stats = NoTreeStats>
+class AVLTree : public BinarySearchTree<Key, Value, Compare, Alloc, Stats>
+{
+public:
+    explicit AVLTree(const Compare& comp = Compare(), const Alloc& alloc = Alloc());
+    explicit AVLTree(const Alloc& alloc);
+    AVLTree(AVLTree&& other);
+    AVLTree& operator=(AVLTree&& other);
+    virtual ~AVLTree();
+    using BinarySearchTree<Key, Value, Compare, Alloc, Stats>::insert;
+    virtual void insert (const std::pair<const Key, Value> &new_item); // TODO
+    virtual void remove(const Key& key);  // TODO
+    virtual void clear();
+    int height() const;
+
+    // Work done restoring balance after the last node was linked or unlinked
+    struct RebalanceStats
+    {
+        unsigned rotations;
+        unsigned ancestors;
+    };
+    RebalanceStats lastRebalance() const;
+
+    // Bulk construction; both replace the current contents
+    template<typename ForwardIt>
+    void bulkLoad(ForwardIt first, ForwardIt last);
+    void bulkLoadUnsorted(std::vector<std::pair<Key, Value> > items, unsigned threads = 0);
+
+    // Batched updates, applied in key order after sorting the batch
+    void insert_batch(std::vector<std::pair<Key, Value> > items, unsigned threads = 0);
+    std::size_t erase_batch(std::vector<Key> keys, unsigned threads = 0);
+
+    // Split and join in O(log n). Each tree keeps a node pool of its own, so the
+    // results may go to different threads; their pools share the blocks the nodes
+    // came from.
+    // Unless NodeT keeps subtree sizes, the parts count their items in O(n) on
+    // the first call to size()
+    std::pair<AVLTree, AVLTree> split(const Key& key);
+    static AVLTree join(AVLTree&& left, const std::pair<const Key, Value>& pivot, AVLTree&& right);
+    static AVLTree join(AVLTree&& left, AVLTree&& right);
+
+    // Join-based set operations, spread over up to "threads" threads
+    template<typename Combine = KeepFirstValue>
+    static AVLTree setUnion(AVLTree&& a, AVLTree&& b, Combine combine = Combine(), unsigned threads = 0);
+    template<typename Combine = KeepFirstValue>
+    static AVLTree setIntersection(AVLTree&& a, AVLTree&& b, Combine combine = Combine(), unsigned threads = 0);
+    static AVLTree setDifference(AVLTree&& a, AVLTree&& b, unsigned threads = 0);
+
+    // Order statistics; these need a NodeT that keeps subtree sizes, such as RankedAVLNode
+    typename BinarySearchTree<Key, Value, Compare, Alloc, Stats>::iterator select(std::size_t k) const;
+    std::size_t rank(const Key& key) const;
+    std::size_t count(const Key& lo, const Key& hi) const;
+protected:
+    typedef SubtreeSizeTraits<NodeT> SizeTraits;
+
+    virtual void nodeSwap( NodeT* n1, NodeT* n2);
+    virtual void destroyNode(Node<Key, Value>* node);
+    virtual Node<Key, Value>* linkNewNode(Node<Key, Value>* parent, Key&& key, Value&& value);
+    virtual void buildFromSnapshot(SnapshotSource<Key, Value>& source, std::size_t count);
+
+    // Add helper functions here
+    void attachNewNode(NodeT* node);
+    void insertFix(NodeT* parent, NodeT* node);
+    void removeNode(NodeT* n);
+    void unlinkNode(NodeT* n);
+    void removeFix(NodeT* node, int diff);
+    void rotateRight(NodeT* grandparent); 
+    void rotateLeft(NodeT* parent);
+    NodeT* predecessor(NodeT* current);
+    template<typename ForwardIt>
+    NodeT* buildBalanced(ForwardIt& next, ForwardIt last, std::size_t count, NodeT* parent);
+    NodeT* buildSnapshotNodes(SnapshotSource<Key, Value>& source, std::size_t count, NodeT* parent, const NodeT*& last);
+    static int bitLength(std::size_t count);
+    void addPathSize(NodeT* node, long delta);
+
+    // Batch helpers
+    bool batchPrefersRebuild(std::size_t batchSize) const;
+    bool batchPrefersFinger(std::size_t batchSize) const;
+    NodeT* fingerFind(NodeT* finger, const Key& key, NodeT*& parent) const;
+    void collectNodes(std::vector<NodeT*>& nodes) const;
+    NodeT* linkBalanced(NodeT* const* nodes, std::size_t count, NodeT* parent);
+    void relinkAll(const std::vector<NodeT*>& nodes);
+
+    // Split, join and set operation helpers. They work on detached
+    // subtrees, whose height is carried alongside the root.
+    struct Subtree
+    {
+        NodeT* root;
+        int height;
+    };
+    static const int kForkHeight = 16;
+    Subtree takeNodes();
+    void adoptNodes(Subtree nodes,
+                    std::size_t size = BinarySearchTree<Key, Value, Compare, Alloc, Stats>::kUnknownSize);
+    static std::size_t knownSum(std::size_t a, std::size_t b, long delta);
+    void destroyNodes(const std::vector<NodeT*>& nodes);
+    static void appendNodes(NodeT* node, std::vector<NodeT*>& nodes);
+    static void detachChildren(NodeT* node, int height, Subtree& left, Subtree& right);
+    Subtree joinNodes(Subtree left, NodeT* pivot, Subtree right);
+    Subtree joinPair(Subtree left, Subtree right);
+    Subtree splitLast(Subtree nodes, NodeT*& last);
+    void splitNodes(Subtree nodes, const Key& key, Subtree& left, Subtree& right, NodeT** found = NULL);
+    static AVLTree joinAt(AVLTree&& left, NodeT* pivot, AVLTree&& right);
+    template<typename First, typename Second>
+    void forkJoin(bool fork, unsigned forks, First first, Second second, std::vector<NodeT*>& discarded);
+    template<typename Combine>
+    Subtree unionNodes(Subtree a, Subtree b, Combine& combine, unsigned forks, std::vector<NodeT*>& discarded);
+    template<typename Combine>
+    Subtree insertSingle(Subtree nodes, NodeT* single, bool singleFirst, Combine& combine,
+                         std::vector<NodeT*>& discarded);
+    template<typename Combine>
+    Subtree intersectNodes(Subtree a, Subtree b, Combine& combine, unsigned forks, std::vector<NodeT*>& discarded);
+    Subtree subtractNodes(Subtree a, Subtree b, unsigned forks, std::vector<NodeT*>& discarded);
+
+    // Height of the whole tree, kept up to date by insertFix and removeFix
+    int height_;
+    RebalanceStats lastRebalance_;
+};
+
+/**
+* Default constructor, which sizes the node pool for NodeT.
+*/
+template<class Key, class Value, class Compare, class Alloc, class NodeT, class Stats>
+AVLTree<Key, Value, Compare, Alloc, NodeT, Stats>::AVLTree(const Compare& comp, const Alloc& alloc) :
+    BinarySearchTree<Key, Value, Compare, Alloc, Stats>(sizeof(NodeT), alignof(NodeT), comp, alloc),
+    height_(0),
+    lastRebalance_()
+{
+}
+
+/**
+* Constructor taking only an allocator, with a default Compare.
+*/
+template<class Key, class Value, class Compare, class Alloc, class NodeT, class Stats>
+AVLTree<Key, Value, Compare, Alloc, NodeT, Stats>::AVLTree(const Alloc& alloc) :
+    BinarySearchTree<Key, Value, Compare, Alloc, Stats>(sizeof(NodeT), alignof(NodeT), Compare(), alloc),
+    height_(0),
+    lastRebalance_()
+{
+}
+
+/**
+* Move constructor, which takes other's nodes and height.
+*/
+template<class Key, class Value, class Compare, class Alloc, class NodeT, class Stats>
+AVLTree<Key, Value, Compare, Alloc, NodeT, Stats>::AVLTree(AVLTree&& other) :
+    BinarySearchTree<Key, Value, Compare, Alloc, Stats>(std::move(other)),
+    height_(other.height_),
+    lastRebalance_(other.lastRebalance_)
+{
+    other.height_ = 0;
+}
+
+/**
+* Move assignment, which clears this tree and then takes other's nodes.
+*/
+template<class Key, class Value, class Compare, class Alloc, class NodeT, class Stats>
+AVLTree<Key, Value, Compare, Alloc, NodeT, Stats>&
+AVLTree<Key, Value, Compare, Alloc, NodeT, Stats>::operator=(AVLTree&& other)
+{
+    if(this != &other){
+        BinarySearchTree<Key, Value, Compare, Alloc, Stats>::operator=(std::move(other));
+        height_ = other.height_;
+        lastRebalance_ = other.lastRebalance_;
+        other.height_ = 0;
+    }
+    return *this;
+}
+
+/**
+* Destructor, which clears the tree while destroyNode() still
+* dispatches to AVLTree.
+*/
+template<class Key, class Value, class Compare, class Alloc, class NodeT, class Stats>
+AVLTree<Key, Value, Compare, Alloc, NodeT, Stats>::~AVLTree()
+{
+    this->clear();
+}
+
+/**
+* Removes all contents of the tree.
+*/
+template<class Key, class Value, class Compare, class Alloc, class NodeT, class Stats>
+void AVLTree<Key, Value, Compare, Alloc, NodeT, Stats>::clear()
+{
+    BinarySearchTree<Key, Value, Compare, Alloc, Stats>::clear();
+    height_ = 0;
+}
+
+/**
+* Returns the height of the tree in O(1); an empty tree has height 0.
+*/
+template<class Key, class Value, class Compare, class Alloc, class NodeT, class Stats>
+int AVLTree<Key, Value, Compare, Alloc, NodeT, Stats>::height() const
+{
+    return height_;
+}
+
+/**
+* Returns how many rotations the last link or unlink of a single node
+* made, and how many ancestors its walk back up examined. An insert that
+* only overwrites a value, or a remove that finds nothing, leaves the
+* previous figures in place.
+*/
+template<class Key, class Value, class Compare, class Alloc, class NodeT, class Stats>
+typename AVLTree<Key, Value, Compare, Alloc, NodeT, Stats>::RebalanceStats
+AVLTree<Key, Value, Compare, Alloc, NodeT, Stats>::lastRebalance() const
+{
+    return lastRebalance_;
+}
+
+/**
+* Replaces the contents of the tree with the items in [first, last), which
+* must be sorted by key. If a key repeats, the last value wins, as with
+* repeated insert() calls. The tree is built perfectly balanced in O(n)
+* with balances set directly, so there are no per-key walks or rotations,
+* and nodes are allocated in key order so neighbours share cache lines.
+* Throws std::invalid_argument, leaving the tree untouched, if the range
+* is not sorted.
+*/
+template<class Key, class Value, class Compare, class Alloc, class NodeT, class Stats>
+template<typename ForwardIt>
+void AVLTree<Key, Value, Compare, Alloc, NodeT, Stats>::bulkLoad(ForwardIt first, ForwardIt last)
+{
+    // count the distinct keys and check the order before touching the tree
+    std::size_t count = 0;
+    for(ForwardIt prev = first, it = first; it != last; prev = it, ++it) {
+        if(it == first || this->comp_(prev->first, it->first)) {
+            ++count;
+        }
+        else if(this->comp_(it->first, prev->first)) {
+            throw std::invalid_argument("bulkLoad input is not sorted");
+        }
+    }
+
+    clear();
+    this->root_ = buildBalanced(first, last, count, static_cast<NodeT*>(NULL));
+    this->size_ = count;
+    height_ = bitLength(count);
+}
+
+/**
+* Replaces the contents of the tree with items, which may be in any order.
+* The items are stable-sorted by key on up to "threads" threads (0 means
+* one per hardware thread) and then bulk loaded, so for repeated keys the
+* one that came last wins.
+*/
+template<class Key, class Value, class Compare, class Alloc, class NodeT, class Stats>
+void AVLTree<Key, Value, Compare, Alloc, NodeT, Stats>::bulkLoadUnsorted(std::vector<std::pair<Key, Value> > items, unsigned threads)
+{
+    Compare comp = this->comp_;
+    parallelStableSort(items.begin(), items.end(),
+        [comp](const std::pair<Key, Value>& a, const std::pair<Key, Value>& b) { return comp(a.first, b.first); },
+        threads);
+    bulkLoad(items.begin(), items.end());
+}
+
+/**
+* Builds a perfectly balanced subtree from the next "count" distinct keys,
+* consuming them in order so nodes are created in key order. The left side
+* gets the extra node when count is even, so every balance is 0 or -1.
+*/
+template<class Key, class Value, class Compare, class Alloc, class NodeT, class Stats>
+template<typename ForwardIt>
+NodeT* AVLTree<Key, Value, Compare, Alloc, NodeT, Stats>::buildBalanced(ForwardIt& next, ForwardIt last, std::size_t count, NodeT* parent)
+{
+    if(count == 0){
+        return NULL;
+    }
+    std::size_t leftCount = count / 2;
+    std::size_t rightCount = count - 1 - leftCount;
+
+    NodeT* left = buildBalanced(next, last, leftCount, static_cast<NodeT*>(NULL));
+
+    // take the last item in a run of equal keys
+    ForwardIt item = next;
+    for(++next; next != last && !this->comp_(item->first, next->first); ++next){
+        item = next;
+    }
+
+    NodeT* node = this->template createNode<NodeT>(item->first, item->second, parent);
+    node->setLeft(left);
+    if(left != NULL){
+        left->setParent(node);
+    }
+    node->setRight(buildBalanced(next, last, rightCount, node));
+    node->setBalance(bitLength(rightCount) - bitLength(leftCount));
+    SizeTraits::update(node);
+    return node;
+}
+
+/**
+* Links count items read from a snapshot into the empty tree, perfectly
+* balanced and with balances set directly, as bulkLoad() does.
+*/
+template<class Key, class Value, class Compare, class Alloc, class NodeT, class Stats>
+void AVLTree<Key, Value, Compare, Alloc, NodeT, Stats>::buildFromSnapshot(SnapshotSource<Key, Value>& source, std::size_t count)
+{
+    const NodeT* last = NULL;
+    this->root_ = buildSnapshotNodes(source, count, static_cast<NodeT*>(NULL), last);
+    this->size_ = count;
+    height_ = bitLength(count);
+}
+
+/**
+* Builds a perfectly balanced subtree from the next count items of the
+* snapshot, shaped like buildBalanced() builds it. Each item is moved
+* into its node and checked to follow last, the node built before it.
+* On a failure the subtree's nodes are destroyed before it rethrows.
+*/
+template<class Key, class Value, class Compare, class Alloc, class NodeT, class Stats>
+NodeT* AVLTree<Key, Value, Compare, Alloc, NodeT, Stats>::buildSnapshotNodes(
+    SnapshotSource<Key, Value>& source, std::size_t count, NodeT* parent, const NodeT*& last)
+{
+    if(count == 0){
+        return NULL;
+    }
+    std::size_t leftCount = count / 2;
+    std::size_t rightCount = count - 1 - leftCount;
+
+    NodeT* left = buildSnapshotNodes(source, leftCount, static_cast<NodeT*>(NULL), last);
+
+    // nodes built so far are not in the tree yet, so a failure frees them here
+    NodeT* node;
+    try {
+        std::pair<Key, Value> item;
+        source.read(item.first, item.second);
+        if(last != NULL && !this->comp_(last->getKey(), item.first)){
+            throw std::runtime_error("Snapshot keys are not in increasing order");
+        }
+        node = this->template createNode<NodeT>(std::move(item.first), std::move(item.second), parent);
+    }
+    catch(...) {
+        this->destroySubtree(left);
+        throw;
+    }
+    last = node;
+
+    node->setLeft(left);
+    if(left != NULL){
+        left->setParent(node);
+    }
+    try {
+        node->setRight(buildSnapshotNodes(source, rightCount, node, last));
+    }
+    catch(...) {
+        this->destroySubtree(node);
+        throw;
+    }
+    node->setBalance(bitLength(rightCount) - bitLength(leftCount));
+    SizeTraits::update(node);
+    return node;
+}
+
+/**
+* Returns the height of a perfectly balanced tree holding count nodes.
+*/
+template<class Key, class Value, class Compare, class Alloc, class NodeT, class Stats>
+int AVLTree<Key, Value, Compare, Alloc, NodeT, Stats>::bitLength(std::size_t count)
+{
+    int bits = 0;
+    while(count != 0){
+        ++bits;
+        count >>= 1;
+    }
+    return bits;
+}
+
+/**
+* Adds delta to the subtree size of node and every ancestor. Used after a
+* leaf is linked in or unlinked, before any rotations.
+*/
+template<class Key, class Value, class Compare, class Alloc, class NodeT, class Stats>
+void AVLTree<Key, Value, Compare, Alloc, NodeT, Stats>::addPathSize(NodeT* node, long delta)
+{
+    if(!SizeTraits::enabled){
+        return;
+    }
+    for(; node != NULL; node = node->getParent()){
+        SizeTraits::add(node, delta);
+    }
+}
+
+/**
+* Inserts every item, overwriting the values of keys already in the tree;
+* for keys repeated in the batch the one that came last wins.
+* The batch is stable-sorted by key on up to "threads" threads (0 means one
+* per hardware thread) and then applied in key order, so consecutive walks
+* share their upper levels in cache. A batch that is large next to the tree
+* is merged with the tree's nodes in one pass and the result relinked into
+* a perfectly balanced tree, rebalancing once in O(n + k). Otherwise keys
+* are inserted one by one; for a batch that is a sizeable fraction of the
+* tree each walk starts from the previous key's node instead of the root,
+* costing O(log(n / k)) amortized per key instead of O(log n).
+*/
+template<class Key, class Value, class Compare, class Alloc, class NodeT, class Stats>
+void AVLTree<Key, Value, Compare, Alloc, NodeT, Stats>::insert_batch(std::vector<std::pair<Key, Value> > items, unsigned threads)
+{
+    Compare comp = this->comp_;
+    parallelStableSort(items.begin(), items.end(),
+        [comp](const std::pair<Key, Value>& a, const std::pair<Key, Value>& b) { return comp(a.first, b.first); },
+        threads);
+
+    if(!batchPrefersRebuild(items.size())){
+        bool useFinger = batchPrefersFinger(items.size());
+        NodeT* finger = NULL;
+        for(std::size_t j = 0; j < items.size(); ++j){
+            NodeT* parent = NULL;
+            NodeT* node = fingerFind(useFinger ? finger : NULL, items[j].first, parent);
+            if(node != NULL){
+                node->getValue() = std::move(items[j].second);
+            }
+            else {
+                node = this->template createNode<NodeT>(std::move(items[j].first), std::move(items[j].second), parent);
+                attachNewNode(node);
+            }
+            finger = node;
+        }
+        return;
+    }
+
+    std::vector<NodeT*> old;
+    collectNodes(old);
+    std::vector<NodeT*> merged;
+    merged.reserve(old.size() + items.size());
+    std::vector<NodeT*> created;
+
+    try {
+        std::size_t i = 0;
+        std::size_t j = 0;
+        while(i < old.size() || j < items.size()){
+            if(j == items.size()){
+                merged.push_back(old[i++]);
+                continue;
+            }
+            // skip to the last item in a run of equal keys
+            while(j + 1 < items.size() && !comp(items[j].first, items[j + 1].first)){
+                ++j;
+            }
+            if(i == old.size() || comp(items[j].first, old[i]->getKey())){
+                NodeT* node = this->template createNode<NodeT>(std::move(items[j].first), std::move(items[j].second), static_cast<NodeT*>(NULL));
+                created.push_back(node);
+                merged.push_back(node);
+                ++j;
+            }
+            else if(comp(old[i]->getKey(), items[j].first)){
+                merged.push_back(old[i++]);
+            }
+            else {
+                old[i]->getValue() = std::move(items[j].second);
+                merged.push_back(old[i++]);
+                ++j;
+            }
+        }
+    }
+    catch(...) {
+        // the tree has not been relinked yet, so only the new nodes need undoing
+        for(std::size_t c = 0; c < created.size(); ++c){
+            this->destroyNode(created[c]);
+        }
+        throw;
+    }
+    relinkAll(merged);
+}
+
+/**
+* Removes every key in keys that is in the tree and returns how many
+* items were removed. Keys are sorted first and then applied like
+* insert_batch(): merged with the tree and relinked once for a large
+* batch, or removed one by one in key order otherwise.
+*/
+template<class Key, class Value, class Compare, class Alloc, class NodeT, class Stats>
+std::size_t AVLTree<Key, Value, Compare, Alloc, NodeT, Stats>::erase_batch(std::vector<Key> keys, unsigned threads)
+{
+    parallelStableSort(keys.begin(), keys.end(), this->comp_, threads);
+    std::size_t erased = 0;
+
+    if(!batchPrefersRebuild(keys.size())){
+        bool useFinger = batchPrefersFinger(keys.size());
+        NodeT* finger = NULL;
+        for(std::size_t j = 0; j < keys.size(); ++j){
+            NodeT* parent = NULL;
+            NodeT* node = fingerFind(useFinger ? finger : NULL, keys[j], parent);
+            if(node == NULL){
+                // the next key is larger, so its slot is near this one's
+                finger = parent;
+                continue;
+            }
+            // the successor survives the removal and bounds the next key from below
+            finger = static_cast<NodeT*>(BinarySearchTree<Key, Value, Compare, Alloc, Stats>::successor(node));
+            removeNode(node);
+            ++erased;
+        }
+        return erased;
+    }
+
+    std::vector<NodeT*> old;
+    collectNodes(old);
+    std::vector<NodeT*> kept;
+    kept.reserve(old.size());
+    std::size_t j = 0;
+    for(std::size_t i = 0; i < old.size(); ++i){
+        while(j < keys.size() && this->comp_(keys[j], old[i]->getKey())){
+            ++j;
+        }
+        if(j < keys.size() && !this->comp_(old[i]->getKey(), keys[j])){
+            this->destroyNode(old[i]);
+            ++erased;
+        }
+        else {
+            kept.push_back(old[i]);
+        }
+    }
+    relinkAll(kept);
+    return erased;
+}
+
+/**
+* Returns true if a batch of batchSize keys should be merged and relinked
+* rather than applied key by key. Relinking writes every node in the tree,
+* while sorted walks only touch the paths they need and mostly hit cache,
+* so on 1M keys the rebuild only pulls ahead once the batch is about twice
+* the size of the tree.
+*/
+template<class Key, class Value, class Compare, class Alloc, class NodeT, class Stats>
+bool AVLTree<Key, Value, Compare, Alloc, NodeT, Stats>::batchPrefersRebuild(std::size_t batchSize) const
+{
+    return batchSize >= 2 * this->size();
+}
+
+/**
+* Returns true if key-by-key walks should start from the previous key's
+* node. Climbing from the finger pays off once neighbouring batch keys
+* are close in the tree; for sparse batches the cached top of a walk from
+* the root is cheaper.
+*/
+template<class Key, class Value, class Compare, class Alloc, class NodeT, class Stats>
+bool AVLTree<Key, Value, Compare, Alloc, NodeT, Stats>::batchPrefersFinger(std::size_t batchSize) const
+{
+    return batchSize * 8 >= this->size();
+}
+
+/**
+* Finds key starting from finger, the node found or passed by the previous,
+* smaller key of a sorted batch (NULL starts at the root). The walk climbs
+* until key is below the current subtree's upper bound, which is enough
+* because its lower bound is already below the previous key, and then
+* descends. Returns key's node, or NULL with parent set to the node a new
+* key would hang from.
+*/
+template<class Key, class Value, class Compare, class Alloc, class NodeT, class Stats>
+NodeT* AVLTree<Key, Value, Compare, Alloc, NodeT, Stats>::fingerFind(NodeT* finger, const Key& key, NodeT*& parent) const
+{
+    NodeT* current = finger;
+    if(current == NULL){
+        current = static_cast<NodeT*>(this->root_);
+    }
+    else {
+        while(current->getParent() != NULL){
+            NodeT* up = current->getParent();
+            if(up->getLeft() == current && this->comp_(key, up->getKey())){
+                break;
+            }
+            current = up;
+        }
+    }
+
+    parent = NULL;
+    while(current != NULL){
+        KeyOrder order = ThreeWayCompare<Compare>::order(this->comp_, key, current->getKey());
+        if(!(order.less | order.greater)){
+            return current;
+        }
+        parent = current;
+        current = order.less ? current->getLeft() : current->getRight();
+    }
+    return NULL;
+}
+
+/**
+* Appends every node to nodes in key order. O(n).
+*/
+template<class Key, class Value, class Compare, class Alloc, class NodeT, class Stats>
+void AVLTree<Key, Value, Compare, Alloc, NodeT, Stats>::collectNodes(std::vector<NodeT*>& nodes) const
+{
+    nodes.reserve(nodes.size() + this->size());
+    Node<Key, Value>* node = this->getSmallestNode();
+    while(node != NULL){
+        nodes.push_back(static_cast<NodeT*>(node));
+        node = BinarySearchTree<Key, Value, Compare, Alloc, Stats>::successor(node);
+    }
+}
+
+/**
+* Relinks count nodes, given in key order, into a perfectly balanced
+* subtree under parent and returns its root. Shaped like buildBalanced().
+*/
+template<class Key, class Value, class Compare, class Alloc, class NodeT, class Stats>
+NodeT* AVLTree<Key, Value, Compare, Alloc, NodeT, Stats>::linkBalanced(NodeT* const* nodes, std::size_t count, NodeT* parent)
+{
+    if(count == 0){
+        return NULL;
+    }
+    std::size_t leftCount = count / 2;
+    std::size_t rightCount = count - 1 - leftCount;
+
+    NodeT* node = nodes[leftCount];
+    node->setParent(parent);
+    node->setLeft(linkBalanced(nodes, leftCount, node));
+    node->setRight(linkBalanced(nodes + leftCount + 1, rightCount, node));
+    node->setBalance(bitLength(rightCount) - bitLength(leftCount));
+    SizeTraits::update(node);
+    return node;
+}
+
+/**
+* Makes nodes, given in key order, the whole contents of the tree.
+*/
+template<class Key, class Value, class Compare, class Alloc, class NodeT, class Stats>
+void AVLTree<Key, Value, Compare, Alloc, NodeT, Stats>::relinkAll(const std::vector<NodeT*>& nodes)
+{
+    this->root_ = linkBalanced(nodes.data(), nodes.size(), static_cast<NodeT*>(NULL));
+    this->size_ = nodes.size();
+    height_ = bitLength(nodes.size());
+}
+
+/**
+* Splits the tree around key: the first tree returned holds the keys less
+* than key, the second the rest. This tree is left empty. Only the nodes
+* on the search path for key are relinked, with one join per node, and
+* the joins' heights telescope, so the whole split takes O(log n).
+* Each part gets a pool of its own that shares this tree's blocks, so the
+* parts can be used from different threads.
+*/
+template<class Key, class Value, class Compare, class Alloc, class NodeT, class Stats>
+std::pair<AVLTree<Key, Value, Compare, Alloc, NodeT, Stats>, AVLTree<Key, Value, Compare, Alloc, NodeT, Stats> >
+AVLTree<Key, Value, Compare, Alloc, NodeT, Stats>::split(const Key& key)
+{
+    std::pair<AVLTree, AVLTree> parts(AVLTree(this->comp_, this->get_allocator()),
+                                      AVLTree(this->comp_, this->get_allocator()));
+    Subtree left;
+    Subtree right;
+    splitNodes(takeNodes(), key, left, right);
+
+    NodePool<Alloc>::unite(parts.first.pool_, this->pool_);
+    NodePool<Alloc>::unite(parts.second.pool_, this->pool_);
+    parts.first.adoptNodes(left);
+    parts.second.adoptNodes(right);
+    return parts;
+}
+
+/**
+* Joins left, the item pivot and right into one tree in O(|height(left) -
+* height(right)| + 1). Every key in left must be less than pivot's key and
+* every key in right greater; otherwise std::invalid_argument is thrown and
+* both trees are left untouched. left and right are left empty, and the
+* result's pool shares the blocks of both.
+*/
+template<class Key, class Value, class Compare, class Alloc, class NodeT, class Stats>
+AVLTree<Key, Value, Compare, Alloc, NodeT, Stats>
+AVLTree<Key, Value, Compare, Alloc, NodeT, Stats>::join(AVLTree&& left, const std::pair<const Key, Value>& pivot, AVLTree&& right)
+{
+    if((!left.empty() && !left.comp_(left.getLargestNode()->getKey(), pivot.first)) ||
+       (!right.empty() && !left.comp_(pivot.first, right.getSmallestNode()->getKey()))){
+        throw std::invalid_argument("join needs left < pivot < right");
+    }
+    NodeT* node = left.template createNode<NodeT>(pivot.first, pivot.second, static_cast<NodeT*>(NULL));
+    return joinAt(std::move(left), node, std::move(right));
+}
+
+/**
+* Joins left and right into one tree in O(log n), using the smallest node
+* of right as the pivot. Every key in left must be less than every key in
+* right; otherwise std::invalid_argument is thrown and both trees are left
+* untouched. left and right are left empty.
+*/
+template<class Key, class Value, class Compare, class Alloc, class NodeT, class Stats>
+AVLTree<Key, Value, Compare, Alloc, NodeT, Stats>
+AVLTree<Key, Value, Compare, Alloc, NodeT, Stats>::join(AVLTree&& left, AVLTree&& right)
+{
+    if(right.empty()){
+        return AVLTree(std::move(left));
+    }
+    NodeT* pivot = static_cast<NodeT*>(right.getSmallestNode());
+    if(!left.empty() && !left.comp_(left.getLargestNode()->getKey(), pivot->getKey())){
+        throw std::invalid_argument("join needs left < right");
+    }
+    right.unlinkNode(pivot);
+    return joinAt(std::move(left), pivot, std::move(right));
+}
+
+/**
+* Links the detached node pivot between left and right, whose order has
+* already been checked, and returns the joined tree.
+*/
+template<class Key, class Value, class Compare, class Alloc, class NodeT, class Stats>
+AVLTree<Key, Value, Compare, Alloc, NodeT, Stats>
+AVLTree<Key, Value, Compare, Alloc, NodeT, Stats>::joinAt(AVLTree&& left, NodeT* pivot, AVLTree&& right)
+{
+    AVLTree result(std::move(left));
+    NodePool<Alloc>::unite(result.pool_, right.pool_);
+    std::size_t size = knownSum(result.size_, right.size_, 1);
+    Subtree leftNodes = result.takeNodes();
+    Subtree rightNodes = right.takeNodes();
+    result.adoptNodes(result.joinNodes(leftNodes, pivot, rightNodes), size);
+    return result;
+}
+
+/**
+* Returns the union of the trees a and b. For a key in both, the item
+* takes the value combine(value in a, value in b), which by default keeps
+* a's value.
+*
+* This and the other set operations are join-based: the root of one tree
+* splits the other, the two halves are combined recursively, and the
+* results are joined back around the root. That takes O(m log(n/m + 1))
+* for trees of m <= n items, so combining a small tree with a large one
+* only touches the large tree along m paths. The two recursive calls work
+* on disjoint nodes, so the upper levels hand one of them to another
+* thread, up to "threads" threads in all (0 means one per hardware
+* thread). Compare and combine must then be safe to call concurrently.
+*
+* a and b are left empty and the result's pool shares the blocks of both;
+* nodes not kept are destroyed at the end, on the calling thread. If
+* combine throws, the items of both trees are lost.
+*/
+template<class Key, class Value, class Compare, class Alloc, class NodeT, class Stats>
+template<typename Combine>
+AVLTree<Key, Value, Compare, Alloc, NodeT, Stats>
+AVLTree<Key, Value, Compare, Alloc, NodeT, Stats>::setUnion(AVLTree&& a, AVLTree&& b, Combine combine, unsigned threads)
+{
+    AVLTree result(std::move(a));
+    NodePool<Alloc>::unite(result.pool_, b.pool_);
+    std::size_t size = knownSum(result.size_, b.size_, 0);
+    Subtree aNodes = result.takeNodes();
+    Subtree bNodes = b.takeNodes();
+    std::vector<NodeT*> discarded;
+    Subtree nodes = result.unionNodes(aNodes, bNodes, combine, sortThreadCount(threads) - 1, discarded);
+    result.adoptNodes(nodes, knownSum(size, 0, -static_cast<long>(discarded.size())));
+    result.destroyNodes(discarded);
+    return result;
+}
+
+/**
+* Returns the items of a whose keys are also in b, with the values
+* combine(value in a, value in b). Works like setUnion().
+*/
+template<class Key, class Value, class Compare, class Alloc, class NodeT, class Stats>
+template<typename Combine>
+AVLTree<Key, Value, Compare, Alloc, NodeT, Stats>
+AVLTree<Key, Value, Compare, Alloc, NodeT, Stats>::setIntersection(AVLTree&& a, AVLTree&& b, Combine combine, unsigned threads)
+{
+    AVLTree result(std::move(a));
+    NodePool<Alloc>::unite(result.pool_, b.pool_);
+    std::size_t size = knownSum(result.size_, b.size_, 0);
+    Subtree aNodes = result.takeNodes();
+    Subtree bNodes = b.takeNodes();
+    std::vector<NodeT*> discarded;
+    Subtree nodes = result.intersectNodes(aNodes, bNodes, combine, sortThreadCount(threads) - 1, discarded);
+    result.adoptNodes(nodes, knownSum(size, 0, -static_cast<long>(discarded.size())));
+    result.destroyNodes(discarded);
+    return result;
+}
+
+/**
+* Returns the items of a whose keys are not in b. Works like setUnion().
+*/
+template<class Key, class Value, class Compare, class Alloc, class NodeT, class Stats>
+AVLTree<Key, Value, Compare, Alloc, NodeT, Stats>
+AVLTree<Key, Value, Compare, Alloc, NodeT, Stats>::setDifference(AVLTree&& a, AVLTree&& b, unsigned threads)
+{
+    AVLTree result(std::move(a));
+    NodePool<Alloc>::unite(result.pool_, b.pool_);
+    std::size_t size = knownSum(result.size_, b.size_, 0);
+    Subtree aNodes = result.takeNodes();
+    Subtree bNodes = b.takeNodes();
+    std::vector<NodeT*> discarded;
+    Subtree nodes = result.subtractNodes(aNodes, bNodes, sortThreadCount(threads) - 1, discarded);
+    result.adoptNodes(nodes, knownSum(size, 0, -static_cast<long>(discarded.size())));
+    result.destroyNodes(discarded);
+    return result;
+}
+
+/**
+* Returns the nodes of the tree with their height and leaves the tree
+* empty, without destroying anything.
+*/
+template<class Key, class Value, class Compare, class Alloc, class NodeT, class Stats>
+typename AVLTree<Key, Value, Compare, Alloc, NodeT, Stats>::Subtree
+AVLTree<Key, Value, Compare, Alloc, NodeT, Stats>::takeNodes()
+{
+    Subtree nodes = { static_cast<NodeT*>(this->root_), height_ };
+    this->root_ = NULL;
+    this->size_ = 0;
+    height_ = 0;
+    return nodes;
+}
+
+/**
+* Makes the detached subtree nodes the contents of this empty tree. size is
+* the item count if the caller knows it; otherwise it comes from the
+* subtree sizes when NodeT keeps them, or is counted on the first call to
+* size().
+*/
+template<class Key, class Value, class Compare, class Alloc, class NodeT, class Stats>
+void AVLTree<Key, Value, Compare, Alloc, NodeT, Stats>::adoptNodes(Subtree nodes, std::size_t size)
+{
+    this->root_ = nodes.root;
+    height_ = nodes.height;
+    if(nodes.root == NULL){
+        this->size_ = 0;
+    }
+    else if(SizeTraits::enabled){
+        this->size_ = SizeTraits::get(nodes.root);
+    }
+    else {
+        this->size_ = size;
+    }
+}
+
+/**
+* Returns a + b + delta, or the unknown size if a or b is unknown.
+*/
+template<class Key, class Value, class Compare, class Alloc, class NodeT, class Stats>
+std::size_t AVLTree<Key, Value, Compare, Alloc, NodeT, Stats>::knownSum(std::size_t a, std::size_t b, long delta)
+{
+    const std::size_t unknown = BinarySearchTree<Key, Value, Compare, Alloc, Stats>::kUnknownSize;
+    if(a == unknown || b == unknown){
+        return unknown;
+    }
+    return a + b + delta;
+}
+
+/**
+* Destroys the detached nodes in nodes.
+*/
+template<class Key, class Value, class Compare, class Alloc, class NodeT, class Stats>
+void AVLTree<Key, Value, Compare, Alloc, NodeT, Stats>::destroyNodes(const std::vector<NodeT*>& nodes)
+{
+    for(std::size_t i = 0; i < nodes.size(); ++i){
+        this->destroyNode(nodes[i]);
+    }
+}
+
+/**
+* Appends every node of the subtree under node to nodes.
+*/
+template<class Key, class Value, class Compare, class Alloc, class NodeT, class Stats>
+void AVLTree<Key, Value, Compare, Alloc, NodeT, Stats>::appendNodes(NodeT* node, std::vector<NodeT*>& nodes)
+{
+    for(; node != NULL; node = node->getRight()){
+        appendNodes(node->getLeft(), nodes);
+        nodes.push_back(node);
+    }
+}
+
+/**
+* Cuts node, the root of a detached subtree of the given height, off from
+* its children and returns them as detached subtrees with their heights,
+* which follow from node's balance.
+*/
+template<class Key, class Value, class Compare, class Alloc, class NodeT, class Stats>
+void AVLTree<Key, Value, Compare, Alloc, NodeT, Stats>::detachChildren(NodeT* node, int height, Subtree& left, Subtree& right)
+{
+    left.root = node->getLeft();
+    left.height = height - ((node->getBalance() > 0) ? 2 : 1);
+    right.root = node->getRight();
+    right.height = height - ((node->getBalance() < 0) ? 2 : 1);
+    if(left.root != NULL){
+        left.root->setParent(NULL);
+    }
+    if(right.root != NULL){
+        right.root->setParent(NULL);
+    }
+}
+
+/**
+* Joins the detached subtrees left and right with the detached node pivot
+* between them and returns the result. When the heights differ by more
+* than one, pivot is hung off the spine of the taller subtree at the first
+* node no more than one level taller than the shorter subtree, and the
+* taller side is rebalanced with insertFix() exactly as after an insert,
+* since its height grew by at most one at that spot. root_ and height_
+* are used as scratch while that runs and are left cleared.
+*/
+template<class Key, class Value, class Compare, class Alloc, class NodeT, class Stats>
+typename AVLTree<Key, Value, Compare, Alloc, NodeT, Stats>::Subtree
+AVLTree<Key, Value, Compare, Alloc, NodeT, Stats>::joinNodes(Subtree left, NodeT* pivot, Subtree right)
+{
+    pivot->setParent(NULL);
+    if(left.height > right.height + 1){
+        // walk down the right spine of left; a child's height follows from the balance
+        NodeT* parent = NULL;
+        NodeT* spine = left.root;
+        int spineHeight = left.height;
+        while(spineHeight > right.height + 1){
+            parent = spine;
+            spineHeight -= (spine->getBalance() < 0) ? 2 : 1;
+            spine = spine->getRight();
+        }
+        pivot->setLeft(spine);
+        pivot->setRight(right.root);
+        if(spine != NULL){
+            spine->setParent(pivot);
+        }
+        if(right.root != NULL){
+            right.root->setParent(pivot);
+        }
+        pivot->setBalance(right.height - spineHeight);
+        SizeTraits::update(pivot);
+        parent->setRight(pivot);
+        pivot->setParent(parent);
+        addPathSize(parent, SizeTraits::get(right.root) + 1);
+
+        this->root_ = left.root;
+        height_ = left.height;
+        insertFix(pivot, spine);
+    }
+    else if(right.height > left.height + 1){
+        // mirror image: walk down the left spine of right
+        NodeT* parent = NULL;
+        NodeT* spine = right.root;
+        int spineHeight = right.height;
+        while(spineHeight > left.height + 1){
+            parent = spine;
+            spineHeight -= (spine->getBalance() > 0) ? 2 : 1;
+            spine = spine->getLeft();
+        }
+        pivot->setLeft(left.root);
+        pivot->setRight(spine);
+        if(left.root != NULL){
+            left.root->setParent(pivot);
+        }
+        if(spine != NULL){
+            spine->setParent(pivot);
+        }
+        pivot->setBalance(spineHeight - left.height);
+        SizeTraits::update(pivot);
+        parent->setLeft(pivot);
+        pivot->setParent(parent);
+        addPathSize(parent, SizeTraits::get(left.root) + 1);
+
+        this->root_ = right.root;
+        height_ = right.height;
+        insertFix(pivot, spine);
+    }
+    else {
+        pivot->setLeft(left.root);
+        pivot->setRight(right.root);
+        if(left.root != NULL){
+            left.root->setParent(pivot);
+        }
+        if(right.root != NULL){
+            right.root->setParent(pivot);
+        }
+        pivot->setBalance(right.height - left.height);
+        SizeTraits::update(pivot);
+        this->root_ = pivot;
+        height_ = std::max(left.height, right.height) + 1;
+    }
+    Subtree joined = { static_cast<NodeT*>(this->root_), height_ };
+    this->root_ = NULL;
+    height_ = 0;
+    return joined;
+}
+
+/**
+* Joins the detached subtrees left and right, every key of left being less
+* than every key of right, using the largest node of left as the pivot.
+*/
+template<class Key, class Value, class Compare, class Alloc, class NodeT, class Stats>
+typename AVLTree<Key, Value, Compare, Alloc, NodeT, Stats>::Subtree
+AVLTree<Key, Value, Compare, Alloc, NodeT, Stats>::joinPair(Subtree left, Subtree right)
 {
-
+    if(left.root == NULL){
+        return right;
+    }
+    NodeT* pivot;
+    Subtree rest = splitLast(left, pivot);
+    return joinNodes(rest, pivot, right);
 }
 
 /**
-* A getter for the balance of a AVLNode.
+* Takes the largest node out of the detached subtree nodes into last and
+* returns the rest, rejoined on the way back up the right spine.
 */
-template<class Key, class Value>
-int8_t AVLNode<Key, Value>::getBalance() const
+template<class Key, class Value, class Compare, class Alloc, class NodeT, class Stats>
+typename AVLTree<Key, Value, Compare, Alloc, NodeT, Stats>::Subtree
+AVLTree<Key, Value, Compare, Alloc, NodeT, Stats>::splitLast(Subtree nodes, NodeT*& last)
 {
-    return balance_;
+    Subtree left;
+    Subtree right;
+    detachChildren(nodes.root, nodes.height, left, right);
+    if(right.root == NULL){
+        last = nodes.root;
+        return left;
+    }
+    return joinNodes(left, nodes.root, splitLast(right, last));
 }
 
 /**
-* A setter for the balance of a AVLNode.
+* Splits the detached subtree nodes into the keys less than key (left) and
+* the rest (right). Recurses down the search path for key and joins each
+* path node with the piece on its other side on the way back up. If found
+* is given, a node whose key equals key is not joined into right but
+* handed back through *found, which is otherwise set to NULL.
 */
-template<class Key, class Value>
-void AVLNode<Key, Value>::setBalance(int8_t balance)
+template<class Key, class Value, class Compare, class Alloc, class NodeT, class Stats>
+void AVLTree<Key, Value, Compare, Alloc, NodeT, Stats>::splitNodes(Subtree nodes, const Key& key,
+                                                             Subtree& left, Subtree& right, NodeT** found)
 {
-    balance_ = balance;
+    if(nodes.root == NULL){
+        left.root = right.root = NULL;
+        left.height = right.height = 0;
+        if(found != NULL){
+            *found = NULL;
+        }
+        return;
+    }
+    NodeT* node = nodes.root;
+    Subtree nodeLeft;
+    Subtree nodeRight;
+    detachChildren(node, nodes.height, nodeLeft, nodeRight);
+
+    Subtree middle;
+    if(this->comp_(node->getKey(), key)){
+        splitNodes(nodeRight, key, middle, right, found);
+        left = joinNodes(nodeLeft, node, middle);
+    }
+    else if(found != NULL && !this->comp_(key, node->getKey())){
+        left = nodeLeft;
+        right = nodeRight;
+        *found = node;
+    }
+    else {
+        splitNodes(nodeLeft, key, left, middle, found);
+        right = joinNodes(middle, node, nodeRight);
+    }
 }
 
 /**
-* Adds diff to the balance of a AVLNode.
+* Runs first and then second, or, if fork is set and forks allows another
+* thread, runs first on a new thread while second runs on this one. Each
+* gets the tree to use as scratch for its joins, its share of the
+* remaining forks and a list to put discarded nodes on.
 */
-template<class Key, class Value>
-void AVLNode<Key, Value>::updateBalance(int8_t diff)
+template<class Key, class Value, class Compare, class Alloc, class NodeT, class Stats>
+template<typename First, typename Second>
+void AVLTree<Key, Value, Compare, Alloc, NodeT, Stats>::forkJoin(bool fork, unsigned forks, First first, Second second,
+                                                           std::vector<NodeT*>& discarded)
 {
-    balance_ += diff;
+    if(!fork || forks == 0){
+        first(*this, forks, discarded);
+        second(*this, forks, discarded);
+        return;
+    }
+    unsigned spare = forks - 1;
+    AVLTree scratch(this->comp_, this->get_allocator());
+    std::vector<NodeT*> scratchDiscarded;
+    std::exception_ptr error;
+    std::thread worker([&]() {
+        try {
+            first(scratch, spare / 2, scratchDiscarded);
+        }
+        catch(...) {
+            error = std::current_exception();
+        }
+    });
+    try {
+        second(*this, spare - spare / 2, discarded);
+    }
+    catch(...) {
+        worker.join();
+        throw;
+    }
+    worker.join();
+    if(error){
+        std::rethrow_exception(error);
+    }
+    discarded.insert(discarded.end(), scratchDiscarded.begin(), scratchDiscarded.end());
 }
 
 /**
-* An overridden function for getting the parent since a static_cast is necessary to make sure
-* that our node is a AVLNode.
+* Returns the union of the detached subtrees a and b; see setUnion().
 */
-template<class Key, class Value>
-AVLNode<Key, Value> *AVLNode<Key, Value>::getParent() const
+template<class Key, class Value, class Compare, class Alloc, class NodeT, class Stats>
+template<typename Combine>
+typename AVLTree<Key, Value, Compare, Alloc, NodeT, Stats>::Subtree
+AVLTree<Key, Value, Compare, Alloc, NodeT, Stats>::unionNodes(Subtree a, Subtree b, Combine& combine, unsigned forks,
+                                                        std::vector<NodeT*>& discarded)
 {
-    return static_cast<AVLNode<Key, Value>*>(this->parent_);
+    if(a.root == NULL){
+        return b;
+    }
+    if(b.root == NULL){
+        return a;
+    }
+    if(b.height == 1){
+        return insertSingle(a, b.root, false, combine, discarded);
+    }
+    if(a.height == 1){
+        return insertSingle(b, a.root, true, combine, discarded);
+    }
+    NodeT* root = a.root;
+    Subtree aLeft;
+    Subtree aRight;
+    Subtree bLeft;
+    Subtree bRight;
+    NodeT* found;
+    splitNodes(b, root->getKey(), bLeft, bRight, &found);
+    detachChildren(root, a.height, aLeft, aRight);
+
+    Subtree left;
+    Subtree right;
+    forkJoin(std::max(a.height, b.height) >= kForkHeight, forks,
+             [&](AVLTree& tree, unsigned f, std::vector<NodeT*>& d) { left = tree.unionNodes(aLeft, bLeft, combine, f, d); },
+             [&](AVLTree& tree, unsigned f, std::vector<NodeT*>& d) { right = tree.unionNodes(aRight, bRight, combine, f, d); },
+             discarded);
+    if(found != NULL){
+        root->setValue(combine(root->getValue(), found->getValue()));
+        discarded.push_back(found);
+    }
+    return joinNodes(left, root, right);
 }
 
 /**
-* Overridden for the same reasons as above.
+* Inserts the detached leaf single into the detached subtree nodes with an
+* ordinary insert walk, which is cheaper than a split and a join once one
+* side of a union is down to one node. If the key is already there, that
+* node takes the combined value, with the values passed in the order of
+* the trees they came from, and single is discarded.
 */
-template<class Key, class Value>
-AVLNode<Key, Value> *AVLNode<Key, Value>::getLeft() const
+template<class Key, class Value, class Compare, class Alloc, class NodeT, class Stats>
+template<typename Combine>
+typename AVLTree<Key, Value, Compare, Alloc, NodeT, Stats>::Subtree
+AVLTree<Key, Value, Compare, Alloc, NodeT, Stats>::insertSingle(Subtree nodes, NodeT* single, bool singleFirst,
+                                                          Combine& combine, std::vector<NodeT*>& discarded)
 {
-    return static_cast<AVLNode<Key, Value>*>(this->left_);
+    this->root_ = nodes.root;
+    height_ = nodes.height;
+    Node<Key, Value>* parent;
+    NodeT* existing = static_cast<NodeT*>(this->internalFindSlot(single->getKey(), parent));
+    if(existing != NULL){
+        existing->setValue(singleFirst ? combine(single->getValue(), existing->getValue())
+                                       : combine(existing->getValue(), single->getValue()));
+        discarded.push_back(single);
+    }
+    else {
+        single->setParent(static_cast<NodeT*>(parent));
+        attachNewNode(single);
+    }
+    Subtree result = { static_cast<NodeT*>(this->root_), height_ };
+    this->root_ = NULL;
+    this->size_ = 0;
+    height_ = 0;
+    return result;
 }
 
 /**
-* Overridden for the same reasons as above.
+* Returns the intersection of the detached subtrees a and b; see
+* setIntersection().
 */
-template<class Key, class Value>
-AVLNode<Key, Value> *AVLNode<Key, Value>::getRight() const
+template<class Key, class Value, class Compare, class Alloc, class NodeT, class Stats>
+template<typename Combine>
+typename AVLTree<Key, Value, Compare, Alloc, NodeT, Stats>::Subtree
+AVLTree<Key, Value, Compare, Alloc, NodeT, Stats>::intersectNodes(Subtree a, Subtree b, Combine& combine, unsigned forks,
+                                                            std::vector<NodeT*>& discarded)
 {
-    return static_cast<AVLNode<Key, Value>*>(this->right_);
-}
+    if(a.root == NULL || b.root == NULL){
+        appendNodes(a.root, discarded);
+        appendNodes(b.root, discarded);
+        Subtree empty = { NULL, 0 };
+        return empty;
+    }
+    NodeT* root = a.root;
+    Subtree aLeft;
+    Subtree aRight;
+    Subtree bLeft;
+    Subtree bRight;
+    NodeT* found;
+    splitNodes(b, root->getKey(), bLeft, bRight, &found);
+    detachChildren(root, a.height, aLeft, aRight);
 
+    Subtree left;
+    Subtree right;
+    forkJoin(std::max(a.height, b.height) >= kForkHeight, forks,
+             [&](AVLTree& tree, unsigned f, std::vector<NodeT*>& d) { left = tree.intersectNodes(aLeft, bLeft, combine, f, d); },
+             [&](AVLTree& tree, unsigned f, std::vector<NodeT*>& d) { right = tree.intersectNodes(aRight, bRight, combine, f, d); },
+             discarded);
+    if(found != NULL){
+        root->setValue(combine(root->getValue(), found->getValue()));
+        discarded.push_back(found);
+        return joinNodes(left, root, right);
+    }
+    discarded.push_back(root);
+    return joinPair(left, right);
+}
 
-/*
-  -----------------------------------------------
-  End implementations for the AVLNode class.
-  -----------------------------------------------
+/**
+* Returns the detached subtree a without the keys of the detached subtree
+* b; see setDifference().
 */
+template<class Key, class Value, class Compare, class Alloc, class NodeT, class Stats>
+typename AVLTree<Key, Value, Compare, Alloc, NodeT, Stats>::Subtree
+AVLTree<Key, Value, Compare, Alloc, NodeT, Stats>::subtractNodes(Subtree a, Subtree b, unsigned forks,
+                                                           std::vector<NodeT*>& discarded)
+{
+    if(a.root == NULL || b.root == NULL){
+        appendNodes(b.root, discarded);
+        return a;
+    }
+    NodeT* root = b.root;
+    Subtree aLeft;
+    Subtree aRight;
+    Subtree bLeft;
+    Subtree bRight;
+    NodeT* found;
+    splitNodes(a, root->getKey(), aLeft, aRight, &found);
+    detachChildren(root, b.height, bLeft, bRight);
 
+    Subtree left;
+    Subtree right;
+    forkJoin(std::max(a.height, b.height) >= kForkHeight, forks,
+             [&](AVLTree& tree, unsigned f, std::vector<NodeT*>& d) { left = tree.subtractNodes(aLeft, bLeft, f, d); },
+             [&](AVLTree& tree, unsigned f, std::vector<NodeT*>& d) { right = tree.subtractNodes(aRight, bRight, f, d); },
+             discarded);
+    discarded.push_back(root);
+    if(found != NULL){
+        discarded.push_back(found);
+    }
+    return joinPair(left, right);
+}
 
-template <class Key, class Value>
-class AVLTree : public BinarySearchTree<Key, Value>
+/**
+* Returns an iterator to the item with the k-th smallest key (counting from
+* 0), or the end iterator if k >= size(). O(log n).
+*/
+template<class Key, class Value, class Compare, class Alloc, class NodeT, class Stats>
+typename BinarySearchTree<Key, Value, Compare, Alloc, Stats>::iterator
+AVLTree<Key, Value, Compare, Alloc, NodeT, Stats>::select(std::size_t k) const
 {
-public:
-    virtual void insert (const std::pair<const Key, Value> &new_item); // TODO
-    virtual void remove(const Key& key);  // TODO
-protected:
-    virtual void nodeSwap( AVLNode<Key,Value>* n1, AVLNode<Key,Value>* n2);
-
-    // Add helper functions here
-    void insertFix(AVLNode<Key, Value>* parent, AVLNode<Key, Value>* node);
-    void removeFix(AVLNode<Key, Value>* node, int diff);
-    void rotateRight(AVLNode<Key, Value>* grandparent); 
-    void rotateLeft(AVLNode<Key, Value>* parent);
-    AVLNode<Key, Value>* predecessor(AVLNode<Key, Value>* current);
+    static_assert(SizeTraits::enabled, "select() needs a node type that keeps subtree sizes");
+    NodeT* current = static_cast<NodeT*>(this->root_);
+    while(current != NULL){
+        std::size_t leftSize = SizeTraits::get(current->getLeft());
+        if(k < leftSize){
+            current = current->getLeft();
+        }
+        else if(k == leftSize){
+            break;
+        }
+        else {
+            k -= leftSize + 1;
+            current = current->getRight();
+        }
+    }
+    return this->makeIterator(current);
+}
 
+/**
+* Returns the number of keys less than key, which is the position key has
+* or would have in sorted order. O(log n).
+*/
+template<class Key, class Value, class Compare, class Alloc, class NodeT, class Stats>
+std::size_t AVLTree<Key, Value, Compare, Alloc, NodeT, Stats>::rank(const Key& key) const
+{
+    static_assert(SizeTraits::enabled, "rank() needs a node type that keeps subtree sizes");
+    std::size_t below = 0;
+    NodeT* current = static_cast<NodeT*>(this->root_);
+    while(current != NULL){
+        if(this->comp_(current->getKey(), key)){
+            below += SizeTraits::get(current->getLeft()) + 1;
+            current = current->getRight();
+        }
+        else {
+            current = current->getLeft();
+        }
+    }
+    return below;
+}
 
-};
+/**
+* Returns the number of keys in [lo, hi). O(log n).
+*/
+template<class Key, class Value, class Compare, class Alloc, class NodeT, class Stats>
+std::size_t AVLTree<Key, Value, Compare, Alloc, NodeT, Stats>::count(const Key& lo, const Key& hi) const
+{
+    if(!this->comp_(lo, hi)){
+        return 0;
+    }
+    return rank(hi) - rank(lo);
+}
 
 /*
  * Recall: If key is already in the tree, you should 
  * overwrite the current value with the updated value.
  */
-template<typename Key, typename Value>
-void AVLTree<Key, Value>::insert(const std::pair<const Key, Value>& new_item)
+template<typename Key, typename Value, typename Compare, typename Alloc, typename NodeT, typename Stats>
+void AVLTree<Key, Value, Compare, Alloc, NodeT, Stats>::insert(const std::pair<const Key, Value>& new_item)
 {
-    if(this->root_ == NULL){
-        // empty tree - done
-        AVLNode<Key, Value>* newNode = new AVLNode<Key, Value>(new_item.first, new_item.second, NULL);
-        this->root_ = newNode;
-        newNode->setBalance(0);
+    Node<Key, Value>* parent = NULL;
+    Node<Key, Value>* current = this->internalFindSlot(new_item.first, parent);
+    if(current != NULL){
+        current->setValue(new_item.second);
         return;
     }
-    AVLNode<Key, Value>* current = static_cast<AVLNode<Key, Value>*>(this->root_);
-    AVLNode<Key, Value>* parent = NULL;
-
-    // walk the tree to a leaf
-    while(current != NULL){
-        parent = current;
-        if(new_item.first == current->getKey()){
-            current->setValue(new_item.second);
-            break;
-        }
-        // less than
-        else if(new_item.first < current->getKey()){
-            // left child alr exists
-            if(current->getLeft()){
-                current = current->getLeft();
-            }
-            // make new node
-            else {
-                current->setLeft(new AVLNode<Key, Value>(new_item.first, new_item.second, current));
-                current = current->getLeft();
-                current->setBalance(0);
-                // update parent
-                if(parent != NULL){
-                    if(parent->getBalance() == -1 || parent->getBalance() == 1){
-                        parent->setBalance(0);
-                    } 
-                    else { // parent's balance was 0
-                        parent->updateBalance((parent->getLeft() == current) ? -1 : 1);
-                        insertFix(parent, current);
-                    }
-                }
-                return;
-            }
-        }
-        // greater than
-        else {
-            // right child alr exists
-            if(current->getRight()){
-                current = current->getRight();
-            }
-            // make new node
-            else {
-                current->setRight(new AVLNode<Key, Value>(new_item.first, new_item.second, current));
-                current = current->getRight();
-                current->setBalance(0);
-                // update parent
-                if(parent != NULL){
-                    if(parent->getBalance() == -1 || parent->getBalance() == 1){
-                        parent->setBalance(0);
-                    } 
-                    else { // parent's balance was 0
-                        parent->updateBalance((parent->getRight() == current) ? 1 : -1);
-                        insertFix(parent, current);
-                    }
-                }
-                return;
-            }
-        }
-    }
+    attachNewNode(this->template createNode<NodeT>(new_item.first, new_item.second, static_cast<NodeT*>(parent)));
+}
 
+/**
+* Creates an AVL node for a new key, moving the key and value in,
+* and links and rebalances it like insert().
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc, typename NodeT, typename Stats>
+Node<Key, Value>* AVLTree<Key, Value, Compare, Alloc, NodeT, Stats>::linkNewNode(Node<Key, Value>* parent, Key&& key, Value&& value)
+{
+    NodeT* node = this->template createNode<NodeT>(std::move(key), std::move(value), static_cast<NodeT*>(parent));
+    attachNewNode(node);
+    return node;
 }
 
-template<typename Key, typename Value>
-void AVLTree<Key, Value>::insertFix(AVLNode<Key, Value>* parent, AVLNode<Key, Value>* node) {
-    if(parent == NULL || parent->getParent() == NULL){
+/**
+* Links a freshly created leaf below its parent and restores the
+* balance of the path above it.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc, typename NodeT, typename Stats>
+void AVLTree<Key, Value, Compare, Alloc, NodeT, Stats>::attachNewNode(NodeT* node)
+{
+    NodeT* parent = node->getParent();
+    this->linkChild(parent, node);
+    this->addSize(1);
+    addPathSize(parent, 1);
+    lastRebalance_.rotations = 0;
+    lastRebalance_.ancestors = 0;
+
+    if(parent == NULL){
+        // empty tree - done
+        height_ = 1;
         return;
     }
+    // update parent
+    ++lastRebalance_.ancestors;
+    this->countFixStep();
+    if(parent->getBalance() == -1 || parent->getBalance() == 1){
+        parent->setBalance(0);
+    }
+    else { // parent's balance was 0
+        parent->updateBalance((parent->getLeft() == node) ? -1 : 1);
+        insertFix(parent, node);
+    }
+}
 
-    AVLNode<Key, Value>* grandparent = static_cast<AVLNode<Key, Value>*>(parent->getParent());
-    
-    // parent is left child of grandparent
-    if(grandparent->getLeft() == parent){
-        grandparent->updateBalance(-1);
-        // case 1
-        if(grandparent->getBalance() == 0){
+/**
+* Walks up from parent, whose subtree on node's side has just grown one
+* level taller, until the growth is absorbed. Each step looks at one
+* ancestor and either stops (its shorter side caught up, or a rotation
+* restored its old height) or moves up a level, so it never recurses and
+* performs at most one single or double rotation.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc, typename NodeT, typename Stats>
+void AVLTree<Key, Value, Compare, Alloc, NodeT, Stats>::insertFix(NodeT* parent, NodeT* node) {
+    for(;;){
+        if(parent == NULL){
             return;
         }
-        // case 2
-        else if(grandparent->getBalance() == -1){
-            insertFix(grandparent, parent);
-        }
-        // case 3
-        else if(grandparent->getBalance() == -2){
-            // LL zigzig
-            if(parent->getBalance() == -1){
-                rotateRight(grandparent);
-                parent->setBalance(0);
-                grandparent->setBalance(0);
+        // the growth reached the root, so the whole tree is one level taller
+        if(parent->getParent() == NULL){
+            ++height_;
+            return;
+        }
+
+        NodeT* grandparent = static_cast<NodeT*>(parent->getParent());
+        ++lastRebalance_.ancestors;
+        this->countFixStep();
+
+        // parent is left child of grandparent
+        if(grandparent->getLeft() == parent){
+            grandparent->updateBalance(-1);
+            // case 1
+            if(grandparent->getBalance() == 0){
+                return;
             }
-            // LR zigzag
-            else {
-                rotateLeft(parent);
-                rotateRight(grandparent);
-                // case 3a
-                if(node->getBalance() == -1){
-                    parent->setBalance(0);
-                    grandparent->setBalance(1);
-                }
-                // case 3b
-                else if(node->getBalance() == 0){
+            // case 2
+            else if(grandparent->getBalance() == -1){
+                node = parent;
+                parent = grandparent;
+                continue;
+            }
+            // case 3
+            else if(grandparent->getBalance() == -2){
+                // LL zigzig
+                if(parent->getBalance() == -1){
+                    rotateRight(grandparent);
+                    lastRebalance_.rotations += 1;
                     parent->setBalance(0);
                     grandparent->setBalance(0);
                 }
-                // case 3c
-                else if(node->getBalance() == 1){
-                    parent->setBalance(-1);
-                    grandparent->setBalance(0);
-                }
-                node->setBalance(0);
+                // LR zigzag
+                else {
+                    rotateLeft(parent);
+                    rotateRight(grandparent);
+                    lastRebalance_.rotations += 2;
+                    // case 3a
+                    if(node->getBalance() == -1){
+                        parent->setBalance(0);
+                        grandparent->setBalance(1);
+                    }
+                    // case 3b
+                    else if(node->getBalance() == 0){
+                        parent->setBalance(0);
+                        grandparent->setBalance(0);
+                    }
+                    // case 3c
+                    else if(node->getBalance() == 1){
+                        parent->setBalance(-1);
+                        grandparent->setBalance(0);
+                    }
+                    node->setBalance(0);
 
+                }
             }
         }
-    }
-    // assume parent is right child of grandparent
-    else if(grandparent->getRight() == parent){
-        grandparent->updateBalance(1);
-        // case 1
-        if(grandparent->getBalance() == 0){
-            return;
-        }
-        // case 2
-        else if(grandparent->getBalance() == 1){
-            insertFix(grandparent, parent);
-        }
-        // case 3
-        else if(grandparent->getBalance() == 2){
-            // RR zigzig
-            if(parent->getBalance() == 1){
-                rotateLeft(grandparent);
-                parent->setBalance(0);
-                grandparent->setBalance(0);
+        // assume parent is right child of grandparent
+        else if(grandparent->getRight() == parent){
+            grandparent->updateBalance(1);
+            // case 1
+            if(grandparent->getBalance() == 0){
+                return;
             }
-            // RL zigzag
-            else {
-                rotateRight(parent);
-                rotateLeft(grandparent);
-                // case 3a
-                if(node->getBalance() == 1){
-
-                    parent->setBalance(0);
-                    grandparent->setBalance(-1);
-                }
-                // case 3b
-                else if(node->getBalance() == 0){
+            // case 2
+            else if(grandparent->getBalance() == 1){
+                node = parent;
+                parent = grandparent;
+                continue;
+            }
+            // case 3
+            else if(grandparent->getBalance() == 2){
+                // RR zigzig
+                if(parent->getBalance() == 1){
+                    rotateLeft(grandparent);
+                    lastRebalance_.rotations += 1;
                     parent->setBalance(0);
                     grandparent->setBalance(0);
                 }
-                // case 3c
-                else if(node->getBalance() == -1){
-                    parent->setBalance(1);
-                    grandparent->setBalance(0);
+                // RL zigzag
+                else {
+                    rotateRight(parent);
+                    rotateLeft(grandparent);
+                    lastRebalance_.rotations += 2;
+                    // case 3a
+                    if(node->getBalance() == 1){
+
+                        parent->setBalance(0);
+                        grandparent->setBalance(-1);
+                    }
+                    // case 3b
+                    else if(node->getBalance() == 0){
+                        parent->setBalance(0);
+                        grandparent->setBalance(0);
+                    }
+                    // case 3c
+                    else if(node->getBalance() == -1){
+                        parent->setBalance(1);
+                        grandparent->setBalance(0);
+                    }
+                    node->setBalance(0);
                 }
-                node->setBalance(0);
             }
         }
+        return;
     }
 }
 
@@ -323,24 +1917,44 @@ void AVLTree<Key, Value>::insertFix(AVLNode<Key, Value>* parent, AVLNode<Key, Va
  * Recall: The writeup specifies that if a node has 2 children you
  * should swap with the predecessor and then remove.
  */
-template<class Key, class Value>
-void AVLTree<Key, Value>:: remove(const Key& key)
+template<class Key, class Value, class Compare, class Alloc, class NodeT, class Stats>
+void AVLTree<Key, Value, Compare, Alloc, NodeT, Stats>:: remove(const Key& key)
 {
     // TODO
     // find node n to remove
-    AVLNode<Key, Value>* n = static_cast<AVLNode<Key, Value>*>(this->internalFind(key));
-    int8_t diff = 0;
+    NodeT* n = static_cast<NodeT*>(this->internalFind(key));
     if(n == NULL){
         return;
     }
+    removeNode(n);
+}
+
+/**
+* Unlinks and destroys node n, then rebalances the path above it.
+*/
+template<class Key, class Value, class Compare, class Alloc, class NodeT, class Stats>
+void AVLTree<Key, Value, Compare, Alloc, NodeT, Stats>::removeNode(NodeT* n)
+{
+    unlinkNode(n);
+    this->destroyNode(n);
+}
+
+/**
+* Takes node n out of the tree without destroying it and rebalances the
+* path above it.
+*/
+template<class Key, class Value, class Compare, class Alloc, class NodeT, class Stats>
+void AVLTree<Key, Value, Compare, Alloc, NodeT, Stats>::unlinkNode(NodeT* n)
+{
+    int8_t diff = 0;
 
     // if n has two children swap positions with predecessor
     if(n->getLeft() != NULL && n->getRight() != NULL){
-        AVLNode<Key, Value>* pred = static_cast<AVLNode<Key, Value>*>(BinarySearchTree<Key, Value>::predecessor(n));
+        NodeT* pred = static_cast<NodeT*>(BinarySearchTree<Key, Value, Compare, Alloc, Stats>::predecessor(n));
         nodeSwap(n, pred);
     }
 
-    AVLNode<Key, Value>* parent = n->getParent();
+    NodeT* parent = n->getParent();
     if(parent){
         if(n == parent->getLeft()){
             diff = 1;
@@ -371,7 +1985,6 @@ void AVLTree<Key, Value>:: remove(const Key& key)
         else {
             this->root_ = NULL;
         }
-        delete n;
     }
     // one child
     else if(n->getLeft() != NULL || n->getRight() != NULL){
@@ -381,7 +1994,7 @@ void AVLTree<Key, Value>:: remove(const Key& key)
                 n->getLeft()->setParent(n->getParent());
                 n->getParent()->setLeft(n->getLeft());
             }
-            if(children == 1){
+            else if(children == 1){
                 n->getLeft()->setParent(n->getParent());
                 n->getParent()->setRight(n->getLeft());
             }
@@ -396,7 +2009,7 @@ void AVLTree<Key, Value>:: remove(const Key& key)
                 n->getRight()->setParent(n->getParent());
                 n->getParent()->setLeft(n->getRight());
             }
-            if(children == 1){
+            else if(children == 1){
                 n->getRight()->setParent(n->getParent());
                 n->getParent()->setRight(n->getRight());
             }
@@ -405,127 +2018,157 @@ void AVLTree<Key, Value>:: remove(const Key& key)
                 this->root_->setParent(NULL);
             }
         }
-        delete n;
     }
+    this->addSize(-1);
+    addPathSize(parent, -1);
+    lastRebalance_.rotations = 0;
+    lastRebalance_.ancestors = 0;
     removeFix(parent, diff);
 }
 
-template<class Key, class Value>
-void AVLTree<Key, Value>::removeFix(AVLNode<Key, Value>* node, int diff) {
-    if(node == NULL){
-        return;
-    }
+/**
+* Walks up from node, whose subtree on one side has just lost a level
+* (diff is +1 for the left side, -1 for the right), until the loss is
+* absorbed. A step stops when node's height is unchanged: its balance
+* only tips to one side (case 2), or a rotation with a balanced child
+* leaves the subtree as tall as before (case 1b). Otherwise node's
+* subtree is one level shorter and the walk moves to its parent. It never
+* recurses.
+*/
+template<class Key, class Value, class Compare, class Alloc, class NodeT, class Stats>
+void AVLTree<Key, Value, Compare, Alloc, NodeT, Stats>::removeFix(NodeT* node, int diff) {
+    for(;;){
+        // the shrink passed through the root, so the whole tree is one level shorter
+        if(node == NULL){
+            --height_;
+            return;
+        }
+        ++lastRebalance_.ancestors;
+        this->countFixStep();
 
-    AVLNode<Key, Value>* parent = node->getParent();
-    int ndiff = 0;
-    if(parent != NULL){
-        ndiff = 1;
-    }
-    else {
-        ndiff = -1;
-    }
+        NodeT* parent = node->getParent();
+        // losing height on the left raises the parent's balance
+        int ndiff = 0;
+        if(parent != NULL){
+            ndiff = (parent->getLeft() == node) ? 1 : -1;
+        }
 
-    if(diff == -1){
-        // case 1
-        if(node->getBalance() + diff == -2){
-            AVLNode<Key, Value>* c = node->getLeft();
-            // case 1a - zigzig
-            if(c->getBalance() == -1){
-                rotateRight(node);
-                node->setBalance(0);
-                c->setBalance(0);
-                removeFix(parent, ndiff);
-            }
-            // case 1b - zigzig
-            else if(c->getBalance() == 0){
-                rotateRight(node);
-                node->setBalance(-1);
-                c->setBalance(1);
-            }
-            // case 1c
-            else if (c->getBalance() == 1){
-                AVLNode<Key, Value>* g = c->getRight();
-                rotateLeft(c);
-                rotateRight(node);
-                if(g->getBalance() == 1){
-                    node->setBalance(0);
-                    c->setBalance(-1);
-                    g->setBalance(0);
-                }
-                else if(g->getBalance() == 0){
+        if(diff == -1){
+            // case 1
+            if(node->getBalance() + diff == -2){
+                NodeT* c = node->getLeft();
+                // case 1a - zigzig
+                if(c->getBalance() == -1){
+                    rotateRight(node);
+                    lastRebalance_.rotations += 1;
                     node->setBalance(0);
                     c->setBalance(0);
-                    g->setBalance(0);
                 }
+                // case 1b - zigzig
+                else if(c->getBalance() == 0){
+                    rotateRight(node);
+                    lastRebalance_.rotations += 1;
+                    node->setBalance(-1);
+                    c->setBalance(1);
+                    return;
+                }
+                // case 1c
                 else {
-                    node->setBalance(1);
-                    c->setBalance(0);
-                    g->setBalance(0);
+                    NodeT* g = c->getRight();
+                    rotateLeft(c);
+                    rotateRight(node);
+                    lastRebalance_.rotations += 2;
+                    if(g->getBalance() == 1){
+                        node->setBalance(0);
+                        c->setBalance(-1);
+                        g->setBalance(0);
+                    }
+                    else if(g->getBalance() == 0){
+                        node->setBalance(0);
+                        c->setBalance(0);
+                        g->setBalance(0);
+                    }
+                    else {
+                        node->setBalance(1);
+                        c->setBalance(0);
+                        g->setBalance(0);
+                    }
                 }
-                removeFix(parent, ndiff);
-            }
-        }
-    }
-    else { // diff = 1
-        // mirror case 1
-        if(node->getBalance() + diff == 2){
-            AVLNode<Key, Value>* c = node->getRight();
-            // case 1a - zigzig
-            if(c->getBalance() == 1){
-                rotateLeft(node);
-                node->setBalance(0);
-                c->setBalance(0);
-                removeFix(parent, ndiff);
             }
-            // case 1b - zigzig
-            else if(c->getBalance() == 0){
-                rotateLeft(node);
-                node->setBalance(1);
-                c->setBalance(-1);
+            // case 2
+            else if(node->getBalance() + diff == -1){
+                node->setBalance(-1);
                 return;
             }
-            // case 1c
-            else if (c->getBalance() == -1){
-                AVLNode<Key, Value>* g = c->getLeft();
-                rotateRight(c);
-                rotateLeft(node);
-                if(g->getBalance() == -1){
-                    node->setBalance(0);
-                    c->setBalance(1);
-                    g->setBalance(0);
-                }
-                else if(g->getBalance() == 0){
+            // case 3
+            else {
+                node->setBalance(0);
+            }
+        }
+        else { // diff = 1
+            // mirror case 1
+            if(node->getBalance() + diff == 2){
+                NodeT* c = node->getRight();
+                // case 1a - zigzig
+                if(c->getBalance() == 1){
+                    rotateLeft(node);
+                    lastRebalance_.rotations += 1;
                     node->setBalance(0);
                     c->setBalance(0);
-                    g->setBalance(0);
                 }
+                // case 1b - zigzig
+                else if(c->getBalance() == 0){
+                    rotateLeft(node);
+                    lastRebalance_.rotations += 1;
+                    node->setBalance(1);
+                    c->setBalance(-1);
+                    return;
+                }
+                // case 1c
                 else {
-                    node->setBalance(-1);
-                    c->setBalance(0);
-                    g->setBalance(0);
+                    NodeT* g = c->getLeft();
+                    rotateRight(c);
+                    rotateLeft(node);
+                    lastRebalance_.rotations += 2;
+                    if(g->getBalance() == -1){
+                        node->setBalance(0);
+                        c->setBalance(1);
+                        g->setBalance(0);
+                    }
+                    else if(g->getBalance() == 0){
+                        node->setBalance(0);
+                        c->setBalance(0);
+                        g->setBalance(0);
+                    }
+                    else {
+                        node->setBalance(-1);
+                        c->setBalance(0);
+                        g->setBalance(0);
+                    }
                 }
-                removeFix(parent, ndiff);
+            }
+            // case 2
+            else if(node->getBalance() + diff == 1){
+                node->setBalance(1);
+                return;
+            }
+            // case 3
+            else {
+                node->setBalance(0);
             }
         }
-        // case 2
-        else if(node->getBalance() + diff == 1){
-            node->setBalance(1);
-            return;
-        }
-        // case 3
-        else if(node->getBalance() + diff == 0){
-            node->setBalance(0);
-            removeFix(parent, ndiff);
-        }
+        // node's subtree is one level shorter; carry on at its parent
+        node = parent;
+        diff = ndiff;
     }
 }
 
-template<class Key, class Value>
-void AVLTree<Key, Value>::rotateRight(AVLNode<Key, Value>* grandparent) {
-    
-    AVLNode<Key, Value>* gp = grandparent->getParent();
-    AVLNode<Key, Value>* pivot = grandparent->getLeft();
-    AVLNode<Key, Value>* gr = pivot->getRight();
+template<class Key, class Value, class Compare, class Alloc, class NodeT, class Stats>
+void AVLTree<Key, Value, Compare, Alloc, NodeT, Stats>::rotateRight(NodeT* grandparent) {
+    this->countRotation();
+    NodeT* gp = grandparent->getParent();
+    NodeT* pivot = grandparent->getLeft();
+    NodeT* gr = pivot->getRight();
 
     if(gp != NULL){
         if(grandparent == gp->getLeft()){
@@ -545,13 +2188,16 @@ void AVLTree<Key, Value>::rotateRight(AVLNode<Key, Value>* grandparent) {
     if(gr != NULL){
         gr->setParent(grandparent);
     }
+    SizeTraits::update(grandparent);
+    SizeTraits::update(pivot);
 }
 
-template<class Key, class Value>
-void AVLTree<Key, Value>::rotateLeft(AVLNode<Key, Value>* parent) {
-    AVLNode<Key, Value>* p = parent->getParent();
-    AVLNode<Key, Value>* pivot = parent->getRight();
-    AVLNode<Key, Value>* l = pivot->getLeft();
+template<class Key, class Value, class Compare, class Alloc, class NodeT, class Stats>
+void AVLTree<Key, Value, Compare, Alloc, NodeT, Stats>::rotateLeft(NodeT* parent) {
+    this->countRotation();
+    NodeT* p = parent->getParent();
+    NodeT* pivot = parent->getRight();
+    NodeT* l = pivot->getLeft();
 
     if(p != NULL){
         if(parent == p->getLeft()){
@@ -571,15 +2217,17 @@ void AVLTree<Key, Value>::rotateLeft(AVLNode<Key, Value>* parent) {
     if(l != NULL){
         l->setParent(parent);
     }
+    SizeTraits::update(parent);
+    SizeTraits::update(pivot);
 }
 
-template<class Key, class Value>
-AVLNode<Key, Value>*
-AVLTree<Key, Value>::predecessor(AVLNode<Key, Value>* current)
+template<class Key, class Value, class Compare, class Alloc, class NodeT, class Stats>
+NodeT*
+AVLTree<Key, Value, Compare, Alloc, NodeT, Stats>::predecessor(NodeT* current)
 {
     // TODO
     // we have left child
-    AVLNode<Key, Value>* pred = NULL;
+    NodeT* pred = NULL;
     if(current == NULL){
         return NULL;
     }
@@ -603,13 +2251,42 @@ AVLTree<Key, Value>::predecessor(AVLNode<Key, Value>* current)
 }
 
 
-template<class Key, class Value>
-void AVLTree<Key, Value>::nodeSwap( AVLNode<Key,Value>* n1, AVLNode<Key,Value>* n2)
+template<class Key, class Value, class Compare, class Alloc, class NodeT, class Stats>
+void AVLTree<Key, Value, Compare, Alloc, NodeT, Stats>::nodeSwap( NodeT* n1, NodeT* n2)
 {
-    BinarySearchTree<Key, Value>::nodeSwap(n1, n2);
+    BinarySearchTree<Key, Value, Compare, Alloc, Stats>::nodeSwap(n1, n2);
     int8_t tempB = n1->getBalance();
     n1->setBalance(n2->getBalance());
     n2->setBalance(tempB);
+    SizeTraits::swap(n1, n2);
+}
+
+/**
+* Destroys a node as the NodeT it really is and returns its slot to the pool.
+*/
+template<class Key, class Value, class Compare, class Alloc, class NodeT, class Stats>
+void AVLTree<Key, Value, Compare, Alloc, NodeT, Stats>::destroyNode(Node<Key, Value>* node)
+{
+    static_cast<NodeT*>(node)->~NodeT();
+    this->pool_->deallocate(node);
 }
 
+/**
+* An AVLTree using the CompactAVLNode layout.
+*/
+template <class Key, class Value,
+          class Compare = std::less<Key>,
+          class Alloc = std::allocator<std::pair<const Key, Value> >,
+          class Stats = NoTreeStats>
+using CompactAVLTree = AVLTree<Key, Value, Compare, Alloc, CompactAVLNode<Key, Value>, Stats>;
+
+/**
+* An AVLTree whose nodes keep subtree sizes, for select/rank/count queries.
+*/
+template <class Key, class Value,
+          class Compare = std::less<Key>,
+          class Alloc = std::allocator<std::pair<const Key, Value> >,
+          class Stats = NoTreeStats>
+using RankedAVLTree = AVLTree<Key, Value, Compare, Alloc, RankedAVLNode<Key, Value>, Stats>;
+
 #endif
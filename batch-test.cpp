@@ -0,0 +1,201 @@
+#include <iostream>
+#include <cstdlib>
+#include <map>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+#include "avlbst.h"
+
+using namespace std;
+
+// Checked test for AVLTree::insert_batch() and erase_batch() against
+// std::map. Batches are sized on both sides of each switch between the
+// three ways a batch is applied: merged with the tree and relinked once
+// it is twice the tree's size, walked from the previous key's node once it
+// is an eighth of it, and walked from the root below that. Batches repeat
+// keys, so the last value given for a key must be the one kept and a key
+// erased twice must be counted once; erase_batch() must return how many
+// items it removed. Every tree must match the map, be balanced, report
+// its true height and, for RankedAVLTree, keep the subtree sizes select()
+// relies on. It exits with status 1 if any check fails.
+
+typedef AVLTree<long, long> Tree;
+typedef CompactAVLTree<long, long> CompactTree;
+typedef RankedAVLTree<long, long> RankedTree;
+
+static int failures = 0;
+
+static void check(bool ok, const string& what)
+{
+    if(!ok && ++failures <= 20) {
+        cerr << "FAIL " << what << endl;
+    }
+}
+
+// Subtree sizes, checked through select(); only trees whose nodes keep
+// them have these
+static bool ranksMatch(const Tree&, const map<long, long>&) { return true; }
+static bool ranksMatch(const CompactTree&, const map<long, long>&) { return true; }
+
+static bool ranksMatch(const RankedTree& tree, const map<long, long>& expected)
+{
+    size_t k = 0;
+    for(map<long, long>::const_iterator want = expected.begin(); want != expected.end(); ++want, ++k) {
+        RankedTree::iterator got = tree.select(k);
+        if(got == tree.end() || got->first != want->first) {
+            return false;
+        }
+    }
+    return tree.select(expected.size()) == tree.end();
+}
+
+template<typename T>
+static bool matches(const T& tree, const map<long, long>& expected)
+{
+    if(tree.size() != expected.size() || !tree.isBalanced()) {
+        return false;
+    }
+    typename T::BalanceInfo info = tree.checkBalance();
+    if(!info.balanced || info.height != tree.height()) {
+        return false;
+    }
+    typename T::const_iterator it = tree.cbegin();
+    for(map<long, long>::const_iterator want = expected.begin(); want != expected.end(); ++want, ++it) {
+        if(it == tree.cend() || it->first != want->first || it->second != want->second) {
+            return false;
+        }
+    }
+    return it == tree.cend() && ranksMatch(tree, expected);
+}
+
+// A tree of n random keys from [0, 4n), inserted one by one
+template<typename T>
+static void fill(T& tree, map<long, long>& expected, size_t n, mt19937_64& rng)
+{
+    while(expected.size() < n) {
+        long key = static_cast<long>(rng() % (4 * n));
+        tree.insert(make_pair(key, key));
+        expected[key] = key;
+    }
+}
+
+// The batch sizes to try on a tree of n items: just below and at each
+// threshold, and the far ends
+static vector<size_t> batchSizes(size_t n)
+{
+    vector<size_t> sizes;
+    sizes.push_back(1);
+    if(n / 8 > 2) {
+        sizes.push_back((n + 7) / 8 - 1);
+    }
+    sizes.push_back((n + 7) / 8);
+    sizes.push_back(n / 2);
+    if(n > 0) {
+        sizes.push_back(2 * n - 1);
+    }
+    sizes.push_back(2 * n);
+    sizes.push_back(5 * n + 3);
+    return sizes;
+}
+
+template<typename T>
+static void testInsertBatch(const string& name, size_t n, size_t k, unsigned threads, mt19937_64& rng)
+{
+    string where = name + " insert_batch of " + to_string(k) + " into " + to_string(n)
+                 + " items on " + to_string(threads) + " threads";
+    T tree;
+    map<long, long> expected;
+    fill(tree, expected, n, rng);
+
+    // keys from a range about the size of the batch and the tree together,
+    // so a batch both overwrites and adds, and repeats keys; every value is
+    // distinct, so the one kept shows which duplicate won
+    vector<pair<long, long> > batch;
+    long range = static_cast<long>(4 * n + k / 2 + 1);
+    for(size_t i = 0; i < k; ++i) {
+        long key = static_cast<long>(rng() % static_cast<unsigned long>(range));
+        batch.push_back(make_pair(key, -1 - static_cast<long>(i)));
+        expected[key] = -1 - static_cast<long>(i);
+    }
+    tree.insert_batch(batch, threads);
+    check(matches(tree, expected), where + ": tree differs");
+
+    // the tree keeps working one item at a time
+    for(long key = -2; key < 2; ++key) {
+        tree.insert(make_pair(key, key));
+        expected[key] = key;
+    }
+    tree.remove(range / 2);
+    expected.erase(range / 2);
+    check(matches(tree, expected), where + ": tree differs after changes");
+}
+
+template<typename T>
+static void testEraseBatch(const string& name, size_t n, size_t k, unsigned threads, mt19937_64& rng)
+{
+    string where = name + " erase_batch of " + to_string(k) + " from " + to_string(n)
+                 + " items on " + to_string(threads) + " threads";
+    T tree;
+    map<long, long> expected;
+    fill(tree, expected, n, rng);
+
+    // half the keys are in the tree; the rest are absent, and either kind
+    // may come twice
+    vector<long> keys;
+    size_t removed = 0;
+    long range = static_cast<long>(4 * n + 1);
+    for(size_t i = 0; i < k; ++i) {
+        long key = -static_cast<long>(i % 7) - 1;
+        if(rng() % 2) {
+            key = static_cast<long>(rng() % static_cast<unsigned long>(range));
+        }
+        keys.push_back(key);
+        removed += expected.erase(key);
+    }
+    size_t erased = tree.erase_batch(keys, threads);
+    check(erased == removed, where + ": returned " + to_string(erased) + ", not " + to_string(removed));
+    check(matches(tree, expected), where + ": tree differs");
+
+    for(long key = -2; key < 2; ++key) {
+        tree.insert(make_pair(key, key));
+        expected[key] = key;
+    }
+    check(matches(tree, expected), where + ": tree differs after changes");
+}
+
+template<typename T>
+static void testTree(const string& name)
+{
+    mt19937_64 rng(11);
+    const size_t treeSizes[] = { 0, 1, 2, 17, 1000, 20000 };
+    const unsigned threadCounts[] = { 1, 4 };
+    for(size_t s = 0; s < sizeof(treeSizes) / sizeof(treeSizes[0]); ++s) {
+        vector<size_t> sizes = batchSizes(treeSizes[s]);
+        for(size_t b = 0; b < sizes.size(); ++b) {
+            for(size_t t = 0; t < sizeof(threadCounts) / sizeof(threadCounts[0]); ++t) {
+                testInsertBatch<T>(name, treeSizes[s], sizes[b], threadCounts[t], rng);
+                testEraseBatch<T>(name, treeSizes[s], sizes[b], threadCounts[t], rng);
+            }
+        }
+    }
+
+    // empty batches leave the tree alone
+    T tree;
+    map<long, long> expected;
+    fill(tree, expected, 100, rng);
+    tree.insert_batch(vector<pair<long, long> >());
+    check(tree.erase_batch(vector<long>()) == 0, name + ": empty erase_batch removed items");
+    check(matches(tree, expected), name + ": empty batches changed the tree");
+}
+
+int main(int argc, char *argv[])
+{
+    testTree<Tree>("AVLTree");
+    testTree<CompactTree>("CompactAVLTree");
+    testTree<RankedTree>("RankedAVLTree");
+
+    cout << (failures == 0 ? "All batch checks passed" : "Batch checks FAILED")
+         << " (" << failures << " failures)" << endl;
+    return failures == 0 ? 0 : 1;
+}
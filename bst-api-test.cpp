@@ -0,0 +1,226 @@
+#include <iostream>
+#include <cstdlib>
+#include <functional>
+#include <iterator>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+#include "bst.h"
+#include "avlbst.h"
+#include "rbbst.h"
+
+using namespace std;
+
+// Checked test for the std::map-style interface every tree shares, on
+// BinarySearchTree, AVLTree and RedBlackTree, against std::map:
+// lower_bound(), upper_bound(), equal_range() and range() with bounds at,
+// between and outside the keys; forward, const and reverse iteration,
+// including --end() on an empty and a one-item tree; emplace(),
+// try_emplace() leaving an existing value and its arguments alone, and
+// insert_or_assign() reporting whether it inserted or overwrote; and
+// lookups in a std::string tree by const char* through std::less<>,
+// which is why the Makefile builds this test as C++14. It exits with
+// status 1 if any check fails.
+
+static int failures = 0;
+
+static void check(bool ok, const string& what)
+{
+    if(!ok && ++failures <= 20) {
+        cerr << "FAIL " << what << endl;
+    }
+}
+
+// True if it and want both point past the end, or at the same item
+template<typename Tree, typename It>
+static bool same(const Tree& tree, typename Tree::iterator it, const map<long, long>& expected, It want)
+{
+    if(want == expected.end()) {
+        return it == tree.end();
+    }
+    return it != tree.end() && it->first == want->first && it->second == want->second;
+}
+
+// Keys 10, 20, ... 10n; bounds from below the first to past the last, so
+// every bound is at a key, between two keys or outside them all
+template<typename Tree>
+static void testBounds(const string& name)
+{
+    const long sizes[] = { 0, 1, 2, 5, 50 };
+    for(size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+        long n = sizes[s];
+        string where = name + " with " + to_string(n) + " items";
+        Tree tree;
+        map<long, long> expected;
+        for(long i = n; i >= 1; --i) {
+            tree.insert(make_pair(10 * i, i));
+            expected[10 * i] = i;
+        }
+
+        bool lowerOk = true;
+        bool upperOk = true;
+        bool equalOk = true;
+        for(long key = -5; key <= 10 * n + 15; ++key) {
+            lowerOk = lowerOk && same(tree, tree.lower_bound(key), expected, expected.lower_bound(key));
+            upperOk = upperOk && same(tree, tree.upper_bound(key), expected, expected.upper_bound(key));
+            pair<typename Tree::iterator, typename Tree::iterator> got = tree.equal_range(key);
+            pair<map<long, long>::const_iterator, map<long, long>::const_iterator> want = expected.equal_range(key);
+            equalOk = equalOk && same(tree, got.first, expected, want.first) && same(tree, got.second, expected, want.second);
+        }
+        check(lowerOk, where + ": lower_bound() differs");
+        check(upperOk, where + ": upper_bound() differs");
+        check(equalOk, where + ": equal_range() differs");
+
+        // [lo, hi) for bounds every five apart, reversed and equal ones too
+        bool rangeOk = true;
+        for(long lo = -5; lo <= 10 * n + 15; lo += 5) {
+            for(long hi = -5; hi <= 10 * n + 15; hi += 5) {
+                vector<long> want;
+                if(lo < hi) {
+                    for(map<long, long>::const_iterator it = expected.lower_bound(lo); it != expected.lower_bound(hi); ++it) {
+                        want.push_back(it->first);
+                    }
+                }
+                vector<long> got;
+                typename Tree::Range items = tree.range(lo, hi);
+                for(typename Tree::iterator it = items.begin(); it != items.end(); ++it) {
+                    got.push_back(it->first);
+                }
+                rangeOk = rangeOk && got == want && items.empty() == want.empty();
+            }
+        }
+        check(rangeOk, where + ": range() differs");
+    }
+}
+
+template<typename Tree>
+static void testIterators(const string& name)
+{
+    Tree empty;
+    typename Tree::iterator end = empty.end();
+    check(--end == empty.end() && empty.begin() == empty.end() && empty.rbegin() == empty.rend()
+          && empty.cbegin() == empty.cend(), name + ": --end() on an empty tree is not end()");
+
+    Tree one;
+    one.insert(make_pair(7L, 70L));
+    end = one.end();
+    --end;
+    check(end == one.begin() && end->first == 7 && end->second == 70, name + ": --end() on a one-item tree differs");
+    typename Tree::const_iterator cend = one.cend();
+    --cend;
+    check(cend == one.cbegin() && cend->first == 7, name + ": --cend() on a one-item tree differs");
+    check(one.rbegin()->first == 7 && ++one.rbegin() == one.rend(), name + ": reverse walk of a one-item tree differs");
+
+    Tree tree;
+    map<long, long> expected;
+    for(long i = 0; i < 200; ++i) {
+        long key = (i * 37) % 211;
+        tree.insert(make_pair(key, -key));
+        expected[key] = -key;
+    }
+    bool forward = true;
+    typename Tree::const_iterator it = tree.cbegin();
+    for(map<long, long>::const_iterator want = expected.begin(); want != expected.end(); ++want, it++) {
+        forward = forward && it != tree.cend() && it->first == want->first && (*it).second == want->second;
+    }
+    check(forward && it == tree.cend(), name + ": const forward walk differs");
+
+    bool backward = true;
+    typename Tree::iterator back = tree.end();
+    for(map<long, long>::const_reverse_iterator want = expected.rbegin(); want != expected.rend(); ++want) {
+        back--;
+        backward = backward && back->first == want->first;
+    }
+    check(backward && back == tree.begin(), name + ": walk back from end() differs");
+
+    check(equal(tree.rbegin(), tree.rend(), expected.rbegin()), name + ": reverse walk differs");
+    check(equal(tree.crbegin(), tree.crend(), expected.rbegin()), name + ": const reverse walk differs");
+    check(distance(tree.begin(), tree.end()) == 200 && distance(tree.rbegin(), tree.rend()) == 200,
+          name + ": walks have the wrong length");
+
+    // an iterator converts to a const_iterator at the same item, and
+    // writes through an iterator show up in the tree
+    typename Tree::iterator found = tree.find(74);
+    typename Tree::const_iterator converted = found;
+    check(converted != tree.cend() && converted->first == 74, name + ": converted iterator differs");
+    found->second = 1234;
+    check(tree[74] == 1234, name + ": write through an iterator lost");
+}
+
+template<typename Tree>
+static void testInsertion(const string& name)
+{
+    Tree tree;
+
+    pair<typename Tree::iterator, bool> result = tree.emplace(5L, string(40, 'a'));
+    check(result.second && result.first->first == 5 && result.first->second == string(40, 'a'),
+          name + ": emplace of a new key failed");
+    result = tree.emplace(5L, string(40, 'b'));
+    check(!result.second && result.first->second == string(40, 'a'), name + ": emplace overwrote an existing value");
+
+    string value(40, 'c');
+    result = tree.try_emplace(5L, std::move(value));
+    check(!result.second && result.first->second == string(40, 'a'), name + ": try_emplace overwrote an existing value");
+    check(value == string(40, 'c'), name + ": try_emplace moved from its argument for an existing key");
+    result = tree.try_emplace(6L, std::move(value));
+    check(result.second && result.first->second == string(40, 'c'), name + ": try_emplace of a new key failed");
+    result = tree.try_emplace(7L, 3, 'x');
+    check(result.second && tree[7] == "xxx", name + ": try_emplace did not build the value from its arguments");
+
+    result = tree.insert_or_assign(5L, string("five"));
+    check(!result.second && result.first->first == 5 && tree[5] == "five", name + ": insert_or_assign did not overwrite");
+    result = tree.insert_or_assign(8L, string("eight"));
+    check(result.second && tree[8] == "eight", name + ": insert_or_assign did not insert");
+
+    result = tree.insert(make_pair(9L, string("nine")));
+    check(result.second && tree[9] == "nine", name + ": rvalue insert of a new key failed");
+    result = tree.insert(make_pair(9L, string("NINE")));
+    check(!result.second && tree[9] == "NINE", name + ": rvalue insert did not overwrite");
+
+    check(tree.size() == 5, name + ": tree has the wrong size after insertions");
+}
+
+template<typename Tree>
+static void testTransparent(const string& name)
+{
+    Tree tree;
+    const char* words[] = { "delta", "alpha", "echo", "charlie", "bravo" };
+    for(size_t i = 0; i < sizeof(words) / sizeof(words[0]); ++i) {
+        tree.insert(make_pair(string(words[i]), static_cast<int>(i)));
+    }
+    check(tree.find("charlie") != tree.end() && tree.find("charlie")->second == 3, name + ": find by const char* failed");
+    check(tree.find("zulu") == tree.end() && tree.find("") == tree.end(), name + ": find by const char* found a missing key");
+    check(tree.lower_bound("c")->first == "charlie" && tree.upper_bound("charlie")->first == "delta"
+          && tree.lower_bound("f") == tree.end() && tree.upper_bound("a")->first == "alpha",
+          name + ": bounds by const char* differ");
+    pair<typename Tree::iterator, typename Tree::iterator> hit = tree.equal_range("echo");
+    pair<typename Tree::iterator, typename Tree::iterator> miss = tree.equal_range("d");
+    check(hit.first->first == "echo" && hit.second == tree.end() && miss.first == miss.second
+          && miss.first->first == "delta", name + ": equal_range by const char* differs");
+}
+
+template<template<typename, typename, typename> class TreeT>
+static void testTree(const string& name)
+{
+    testBounds<TreeT<long, long, std::less<long> > >(name);
+    testIterators<TreeT<long, long, std::less<long> > >(name);
+    testInsertion<TreeT<long, string, std::less<long> > >(name);
+    testTransparent<TreeT<string, int, std::less<> > >(name + "<string, int, std::less<> >");
+}
+
+// The trees with their other parameters left at the defaults
+template<typename K, typename V, typename C> using PlainTree = BinarySearchTree<K, V, C>;
+template<typename K, typename V, typename C> using BalancedTree = AVLTree<K, V, C>;
+template<typename K, typename V, typename C> using RedBlack = RedBlackTree<K, V, C>;
+
+int main(int argc, char *argv[])
+{
+    testTree<PlainTree>("BinarySearchTree");
+    testTree<BalancedTree>("AVLTree");
+    testTree<RedBlack>("RedBlackTree");
+
+    cout << (failures == 0 ? "All tree interface checks passed" : "Tree interface checks FAILED")
+         << " (" << failures << " failures)" << endl;
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,967 @@
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <cmath>
+#include <map>
+#include <mutex>
+#include <thread>
+#include "bst.h"
+#include "avlbst.h"
+#include "btree.h"
+#include "concurrent_avlbst.h"
+#include "persistent_avlbst.h"
+#include "mapped_avlbst.h"
+#include "rbbst.h"
+
+using namespace std;
+
+// Keeps the timed lookups from being optimized away
+static volatile long sink = 0;
+
+// Seconds elapsed since start.
+static double secondsSince(chrono::steady_clock::time_point start)
+{
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+// Inserts every key, then looks every key up again in a different order,
+// and prints the throughput of both phases in millions of operations per second.
+template<typename Tree>
+void benchTree(const char* name, const vector<long>& keys, const vector<long>& probes)
+{
+    Tree tree;
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for(size_t i = 0; i < keys.size(); ++i) {
+        tree.insert(make_pair(keys[i], keys[i]));
+    }
+    double insertSecs = secondsSince(start);
+
+    start = chrono::steady_clock::now();
+    size_t found = 0;
+    for(size_t i = 0; i < probes.size(); ++i) {
+        if(tree.find(probes[i]) != tree.end()) {
+            ++found;
+        }
+    }
+    double findSecs = secondsSince(start);
+
+    cout << name << ": "
+         << keys.size() / insertSecs / 1e6 << " M inserts/s, "
+         << probes.size() / findSecs / 1e6 << " M finds/s"
+         << " (" << found << " found)" << endl;
+}
+
+// Inserts and then removes every key of an AVLTree, and prints how much
+// rebalancing each operation took: rotations, and ancestors its walk back
+// up the tree examined, on average and at worst.
+void benchRebalance(const char* name, const vector<long>& keys)
+{
+    AVLTree<long, long> tree;
+    for(int phase = 0; phase < 2; ++phase) {
+        size_t rotations = 0;
+        size_t ancestors = 0;
+        unsigned maxAncestors = 0;
+        for(size_t i = 0; i < keys.size(); ++i) {
+            if(phase == 0) {
+                tree.insert(make_pair(keys[i], keys[i]));
+            }
+            else {
+                tree.remove(keys[i]);
+            }
+            AVLTree<long, long>::RebalanceStats stats = tree.lastRebalance();
+            rotations += stats.rotations;
+            ancestors += stats.ancestors;
+            maxAncestors = max(maxAncestors, stats.ancestors);
+        }
+        cout << "AVLTree " << (phase == 0 ? "inserts" : "removes") << ", " << name << " keys: "
+             << double(rotations) / keys.size() << " rotations/op, "
+             << double(ancestors) / keys.size() << " ancestors/op (max " << maxAncestors << ")" << endl;
+    }
+}
+
+// One update of a write mix: insert or remove the key.
+struct WriteOp
+{
+    bool insert;
+    long key;
+};
+
+// Applies the preload keys and then times the updates; the stats of the
+// tree are reset after the preload, so they cover the updates alone.
+template<typename Tree>
+double runWriteMix(Tree& tree, const vector<long>& preload, const vector<WriteOp>& ops)
+{
+    for(size_t i = 0; i < preload.size(); ++i) {
+        tree.insert(make_pair(preload[i], preload[i]));
+    }
+    tree.resetStats();
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for(size_t i = 0; i < ops.size(); ++i) {
+        if(ops[i].insert) {
+            tree.insert(make_pair(ops[i].key, ops[i].key));
+        }
+        else {
+            tree.remove(ops[i].key);
+        }
+    }
+    return secondsSince(start);
+}
+
+// Runs the same write-heavy mix on an AVLTree and a RedBlackTree: an
+// insert-heavy one (90% inserts, 10% removes) growing an empty tree, or
+// a delete-heavy one (10% inserts, 90% removes) draining a tree loaded
+// with all the keys, each over as many random keys as there are keys.
+// Prints the throughput, then the rotations and fix-up steps per update
+// from a second run with CountingTreeStats.
+void benchWriteMix(const vector<long>& keys, bool deleteHeavy)
+{
+    typedef AVLTree<long, long, less<long>, allocator<pair<const long, long> >,
+                    AVLNode<long, long>, CountingTreeStats> CountedAVLTree;
+    typedef RedBlackTree<long, long, less<long>, allocator<pair<const long, long> >,
+                         CountingTreeStats> CountedRedBlackTree;
+
+    mt19937_64 rng(deleteHeavy ? 29 : 23);
+    long range = static_cast<long>(keys.size());
+    vector<long> preload;
+    if(deleteHeavy) {
+        preload = keys;
+    }
+    else {
+        range *= 2;
+    }
+    vector<WriteOp> ops(keys.size());
+    for(size_t i = 0; i < ops.size(); ++i) {
+        ops[i].insert = (rng() % 100 < 10) == deleteHeavy;
+        ops[i].key = static_cast<long>(rng() % range);
+    }
+
+    const char* mix = deleteHeavy ? "delete-heavy" : "insert-heavy";
+    AVLTree<long, long> avl;
+    RedBlackTree<long, long> redBlack;
+    double avlSecs = runWriteMix(avl, preload, ops);
+    double redBlackSecs = runWriteMix(redBlack, preload, ops);
+    CountedAVLTree countedAvl;
+    CountedRedBlackTree countedRedBlack;
+    runWriteMix(countedAvl, preload, ops);
+    runWriteMix(countedRedBlack, preload, ops);
+
+    cout << "AVLTree " << mix << ": " << ops.size() / avlSecs / 1e6 << " M updates/s, "
+         << double(countedAvl.stats().rotations()) / ops.size() << " rotations/op, "
+         << double(countedAvl.stats().fixSteps()) / ops.size() << " fix-up steps/op" << endl;
+    cout << "RedBlackTree " << mix << ": " << ops.size() / redBlackSecs / 1e6 << " M updates/s, "
+         << double(countedRedBlack.stats().rotations()) / ops.size() << " rotations/op, "
+         << double(countedRedBlack.stats().fixSteps()) / ops.size() << " fix-up steps/op ("
+         << redBlack.size() << " items, AVLTree " << avl.size() << ")" << endl;
+}
+
+// Saves an AVLTree of the keys to a snapshot file and loads it back, and
+// compares the load with the usual restart path of re-inserting every
+// item, printing items per second and the file's read rate.
+void benchSnapshot(const vector<long>& keys)
+{
+    const char* path = "bst-bench.snapshot";
+    vector<pair<long, long> > items;
+    items.reserve(keys.size());
+    for(size_t i = 0; i < keys.size(); ++i) {
+        items.push_back(make_pair(keys[i], keys[i]));
+    }
+    AVLTree<long, long> tree;
+    tree.bulkLoadUnsorted(items);
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    tree.saveTo(path);
+    double saveSecs = secondsSince(start);
+
+    AVLTree<long, long> loaded;
+    start = chrono::steady_clock::now();
+    loaded.loadFrom(path);
+    double loadSecs = secondsSince(start);
+    remove(path);
+
+    AVLTree<long, long> reinserted;
+    start = chrono::steady_clock::now();
+    for(AVLTree<long, long>::iterator it = tree.begin(); it != tree.end(); ++it) {
+        reinserted.insert(*it);
+    }
+    double reinsertSecs = secondsSince(start);
+
+    double megabytes = (sizeof(SnapshotHeader) + keys.size() * 2 * sizeof(long)) / 1e6;
+    cout << "AVLTree snapshot: save " << keys.size() / saveSecs / 1e6 << " M items/s, load "
+         << keys.size() / loadSecs / 1e6 << " M items/s (" << megabytes / loadSecs << " MB/s) vs re-insert "
+         << keys.size() / reinsertSecs / 1e6 << " M items/s (" << loaded.size() << " loaded)" << endl;
+}
+
+// Builds a MappedAVLTree in a file, then times opening the file again and
+// the first finds on it, which work straight on the mapped nodes with no
+// loading step. Opening only checks the links, one pass over the nodes
+// with nothing copied. The pages come from the page cache, so this
+// measures that check rather than the disk.
+void benchMapped(const vector<long>& keys, const vector<long>& probes)
+{
+    const char* path = "bst-bench.mapped";
+    remove(path);
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    {
+        MappedAVLTree<long, long> tree(path);
+        for(size_t i = 0; i < keys.size(); ++i) {
+            tree.insert(make_pair(keys[i], keys[i]));
+        }
+    }
+    double buildSecs = secondsSince(start);
+
+    start = chrono::steady_clock::now();
+    MappedAVLTree<long, long> tree(path);
+    double openSecs = secondsSince(start);
+
+    start = chrono::steady_clock::now();
+    size_t found = 0;
+    for(size_t i = 0; i < probes.size(); ++i) {
+        if(tree.find(probes[i]) != tree.end()) {
+            ++found;
+        }
+    }
+    double findSecs = secondsSince(start);
+    remove(path);
+
+    cout << "MappedAVLTree file: build " << keys.size() / buildSecs / 1e6 << " M inserts/s, open "
+         << openSecs * 1e6 << " us, then " << probes.size() / findSecs / 1e6 << " M finds/s ("
+         << found << " found)" << endl;
+}
+
+// Times rebuilding an AVLTree from the keys with bulkLoadUnsorted, which
+// sorts the keys and then builds the tree in O(n).
+void benchBulkLoad(const vector<long>& keys)
+{
+    vector<pair<long, long> > items;
+    items.reserve(keys.size());
+    for(size_t i = 0; i < keys.size(); ++i) {
+        items.push_back(make_pair(keys[i], keys[i]));
+    }
+
+    AVLTree<long, long> tree;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    tree.bulkLoadUnsorted(items);
+    double secs = secondsSince(start);
+
+    cout << "AVLTree bulkLoadUnsorted: " << keys.size() / secs / 1e6 << " M items/s"
+         << " (height " << tree.height() << ")" << endl;
+}
+
+// Loads a tree with the even keys 2k, then adds the odd keys 2k+1 in
+// batches of batchSize and removes them again, once with repeated
+// insert()/remove() calls and once with insert_batch()/erase_batch(),
+// and prints the throughput of each in millions of keys per second.
+void benchBatch(const vector<long>& keys, size_t batchSize)
+{
+    vector<pair<long, long> > base;
+    base.reserve(keys.size());
+    for(size_t i = 0; i < keys.size(); ++i) {
+        base.push_back(make_pair(2 * keys[i], keys[i]));
+    }
+    size_t added = keys.size() / 2;
+    vector<vector<pair<long, long> > > inserts;
+    vector<vector<long> > erases;
+    for(size_t i = 0; i < added; i += batchSize) {
+        inserts.push_back(vector<pair<long, long> >());
+        erases.push_back(vector<long>());
+        for(size_t j = i; j < i + batchSize && j < added; ++j) {
+            inserts.back().push_back(make_pair(2 * keys[j] + 1, keys[j]));
+            erases.back().push_back(2 * keys[j] + 1);
+        }
+    }
+
+    AVLTree<long, long> single;
+    single.bulkLoadUnsorted(base);
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for(size_t b = 0; b < inserts.size(); ++b) {
+        for(size_t j = 0; j < inserts[b].size(); ++j) {
+            single.insert(inserts[b][j]);
+        }
+    }
+    double singleInsertSecs = secondsSince(start);
+    start = chrono::steady_clock::now();
+    for(size_t b = 0; b < erases.size(); ++b) {
+        for(size_t j = 0; j < erases[b].size(); ++j) {
+            single.remove(erases[b][j]);
+        }
+    }
+    double singleEraseSecs = secondsSince(start);
+
+    AVLTree<long, long> batched;
+    batched.bulkLoadUnsorted(base);
+    start = chrono::steady_clock::now();
+    for(size_t b = 0; b < inserts.size(); ++b) {
+        batched.insert_batch(inserts[b]);
+    }
+    double batchInsertSecs = secondsSince(start);
+    start = chrono::steady_clock::now();
+    for(size_t b = 0; b < erases.size(); ++b) {
+        batched.erase_batch(erases[b]);
+    }
+    double batchEraseSecs = secondsSince(start);
+
+    cout << "AVLTree batches of " << batchSize << ": "
+         << added / singleInsertSecs / 1e6 << " vs "
+         << added / batchInsertSecs / 1e6 << " M inserts/s (single vs batch), "
+         << added / singleEraseSecs / 1e6 << " vs "
+         << added / batchEraseSecs / 1e6 << " M erases/s" << endl;
+}
+
+// Looks every probe up in an AVLTree of the keys and in frozen copies of
+// it in both layouts, and prints the throughput of each in millions of
+// finds per second along with the frozen copies' bytes per item.
+template<typename Tree>
+static double timeFinds(const Tree& tree, const vector<long>& probes, size_t& found)
+{
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for(size_t i = 0; i < probes.size(); ++i) {
+        if(tree.find(probes[i]) != tree.end()) {
+            ++found;
+        }
+    }
+    return probes.size() / secondsSince(start) / 1e6;
+}
+
+void benchFrozen(const vector<long>& keys, const vector<long>& probes)
+{
+    vector<pair<long, long> > items;
+    items.reserve(keys.size());
+    for(size_t i = 0; i < keys.size(); ++i) {
+        items.push_back(make_pair(keys[i], keys[i]));
+    }
+    AVLTree<long, long> tree;
+    tree.bulkLoadUnsorted(items);
+    FrozenTree<long, long> eytzinger = tree.freeze();
+    FrozenTree<long, long, less<long>, allocator<pair<const long, long> >, VanEmdeBoasLayout> veb =
+        tree.freeze<VanEmdeBoasLayout>();
+
+    size_t found = 0;
+    double linked = timeFinds(tree, probes, found);
+    double eytzingerRate = timeFinds(eytzinger, probes, found);
+    double vebRate = timeFinds(veb, probes, found);
+    cout << "AVLTree vs frozen Eytzinger vs frozen vEB: "
+         << linked << " vs " << eytzingerRate << " vs " << vebRate << " M finds/s, "
+         << double(eytzinger.memoryUsage()) / keys.size() << " and "
+         << double(veb.memoryUsage()) / keys.size() << " bytes per item frozen"
+         << " (" << found << " found)" << endl;
+}
+
+// Splits a tree of all the keys at a random key and joins the two halves
+// back together, repeatedly, and prints the average time per round trip.
+void benchSplitJoin(const vector<long>& keys)
+{
+    vector<pair<long, long> > items;
+    items.reserve(keys.size());
+    for(size_t i = 0; i < keys.size(); ++i) {
+        items.push_back(make_pair(keys[i], keys[i]));
+    }
+    AVLTree<long, long> tree;
+    tree.bulkLoadUnsorted(items);
+
+    const size_t rounds = 10000;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for(size_t i = 0; i < rounds; ++i) {
+        pair<AVLTree<long, long>, AVLTree<long, long> > parts = tree.split(keys[i % keys.size()]);
+        tree = AVLTree<long, long>::join(std::move(parts.first), std::move(parts.second));
+    }
+    double secs = secondsSince(start);
+
+    cout << "AVLTree split + join: " << secs / rounds * 1e6 << " us per round trip"
+         << " (height " << tree.height() << ")" << endl;
+}
+
+// Builds a tree of the even keys 2k and one of smallCount odd keys, then
+// merges them once by inserting the small tree's items one by one and once
+// with setUnion, and prints the time each took.
+void benchUnion(const vector<long>& keys, size_t smallCount, unsigned threads)
+{
+    vector<pair<long, long> > large;
+    vector<pair<long, long> > small;
+    for(size_t i = 0; i < keys.size(); ++i) {
+        large.push_back(make_pair(2 * keys[i], keys[i]));
+        if(i < smallCount) {
+            small.push_back(make_pair(2 * keys[i] + 1, keys[i]));
+        }
+    }
+
+    AVLTree<long, long> looped;
+    AVLTree<long, long> loopedSmall;
+    looped.bulkLoadUnsorted(large);
+    loopedSmall.bulkLoadUnsorted(small);
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for(AVLTree<long, long>::iterator it = loopedSmall.begin(); it != loopedSmall.end(); ++it) {
+        looped.insert(*it);
+    }
+    double loopSecs = secondsSince(start);
+
+    AVLTree<long, long> a;
+    AVLTree<long, long> b;
+    a.bulkLoadUnsorted(large);
+    b.bulkLoadUnsorted(small);
+    start = chrono::steady_clock::now();
+    AVLTree<long, long> merged = AVLTree<long, long>::setUnion(std::move(a), std::move(b), KeepFirstValue(), threads);
+    double unionSecs = secondsSince(start);
+
+    cout << "AVLTree union of " << keys.size() << " and " << smallCount << " keys on "
+         << sortThreadCount(threads) << " threads: "
+         << loopSecs * 1e3 << " ms inserting vs " << unionSecs * 1e3 << " ms setUnion"
+         << " (" << merged.size() << " items)" << endl;
+}
+
+// The tree operations benchConcurrent runs, for an AVLTree behind one
+// mutex and for a ConcurrentAVLTree.
+struct LockedAVLTree
+{
+    AVLTree<long, long> tree;
+    mutex lock;
+
+    bool read(long key)
+    {
+        lock_guard<mutex> guard(lock);
+        return tree.find(key) != tree.end();
+    }
+    void insert(long key)
+    {
+        lock_guard<mutex> guard(lock);
+        tree.insert(make_pair(key, key));
+    }
+    void remove(long key)
+    {
+        lock_guard<mutex> guard(lock);
+        tree.remove(key);
+    }
+};
+
+struct SharedAVLTree
+{
+    ConcurrentAVLTree<long, long> tree;
+
+    bool read(long key)
+    {
+        return tree.contains(key);
+    }
+    void insert(long key)
+    {
+        tree.insert(make_pair(key, key));
+    }
+    void remove(long key)
+    {
+        tree.remove(key);
+    }
+};
+
+// Loads the even keys 2k, then runs "threads" threads that each do
+// opsPerThread random operations: a lookup, or with probability
+// writePercent / 100 an insert or remove of an odd key. Prints the total
+// throughput in millions of operations per second.
+template<typename Tree>
+void benchConcurrent(const char* name, const vector<long>& keys, unsigned threads, unsigned writePercent)
+{
+    const size_t opsPerThread = 200000;
+    Tree tree;
+    for(size_t i = 0; i < keys.size(); ++i) {
+        tree.insert(2 * keys[i]);
+    }
+    long range = 2 * static_cast<long>(keys.size());
+
+    vector<thread> workers;
+    vector<size_t> found(threads, 0);
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for(unsigned t = 0; t < threads; ++t) {
+        workers.push_back(thread([&tree, &found, range, writePercent, t]() {
+            mt19937_64 rng(1000 + t);
+            size_t hits = 0;
+            for(size_t i = 0; i < opsPerThread; ++i) {
+                long key = static_cast<long>(rng() % range);
+                if(rng() % 100 < writePercent) {
+                    if(key & 1) {
+                        tree.insert(key);
+                    }
+                    else {
+                        tree.remove(key + 1);
+                    }
+                }
+                else {
+                    hits += tree.read(key);
+                }
+            }
+            found[t] = hits;
+        }));
+    }
+    for(size_t t = 0; t < workers.size(); ++t) {
+        workers[t].join();
+    }
+    double secs = secondsSince(start);
+    for(size_t t = 0; t < found.size(); ++t) {
+        sink += found[t];
+    }
+
+    cout << name << " " << threads << " threads, " << writePercent << "% writes: "
+         << threads * opsPerThread / secs / 1e6 << " M ops/s" << endl;
+}
+
+// Overwrites random keys of a PersistentAVLTree loaded with all the keys,
+// taking a snapshot every snapshotEvery writes (never if 0) and keeping the
+// last one alive, and prints the write throughput.
+void benchPersistent(const vector<long>& keys, size_t snapshotEvery)
+{
+    PersistentAVLTree<long, long> tree;
+    PersistentAVLTree<long, long>::Snapshot snapshot = tree.snapshot();
+    for(size_t i = 0; i < keys.size(); ++i) {
+        tree.insert(make_pair(keys[i], keys[i]));
+    }
+
+    const size_t writes = min<size_t>(keys.size(), 1000000);
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for(size_t i = 0; i < writes; ++i) {
+        if(snapshotEvery != 0 && i % snapshotEvery == 0) {
+            snapshot = tree.snapshot();
+        }
+        tree.insert(make_pair(keys[(i * 7919) % keys.size()], static_cast<long>(i)));
+    }
+    double secs = secondsSince(start);
+
+    cout << "PersistentAVLTree writes, snapshot every " << snapshotEvery << ": "
+         << writes / secs / 1e6 << " M writes/s (" << snapshot.size() << " items in the last snapshot)" << endl;
+}
+
+// Fills keys with 0 .. n-1 in random order and probes with the same keys
+// in another order.
+static void makeKeys(size_t n, vector<long>& keys, vector<long>& probes)
+{
+    mt19937_64 rng(104);
+    keys.resize(n);
+    for(size_t i = 0; i < n; ++i) {
+        keys[i] = static_cast<long>(i);
+    }
+    shuffle(keys.begin(), keys.end(), rng);
+    probes = keys;
+    shuffle(probes.begin(), probes.end(), rng);
+}
+
+// Compares the trees meant for large indexes at 1M, 10M and 100M keys,
+// stopping after maxKeys. 100M keys need about 12 GB for std::map.
+static void benchIndexes(size_t maxKeys)
+{
+    for(size_t n = 1000000; n <= maxKeys && n <= 100000000; n *= 10) {
+        vector<long> keys;
+        vector<long> probes;
+        makeKeys(n, keys, probes);
+        cout << n << " random keys" << endl;
+        benchTree<BTree<long, long> >("BTree", keys, probes);
+        benchTree<AVLTree<long, long> >("AVLTree", keys, probes);
+        benchTree<map<long, long> >("std::map", keys, probes);
+    }
+}
+
+// ---------------------------------------------------------------------
+// Workload suite: "bst-bench suite [keys] [ops] [--dist names] [--mix names]"
+// drives BinarySearchTree, AVLTree and std::map through every key
+// distribution and operation mix below, or the comma-separated ones named,
+// and prints one JSON document, so runs can be stored and compared from
+// commit to commit.
+// ---------------------------------------------------------------------
+
+// Bytes currently held by every CountingAllocator.
+static size_t liveBytes = 0;
+
+// An allocator that keeps liveBytes up to date, so the suite can report
+// the memory each container really uses per entry.
+template<typename T>
+struct CountingAllocator
+{
+    typedef T value_type;
+
+    CountingAllocator() {}
+    template<typename U>
+    CountingAllocator(const CountingAllocator<U>&) {}
+
+    T* allocate(size_t n)
+    {
+        liveBytes += n * sizeof(T);
+        return static_cast<T*>(::operator new(n * sizeof(T)));
+    }
+    void deallocate(T* p, size_t n)
+    {
+        liveBytes -= n * sizeof(T);
+        ::operator delete(p);
+    }
+};
+
+template<typename T, typename U>
+bool operator==(const CountingAllocator<T>&, const CountingAllocator<U>&) { return true; }
+template<typename T, typename U>
+bool operator!=(const CountingAllocator<T>&, const CountingAllocator<U>&) { return false; }
+
+typedef CountingAllocator<pair<const long, long> > SuiteAlloc;
+typedef BinarySearchTree<long, long, less<long>, SuiteAlloc> SuiteBST;
+typedef AVLTree<long, long, less<long>, SuiteAlloc> SuiteAVL;
+typedef map<long, long, less<long>, SuiteAlloc> SuiteMap;
+
+// Inserts or overwrites, and removes, the same way in every container.
+template<typename Tree>
+static void suiteInsert(Tree& tree, long key, long value)
+{
+    tree.insert(make_pair(key, value));
+}
+
+static void suiteInsert(SuiteMap& tree, long key, long value)
+{
+    tree[key] = value;
+}
+
+template<typename Tree>
+static void suiteRemove(Tree& tree, long key)
+{
+    tree.remove(key);
+}
+
+static void suiteRemove(SuiteMap& tree, long key)
+{
+    tree.erase(key);
+}
+
+enum KeyDistribution { kSequential, kRandom, kZipfian, kZigZag };
+static const char* const kDistributionNames[] = { "sequential", "random", "zipfian", "zigzag" };
+
+// The share of each operation in a mix, in percent; scans make up the rest.
+struct OperationMix
+{
+    const char* name;
+    unsigned findPercent;
+    unsigned insertPercent;
+    unsigned removePercent;
+};
+static const OperationMix kMixes[] = {
+    { "read-heavy", 90, 5, 5 },
+    { "write-heavy", 10, 45, 45 },
+    { "scan-heavy", 0, 5, 5 },
+};
+static const size_t kMixCount = sizeof(kMixes) / sizeof(kMixes[0]);
+static const size_t kScanLength = 100;
+
+// The order the keys 0 .. n-1 are loaded in. Sequential and zig-zag
+// (0, n-1, 1, n-2, ...) orders turn an unbalanced tree into a list;
+// Zipfian loads in random order and only skews the operations.
+static vector<long> loadOrder(KeyDistribution dist, size_t n, mt19937_64& rng)
+{
+    vector<long> keys(n);
+    for(size_t i = 0; i < n; ++i) {
+        if(dist == kZigZag) {
+            keys[i] = static_cast<long>((i % 2 == 0) ? i / 2 : n - 1 - i / 2);
+        }
+        else {
+            keys[i] = static_cast<long>(i);
+        }
+    }
+    if(dist == kRandom || dist == kZipfian) {
+        shuffle(keys.begin(), keys.end(), rng);
+    }
+    return keys;
+}
+
+// The keys count operations touch, drawn from 0 .. n-1. Zipfian keys
+// follow a skew of 0.99 over a random ranking of the keys, so a few keys
+// take most of the operations.
+static vector<long> operationKeys(KeyDistribution dist, size_t n, size_t count, mt19937_64& rng)
+{
+    vector<long> keys(count);
+    if(dist == kZipfian) {
+        vector<double> cdf(n);
+        double total = 0;
+        for(size_t r = 0; r < n; ++r) {
+            total += 1.0 / pow(double(r + 1), 0.99);
+            cdf[r] = total;
+        }
+        vector<long> ranking = loadOrder(kRandom, n, rng);
+        uniform_real_distribution<double> uniform(0, total);
+        for(size_t i = 0; i < count; ++i) {
+            size_t r = lower_bound(cdf.begin(), cdf.end(), uniform(rng)) - cdf.begin();
+            keys[i] = ranking[min(r, n - 1)];
+        }
+    }
+    else if(dist == kRandom) {
+        uniform_int_distribution<long> uniform(0, static_cast<long>(n) - 1);
+        for(size_t i = 0; i < count; ++i) {
+            keys[i] = uniform(rng);
+        }
+    }
+    else {
+        vector<long> order = loadOrder(dist, n, rng);
+        for(size_t i = 0; i < count; ++i) {
+            keys[i] = order[i % n];
+        }
+    }
+    return keys;
+}
+
+// The value at fraction q of the sorted latencies.
+static double percentile(const vector<double>& sorted, double q)
+{
+    return sorted[min(sorted.size() - 1, static_cast<size_t>(q * sorted.size()))];
+}
+
+// Loads a fresh Tree in the distribution's order, runs the operations of
+// the mix one by one, timing each, and prints the run as a JSON object.
+// The checksum adds up every value found or scanned, so it must be the
+// same for every container given the same workload.
+template<typename Tree>
+static void suiteRun(const char* name, KeyDistribution dist, const OperationMix& mix,
+                     const vector<long>& load, const vector<long>& opKeys,
+                     const vector<unsigned char>& opKinds, bool first)
+{
+    size_t baseBytes = liveBytes;
+    Tree tree;
+    for(size_t i = 0; i < load.size(); ++i) {
+        suiteInsert(tree, load[i], load[i]);
+    }
+    double bytesPerEntry = double(liveBytes - baseBytes) / load.size();
+
+    vector<double> latencies(opKeys.size());
+    long checksum = 0;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for(size_t i = 0; i < opKeys.size(); ++i) {
+        chrono::steady_clock::time_point opStart = chrono::steady_clock::now();
+        long key = opKeys[i];
+        switch(opKinds[i]) {
+        case 0: {
+            typename Tree::iterator it = tree.find(key);
+            if(it != tree.end()) {
+                checksum += it->second;
+            }
+            break;
+        }
+        case 1:
+            suiteInsert(tree, key, key + 1);
+            break;
+        case 2:
+            suiteRemove(tree, key);
+            break;
+        default: {
+            typename Tree::iterator it = tree.lower_bound(key);
+            for(size_t j = 0; j < kScanLength && it != tree.end(); ++j, ++it) {
+                checksum += it->second;
+            }
+            break;
+        }
+        }
+        latencies[i] = chrono::duration<double, nano>(chrono::steady_clock::now() - opStart).count();
+    }
+    double secs = secondsSince(start);
+    sort(latencies.begin(), latencies.end());
+
+    cout << (first ? "" : ",\n")
+         << "    {\"tree\": \"" << name << "\", \"distribution\": \"" << kDistributionNames[dist]
+         << "\", \"mix\": \"" << mix.name << "\", \"ops_per_sec\": " << opKeys.size() / secs
+         << ", \"latency_ns\": {\"p50\": " << percentile(latencies, 0.5)
+         << ", \"p90\": " << percentile(latencies, 0.9)
+         << ", \"p99\": " << percentile(latencies, 0.99)
+         << ", \"p999\": " << percentile(latencies, 0.999)
+         << ", \"max\": " << latencies.back()
+         << "}, \"bytes_per_entry\": " << bytesPerEntry
+         << ", \"checksum\": " << checksum << "}";
+}
+
+// Runs every container through each distribution and mix whose bit is set
+// in distMask and mixMask. Each distribution and mix pair uses one fixed
+// workload for all three. n and ops must be at least 1.
+static void benchSuite(size_t n, size_t ops, unsigned distMask, unsigned mixMask)
+{
+    ios::fmtflags flags = cout.flags();
+    cout << fixed << setprecision(1);
+    cout << "{\n  \"keys\": " << n << ",\n  \"ops\": " << ops
+         << ",\n  \"scan_length\": " << kScanLength << ",\n  \"runs\": [\n";
+    bool first = true;
+    for(int d = kSequential; d <= kZigZag; ++d) {
+        KeyDistribution dist = static_cast<KeyDistribution>(d);
+        for(size_t m = 0; m < kMixCount; ++m) {
+            if(!(distMask & (1u << d)) || !(mixMask & (1u << m))) {
+                continue;
+            }
+            mt19937_64 rng(2024 + 16 * d + m);
+            vector<long> load = loadOrder(dist, n, rng);
+            vector<long> opKeys = operationKeys(dist, n, ops, rng);
+            vector<unsigned char> opKinds(ops);
+            uniform_int_distribution<unsigned> percent(0, 99);
+            for(size_t i = 0; i < ops; ++i) {
+                unsigned p = percent(rng);
+                opKinds[i] = (p < kMixes[m].findPercent) ? 0
+                           : (p < kMixes[m].findPercent + kMixes[m].insertPercent) ? 1
+                           : (p < kMixes[m].findPercent + kMixes[m].insertPercent + kMixes[m].removePercent) ? 2
+                           : 3;
+            }
+            suiteRun<SuiteBST>("BinarySearchTree", dist, kMixes[m], load, opKeys, opKinds, first);
+            first = false;
+            suiteRun<SuiteAVL>("AVLTree", dist, kMixes[m], load, opKeys, opKinds, first);
+            suiteRun<SuiteMap>("std::map", dist, kMixes[m], load, opKeys, opKinds, first);
+        }
+    }
+    cout << "\n  ]\n}" << endl;
+    cout.flags(flags);
+}
+
+// Reads a count of at least 1 from text, which must be all digits.
+static bool parseCount(const char* text, size_t& count)
+{
+    if(*text < '0' || *text > '9') {
+        return false;
+    }
+    char* end = NULL;
+    errno = 0;
+    unsigned long long value = strtoull(text, &end, 10);
+    if(*end != '\0' || errno == ERANGE || value == 0) {
+        return false;
+    }
+    count = static_cast<size_t>(value);
+    return true;
+}
+
+// Sets the bit of each comma-separated name in names found in the n
+// entries of table, and fails on a name it does not know.
+template<typename Entry, typename NameOf>
+static bool parseNames(const char* names, const Entry* table, size_t n, NameOf nameOf, unsigned& mask)
+{
+    mask = 0;
+    string list(names);
+    for(size_t start = 0; start <= list.size(); ) {
+        size_t comma = min(list.find(',', start), list.size());
+        string name = list.substr(start, comma - start);
+        size_t i = 0;
+        while(i < n && name != nameOf(table[i])) {
+            ++i;
+        }
+        if(i == n) {
+            return false;
+        }
+        mask |= 1u << i;
+        start = comma + 1;
+    }
+    return true;
+}
+
+static const char* distributionName(const char* name) { return name; }
+static const char* mixName(const OperationMix& mix) { return mix.name; }
+
+static int usage()
+{
+    cerr << "usage: bst-bench [keys]\n"
+         << "       bst-bench index [keys]\n"
+         << "       bst-bench suite [keys] [ops] [--dist names] [--mix names]\n"
+         << "keys and ops are whole numbers of at least 1; names are comma-separated.\n"
+         << "distributions:";
+    for(size_t d = 0; d <= kZigZag; ++d) {
+        cerr << " " << kDistributionNames[d];
+    }
+    cerr << "\nmixes:";
+    for(size_t m = 0; m < kMixCount; ++m) {
+        cerr << " " << kMixes[m].name;
+    }
+    cerr << endl;
+    return 2;
+}
+
+// "bst-bench suite ..." after the word suite
+static int suiteMain(int argc, char *argv[])
+{
+    size_t counts[2] = { 20000, 100000 };
+    size_t positional = 0;
+    unsigned distMask = (1u << (kZigZag + 1)) - 1;
+    unsigned mixMask = (1u << kMixCount) - 1;
+    for(int i = 0; i < argc; ++i) {
+        if(strcmp(argv[i], "--dist") == 0 && i + 1 < argc) {
+            if(!parseNames(argv[++i], kDistributionNames, kZigZag + 1, distributionName, distMask)) {
+                return usage();
+            }
+        }
+        else if(strcmp(argv[i], "--mix") == 0 && i + 1 < argc) {
+            if(!parseNames(argv[++i], kMixes, kMixCount, mixName, mixMask)) {
+                return usage();
+            }
+        }
+        else if(positional == 2 || !parseCount(argv[i], counts[positional++])) {
+            return usage();
+        }
+    }
+    benchSuite(counts[0], counts[1], distMask, mixMask);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    if(argc > 1 && strcmp(argv[1], "suite") == 0) {
+        return suiteMain(argc - 2, argv + 2);
+    }
+    if(argc > 1 && strcmp(argv[1], "index") == 0) {
+        size_t n = 100000000;
+        if(argc > 3 || (argc == 3 && !parseCount(argv[2], n))) {
+            return usage();
+        }
+        benchIndexes(n);
+        return 0;
+    }
+    size_t n = 10000000;
+    if(argc > 2 || (argc == 2 && !parseCount(argv[1], n))) {
+        return usage();
+    }
+
+    vector<long> keys;
+    vector<long> probes;
+    makeKeys(n, keys, probes);
+
+    cout << n << " random keys" << endl;
+    benchTree<BinarySearchTree<long, long> >("BinarySearchTree", keys, probes);
+    benchTree<AVLTree<long, long> >("AVLTree", keys, probes);
+    benchTree<CompactAVLTree<long, long> >("CompactAVLTree", keys, probes);
+    benchTree<BTree<long, long> >("BTree", keys, probes);
+    benchTree<MappedAVLTree<long, long> >("MappedAVLTree", keys, probes);
+    benchTree<RedBlackTree<long, long> >("RedBlackTree", keys, probes);
+    benchRebalance("random", keys);
+    vector<long> sortedKeys(keys);
+    sort(sortedKeys.begin(), sortedKeys.end());
+    benchRebalance("sorted", sortedKeys);
+    benchWriteMix(keys, false);
+    benchWriteMix(keys, true);
+    benchBulkLoad(keys);
+    benchSnapshot(keys);
+    benchMapped(keys, probes);
+    benchFrozen(keys, probes);
+    benchBatch(keys, 1000);
+    benchBatch(keys, keys.size() / 8 + 1);
+    benchBatch(keys, keys.size());
+    benchSplitJoin(keys);
+    benchUnion(keys, 1000, 0);
+    benchUnion(keys, keys.size(), 1);
+    benchUnion(keys, keys.size(), 0);
+    benchTree<PersistentAVLTree<long, long> >("PersistentAVLTree", keys, probes);
+    benchPersistent(keys, 0);
+    benchPersistent(keys, 1);
+    benchPersistent(keys, 1000);
+
+    vector<long> concurrentKeys(keys.begin(), keys.begin() + min<size_t>(keys.size(), 1000000));
+    vector<unsigned> threadCounts;
+    for(unsigned t = 1; t <= max(4u, thread::hardware_concurrency()); t *= 2) {
+        threadCounts.push_back(t);
+    }
+    for(size_t i = 0; i < threadCounts.size(); ++i) {
+        for(unsigned writePercent = 0; writePercent <= 50; writePercent += (writePercent == 0) ? 10 : 40) {
+            benchConcurrent<LockedAVLTree>("AVLTree + mutex", concurrentKeys, threadCounts[i], writePercent);
+            benchConcurrent<SharedAVLTree>("ConcurrentAVLTree", concurrentKeys, threadCounts[i], writePercent);
+        }
+    }
+
+    cout << "bytes per node: Node " << sizeof(Node<long, long>)
+         << ", AVLNode " << sizeof(AVLNode<long, long>)
+         << ", CompactAVLNode " << sizeof(CompactAVLNode<long, long>)
+         << ", MappedAVLNode " << sizeof(MappedAVLNode<long, long>)
+         << ", RedBlackNode " << sizeof(RedBlackNode<long, long>) << endl;
+
+    return 0;
+}
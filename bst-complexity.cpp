@@ -0,0 +1,244 @@
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <cmath>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <algorithm>
+#include "avlbst.h"
+
+using namespace std;
+
+// Complexity regression suite for AVLTree. It exits with status 1 if any
+// check fails, so "make complexity" stops a change that makes insert,
+// remove, find, begin or iteration asymptotically worse.
+//
+// Two kinds of check run for every insertion order:
+//  - operation counts, from an AVLTree built with CountingTreeStats, are
+//    held to the AVL height bound for every single operation, so a
+//    rebalancing bug that lets one path grow long is caught exactly;
+//  - running times are compared between a small and a 16 times larger
+//    tree, and must grow no faster than the expected O(log n) per
+//    operation (and per item of a full iteration, which is O(n) in all),
+//    with generous slack for timer noise and cache misses.
+
+typedef AVLTree<int, int> Tree;
+typedef AVLTree<int, int, less<int>, allocator<pair<const int, int> >, AVLNode<int, int>, CountingTreeStats> CountedTree;
+
+static const size_t kSmall = 1 << 12;
+static const size_t kLarge = 1 << 16;
+static const int kRepeats = 5;
+// How far a measured time ratio may exceed the expected one. Randomly
+// placed nodes of the large tree miss the cache far more often, which
+// alone can double or triple the ratio; an O(n) step still exceeds it.
+static const double kTimeSlack = 6.0;
+
+static int failures = 0;
+// Keeps the timed loops from being optimized away
+static volatile long sink = 0;
+
+enum InsertOrder { kSorted, kReverse, kAlternating, kRandom };
+static const char* const kOrderNames[] = { "sorted", "reverse-sorted", "alternating", "random" };
+
+// The keys 0 .. n-1 in the given order; alternating goes 0, n-1, 1, n-2, ...
+static vector<int> makeKeys(InsertOrder order, size_t n)
+{
+    vector<int> keys(n);
+    for(size_t i = 0; i < n; ++i) {
+        switch(order) {
+        case kReverse:
+            keys[i] = static_cast<int>(n - 1 - i);
+            break;
+        case kAlternating:
+            keys[i] = static_cast<int>((i % 2 == 0) ? i / 2 : n - 1 - i / 2);
+            break;
+        default:
+            keys[i] = static_cast<int>(i);
+            break;
+        }
+    }
+    if(order == kRandom) {
+        mt19937 rng(7);
+        shuffle(keys.begin(), keys.end(), rng);
+    }
+    return keys;
+}
+
+// The tallest an AVL tree of n nodes can be.
+static unsigned heightBound(size_t n)
+{
+    return static_cast<unsigned>(1.4405 * log2(double(n) + 2) - 0.3277);
+}
+
+static void report(bool ok, const char* what, InsertOrder order, double value, double limit)
+{
+    if(!ok) {
+        ++failures;
+    }
+    cout << (ok ? "PASS " : "FAIL ") << what << ", " << kOrderNames[order] << ": "
+         << value << " (limit " << limit << ")" << endl;
+}
+
+// The largest and total increase of a counter over single operations.
+struct OpCost
+{
+    uint64_t worst;
+    uint64_t total;
+};
+
+static void addCost(OpCost& cost, uint64_t before, uint64_t after)
+{
+    cost.worst = max(cost.worst, after - before);
+    cost.total += after - before;
+}
+
+// Inserts, finds and removes every key one at a time in a counted tree
+// and checks each operation against the height bound.
+static void checkCounts(InsertOrder order)
+{
+    vector<int> keys = makeKeys(order, kLarge);
+    unsigned bound = heightBound(kLarge);
+    CountedTree tree;
+    const CountingTreeStats& stats = tree.stats();
+
+    OpCost comparisons = { 0, 0 };
+    OpCost rotations = { 0, 0 };
+    OpCost fixSteps = { 0, 0 };
+    for(size_t i = 0; i < keys.size(); ++i) {
+        uint64_t c = stats.comparisons(), r = stats.rotations(), f = stats.fixSteps();
+        tree.insert(make_pair(keys[i], keys[i]));
+        addCost(comparisons, c, stats.comparisons());
+        addCost(rotations, r, stats.rotations());
+        addCost(fixSteps, f, stats.fixSteps());
+    }
+    report(unsigned(tree.height()) <= bound, "height after inserts", order, tree.height(), bound);
+    // std::less<int> is called both ways at each level, and once more to link the new leaf
+    report(comparisons.worst <= 2 * bound + 1, "worst insert comparisons", order, comparisons.worst, 2 * bound + 1);
+    report(rotations.worst <= 2, "worst insert rotations", order, rotations.worst, 2);
+    report(fixSteps.worst <= bound, "worst insert fix-up steps", order, fixSteps.worst, bound);
+    // rebalancing after an insert is O(1) amortized
+    report(fixSteps.total <= 4 * keys.size(), "average insert fix-up steps", order,
+           double(fixSteps.total) / keys.size(), 4);
+
+    OpCost findComparisons = { 0, 0 };
+    for(size_t i = 0; i < keys.size(); ++i) {
+        uint64_t c = stats.comparisons();
+        if(tree.find(keys[i]) == tree.end()) {
+            report(false, "find of an inserted key", order, keys[i], 0);
+        }
+        addCost(findComparisons, c, stats.comparisons());
+    }
+    report(findComparisons.worst <= 2 * bound, "worst find comparisons", order, findComparisons.worst, 2 * bound);
+
+    uint64_t steps = stats.iteratorSteps();
+    size_t visited = 0;
+    for(CountedTree::iterator it = tree.begin(); it != tree.end(); ++it) {
+        ++visited;
+    }
+    report(visited == keys.size() && stats.iteratorSteps() - steps == keys.size(),
+           "iterator steps for a full pass", order, double(stats.iteratorSteps() - steps), keys.size());
+
+    comparisons.worst = comparisons.total = 0;
+    rotations.worst = rotations.total = 0;
+    fixSteps.worst = fixSteps.total = 0;
+    OpCost swaps = { 0, 0 };
+    for(size_t i = 0; i < keys.size(); ++i) {
+        uint64_t c = stats.comparisons(), r = stats.rotations(), f = stats.fixSteps(), s = stats.nodeSwaps();
+        tree.remove(keys[i]);
+        addCost(comparisons, c, stats.comparisons());
+        addCost(rotations, r, stats.rotations());
+        addCost(fixSteps, f, stats.fixSteps());
+        addCost(swaps, s, stats.nodeSwaps());
+    }
+    report(tree.empty(), "empty after removes", order, double(tree.size()), 0);
+    report(comparisons.worst <= 2 * bound, "worst remove comparisons", order, comparisons.worst, 2 * bound);
+    report(rotations.worst <= 2 * bound, "worst remove rotations", order, rotations.worst, 2 * bound);
+    report(fixSteps.worst <= bound, "worst remove fix-up steps", order, fixSteps.worst, bound);
+    report(swaps.worst <= 1, "worst remove node swaps", order, swaps.worst, 1);
+    report(fixSteps.total <= 4 * keys.size(), "average remove fix-up steps", order,
+           double(fixSteps.total) / keys.size(), 4);
+}
+
+// Seconds per operation (per item for the iteration) for each step of a
+// run over n keys, the best of kRepeats runs.
+struct Timings
+{
+    double insert;
+    double find;
+    double begin;
+    double iterate;
+    double remove;
+};
+
+static double secondsSince(chrono::steady_clock::time_point start)
+{
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+static Timings timeRun(InsertOrder order, size_t n)
+{
+    vector<int> keys = makeKeys(order, n);
+    const size_t beginCalls = 100000;
+    Timings best = { 1e9, 1e9, 1e9, 1e9, 1e9 };
+    for(int r = 0; r < kRepeats; ++r) {
+        Tree tree;
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        for(size_t i = 0; i < n; ++i) {
+            tree.insert(make_pair(keys[i], keys[i]));
+        }
+        best.insert = min(best.insert, secondsSince(start) / n);
+
+        start = chrono::steady_clock::now();
+        for(size_t i = 0; i < n; ++i) {
+            sink += tree.find(keys[i])->second;
+        }
+        best.find = min(best.find, secondsSince(start) / n);
+
+        start = chrono::steady_clock::now();
+        for(size_t i = 0; i < beginCalls; ++i) {
+            sink += tree.begin()->second;
+        }
+        best.begin = min(best.begin, secondsSince(start) / beginCalls);
+
+        start = chrono::steady_clock::now();
+        for(Tree::iterator it = tree.begin(); it != tree.end(); ++it) {
+            sink += it->second;
+        }
+        best.iterate = min(best.iterate, secondsSince(start) / n);
+
+        start = chrono::steady_clock::now();
+        for(size_t i = 0; i < n; ++i) {
+            tree.remove(keys[i]);
+        }
+        best.remove = min(best.remove, secondsSince(start) / n);
+    }
+    return best;
+}
+
+// Compares the small and large runs against the expected growth.
+static void checkTimes(InsertOrder order)
+{
+    Timings small = timeRun(order, kSmall);
+    Timings large = timeRun(order, kLarge);
+    double logGrowth = log2(double(kLarge)) / log2(double(kSmall)) * kTimeSlack;
+
+    report(large.insert / small.insert <= logGrowth, "insert time growth", order, large.insert / small.insert, logGrowth);
+    report(large.find / small.find <= logGrowth, "find time growth", order, large.find / small.find, logGrowth);
+    report(large.begin / small.begin <= logGrowth, "begin time growth", order, large.begin / small.begin, logGrowth);
+    report(large.iterate / small.iterate <= logGrowth, "iteration time growth per item", order,
+           large.iterate / small.iterate, logGrowth);
+    report(large.remove / small.remove <= logGrowth, "remove time growth", order, large.remove / small.remove, logGrowth);
+}
+
+int main()
+{
+    cout << setprecision(3);
+    for(int o = kSorted; o <= kRandom; ++o) {
+        checkCounts(static_cast<InsertOrder>(o));
+        checkTimes(static_cast<InsertOrder>(o));
+    }
+    cout << (failures == 0 ? "All complexity checks passed" : "Complexity checks FAILED")
+         << " (" << failures << " failures)" << endl;
+    return failures == 0 ? 0 : 1;
+}
@@ -2,6 +2,7 @@
 #include <map>
 #include "bst.h"
 #include "avlbst.h"
+#include "rbbst.h"
 
 using namespace std;
 
@@ -44,5 +45,34 @@ int main(int argc, char *argv[])
     cout << "Erasing b" << endl;
     at.remove('b');
 
+    // Range queries
+    for(char c = 'c'; c <= 'h'; ++c) {
+        at.insert(std::make_pair(c, c - 'a' + 1));
+    }
+    cout << "\nAVLTree keys in [d, g):" << endl;
+    for(std::pair<const char, int>& item : at.range('d', 'g')) {
+        cout << item.first << " " << item.second << endl;
+    }
+
+    cout << "\nAVLTree contents in reverse:" << endl;
+    for(AVLTree<char,int>::reverse_iterator it = at.rbegin(); it != at.rend(); ++it) {
+        cout << it->first << " " << it->second << endl;
+    }
+
+    // Red-black tree tests
+    RedBlackTree<char,int> rt;
+    for(char c = 'a'; c <= 'h'; ++c) {
+        rt.insert(std::make_pair(c, c - 'a' + 1));
+    }
+    cout << "Erasing b and e" << endl;
+    rt.remove('b');
+    rt.remove('e');
+
+    cout << "\nRedBlackTree contents:" << endl;
+    for(RedBlackTree<char,int>::iterator it = rt.begin(); it != rt.end(); ++it) {
+        cout << it->first << " " << it->second << endl;
+    }
+    cout << "RedBlackTree black height: " << rt.blackHeight() << endl;
+
     return 0;
 }
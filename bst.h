@@ -5,20 +5,48 @@
 #include <exception>
 #include <cstdlib>
 #include <utility>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <functional>
+#include <string>
+#include <cstring>
+#include <stdexcept>
+#include <atomic>
+#if __cplusplus >= 201703L
+#include <string_view>
+#endif
+#include "node_pool.h"
+#include "tree_stats.h"
+#include "tree_snapshot.h"
+#include "frozen_bst.h"
 
 /**
  * A templated class for a Node in a search tree.
- * The getters for parent/left/right are virtual so
- * that they can be overridden for future kinds of
- * search trees, such as Red Black trees, Splay trees,
- * and AVL trees.
+ * The getters for parent/left/right are not virtual:
+ * node types for other kinds of search trees, such as
+ * Red Black trees, Splay trees, and AVL trees, hide them
+ * with getters returning their own type. Every call is
+ * resolved statically, so tree walks inline down to plain
+ * loads and nodes carry no vtable pointer.
+ *
+ * The low bits of the parent link are always zero for an
+ * aligned node, so derived node types may keep a small tag
+ * there (see CompactAVLNode). getParent() and setParent()
+ * hide the tag from the rest of the tree.
  */
 template <typename Key, typename Value>
 class Node
 {
 public:
     Node(const Key& key, const Value& value, Node<Key, Value>* parent);
-    virtual ~Node();
+    Node(Key&& key, Value&& value, Node<Key, Value>* parent);
+    ~Node();
 
     const std::pair<const Key, Value>& getItem() const;
     std::pair<const Key, Value>& getItem();
@@ -26,9 +54,9 @@ public:
     const Value& getValue() const;
     Value& getValue();
 
-    virtual Node<Key, Value>* getParent() const;
-    virtual Node<Key, Value>* getLeft() const;
-    virtual Node<Key, Value>* getRight() const;
+    Node<Key, Value>* getParent() const;
+    Node<Key, Value>* getLeft() const;
+    Node<Key, Value>* getRight() const;
 
     void setParent(Node<Key, Value>* parent);
     void setLeft(Node<Key, Value>* left);
@@ -36,8 +64,15 @@ public:
     void setValue(const Value &value);
 
 protected:
+    // Number of low parent-link bits available for a tag
+    static const int kParentTagBits = 3;
+    static const std::uintptr_t kParentTagMask = (std::uintptr_t(1) << kParentTagBits) - 1;
+
+    std::uintptr_t getParentTag() const;
+    void setParentTag(std::uintptr_t tag);
+
     std::pair<const Key, Value> item_;
-    Node<Key, Value>* parent_;
+    std::uintptr_t parent_;    // parent pointer, with a tag in the low bits
     Node<Key, Value>* left_;
     Node<Key, Value>* right_;
 };
@@ -54,7 +89,20 @@ protected:
 template<typename Key, typename Value>
 Node<Key, Value>::Node(const Key& key, const Value& value, Node<Key, Value>* parent) :
     item_(key, value),
-    parent_(parent),
+    parent_(reinterpret_cast<std::uintptr_t>(parent)),
+    left_(NULL),
+    right_(NULL)
+{
+
+}
+
+/**
+* A constructor that moves the key and value into the node.
+*/
+template<typename Key, typename Value>
+Node<Key, Value>::Node(Key&& key, Value&& value, Node<Key, Value>* parent) :
+    item_(std::move(key), std::move(value)),
+    parent_(reinterpret_cast<std::uintptr_t>(parent)),
     left_(NULL),
     right_(NULL)
 {
@@ -64,7 +112,8 @@ Node<Key, Value>::Node(const Key& key, const Value& value, Node<Key, Value>* par
 /**
 * Destructor, which does not need to do anything since the pointers inside of a node
 * are only used as references to existing nodes. The nodes pointed to by parent/left/right
-* are freed by the BinarySearchTree.
+* are freed by the BinarySearchTree. It is not virtual; the tree destroys each node
+* through destroyNode(), which knows the node's real type.
 */
 template<typename Key, typename Value>
 Node<Key, Value>::~Node()
@@ -118,16 +167,16 @@ Value& Node<Key, Value>::getValue()
 }
 
 /**
-* An implementation of the virtual function for retreiving the parent.
+* A getter for the parent.
 */
 template<typename Key, typename Value>
 Node<Key, Value>* Node<Key, Value>::getParent() const
 {
-    return parent_;
+    return reinterpret_cast<Node<Key, Value>*>(parent_ & ~kParentTagMask);
 }
 
 /**
-* An implementation of the virtual function for retreiving the left child.
+* A getter for the left child.
 */
 template<typename Key, typename Value>
 Node<Key, Value>* Node<Key, Value>::getLeft() const
@@ -136,7 +185,7 @@ Node<Key, Value>* Node<Key, Value>::getLeft() const
 }
 
 /**
-* An implementation of the virtual function for retreiving the right child.
+* A getter for the right child.
 */
 template<typename Key, typename Value>
 Node<Key, Value>* Node<Key, Value>::getRight() const
@@ -145,12 +194,30 @@ Node<Key, Value>* Node<Key, Value>::getRight() const
 }
 
 /**
-* A setter for setting the parent of a node.
+* A setter for setting the parent of a node. Any tag is kept.
 */
 template<typename Key, typename Value>
 void Node<Key, Value>::setParent(Node<Key, Value>* parent)
 {
-    parent_ = parent;
+    parent_ = reinterpret_cast<std::uintptr_t>(parent) | (parent_ & kParentTagMask);
+}
+
+/**
+* A getter for the tag kept in the low bits of the parent link.
+*/
+template<typename Key, typename Value>
+std::uintptr_t Node<Key, Value>::getParentTag() const
+{
+    return parent_ & kParentTagMask;
+}
+
+/**
+* A setter for the tag kept in the low bits of the parent link.
+*/
+template<typename Key, typename Value>
+void Node<Key, Value>::setParentTag(std::uintptr_t tag)
+{
+    parent_ = (parent_ & ~kParentTagMask) | (tag & kParentTagMask);
 }
 
 /**
@@ -186,31 +253,205 @@ void Node<Key, Value>::setValue(const Value& value)
   ---------------------------------------
 */
 
+/**
+* The result of ordering a search key against a node's key.
+*/
+struct KeyOrder
+{
+    bool less;              // the search key goes before the node's key
+    bool greater;           // the search key goes after the node's key
+    unsigned comparisons;   // how many times Compare (or compare()) was called
+};
+
+/**
+* Orders a search key against a node's key in one step, so the search
+* loops stop at an equal key without needing ==, < and > on Key.
+* The general version asks Compare both ways; for built-in keys the two
+* tests fold into a single machine compare and the child is picked with
+* a conditional move. Specialise it for comparators that can order two
+* keys with one call, as below for std::less on strings.
+*/
+template<typename Compare>
+struct ThreeWayCompare
+{
+    template<typename A, typename B>
+    static KeyOrder order(const Compare& comp, const A& a, const B& b)
+    {
+        KeyOrder result;
+        result.less = comp(a, b);
+        result.greater = comp(b, a);
+        result.comparisons = 2;
+        return result;
+    }
+};
+
+/**
+* Strings are ordered with one compare() call per level.
+*/
+template<typename CharT, typename Traits, typename StrAlloc>
+struct ThreeWayCompare<std::less<std::basic_string<CharT, Traits, StrAlloc> > >
+{
+    template<typename A, typename B>
+    static KeyOrder order(const std::less<std::basic_string<CharT, Traits, StrAlloc> >&, const A& a, const B& b)
+    {
+        int c = a.compare(b);
+        KeyOrder result;
+        result.less = c < 0;
+        result.greater = c > 0;
+        result.comparisons = 1;
+        return result;
+    }
+};
+
+#if __cplusplus >= 201402L
+/**
+* True for the string types whose compare() orders them as operator<
+* does: std::basic_string, and std::basic_string_view from C++17.
+*/
+template<typename T>
+struct IsStringLike : std::false_type { };
+
+template<typename CharT, typename Traits, typename StrAlloc>
+struct IsStringLike<std::basic_string<CharT, Traits, StrAlloc> > : std::true_type { };
+
+#if __cplusplus >= 201703L
+template<typename CharT, typename Traits>
+struct IsStringLike<std::basic_string_view<CharT, Traits> > : std::true_type { };
+#endif
+
+/**
+* True if a.compare(b) is a valid call returning an int.
+*/
+template<typename A, typename B, typename = void>
+struct HasCompareMember : std::false_type { };
+
+template<typename A, typename B>
+struct HasCompareMember<A, B, typename std::enable_if<std::is_convertible<
+    decltype(std::declval<const A&>().compare(std::declval<const B&>())), int>::value>::type> : std::true_type { };
+
+/**
+* The transparent std::less<>, used for heterogeneous lookup such as a
+* string_view probe into std::string keys. When either operand is a
+* string that can compare() itself against the other, each level makes
+* one compare() call; anything else is asked both ways with operator<.
+*/
+template<>
+struct ThreeWayCompare<std::less<void> >
+{
+    template<typename A, typename B>
+    static KeyOrder order(const std::less<void>& comp, const A& a, const B& b)
+    {
+        typedef std::integral_constant<int,
+            (IsStringLike<A>::value && HasCompareMember<A, B>::value) ? 1 :
+            (IsStringLike<B>::value && HasCompareMember<B, A>::value) ? 2 : 0> Path;
+        return orderBy(comp, a, b, Path());
+    }
+
+private:
+    template<typename A, typename B>
+    static KeyOrder orderBy(const std::less<void>& comp, const A& a, const B& b, std::integral_constant<int, 0>)
+    {
+        KeyOrder result;
+        result.less = comp(a, b);
+        result.greater = comp(b, a);
+        result.comparisons = 2;
+        return result;
+    }
+
+    // a is the string
+    template<typename A, typename B>
+    static KeyOrder orderBy(const std::less<void>&, const A& a, const B& b, std::integral_constant<int, 1>)
+    {
+        int c = a.compare(b);
+        KeyOrder result;
+        result.less = c < 0;
+        result.greater = c > 0;
+        result.comparisons = 1;
+        return result;
+    }
+
+    // only b is a string, so its result is read the other way round
+    template<typename A, typename B>
+    static KeyOrder orderBy(const std::less<void>&, const A& a, const B& b, std::integral_constant<int, 2>)
+    {
+        int c = b.compare(a);
+        KeyOrder result;
+        result.less = c > 0;
+        result.greater = c < 0;
+        result.comparisons = 1;
+        return result;
+    }
+};
+#endif
+
 /**
 * A templated unbalanced binary search tree.
+* Keys are ordered by Compare, a strict weak ordering like std::less;
+* searches order the key against each node through ThreeWayCompare and
+* stop at the first equal key. If Compare declares is_transparent
+* (std::less<> does), find and the bound functions also accept any type
+* Compare can order against Key, so no temporary Key is built.
+* Nodes are drawn from a NodePool fed by Alloc, so inserts do not call
+* the global allocator for every node and clear() frees whole blocks.
 */
-template <typename Key, typename Value>
-class BinarySearchTree
+template <typename Key, typename Value,
+          typename Compare = std::less<Key>,
+          typename Alloc = std::allocator<std::pair<const Key, Value> >,
+          typename Stats = NoTreeStats>
+class BinarySearchTree : protected Stats
 {
 public:
-    BinarySearchTree(); //TODO
+    typedef Compare key_compare;
+    typedef Alloc allocator_type;
+
+    explicit BinarySearchTree(const Compare& comp = Compare(), const Alloc& alloc = Alloc()); //TODO
+    explicit BinarySearchTree(const Alloc& alloc);
+    BinarySearchTree(BinarySearchTree&& other);
+    BinarySearchTree& operator=(BinarySearchTree&& other);
     virtual ~BinarySearchTree(); //TODO
     virtual void insert(const std::pair<const Key, Value>& keyValuePair); //TODO
     virtual void remove(const Key& key); //TODO
-    void clear(); //TODO
+    virtual void clear(); //TODO
     bool isBalanced() const; //TODO
     void print() const;
     bool empty() const;
+    std::size_t size() const;
+
+    // Operation counters kept by the Stats policy (see tree_stats.h)
+    const Stats& stats() const;
+    void resetStats();
+
+    /**
+    * The result of a full balance check: the tree's height and
+    * whether every node's subtrees differ in height by at most one.
+    */
+    struct BalanceInfo
+    {
+        int height;
+        bool balanced;
+    };
+    BalanceInfo checkBalance() const;
 
     template<typename PPKey, typename PPValue>
     friend void prettyPrintBST(BinarySearchTree<PPKey, PPValue> & tree);
 public:
+    class const_iterator;
+
     /**
     * An internal iterator class for traversing the contents of the BST.
+    * It is bidirectional: the end iterator remembers its tree, so --end()
+    * reaches the largest item. Steps follow parent pointers and take O(1)
+    * amortized time over a full traversal.
     */
     class iterator  // TODO
     {
     public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef std::pair<const Key, Value> value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef std::pair<const Key, Value>* pointer;
+        typedef std::pair<const Key, Value>& reference;
+
         iterator();
 
         std::pair<const Key,Value>& operator*() const;
@@ -220,25 +461,159 @@ public:
         bool operator!=(const iterator& rhs) const;
 
         iterator& operator++();
+        iterator operator++(int);
+        iterator& operator--();
+        iterator operator--(int);
 
     protected:
-        friend class BinarySearchTree<Key, Value>;
-        iterator(Node<Key,Value>* ptr);
+        friend class BinarySearchTree<Key, Value, Compare, Alloc, Stats>;
+        friend class const_iterator;
+        iterator(Node<Key,Value>* ptr, const BinarySearchTree<Key, Value, Compare, Alloc, Stats>* tree);
         Node<Key, Value> *current_;
+        const BinarySearchTree<Key, Value, Compare, Alloc, Stats>* tree_;
+    };
+
+    /**
+    * An iterator that gives read-only access to the items.
+    * Any iterator converts to a const_iterator.
+    */
+    class const_iterator
+    {
+    public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef std::pair<const Key, Value> value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const std::pair<const Key, Value>* pointer;
+        typedef const std::pair<const Key, Value>& reference;
+
+        const_iterator();
+        const_iterator(const iterator& it);
+
+        const std::pair<const Key,Value>& operator*() const;
+        const std::pair<const Key,Value>* operator->() const;
+
+        bool operator==(const const_iterator& rhs) const;
+        bool operator!=(const const_iterator& rhs) const;
+
+        const_iterator& operator++();
+        const_iterator operator++(int);
+        const_iterator& operator--();
+        const_iterator operator--(int);
+
+    protected:
+        friend class BinarySearchTree<Key, Value, Compare, Alloc, Stats>;
+        const Node<Key, Value> *current_;
+        const BinarySearchTree<Key, Value, Compare, Alloc, Stats>* tree_;
+    };
+
+    typedef std::reverse_iterator<iterator> reverse_iterator;
+    typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+
+    /**
+    * A view of the items with keys in [lo, hi), usable in a range-based for loop.
+    */
+    class Range
+    {
+    public:
+        iterator begin() const;
+        iterator end() const;
+        bool empty() const;
+
+    protected:
+        friend class BinarySearchTree<Key, Value, Compare, Alloc, Stats>;
+        Range(const iterator& first, const iterator& last);
+        iterator first_;
+        iterator last_;
     };
 
 public:
     iterator begin() const;
     iterator end() const;
+    const_iterator cbegin() const;
+    const_iterator cend() const;
+    reverse_iterator rbegin() const;
+    reverse_iterator rend() const;
+    const_reverse_iterator crbegin() const;
+    const_reverse_iterator crend() const;
     iterator find(const Key& key) const;
+    iterator lower_bound(const Key& key) const;
+    iterator upper_bound(const Key& key) const;
+    std::pair<iterator, iterator> equal_range(const Key& key) const;
+    Range range(const Key& lo, const Key& hi) const;
+    template<typename Layout = EytzingerLayout>
+    FrozenTree<Key, Value, Compare, Alloc, Layout> freeze() const;
+
+    // Binary snapshots of the items in key order (format in tree_snapshot.h)
+    template<typename KeyCodec = SnapshotCodec<Key>, typename ValueCodec = SnapshotCodec<Value> >
+    void saveTo(const std::string& path) const;
+    template<typename KeyCodec = SnapshotCodec<Key>, typename ValueCodec = SnapshotCodec<Value> >
+    void loadFrom(const std::string& path);
+
     Value& operator[](const Key& key);
     Value const & operator[](const Key& key) const;
+    key_compare key_comp() const;
+    allocator_type get_allocator() const;
+
+    // Heterogeneous lookup, enabled when Compare is transparent
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    iterator find(const K& key) const;
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    iterator lower_bound(const K& key) const;
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    iterator upper_bound(const K& key) const;
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    std::pair<iterator, iterator> equal_range(const K& key) const;
+
+    // Move-aware insertion. Each looks the key up first and only creates
+    // a node when the key is new; the bool is true if a node was created.
+    template<typename P, typename = typename std::enable_if<!std::is_lvalue_reference<P>::value>::type>
+    std::pair<iterator, bool> insert(P&& keyValuePair);
+    template<typename... Args>
+    std::pair<iterator, bool> emplace(Args&&... args);
+    template<typename... Args>
+    std::pair<iterator, bool> try_emplace(const Key& key, Args&&... args);
+    template<typename... Args>
+    std::pair<iterator, bool> try_emplace(Key&& key, Args&&... args);
+    template<typename M>
+    std::pair<iterator, bool> insert_or_assign(const Key& key, M&& value);
+    template<typename M>
+    std::pair<iterator, bool> insert_or_assign(Key&& key, M&& value);
 
 protected:
+    // Lets derived trees size the pool for their own node type
+    BinarySearchTree(std::size_t nodeSize, std::size_t nodeAlign, const Compare& comp, const Alloc& alloc);
+
+    // Node storage
+    template<typename NodeType, typename... Args>
+    NodeType* createNode(Args&&... args);
+    virtual void destroyNode(Node<Key, Value>* node);
+    void destroySubtree(Node<Key, Value>* node);
+
+    // Insertion steps shared by insert() and the move-aware variants
+    Node<Key, Value>* internalFindSlot(const Key& key, Node<Key, Value>*& parent) const;
+    void linkChild(Node<Key, Value>* parent, Node<Key, Value>* node);
+    virtual Node<Key, Value>* linkNewNode(Node<Key, Value>* parent, Key&& key, Value&& value);
+
+    // Lets derived trees hand out iterators to nodes they found
+    iterator makeIterator(Node<Key, Value>* node) const;
+
+    // Builds the (empty) tree from a snapshot's items; derived trees
+    // override it to build their own nodes
+    virtual void buildFromSnapshot(SnapshotSource<Key, Value>& source, std::size_t count);
+    Node<Key, Value>* buildSnapshotNodes(SnapshotSource<Key, Value>& source, std::size_t count,
+                                         Node<Key, Value>* parent, const Node<Key, Value>*& last);
+
     // Mandatory helper functions
-    Node<Key, Value>* internalFind(const Key& k) const; // TODO
+    template<typename K>
+    Node<Key, Value>* internalFind(const K& k) const; // TODO
+    template<typename K>
+    Node<Key, Value>* internalLowerBound(const K& key) const;
+    template<typename K>
+    Node<Key, Value>* internalUpperBound(const K& key) const;
     Node<Key, Value> *getSmallestNode() const;  // TODO
+    Node<Key, Value> *getLargestNode() const;
     static Node<Key, Value>* predecessor(Node<Key, Value>* current); // TODO
+    static Node<Key, Value>* successor(Node<Key, Value>* current);
     // Note:  static means these functions don't have a "this" pointer
     //        and instead just use the input argument.
 
@@ -247,14 +622,21 @@ protected:
     virtual void nodeSwap( Node<Key,Value>* n1, Node<Key,Value>* n2) ;
 
     // Add helper functions here
-    int height(Node<Key, Value>* node) const;
-    bool balancedHelper(Node<Key, Value>* node) const;
+    int balancedHeight(Node<Key, Value>* node, int depth) const;
     Node<Key, Value>* recurseInsert(Node<Key, Value>* root, const std::pair<const Key, Value>& keyValuePair);
 
 
+    // Size bookkeeping; size_ may be left unknown after a split, and is
+    // atomic so concurrent size() calls on a const tree may fill it in
+    static const std::size_t kUnknownSize = static_cast<std::size_t>(-1);
+    void addSize(long delta);
+
+
 protected:
     Node<Key, Value>* root_;
-    // You should not need other data members
+    mutable std::atomic<std::size_t> size_;
+    Compare comp_;
+    std::shared_ptr<NodePool<Alloc> > pool_;
 };
 
 /*
@@ -264,18 +646,21 @@ Begin implementations for the BinarySearchTree::iterator class.
 */
 
 /**
-* Explicit constructor that initializes an iterator with a given node pointer.
+* Explicit constructor that initializes an iterator with a given node pointer
+* in the given tree. A NULL node is the tree's end.
 */
-template<class Key, class Value>
-BinarySearchTree<Key, Value>::iterator::iterator(Node<Key,Value> *ptr) : current_(ptr)
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+BinarySearchTree<Key, Value, Compare, Alloc, Stats>::iterator::iterator(Node<Key,Value> *ptr, const BinarySearchTree<Key, Value, Compare, Alloc, Stats>* tree) :
+    current_(ptr),
+    tree_(tree)
 {
 }
 
 /**
 * A default constructor that initializes the iterator to NULL.
 */
-template<class Key, class Value>
-BinarySearchTree<Key, Value>::iterator::iterator() : current_(NULL)
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+BinarySearchTree<Key, Value, Compare, Alloc, Stats>::iterator::iterator() : current_(NULL), tree_(NULL)
 {
 
 }
@@ -283,9 +668,9 @@ BinarySearchTree<Key, Value>::iterator::iterator() : current_(NULL)
 /**
 * Provides access to the item.
 */
-template<class Key, class Value>
+template<class Key, class Value, class Compare, class Alloc, class Stats>
 std::pair<const Key,Value> &
-BinarySearchTree<Key, Value>::iterator::operator*() const
+BinarySearchTree<Key, Value, Compare, Alloc, Stats>::iterator::operator*() const
 {
     return current_->getItem();
 }
@@ -293,9 +678,9 @@ BinarySearchTree<Key, Value>::iterator::operator*() const
 /**
 * Provides access to the address of the item.
 */
-template<class Key, class Value>
+template<class Key, class Value, class Compare, class Alloc, class Stats>
 std::pair<const Key,Value> *
-BinarySearchTree<Key, Value>::iterator::operator->() const
+BinarySearchTree<Key, Value, Compare, Alloc, Stats>::iterator::operator->() const
 {
     return &(current_->getItem());
 }
@@ -304,10 +689,10 @@ BinarySearchTree<Key, Value>::iterator::operator->() const
 * Checks if 'this' iterator's internals have the same value
 * as 'rhs'
 */
-template<class Key, class Value>
+template<class Key, class Value, class Compare, class Alloc, class Stats>
 bool
-BinarySearchTree<Key, Value>::iterator::operator==(
-    const BinarySearchTree<Key, Value>::iterator& rhs) const
+BinarySearchTree<Key, Value, Compare, Alloc, Stats>::iterator::operator==(
+    const BinarySearchTree<Key, Value, Compare, Alloc, Stats>::iterator& rhs) const
 {
     return this->current_ == rhs.current_;
 }
@@ -316,10 +701,10 @@ BinarySearchTree<Key, Value>::iterator::operator==(
 * Checks if 'this' iterator's internals have a different value
 * as 'rhs'
 */
-template<class Key, class Value>
+template<class Key, class Value, class Compare, class Alloc, class Stats>
 bool
-BinarySearchTree<Key, Value>::iterator::operator!=(
-    const BinarySearchTree<Key, Value>::iterator& rhs) const
+BinarySearchTree<Key, Value, Compare, Alloc, Stats>::iterator::operator!=(
+    const BinarySearchTree<Key, Value, Compare, Alloc, Stats>::iterator& rhs) const
 {
     return this->current_ != rhs.current_;
 }
@@ -328,32 +713,61 @@ BinarySearchTree<Key, Value>::iterator::operator!=(
 /**
 * Advances the iterator's location using an in-order sequencing
 */
-template<class Key, class Value>
-typename BinarySearchTree<Key, Value>::iterator&
-BinarySearchTree<Key, Value>::iterator::operator++()
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+typename BinarySearchTree<Key, Value, Compare, Alloc, Stats>::iterator&
+BinarySearchTree<Key, Value, Compare, Alloc, Stats>::iterator::operator++()
+{
+    current_ = successor(current_);
+    if(tree_ != NULL){
+        tree_->countIteratorStep();
+    }
+    return *this;
+}
+
+/**
+* Postfix increment, which returns the iterator's old position
+*/
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+typename BinarySearchTree<Key, Value, Compare, Alloc, Stats>::iterator
+BinarySearchTree<Key, Value, Compare, Alloc, Stats>::iterator::operator++(int)
+{
+    iterator old(*this);
+    ++(*this);
+    return old;
+}
+
+/**
+* Moves the iterator back to the previous item in order.
+* Decrementing the end iterator moves to the largest item.
+*/
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+typename BinarySearchTree<Key, Value, Compare, Alloc, Stats>::iterator&
+BinarySearchTree<Key, Value, Compare, Alloc, Stats>::iterator::operator--()
 {
     if(current_ == NULL){
-        return *this;
+        current_ = (tree_ == NULL) ? NULL : tree_->getLargestNode();
     }
-    // if right child exists go all the way to left
-    if(current_->getRight() != NULL){
-        current_ = current_->getRight();
-        while(current_->getLeft() != NULL){
-            current_ = current_->getLeft();
-        }
-        return *this;
+    else {
+        current_ = predecessor(current_);
     }
-    // if no right child traverse parent chain
-    Node<Key, Value>* parent = current_->getParent();
-    while (parent != NULL && current_ == parent->getRight()) {
-        current_ = parent;
-        parent = parent->getParent();
+    if(tree_ != NULL){
+        tree_->countIteratorStep();
     }
-    // found left child pointer, that parent is successor
-    current_ = parent;
     return *this;
 }
 
+/**
+* Postfix decrement, which returns the iterator's old position
+*/
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+typename BinarySearchTree<Key, Value, Compare, Alloc, Stats>::iterator
+BinarySearchTree<Key, Value, Compare, Alloc, Stats>::iterator::operator--(int)
+{
+    iterator old(*this);
+    --(*this);
+    return old;
+}
+
 
 /*
 -------------------------------------------------------------
@@ -362,198 +776,1004 @@ End implementations for the BinarySearchTree::iterator class.
 */
 
 /*
------------------------------------------------------
-Begin implementations for the BinarySearchTree class.
------------------------------------------------------
+--------------------------------------------------------------------
+Begin implementations for the BinarySearchTree::const_iterator class.
+--------------------------------------------------------------------
 */
 
 /**
-* Default constructor for a BinarySearchTree, which sets the root to NULL.
+* A default constructor that initializes the iterator to NULL.
 */
-template<class Key, class Value>
-BinarySearchTree<Key, Value>::BinarySearchTree() : root_(NULL)
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+BinarySearchTree<Key, Value, Compare, Alloc, Stats>::const_iterator::const_iterator() : current_(NULL), tree_(NULL)
 {
 }
 
-template<typename Key, typename Value>
-BinarySearchTree<Key, Value>::~BinarySearchTree()
+/**
+* Converts an iterator to a read-only iterator at the same position.
+*/
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+BinarySearchTree<Key, Value, Compare, Alloc, Stats>::const_iterator::const_iterator(const iterator& it) :
+    current_(it.current_),
+    tree_(it.tree_)
 {
-    clear();
 }
 
 /**
- * Returns true if tree is empty
+* Provides read-only access to the item.
 */
-template<class Key, class Value>
-bool BinarySearchTree<Key, Value>::empty() const
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+const std::pair<const Key,Value> &
+BinarySearchTree<Key, Value, Compare, Alloc, Stats>::const_iterator::operator*() const
 {
-    return root_ == NULL;
+    return current_->getItem();
 }
 
-template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::print() const
+/**
+* Provides the address of the item.
+*/
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+const std::pair<const Key,Value> *
+BinarySearchTree<Key, Value, Compare, Alloc, Stats>::const_iterator::operator->() const
 {
-    printRoot(root_);
-    std::cout << "\n";
+    return &(current_->getItem());
 }
 
 /**
-* Returns an iterator to the "smallest" item in the tree
+* Checks if both iterators are at the same position.
 */
-template<class Key, class Value>
-typename BinarySearchTree<Key, Value>::iterator
-BinarySearchTree<Key, Value>::begin() const
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+bool
+BinarySearchTree<Key, Value, Compare, Alloc, Stats>::const_iterator::operator==(const const_iterator& rhs) const
 {
-    BinarySearchTree<Key, Value>::iterator begin(getSmallestNode());
-    return begin;
+    return current_ == rhs.current_;
 }
 
 /**
-* Returns an iterator whose value means INVALID
+* Checks if the iterators are at different positions.
 */
-template<class Key, class Value>
-typename BinarySearchTree<Key, Value>::iterator
-BinarySearchTree<Key, Value>::end() const
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+bool
+BinarySearchTree<Key, Value, Compare, Alloc, Stats>::const_iterator::operator!=(const const_iterator& rhs) const
 {
-    BinarySearchTree<Key, Value>::iterator end(NULL);
-    return end;
+    return current_ != rhs.current_;
 }
 
 /**
-* Returns an iterator to the item with the given key, k
-* or the end iterator if k does not exist in the tree
+* Advances the iterator to the next item in order.
 */
-template<class Key, class Value>
-typename BinarySearchTree<Key, Value>::iterator
-BinarySearchTree<Key, Value>::find(const Key & k) const
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+typename BinarySearchTree<Key, Value, Compare, Alloc, Stats>::const_iterator&
+BinarySearchTree<Key, Value, Compare, Alloc, Stats>::const_iterator::operator++()
 {
-    Node<Key, Value> *curr = internalFind(k);
-    BinarySearchTree<Key, Value>::iterator it(curr);
-    return it;
+    current_ = successor(const_cast<Node<Key, Value>*>(current_));
+    if(tree_ != NULL){
+        tree_->countIteratorStep();
+    }
+    return *this;
 }
 
 /**
- * @precondition The key exists in the map
- * Returns the value associated with the key
- */
-template<class Key, class Value>
-Value& BinarySearchTree<Key, Value>::operator[](const Key& key)
-{
-    Node<Key, Value> *curr = internalFind(key);
-    if(curr == NULL) throw std::out_of_range("Invalid key");
-    return curr->getValue();
-}
-template<class Key, class Value>
-Value const & BinarySearchTree<Key, Value>::operator[](const Key& key) const
+* Postfix increment, which returns the iterator's old position
+*/
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+typename BinarySearchTree<Key, Value, Compare, Alloc, Stats>::const_iterator
+BinarySearchTree<Key, Value, Compare, Alloc, Stats>::const_iterator::operator++(int)
 {
-    Node<Key, Value> *curr = internalFind(key);
-    if(curr == NULL) throw std::out_of_range("Invalid key");
-    return curr->getValue();
+    const_iterator old(*this);
+    ++(*this);
+    return old;
 }
 
 /**
-* An insert method to insert into a Binary Search Tree.
-* The tree will not remain balanced when inserting.
-* Recall: If key is already in the tree, you should 
-* overwrite the current value with the updated value.
+* Moves the iterator back to the previous item in order.
+* Decrementing the end iterator moves to the largest item.
 */
-template<class Key, class Value>
-void BinarySearchTree<Key, Value>::insert(const std::pair<const Key, Value> &keyValuePair)
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+typename BinarySearchTree<Key, Value, Compare, Alloc, Stats>::const_iterator&
+BinarySearchTree<Key, Value, Compare, Alloc, Stats>::const_iterator::operator--()
 {
-    // TODO
-    // make new node
-    Node<Key, Value>* newNode = new Node<Key, Value>(keyValuePair.first, keyValuePair.second, NULL);
-    // empty bst
-    if(root_ == NULL){
-        root_ = newNode;
-        return;
-    }
-
-    Node<Key, Value>* current = root_;
-    Node<Key, Value>* parent = NULL;
-
-    while(current != NULL){
-        parent = current;
-        // greater, successor
-        if(keyValuePair.first < current->getKey()){
-            current = current->getLeft();
-        }
-        // less, predecessor
-        else if(keyValuePair.first > current->getKey()){
-            current = current->getRight();
-        }
-        // same val
-        else {
-            current->setValue(keyValuePair.second);
-            delete newNode;
-            return;
-        }
-    }
-
-    if(keyValuePair.first < parent->getKey()){
-        parent->setLeft(newNode);
+    if(current_ == NULL){
+        current_ = (tree_ == NULL) ? NULL : tree_->getLargestNode();
     }
     else {
-        parent->setRight(newNode);
+        current_ = predecessor(const_cast<Node<Key, Value>*>(current_));
     }
-    newNode->setParent(parent);
+    if(tree_ != NULL){
+        tree_->countIteratorStep();
+    }
+    return *this;
 }
 
-
 /**
-* A remove method to remove a specific key from a Binary Search Tree.
-* Recall: The writeup specifies that if a node has 2 children you
-* should swap with the predecessor and then remove.
+* Postfix decrement, which returns the iterator's old position
 */
-template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::remove(const Key& key)
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+typename BinarySearchTree<Key, Value, Compare, Alloc, Stats>::const_iterator
+BinarySearchTree<Key, Value, Compare, Alloc, Stats>::const_iterator::operator--(int)
 {
-    // find node with given key
-    Node<Key, Value>* removeNode = internalFind(key);
-    if(removeNode == NULL){
-        return;
-    }
-    // node has two children
-    if (removeNode->getLeft() != NULL && removeNode->getRight() != NULL) {
-        Node<Key, Value>* pred = predecessor(removeNode);
-        nodeSwap(pred, removeNode);
-    }
-
-    // removeNode has at most one child
-    Node<Key, Value>* child = (removeNode->getLeft() != NULL) ? removeNode->getLeft() : removeNode->getRight();
-    Node<Key, Value>* parent = removeNode->getParent();
+    const_iterator old(*this);
+    --(*this);
+    return old;
+}
 
-    if (child != NULL)
-        child->setParent(parent);
+/*
+------------------------------------------------------------------
+End implementations for the BinarySearchTree::const_iterator class.
+------------------------------------------------------------------
+*/
 
-    if (parent == NULL) {
-        // removeNode is the root
-        root_ = child;
-    } else {
-        if (removeNode == parent->getLeft())
-            parent->setLeft(child);
-        else
-            parent->setRight(child);
-    }
+/*
+-----------------------------------------------------------
+Begin implementations for the BinarySearchTree::Range class.
+-----------------------------------------------------------
+*/
 
-    delete removeNode;
+/**
+* Explicit constructor for a view of [first, last).
+*/
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+BinarySearchTree<Key, Value, Compare, Alloc, Stats>::Range::Range(const iterator& first, const iterator& last) :
+    first_(first),
+    last_(last)
+{
 }
 
+/**
+* Returns an iterator to the first item in the view.
+*/
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+typename BinarySearchTree<Key, Value, Compare, Alloc, Stats>::iterator
+BinarySearchTree<Key, Value, Compare, Alloc, Stats>::Range::begin() const
+{
+    return first_;
+}
 
+/**
+* Returns an iterator one past the last item in the view.
+*/
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+typename BinarySearchTree<Key, Value, Compare, Alloc, Stats>::iterator
+BinarySearchTree<Key, Value, Compare, Alloc, Stats>::Range::end() const
+{
+    return last_;
+}
 
-template<class Key, class Value>
-Node<Key, Value>*
-BinarySearchTree<Key, Value>::predecessor(Node<Key, Value>* current)
+/**
+* Returns true if no items fall in the view.
+*/
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+bool BinarySearchTree<Key, Value, Compare, Alloc, Stats>::Range::empty() const
 {
-    // TODO
-    // we have left child
-    if(current == NULL){
-        return NULL;
-    }
-    if(current->getLeft() != NULL){
-        Node<Key, Value>* pred = current->getLeft();
-        while(pred->getRight() != NULL){
-            pred = pred->getRight();
+    return first_ == last_;
+}
+
+/*
+---------------------------------------------------------
+End implementations for the BinarySearchTree::Range class.
+---------------------------------------------------------
+*/
+
+/*
+-----------------------------------------------------
+Begin implementations for the BinarySearchTree class.
+-----------------------------------------------------
+*/
+
+/**
+* Default constructor for a BinarySearchTree, which sets the root to NULL.
+* Keys are ordered by comp and nodes are allocated from blocks obtained
+* through alloc.
+*/
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+BinarySearchTree<Key, Value, Compare, Alloc, Stats>::BinarySearchTree(const Compare& comp, const Alloc& alloc) :
+    root_(NULL),
+    size_(0),
+    comp_(comp),
+    pool_(std::allocate_shared<NodePool<Alloc> >(alloc, sizeof(Node<Key, Value>), alignof(Node<Key, Value>), alloc))
+{
+}
+
+/**
+* Constructor taking only an allocator, with a default Compare.
+*/
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+BinarySearchTree<Key, Value, Compare, Alloc, Stats>::BinarySearchTree(const Alloc& alloc) :
+    root_(NULL),
+    size_(0),
+    comp_(),
+    pool_(std::allocate_shared<NodePool<Alloc> >(alloc, sizeof(Node<Key, Value>), alignof(Node<Key, Value>), alloc))
+{
+}
+
+/**
+* Constructor for derived trees whose nodes are larger than Node.
+*/
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+BinarySearchTree<Key, Value, Compare, Alloc, Stats>::BinarySearchTree(std::size_t nodeSize, std::size_t nodeAlign, const Compare& comp, const Alloc& alloc) :
+    root_(NULL),
+    size_(0),
+    comp_(comp),
+    pool_(std::allocate_shared<NodePool<Alloc> >(alloc, nodeSize, nodeAlign, alloc))
+{
+}
+
+/**
+* Move constructor. The nodes move over with the root and the node pool;
+* other is given a new empty pool, so it stays usable and shares nothing
+* with this tree.
+*/
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+BinarySearchTree<Key, Value, Compare, Alloc, Stats>::BinarySearchTree(BinarySearchTree&& other) :
+    Stats(other),
+    root_(other.root_),
+    size_(other.size_.load(std::memory_order_relaxed)),
+    comp_(other.comp_),
+    pool_(NodePool<Alloc>::emptyLike(other.pool_))
+{
+    pool_.swap(other.pool_);
+    other.root_ = NULL;
+    other.size_ = 0;
+}
+
+/**
+* Move assignment, which clears this tree and then takes other's nodes and
+* node pool, leaving other a new empty pool as the move constructor does.
+*/
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+BinarySearchTree<Key, Value, Compare, Alloc, Stats>&
+BinarySearchTree<Key, Value, Compare, Alloc, Stats>::operator=(BinarySearchTree&& other)
+{
+    if(this != &other){
+        std::shared_ptr<NodePool<Alloc> > fresh = NodePool<Alloc>::emptyLike(other.pool_);
+        clear();
+        root_ = other.root_;
+        size_.store(other.size_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        comp_ = other.comp_;
+        pool_ = std::move(other.pool_);
+        other.pool_ = std::move(fresh);
+        Stats::operator=(other);
+        other.root_ = NULL;
+        other.size_ = 0;
+    }
+    return *this;
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Stats>
+BinarySearchTree<Key, Value, Compare, Alloc, Stats>::~BinarySearchTree()
+{
+    clear();
+}
+
+/**
+ * Returns true if tree is empty
+*/
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+bool BinarySearchTree<Key, Value, Compare, Alloc, Stats>::empty() const
+{
+    return root_ == NULL;
+}
+
+/**
+ * Returns the number of items in the tree in O(1), with one exception:
+ * a tree made by split(), or by join or a set operation on such a part,
+ * does not know its count when its nodes keep no subtree sizes (AVLNode,
+ * CompactAVLNode). The first size() call on it counts the items in O(n)
+ * and caches the count, after which size() is O(1) again.
+ *
+ * Like the other const members, size() may be called by several threads
+ * at once; if they all count, they store the same count.
+*/
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+std::size_t BinarySearchTree<Key, Value, Compare, Alloc, Stats>::size() const
+{
+    std::size_t size = size_.load(std::memory_order_relaxed);
+    // a split part counts itself once, on first use
+    if(size == kUnknownSize){
+        size = 0;
+        for(Node<Key, Value>* node = getSmallestNode(); node != NULL; node = successor(node)){
+            ++size;
+        }
+        size_.store(size, std::memory_order_relaxed);
+    }
+    return size;
+}
+
+/**
+* Returns the Stats policy, which for CountingTreeStats holds the counts
+* of comparisons, allocations and the other events since the last reset.
+*/
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+const Stats& BinarySearchTree<Key, Value, Compare, Alloc, Stats>::stats() const
+{
+    return *this;
+}
+
+/**
+* Sets the Stats policy's counters back to zero.
+*/
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+void BinarySearchTree<Key, Value, Compare, Alloc, Stats>::resetStats()
+{
+    Stats::reset();
+}
+
+/**
+* Adds delta to the item count unless it is not known yet.
+*/
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+void BinarySearchTree<Key, Value, Compare, Alloc, Stats>::addSize(long delta)
+{
+    // only writers call this, one at a time, so no atomic add is needed
+    std::size_t size = size_.load(std::memory_order_relaxed);
+    if(size != kUnknownSize){
+        size_.store(size + delta, std::memory_order_relaxed);
+    }
+}
+
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Stats>
+void BinarySearchTree<Key, Value, Compare, Alloc, Stats>::print() const
+{
+    printRoot(root_);
+    std::cout << "\n";
+}
+
+/**
+* Returns an iterator to the "smallest" item in the tree
+*/
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+typename BinarySearchTree<Key, Value, Compare, Alloc, Stats>::iterator
+BinarySearchTree<Key, Value, Compare, Alloc, Stats>::begin() const
+{
+    BinarySearchTree<Key, Value, Compare, Alloc, Stats>::iterator begin(getSmallestNode(), this);
+    return begin;
+}
+
+/**
+* Returns an iterator whose value means INVALID.
+* It is one past the largest item, so it can be decremented.
+*/
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+typename BinarySearchTree<Key, Value, Compare, Alloc, Stats>::iterator
+BinarySearchTree<Key, Value, Compare, Alloc, Stats>::end() const
+{
+    BinarySearchTree<Key, Value, Compare, Alloc, Stats>::iterator end(NULL, this);
+    return end;
+}
+
+/**
+* Returns a read-only iterator to the smallest item
+*/
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+typename BinarySearchTree<Key, Value, Compare, Alloc, Stats>::const_iterator
+BinarySearchTree<Key, Value, Compare, Alloc, Stats>::cbegin() const
+{
+    return begin();
+}
+
+/**
+* Returns the read-only end iterator
+*/
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+typename BinarySearchTree<Key, Value, Compare, Alloc, Stats>::const_iterator
+BinarySearchTree<Key, Value, Compare, Alloc, Stats>::cend() const
+{
+    return end();
+}
+
+/**
+* Returns a reverse iterator to the largest item
+*/
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+typename BinarySearchTree<Key, Value, Compare, Alloc, Stats>::reverse_iterator
+BinarySearchTree<Key, Value, Compare, Alloc, Stats>::rbegin() const
+{
+    return reverse_iterator(end());
+}
+
+/**
+* Returns the reverse iterator one before the smallest item
+*/
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+typename BinarySearchTree<Key, Value, Compare, Alloc, Stats>::reverse_iterator
+BinarySearchTree<Key, Value, Compare, Alloc, Stats>::rend() const
+{
+    return reverse_iterator(begin());
+}
+
+/**
+* Returns a read-only reverse iterator to the largest item
+*/
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+typename BinarySearchTree<Key, Value, Compare, Alloc, Stats>::const_reverse_iterator
+BinarySearchTree<Key, Value, Compare, Alloc, Stats>::crbegin() const
+{
+    return const_reverse_iterator(cend());
+}
+
+/**
+* Returns the read-only reverse iterator one before the smallest item
+*/
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+typename BinarySearchTree<Key, Value, Compare, Alloc, Stats>::const_reverse_iterator
+BinarySearchTree<Key, Value, Compare, Alloc, Stats>::crend() const
+{
+    return const_reverse_iterator(cbegin());
+}
+
+/**
+* Returns an iterator to the item with the given key, k
+* or the end iterator if k does not exist in the tree
+*/
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+typename BinarySearchTree<Key, Value, Compare, Alloc, Stats>::iterator
+BinarySearchTree<Key, Value, Compare, Alloc, Stats>::find(const Key & k) const
+{
+    Node<Key, Value> *curr = internalFind(k);
+    BinarySearchTree<Key, Value, Compare, Alloc, Stats>::iterator it(curr, this);
+    return it;
+}
+
+/**
+* Returns an iterator to the first item whose key is not less than k,
+* or the end iterator if there is none. O(height).
+*/
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+typename BinarySearchTree<Key, Value, Compare, Alloc, Stats>::iterator
+BinarySearchTree<Key, Value, Compare, Alloc, Stats>::lower_bound(const Key & k) const
+{
+    return iterator(internalLowerBound(k), this);
+}
+
+/**
+* Returns an iterator to the first item whose key is greater than k,
+* or the end iterator if there is none. O(height).
+*/
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+typename BinarySearchTree<Key, Value, Compare, Alloc, Stats>::iterator
+BinarySearchTree<Key, Value, Compare, Alloc, Stats>::upper_bound(const Key & k) const
+{
+    return iterator(internalUpperBound(k), this);
+}
+
+/**
+* Returns the range of items whose key is k: both iterators are equal
+* if k is not in the tree.
+*/
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+std::pair<typename BinarySearchTree<Key, Value, Compare, Alloc, Stats>::iterator,
+          typename BinarySearchTree<Key, Value, Compare, Alloc, Stats>::iterator>
+BinarySearchTree<Key, Value, Compare, Alloc, Stats>::equal_range(const Key & k) const
+{
+    iterator first(internalLowerBound(k), this);
+    iterator last(first);
+    // keys are unique, so the range holds at most one item
+    if(last != end() && !comp_(k, last->first)) {
+        ++last;
+    }
+    return std::make_pair(first, last);
+}
+
+/**
+* Heterogeneous find: like find(), but key may be any type that the
+* transparent Compare orders against Key.
+*/
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+template<typename K, typename C, typename>
+typename BinarySearchTree<Key, Value, Compare, Alloc, Stats>::iterator
+BinarySearchTree<Key, Value, Compare, Alloc, Stats>::find(const K& key) const
+{
+    return iterator(internalFind(key), this);
+}
+
+/**
+* Heterogeneous lower_bound.
+*/
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+template<typename K, typename C, typename>
+typename BinarySearchTree<Key, Value, Compare, Alloc, Stats>::iterator
+BinarySearchTree<Key, Value, Compare, Alloc, Stats>::lower_bound(const K& key) const
+{
+    return iterator(internalLowerBound(key), this);
+}
+
+/**
+* Heterogeneous upper_bound.
+*/
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+template<typename K, typename C, typename>
+typename BinarySearchTree<Key, Value, Compare, Alloc, Stats>::iterator
+BinarySearchTree<Key, Value, Compare, Alloc, Stats>::upper_bound(const K& key) const
+{
+    return iterator(internalUpperBound(key), this);
+}
+
+/**
+* Heterogeneous equal_range.
+*/
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+template<typename K, typename C, typename>
+std::pair<typename BinarySearchTree<Key, Value, Compare, Alloc, Stats>::iterator,
+          typename BinarySearchTree<Key, Value, Compare, Alloc, Stats>::iterator>
+BinarySearchTree<Key, Value, Compare, Alloc, Stats>::equal_range(const K& key) const
+{
+    iterator first(internalLowerBound(key), this);
+    iterator last(first);
+    if(last != end() && !comp_(key, last->first)) {
+        ++last;
+    }
+    return std::make_pair(first, last);
+}
+
+/**
+* Returns a view of the items with keys in [lo, hi). Finding the first
+* item costs O(height); each further step is an iterator increment.
+*/
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+typename BinarySearchTree<Key, Value, Compare, Alloc, Stats>::Range
+BinarySearchTree<Key, Value, Compare, Alloc, Stats>::range(const Key & lo, const Key & hi) const
+{
+    if(!comp_(lo, hi)) {
+        return Range(end(), end());
+    }
+    return Range(lower_bound(lo), lower_bound(hi));
+}
+
+/**
+* Returns a read-only copy of the tree in the implicit, pointer-free
+* layout Layout (EytzingerLayout or VanEmdeBoasLayout). The tree itself
+* is left as it was. O(n).
+*/
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+template<typename Layout>
+FrozenTree<Key, Value, Compare, Alloc, Layout> BinarySearchTree<Key, Value, Compare, Alloc, Stats>::freeze() const
+{
+    return FrozenTree<Key, Value, Compare, Alloc, Layout>(begin(), end(), size(), comp_, get_allocator());
+}
+
+/**
+* Writes every item to the file at path in key order, replacing the
+* file, through a 1 MB buffer. KeyCodec and ValueCodec encode each key
+* and value (see SnapshotCodec). Throws std::runtime_error if the file
+* cannot be opened or written.
+*/
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+template<typename KeyCodec, typename ValueCodec>
+void BinarySearchTree<Key, Value, Compare, Alloc, Stats>::saveTo(const std::string& path) const
+{
+    SnapshotWriter out(path);
+    SnapshotHeader header;
+    std::memcpy(header.magic, kSnapshotMagic, sizeof(header.magic));
+    header.version = kSnapshotVersion;
+    header.reserved = 0;
+    header.count = size();
+    out.write(&header, sizeof(header));
+    for(Node<Key, Value>* node = getSmallestNode(); node != NULL; node = successor(node)){
+        KeyCodec::write(out, node->getKey());
+        ValueCodec::write(out, node->getValue());
+    }
+    out.finish();
+}
+
+/**
+* Replaces the contents of the tree with a snapshot written by saveTo()
+* with the same codecs. The items stream in through a 1 MB buffer and
+* are linked straight into a balanced tree in one pass, without a search
+* or rebalancing step per key, so loading is O(n) and runs nearly as
+* fast as bulkLoad() from memory. Key and Value must be default
+* constructible.
+* Throws std::runtime_error if the file cannot be read, is not a
+* snapshot, is truncated or has extra bytes, or holds keys out of order.
+* A file rejected by its header leaves the tree as it was; a failure
+* after that leaves it empty, with every node built so far freed.
+*/
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+template<typename KeyCodec, typename ValueCodec>
+void BinarySearchTree<Key, Value, Compare, Alloc, Stats>::loadFrom(const std::string& path)
+{
+    SnapshotReader in(path);
+    SnapshotHeader header;
+    in.read(&header, sizeof(header));
+    if(std::memcmp(header.magic, kSnapshotMagic, sizeof(header.magic)) != 0 ||
+       header.version != kSnapshotVersion){
+        throw std::runtime_error(path + " is not a tree snapshot");
+    }
+
+    clear();
+    CodecSnapshotSource<Key, Value, KeyCodec, ValueCodec> source(in);
+    buildFromSnapshot(source, static_cast<std::size_t>(header.count));
+    if(!in.atEnd()){
+        clear();
+        throw std::runtime_error(path + " has data past its last item");
+    }
+}
+
+/**
+ * @precondition The key exists in the map
+ * Returns the value associated with the key
+ */
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+Value& BinarySearchTree<Key, Value, Compare, Alloc, Stats>::operator[](const Key& key)
+{
+    Node<Key, Value> *curr = internalFind(key);
+    if(curr == NULL) throw std::out_of_range("Invalid key");
+    return curr->getValue();
+}
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+Value const & BinarySearchTree<Key, Value, Compare, Alloc, Stats>::operator[](const Key& key) const
+{
+    Node<Key, Value> *curr = internalFind(key);
+    if(curr == NULL) throw std::out_of_range("Invalid key");
+    return curr->getValue();
+}
+
+/**
+* Returns a copy of the key comparison object.
+*/
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+typename BinarySearchTree<Key, Value, Compare, Alloc, Stats>::key_compare
+BinarySearchTree<Key, Value, Compare, Alloc, Stats>::key_comp() const
+{
+    return comp_;
+}
+
+/**
+* Returns a copy of the allocator the node pool draws its blocks from.
+*/
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+typename BinarySearchTree<Key, Value, Compare, Alloc, Stats>::allocator_type
+BinarySearchTree<Key, Value, Compare, Alloc, Stats>::get_allocator() const
+{
+    return pool_->get_allocator();
+}
+
+/**
+* Constructs a node of the given type in a slot from the node pool,
+* forwarding args to its constructor.
+* The slot is handed back if the constructor throws.
+*/
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+template<typename NodeType, typename... Args>
+NodeType* BinarySearchTree<Key, Value, Compare, Alloc, Stats>::createNode(Args&&... args)
+{
+    void* slot = pool_->allocate();
+    this->countAllocation();
+    try {
+        return new (slot) NodeType(std::forward<Args>(args)...);
+    }
+    catch(...) {
+        pool_->deallocate(slot);
+        throw;
+    }
+}
+
+/**
+* Wraps a node in an iterator.
+*/
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+typename BinarySearchTree<Key, Value, Compare, Alloc, Stats>::iterator
+BinarySearchTree<Key, Value, Compare, Alloc, Stats>::makeIterator(Node<Key, Value>* node) const
+{
+    return iterator(node, this);
+}
+
+/**
+* Destroys a node and returns its slot to the node pool for reuse.
+*/
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+void BinarySearchTree<Key, Value, Compare, Alloc, Stats>::destroyNode(Node<Key, Value>* node)
+{
+    node->~Node();
+    pool_->deallocate(node);
+}
+
+/**
+* An insert method to insert into a Binary Search Tree.
+* The tree will not remain balanced when inserting.
+* Recall: If key is already in the tree, you should 
+* overwrite the current value with the updated value.
+*/
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+void BinarySearchTree<Key, Value, Compare, Alloc, Stats>::insert(const std::pair<const Key, Value> &keyValuePair)
+{
+    Node<Key, Value>* parent = NULL;
+    Node<Key, Value>* current = internalFindSlot(keyValuePair.first, parent);
+
+    // same val
+    if(current != NULL){
+        current->setValue(keyValuePair.second);
+        return;
+    }
+
+    // only allocate once we know the key is new
+    Node<Key, Value>* newNode = createNode<Node<Key, Value> >(keyValuePair.first, keyValuePair.second, parent);
+    linkChild(parent, newNode);
+    addSize(1);
+}
+
+/**
+* Inserts an rvalue pair, moving its key and value into the tree. As with
+* insert(), an existing key has its value overwritten, here by move.
+*/
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+template<typename P, typename>
+std::pair<typename BinarySearchTree<Key, Value, Compare, Alloc, Stats>::iterator, bool>
+BinarySearchTree<Key, Value, Compare, Alloc, Stats>::insert(P&& keyValuePair)
+{
+    Key key(std::forward<P>(keyValuePair).first);
+    Node<Key, Value>* parent = NULL;
+    Node<Key, Value>* current = internalFindSlot(key, parent);
+    if(current != NULL){
+        current->getValue() = std::forward<P>(keyValuePair).second;
+        return std::make_pair(iterator(current, this), false);
+    }
+    current = linkNewNode(parent, std::move(key), Value(std::forward<P>(keyValuePair).second));
+    return std::make_pair(iterator(current, this), true);
+}
+
+/**
+* Builds a key/value pair from args and inserts it if the key is new.
+* Like std::map::emplace, an existing value is left alone.
+*/
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+template<typename... Args>
+std::pair<typename BinarySearchTree<Key, Value, Compare, Alloc, Stats>::iterator, bool>
+BinarySearchTree<Key, Value, Compare, Alloc, Stats>::emplace(Args&&... args)
+{
+    std::pair<Key, Value> item(std::forward<Args>(args)...);
+    Node<Key, Value>* parent = NULL;
+    Node<Key, Value>* current = internalFindSlot(item.first, parent);
+    if(current != NULL){
+        return std::make_pair(iterator(current, this), false);
+    }
+    current = linkNewNode(parent, std::move(item.first), std::move(item.second));
+    return std::make_pair(iterator(current, this), true);
+}
+
+/**
+* Inserts key with a value built from args if key is not in the tree.
+* Nothing is built or moved from if the key already exists.
+*/
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+template<typename... Args>
+std::pair<typename BinarySearchTree<Key, Value, Compare, Alloc, Stats>::iterator, bool>
+BinarySearchTree<Key, Value, Compare, Alloc, Stats>::try_emplace(const Key& key, Args&&... args)
+{
+    Node<Key, Value>* parent = NULL;
+    Node<Key, Value>* current = internalFindSlot(key, parent);
+    if(current != NULL){
+        return std::make_pair(iterator(current, this), false);
+    }
+    current = linkNewNode(parent, Key(key), Value(std::forward<Args>(args)...));
+    return std::make_pair(iterator(current, this), true);
+}
+
+/**
+* As above, moving key into the tree if it is new.
+*/
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+template<typename... Args>
+std::pair<typename BinarySearchTree<Key, Value, Compare, Alloc, Stats>::iterator, bool>
+BinarySearchTree<Key, Value, Compare, Alloc, Stats>::try_emplace(Key&& key, Args&&... args)
+{
+    Node<Key, Value>* parent = NULL;
+    Node<Key, Value>* current = internalFindSlot(key, parent);
+    if(current != NULL){
+        return std::make_pair(iterator(current, this), false);
+    }
+    current = linkNewNode(parent, std::move(key), Value(std::forward<Args>(args)...));
+    return std::make_pair(iterator(current, this), true);
+}
+
+/**
+* Assigns value to key, forwarding (and so moving, for rvalues) it into
+* the existing item, or inserts key if it is new.
+*/
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+template<typename M>
+std::pair<typename BinarySearchTree<Key, Value, Compare, Alloc, Stats>::iterator, bool>
+BinarySearchTree<Key, Value, Compare, Alloc, Stats>::insert_or_assign(const Key& key, M&& value)
+{
+    Node<Key, Value>* parent = NULL;
+    Node<Key, Value>* current = internalFindSlot(key, parent);
+    if(current != NULL){
+        current->getValue() = std::forward<M>(value);
+        return std::make_pair(iterator(current, this), false);
+    }
+    current = linkNewNode(parent, Key(key), Value(std::forward<M>(value)));
+    return std::make_pair(iterator(current, this), true);
+}
+
+/**
+* As above, moving key into the tree if it is new.
+*/
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+template<typename M>
+std::pair<typename BinarySearchTree<Key, Value, Compare, Alloc, Stats>::iterator, bool>
+BinarySearchTree<Key, Value, Compare, Alloc, Stats>::insert_or_assign(Key&& key, M&& value)
+{
+    Node<Key, Value>* parent = NULL;
+    Node<Key, Value>* current = internalFindSlot(key, parent);
+    if(current != NULL){
+        current->getValue() = std::forward<M>(value);
+        return std::make_pair(iterator(current, this), false);
+    }
+    current = linkNewNode(parent, std::move(key), Value(std::forward<M>(value)));
+    return std::make_pair(iterator(current, this), true);
+}
+
+/**
+* Links count items read from source into the empty tree, as a perfectly
+* balanced tree.
+*/
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+void BinarySearchTree<Key, Value, Compare, Alloc, Stats>::buildFromSnapshot(SnapshotSource<Key, Value>& source, std::size_t count)
+{
+    const Node<Key, Value>* last = NULL;
+    root_ = buildSnapshotNodes(source, count, NULL, last);
+    size_ = count;
+}
+
+/**
+* Builds a perfectly balanced subtree from the next count items of
+* source, reading them in key order: the left subtree, then the root,
+* then the right subtree. last is the node built before, whose key the
+* next one must follow. If reading or building throws, the nodes built
+* for this subtree are destroyed before the exception leaves.
+*/
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare, Alloc, Stats>::buildSnapshotNodes(
+    SnapshotSource<Key, Value>& source, std::size_t count, Node<Key, Value>* parent, const Node<Key, Value>*& last)
+{
+    if(count == 0){
+        return NULL;
+    }
+    std::size_t leftCount = count / 2;
+    Node<Key, Value>* left = buildSnapshotNodes(source, leftCount, NULL, last);
+
+    // nodes built so far are not in the tree yet, so a failure frees them here
+    Node<Key, Value>* node;
+    try {
+        std::pair<Key, Value> item;
+        source.read(item.first, item.second);
+        if(last != NULL && !comp_(last->getKey(), item.first)){
+            throw std::runtime_error("Snapshot keys are not in increasing order");
+        }
+        node = createNode<Node<Key, Value> >(std::move(item.first), std::move(item.second), parent);
+    }
+    catch(...) {
+        destroySubtree(left);
+        throw;
+    }
+    last = node;
+
+    node->setLeft(left);
+    if(left != NULL){
+        left->setParent(node);
+    }
+    try {
+        node->setRight(buildSnapshotNodes(source, count - 1 - leftCount, node, last));
+    }
+    catch(...) {
+        destroySubtree(node);
+        throw;
+    }
+    return node;
+}
+
+/**
+* Helper that walks down to key. Returns its node if key is in the tree;
+* otherwise returns NULL and sets parent to the node a new key would hang
+* from (NULL for an empty tree).
+*/
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare, Alloc, Stats>::internalFindSlot(const Key& key, Node<Key, Value>*& parent) const
+{
+    Node<Key, Value>* current = root_;
+    parent = NULL;
+
+    while(current != NULL){
+        KeyOrder order = ThreeWayCompare<Compare>::order(comp_, key, current->getKey());
+        this->countComparison(order.comparisons);
+        if(!(order.less | order.greater)){
+            return current;
+        }
+        parent = current;
+        current = order.less ? current->getLeft() : current->getRight();
+    }
+    return NULL;
+}
+
+/**
+* Hangs a new leaf off parent on the side its key belongs,
+* or makes it the root if parent is NULL.
+*/
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+void BinarySearchTree<Key, Value, Compare, Alloc, Stats>::linkChild(Node<Key, Value>* parent, Node<Key, Value>* node)
+{
+    if(parent == NULL){
+        root_ = node;
+        return;
+    }
+    this->countComparison();
+    if(comp_(node->getKey(), parent->getKey())){
+        parent->setLeft(node);
+    }
+    else {
+        parent->setRight(node);
+    }
+}
+
+/**
+* Creates a node for a key that is not in the tree, moving the key and
+* value in, and links it below parent. Derived trees override this to
+* create their own node type and rebalance.
+*/
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare, Alloc, Stats>::linkNewNode(Node<Key, Value>* parent, Key&& key, Value&& value)
+{
+    Node<Key, Value>* newNode = createNode<Node<Key, Value> >(std::move(key), std::move(value), parent);
+    linkChild(parent, newNode);
+    addSize(1);
+    return newNode;
+}
+
+
+/**
+* A remove method to remove a specific key from a Binary Search Tree.
+* Recall: The writeup specifies that if a node has 2 children you
+* should swap with the predecessor and then remove.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Stats>
+void BinarySearchTree<Key, Value, Compare, Alloc, Stats>::remove(const Key& key)
+{
+    // find node with given key
+    Node<Key, Value>* removeNode = internalFind(key);
+    if(removeNode == NULL){
+        return;
+    }
+    // node has two children
+    if (removeNode->getLeft() != NULL && removeNode->getRight() != NULL) {
+        Node<Key, Value>* pred = predecessor(removeNode);
+        nodeSwap(pred, removeNode);
+    }
+
+    // removeNode has at most one child
+    Node<Key, Value>* child = (removeNode->getLeft() != NULL) ? removeNode->getLeft() : removeNode->getRight();
+    Node<Key, Value>* parent = removeNode->getParent();
+
+    if (child != NULL)
+        child->setParent(parent);
+
+    if (parent == NULL) {
+        // removeNode is the root
+        root_ = child;
+    } else {
+        if (removeNode == parent->getLeft())
+            parent->setLeft(child);
+        else
+            parent->setRight(child);
+    }
+
+    destroyNode(removeNode);
+    addSize(-1);
+}
+
+
+
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+Node<Key, Value>*
+BinarySearchTree<Key, Value, Compare, Alloc, Stats>::predecessor(Node<Key, Value>* current)
+{
+    // TODO
+    // we have left child
+    if(current == NULL){
+        return NULL;
+    }
+    if(current->getLeft() != NULL){
+        Node<Key, Value>* pred = current->getLeft();
+        while(pred->getRight() != NULL){
+            pred = pred->getRight();
         }
         return pred;
     }
@@ -568,38 +1788,87 @@ BinarySearchTree<Key, Value>::predecessor(Node<Key, Value>* current)
 }
 
 
+/**
+* Returns the in-order successor of current, or NULL if current holds
+* the largest key.
+*/
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+Node<Key, Value>*
+BinarySearchTree<Key, Value, Compare, Alloc, Stats>::successor(Node<Key, Value>* current)
+{
+    if(current == NULL){
+        return NULL;
+    }
+    // if right child exists go all the way to left
+    if(current->getRight() != NULL){
+        current = current->getRight();
+        while(current->getLeft() != NULL){
+            current = current->getLeft();
+        }
+        return current;
+    }
+    // if no right child traverse parent chain
+    Node<Key, Value>* parent = current->getParent();
+    while (parent != NULL && current == parent->getRight()) {
+        current = parent;
+        parent = parent->getParent();
+    }
+    // found left child pointer, that parent is successor
+    return parent;
+}
+
 /**
 * A method to remove all contents of the tree and
 * reset the values in the tree for use again.
+* Nodes are destroyed in place and the pool then
+* frees all of its blocks in one pass. When the items
+* have nothing to destroy the walk is skipped entirely.
+* A pool whose blocks other trees share keeps them,
+* and every node is handed back to it instead.
 */
-template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::clear()
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Stats>
+void BinarySearchTree<Key, Value, Compare, Alloc, Stats>::clear()
 {
-    Node<Key, Value>* current = root_;
-    Node<Key, Value>* lastRight = nullptr;
-
-    while (current != nullptr) {
-        if (current->getLeft() != nullptr) {
-            Node<Key, Value>* temp = current->getLeft();
-            current->setLeft(nullptr);
-            delete current;
-            current = temp;
+    bool ownsPool = NodePool<Alloc>::soleOwner(pool_);
+    if (!(ownsPool && std::is_trivially_destructible<std::pair<const Key, Value> >::value)) {
+        destroySubtree(root_);
+    }
+    root_ = NULL;
+    size_ = 0;
+    if (ownsPool) {
+        pool_->release();
+    }
+}
+
+
+/**
+* Destroys node and everything under it, which must already be cut off
+* from any node that stays in the tree.
+*/
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+void BinarySearchTree<Key, Value, Compare, Alloc, Stats>::destroySubtree(Node<Key, Value>* node)
+{
+    // rotate left subtrees up so every node is visited without a stack
+    while (node != nullptr) {
+        if (node->getLeft() != nullptr) {
+            Node<Key, Value>* left = node->getLeft();
+            node->setLeft(left->getRight());
+            left->setRight(node);
+            node = left;
         } else {
-            lastRight = current->getRight();
-            delete current;
-            current = lastRight;
+            Node<Key, Value>* right = node->getRight();
+            destroyNode(node);
+            node = right;
         }
     }
-    root_ = NULL; 
 }
 
-
 /**
 * A helper function to find the smallest node in the tree.
 */
-template<typename Key, typename Value>
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Stats>
 Node<Key, Value>*
-BinarySearchTree<Key, Value>::getSmallestNode() const
+BinarySearchTree<Key, Value, Compare, Alloc, Stats>::getSmallestNode() const
 {
     Node<Key, Value>* current = root_;
 
@@ -611,49 +1880,174 @@ BinarySearchTree<Key, Value>::getSmallestNode() const
     return current;
 }
 
+/**
+* A helper function to find the largest node in the tree.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Stats>
+Node<Key, Value>*
+BinarySearchTree<Key, Value, Compare, Alloc, Stats>::getLargestNode() const
+{
+    Node<Key, Value>* current = root_;
+
+    // find rightmost node
+    while (current != NULL && current->getRight() != NULL) {
+        current = current->getRight();
+    }
+
+    return current;
+}
+
 /**
 * Helper function to find a node with given key, k and
 * return a pointer to it or NULL if no item with that key
 * exists
 */
-template<typename Key, typename Value>
-Node<Key, Value>* BinarySearchTree<Key, Value>::internalFind(const Key& key) const
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Stats>
+template<typename K>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare, Alloc, Stats>::internalFind(const K& key) const
 {
     // TODO
     Node<Key, Value>* current = root_;
 
     while(current != NULL){
-        if(key == current->getKey()){
+        KeyOrder order = ThreeWayCompare<Compare>::order(comp_, key, current->getKey());
+        this->countComparison(order.comparisons);
+        // bitwise or, so the child is picked without a branch
+        if(!(order.less | order.greater)){
             return current;
         }
-        else if(key < current->getKey()){
+        current = order.less ? current->getLeft() : current->getRight();
+    }
+    // key isn't in bst
+    return NULL;
+}
+
+/**
+* Helper function that returns the node with the smallest key not less
+* than key, or NULL if every key is less.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Stats>
+template<typename K>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare, Alloc, Stats>::internalLowerBound(const K& key) const
+{
+    Node<Key, Value>* current = root_;
+    Node<Key, Value>* bound = NULL;
+
+    while(current != NULL){
+        this->countComparison();
+        if(comp_(current->getKey(), key)){
+            current = current->getRight();
+        }
+        else {
+            // candidate; a smaller one may be on the left
+            bound = current;
+            current = current->getLeft();
+        }
+    }
+    return bound;
+}
+
+/**
+* Helper function that returns the node with the smallest key greater
+* than key, or NULL if no key is greater.
+*/
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Stats>
+template<typename K>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare, Alloc, Stats>::internalUpperBound(const K& key) const
+{
+    Node<Key, Value>* current = root_;
+    Node<Key, Value>* bound = NULL;
+
+    while(current != NULL){
+        this->countComparison();
+        if(comp_(key, current->getKey())){
+            bound = current;
             current = current->getLeft();
         }
         else {
             current = current->getRight();
         }
     }
-    // key isn't in bst
-    return NULL;
+    return bound;
 }
 
 /**
  * Return true iff the BST is balanced.
+ * Runs in a single O(n) pass that stops at the first unbalanced node.
  */
-template<typename Key, typename Value>
-bool BinarySearchTree<Key, Value>::isBalanced() const
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Stats>
+bool BinarySearchTree<Key, Value, Compare, Alloc, Stats>::isBalanced() const
 {
-    return balancedHelper(root_);
+    return balancedHeight(root_, 0) >= 0;
 }
 
+/**
+ * Returns the height of the tree and whether it is balanced, computed
+ * together in one O(n) post-order pass. The walk keeps its own stack
+ * rather than recursing, so it is safe on arbitrarily deep trees.
+ */
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Stats>
+typename BinarySearchTree<Key, Value, Compare, Alloc, Stats>::BalanceInfo
+BinarySearchTree<Key, Value, Compare, Alloc, Stats>::checkBalance() const
+{
+    // stage 0: left subtree next, 1: right subtree next, 2: both done
+    struct Frame
+    {
+        Node<Key, Value>* node;
+        int leftHeight;
+        int stage;
+    };
 
+    BalanceInfo info = {0, true};
+    std::vector<Frame> stack;
+    // height of the subtree finished most recently
+    int height = 0;
 
-template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::nodeSwap( Node<Key,Value>* n1, Node<Key,Value>* n2)
+    if (root_ != NULL) {
+        Frame rootFrame = {root_, 0, 0};
+        stack.push_back(rootFrame);
+    }
+    while (!stack.empty()) {
+        Frame& top = stack.back();
+        if (top.stage == 0) {
+            top.stage = 1;
+            if (top.node->getLeft() != NULL) {
+                Frame child = {top.node->getLeft(), 0, 0};
+                stack.push_back(child);
+                continue;
+            }
+            height = 0;
+        }
+        if (top.stage == 1) {
+            top.leftHeight = height;
+            top.stage = 2;
+            if (top.node->getRight() != NULL) {
+                Frame child = {top.node->getRight(), 0, 0};
+                stack.push_back(child);
+                continue;
+            }
+            height = 0;
+        }
+        // height now holds the right subtree's height
+        if (std::abs(top.leftHeight - height) > 1) {
+            info.balanced = false;
+        }
+        height = std::max(top.leftHeight, height) + 1;
+        stack.pop_back();
+    }
+    info.height = height;
+    return info;
+}
+
+
+
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Stats>
+void BinarySearchTree<Key, Value, Compare, Alloc, Stats>::nodeSwap( Node<Key,Value>* n1, Node<Key,Value>* n2)
 {
     if((n1 == n2) || (n1 == NULL) || (n2 == NULL) ) {
         return;
     }
+    this->countNodeSwap();
     Node<Key, Value>* n1p = n1->getParent();
     Node<Key, Value>* n1r = n1->getRight();
     Node<Key, Value>* n1lt = n1->getLeft();
@@ -732,32 +2126,37 @@ void BinarySearchTree<Key, Value>::nodeSwap( Node<Key,Value>* n1, Node<Key,Value
 
 }
 
-template<typename Key, typename Value>
-int BinarySearchTree<Key, Value>::height(Node<Key, Value>* node) const
+/**
+ * Returns the height of the subtree at node, or -1 if it is not balanced.
+ * A balanced tree deeper than 128 levels would need more nodes than fit in
+ * memory, so recursion stops there and reports the tree as unbalanced;
+ * degenerate trees cannot overflow the stack.
+ */
+template<typename Key, typename Value, typename Compare, typename Alloc, typename Stats>
+int BinarySearchTree<Key, Value, Compare, Alloc, Stats>::balancedHeight(Node<Key, Value>* node, int depth) const
 {
+    // empty bst
     if (node == NULL) {
         return 0;
     }
-    return std::max(height(node->getLeft()), height(node->getRight())) + 1;
-}
-
-template<typename Key, typename Value>
-bool BinarySearchTree<Key, Value>::balancedHelper(Node<Key, Value>* node) const
-{
-    // empty bst
-    if (node == NULL) {
-        return true;
+    if (depth >= 128) {
+        return -1;
     }
 
-    int leftHeight = height(node->getLeft());
-    int rightHeight = height(node->getRight());
+    int leftHeight = balancedHeight(node->getLeft(), depth + 1);
+    if (leftHeight < 0) {
+        return -1;
+    }
+    int rightHeight = balancedHeight(node->getRight(), depth + 1);
+    if (rightHeight < 0) {
+        return -1;
+    }
 
     // differ by more than 1
     if (std::abs(leftHeight - rightHeight) > 1) {
-        return false;
+        return -1;
     }
-
-    return balancedHelper(node->getLeft()) && balancedHelper(node->getRight());
+    return std::max(leftHeight, rightHeight) + 1;
 }
 
 /**
@@ -0,0 +1,198 @@
+#include <iostream>
+#include <cstdlib>
+#include <map>
+#include <random>
+#include <string>
+#include <utility>
+#include "btree.h"
+
+using namespace std;
+
+// Randomized test of BTree against std::map. Each step applies one random
+// operation (insert in each of its forms, emplace, try_emplace,
+// insert_or_assign, remove, clear) to both, and every so often the whole
+// tree is compared: items forward and backward, size, and lookups, bounds,
+// equal_range and range() around random keys. Runs with long keys, which
+// take the vectorized node scans when built with SIMDFLAGS, and with
+// string keys under a transparent comparator, which are then looked up by
+// C strings. It exits with status 1 if any check fails.
+
+static int failures = 0;
+
+static void check(bool ok, const char* what, long step)
+{
+    if(!ok && ++failures <= 20) {
+        cerr << "FAIL " << what << " at step " << step << endl;
+    }
+}
+
+// Orders strings, and strings against C strings without building one
+struct StringLess
+{
+    typedef void is_transparent;
+    bool operator()(const string& a, const string& b) const { return a < b; }
+    bool operator()(const string& a, const char* b) const { return a.compare(b) < 0; }
+    bool operator()(const char* a, const string& b) const { return b.compare(a) > 0; }
+};
+
+// Maps a small number to a key of each type
+static long makeKey(long n, long*) { return n; }
+static string makeKey(long n, string*) { return "k" + to_string(n); }
+
+template<typename Key>
+static Key keyOf(long n)
+{
+    return makeKey(n, static_cast<Key*>(NULL));
+}
+
+// Same position in both containers: both at their end, or on equal items
+template<typename Iter, typename MapIter, typename Tree, typename Map>
+static bool samePlace(Iter it, MapIter want, const Tree& tree, const Map& expected)
+{
+    if(want == expected.end()) {
+        return it == tree.end();
+    }
+    return it != tree.end() && it->first == want->first && it->second == want->second;
+}
+
+// Compares every item both ways, the size, and lookups around random keys
+template<typename Key, typename Tree, typename Map>
+static void compare(const Tree& tree, const Map& expected, mt19937_64& rng, long range, long step)
+{
+    check(tree.size() == expected.size(), "size differs", step);
+    check(tree.empty() == expected.empty(), "empty() differs", step);
+
+    typename Tree::const_iterator it = tree.cbegin();
+    for(typename Map::const_iterator want = expected.begin(); want != expected.end(); ++want, ++it) {
+        if(it == tree.cend() || it->first != want->first || it->second != want->second) {
+            check(false, "forward iteration differs", step);
+            return;
+        }
+    }
+    check(it == tree.cend(), "forward iteration runs long", step);
+
+    typename Tree::reverse_iterator rit = tree.rbegin();
+    for(typename Map::const_reverse_iterator want = expected.rbegin(); want != expected.rend(); ++want, ++rit) {
+        if(rit == tree.rend() || rit->first != want->first || rit->second != want->second) {
+            check(false, "reverse iteration differs", step);
+            return;
+        }
+    }
+    check(rit == tree.rend(), "reverse iteration runs long", step);
+
+    for(int probe = 0; probe < 32; ++probe) {
+        Key key = keyOf<Key>(static_cast<long>(rng() % range));
+        check(samePlace(tree.find(key), expected.find(key), tree, expected), "find differs", step);
+        check(samePlace(tree.lower_bound(key), expected.lower_bound(key), tree, expected), "lower_bound differs", step);
+        check(samePlace(tree.upper_bound(key), expected.upper_bound(key), tree, expected), "upper_bound differs", step);
+        check(samePlace(tree.equal_range(key).second, expected.equal_range(key).second, tree, expected),
+              "equal_range differs", step);
+
+        Key hi = keyOf<Key>(static_cast<long>(rng() % range));
+        size_t count = 0;
+        for(const std::pair<const Key, long>& item : tree.range(key, hi)) {
+            check(!(item.first < key) && item.first < hi, "range() item out of bounds", step);
+            ++count;
+        }
+        size_t wantCount = (key < hi) ? distance(expected.lower_bound(key), expected.lower_bound(hi)) : 0;
+        check(count == wantCount, "range() count differs", step);
+    }
+}
+
+// Applies steps random operations to a fresh tree and a std::map
+template<typename Key, typename Compare>
+static void run(const char* name, long range, long steps, unsigned seed)
+{
+    typedef BTree<Key, long, Compare> Tree;
+    typedef map<Key, long, Compare> Map;
+    mt19937_64 rng(seed);
+    Tree tree;
+    Map expected;
+
+    for(long step = 0; step < steps; ++step) {
+        Key key = keyOf<Key>(static_cast<long>(rng() % range));
+        long value = static_cast<long>(rng() % 1000);
+        switch(rng() % 16) {
+        case 0: {
+            pair<typename Tree::iterator, bool> got = tree.insert(make_pair(key, value));
+            bool added = expected.find(key) == expected.end();
+            expected[key] = value;
+            check(got.second == added && got.first->second == value, "insert(P&&) result", step);
+            break;
+        }
+        case 1: {
+            pair<typename Tree::iterator, bool> got = tree.emplace(key, value);
+            pair<typename Map::iterator, bool> want = expected.emplace(key, value);
+            check(got.second == want.second && got.first->second == want.first->second, "emplace result", step);
+            break;
+        }
+        case 2: {
+            pair<typename Tree::iterator, bool> got = tree.try_emplace(key, value);
+            pair<typename Map::iterator, bool> want = expected.insert(make_pair(key, value));
+            check(got.second == want.second && got.first->second == want.first->second, "try_emplace result", step);
+            break;
+        }
+        case 3: {
+            Key moved = key;
+            pair<typename Tree::iterator, bool> got = tree.insert_or_assign(std::move(moved), value);
+            bool added = expected.find(key) == expected.end();
+            expected[key] = value;
+            check(got.second == added && got.first->first == key && got.first->second == value,
+                  "insert_or_assign result", step);
+            break;
+        }
+        case 4:
+        case 5:
+        case 6:
+        case 7:
+        case 8:
+        case 9:
+            tree.remove(key);
+            expected.erase(key);
+            break;
+        default: {
+            const pair<const Key, long> item(key, value);
+            tree.insert(item);
+            expected[key] = value;
+            break;
+        }
+        }
+        if(rng() % 20000 == 0) {
+            tree.clear();
+            expected.clear();
+        }
+        if(step % 500 == 0) {
+            compare<Key>(tree, expected, rng, range, step);
+        }
+    }
+    compare<Key>(tree, expected, rng, range, steps);
+    cout << name << ": " << tree.size() << " items, height " << tree.height() << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    long steps = (argc > 1) ? atol(argv[1]) : 200000;
+    if(steps < 1) {
+        cerr << "usage: btree-test [steps, at least 1]" << endl;
+        return 2;
+    }
+
+    // a small key range keeps leaves merging; a large one grows the tree
+    run<long, std::less<long> >("BTree<long> small range", 300, steps, 1);
+    run<long, std::less<long> >("BTree<long> large range", 50000, steps, 2);
+    run<string, StringLess>("BTree<string> transparent", 5000, steps, 3);
+
+    // transparent lookup by a C string, with no string built for the probe
+    BTree<string, long, StringLess> named;
+    named.insert(make_pair(string("alpha"), 1L));
+    named.insert(make_pair(string("beta"), 2L));
+    check(named.find("beta") != named.end() && named.find("beta")->second == 2, "find by const char*", 0);
+    check(named.find("gamma") == named.end(), "find by const char* of a missing key", 0);
+    check(named.lower_bound("b")->first == "beta", "lower_bound by const char*", 0);
+    check(named.upper_bound("alpha")->first == "beta", "upper_bound by const char*", 0);
+    check(named.equal_range("alpha").first->first == "alpha", "equal_range by const char*", 0);
+
+    cout << (failures == 0 ? "All BTree checks passed" : "BTree checks FAILED")
+         << " (" << failures << " failures)" << endl;
+    return failures == 0 ? 0 : 1;
+}
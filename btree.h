@@ -0,0 +1,1542 @@
+#ifndef BTREE_H
+#define BTREE_H
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include "node_pool.h"
+#include "simd_search.h"
+
+/**
+* A B+-tree map with BinarySearchTree's map interface: insertion
+* (including the move-aware forms), removal, lookups and bounds, ranges,
+* reverse iteration and transparent lookup. It has none of the binary
+* tree tools (stats, print, freeze, snapshots, balance checks), and its
+* iterators are weaker: any insert or remove invalidates every iterator,
+* where a binary tree only loses iterators to the removed item.
+*
+* Items live in the leaves, which are linked in key order for iteration;
+* the inner nodes hold copies of separator keys. Every node is sized to
+* kNodeBytes (eight cache lines), so a lookup touches one node per level
+* and a tree of a hundred million long/long items is six levels deep
+* where a balanced binary tree is nearly thirty. Nodes are scanned front
+* to back, which suits the hardware prefetcher; smaller nodes measured
+* slower.
+*
+* Nodes split on the way down an insert when full and take an item from a
+* sibling (or merge with one) on the way down a remove when at their
+* minimum, so neither ever walks back up. Any insert or remove invalidates
+* every iterator, since items move between slots.
+*/
+template <typename Key, typename Value,
+          typename Compare = std::less<Key>,
+          typename Alloc = std::allocator<std::pair<const Key, Value> > >
+class BTree
+{
+public:
+    typedef Compare key_compare;
+    typedef Alloc allocator_type;
+
+    explicit BTree(const Compare& comp = Compare(), const Alloc& alloc = Alloc());
+    explicit BTree(const Alloc& alloc);
+    BTree(BTree&& other);
+    BTree& operator=(BTree&& other);
+    ~BTree();
+
+    void insert(const std::pair<const Key, Value>& keyValuePair);
+    void remove(const Key& key);
+    void clear();
+    bool empty() const;
+    std::size_t size() const;
+    int height() const;
+
+    class const_iterator;
+
+protected:
+    typedef std::pair<const Key, Value> Item;
+
+    // Fields every node starts with; count is items in a leaf, keys in an
+    // inner node.
+    struct NodeBase
+    {
+        unsigned short count;
+        bool leaf;
+    };
+
+    static const std::size_t kNodeBytes = 512;
+    static const std::size_t kLeafRoom = kNodeBytes - sizeof(NodeBase) - 2 * sizeof(void*);
+    static const std::size_t kInnerRoom = kNodeBytes - sizeof(NodeBase) - sizeof(void*);
+    static const std::size_t kLeafSlots = (kLeafRoom / sizeof(Item) < 4) ? 4 : kLeafRoom / sizeof(Item);
+    static const std::size_t kInnerSlots =
+        (kInnerRoom / (sizeof(Key) + sizeof(void*)) < 4) ? 4 : kInnerRoom / (sizeof(Key) + sizeof(void*));
+
+    // Node scans; leaf keys are read in place, every kItemStride keys
+    typedef KeyBlockSearch<Key, Compare, 1> InnerSearch;
+    static const std::size_t kItemStride = (sizeof(Item) % sizeof(Key) == 0) ? sizeof(Item) / sizeof(Key) : 0;
+    typedef KeyBlockSearch<Key, Compare, kItemStride> LeafSearch;
+
+    // Fewest entries a node other than the root may hold
+    static const std::size_t kMinLeaf = kLeafSlots / 2;
+    static const std::size_t kMinInner = (kInnerSlots - 1) / 2;
+
+    struct LeafNode : NodeBase
+    {
+        LeafNode* prev;
+        LeafNode* next;
+        alignas(Item) unsigned char bytes[kLeafSlots * sizeof(Item)];
+
+        Item* items() { return reinterpret_cast<Item*>(bytes); }
+    };
+
+    struct InnerNode : NodeBase
+    {
+        NodeBase* children[kInnerSlots + 1];
+        alignas(Key) unsigned char bytes[kInnerSlots * sizeof(Key)];
+
+        Key* keys() { return reinterpret_cast<Key*>(bytes); }
+    };
+
+public:
+    /**
+    * A bidirectional iterator over the items in key order. The end
+    * iterator remembers its tree, so --end() reaches the largest item.
+    */
+    class iterator
+    {
+    public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef std::pair<const Key, Value> value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef std::pair<const Key, Value>* pointer;
+        typedef std::pair<const Key, Value>& reference;
+
+        iterator();
+
+        std::pair<const Key, Value>& operator*() const;
+        std::pair<const Key, Value>* operator->() const;
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+        iterator& operator++();
+        iterator operator++(int);
+        iterator& operator--();
+        iterator operator--(int);
+
+    protected:
+        friend class BTree<Key, Value, Compare, Alloc>;
+        friend class const_iterator;
+        iterator(LeafNode* leaf, unsigned index, const BTree<Key, Value, Compare, Alloc>* tree);
+        LeafNode* leaf_;
+        unsigned index_;
+        const BTree<Key, Value, Compare, Alloc>* tree_;
+    };
+
+    /**
+    * An iterator that gives read-only access to the items.
+    * Any iterator converts to a const_iterator.
+    */
+    class const_iterator
+    {
+    public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef std::pair<const Key, Value> value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const std::pair<const Key, Value>* pointer;
+        typedef const std::pair<const Key, Value>& reference;
+
+        const_iterator();
+        const_iterator(const iterator& it);
+
+        const std::pair<const Key, Value>& operator*() const;
+        const std::pair<const Key, Value>* operator->() const;
+
+        bool operator==(const const_iterator& rhs) const;
+        bool operator!=(const const_iterator& rhs) const;
+
+        const_iterator& operator++();
+        const_iterator operator++(int);
+        const_iterator& operator--();
+        const_iterator operator--(int);
+
+    protected:
+        iterator it_;
+    };
+
+    typedef std::reverse_iterator<iterator> reverse_iterator;
+    typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+
+    /**
+    * A view of the items with keys in [lo, hi), usable in a range-based for loop.
+    */
+    class Range
+    {
+    public:
+        iterator begin() const;
+        iterator end() const;
+        bool empty() const;
+
+    protected:
+        friend class BTree<Key, Value, Compare, Alloc>;
+        Range(const iterator& first, const iterator& last);
+        iterator first_;
+        iterator last_;
+    };
+
+    iterator begin() const;
+    iterator end() const;
+    const_iterator cbegin() const;
+    const_iterator cend() const;
+    reverse_iterator rbegin() const;
+    reverse_iterator rend() const;
+    const_reverse_iterator crbegin() const;
+    const_reverse_iterator crend() const;
+    iterator find(const Key& key) const;
+    iterator lower_bound(const Key& key) const;
+    iterator upper_bound(const Key& key) const;
+    std::pair<iterator, iterator> equal_range(const Key& key) const;
+    Range range(const Key& lo, const Key& hi) const;
+    Value& operator[](const Key& key);
+    Value const & operator[](const Key& key) const;
+    key_compare key_comp() const;
+    allocator_type get_allocator() const;
+
+    // Heterogeneous lookup, enabled when Compare is transparent; these
+    // compare one key at a time rather than through KeyBlockSearch
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    iterator find(const K& key) const;
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    iterator lower_bound(const K& key) const;
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    iterator upper_bound(const K& key) const;
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    std::pair<iterator, iterator> equal_range(const K& key) const;
+
+    // Move-aware insertion, as in BinarySearchTree. Each finds the key's
+    // slot first and only builds an item when the key is new; the bool is
+    // true if an item was added.
+    template<typename P, typename = typename std::enable_if<!std::is_lvalue_reference<P>::value>::type>
+    std::pair<iterator, bool> insert(P&& keyValuePair);
+    template<typename... Args>
+    std::pair<iterator, bool> emplace(Args&&... args);
+    template<typename... Args>
+    std::pair<iterator, bool> try_emplace(const Key& key, Args&&... args);
+    template<typename... Args>
+    std::pair<iterator, bool> try_emplace(Key&& key, Args&&... args);
+    template<typename M>
+    std::pair<iterator, bool> insert_or_assign(const Key& key, M&& value);
+    template<typename M>
+    std::pair<iterator, bool> insert_or_assign(Key&& key, M&& value);
+
+protected:
+    // Trees own their nodes and cannot be copied.
+    BTree(const BTree&);
+    BTree& operator=(const BTree&);
+
+    // Node storage
+    LeafNode* createLeaf();
+    InnerNode* createInner();
+    void freeNode(NodeBase* node);
+    void destroyAll(NodeBase* node);
+
+    // Searches within a node; the templates serve heterogeneous keys
+    unsigned childIndex(InnerNode* inner, const Key& key) const;
+    unsigned leafLowerBound(LeafNode* leaf, const Key& key) const;
+    unsigned leafUpperBound(LeafNode* leaf, const Key& key) const;
+    template<typename K>
+    unsigned childIndex(InnerNode* inner, const K& key) const;
+    template<typename K>
+    unsigned leafLowerBound(LeafNode* leaf, const K& key) const;
+    template<typename K>
+    unsigned leafUpperBound(LeafNode* leaf, const K& key) const;
+    template<typename K>
+    LeafNode* findLeaf(const K& key) const;
+
+    // Lookups shared by the Key and heterogeneous overloads
+    template<typename K>
+    iterator internalFind(const K& key) const;
+    template<typename K>
+    iterator internalLowerBound(const K& key) const;
+    template<typename K>
+    iterator internalUpperBound(const K& key) const;
+    template<typename K>
+    std::pair<iterator, iterator> internalEqualRange(const K& key) const;
+
+    // Insertion steps shared by insert() and the move-aware variants
+    Item* findSlot(const Key& key, LeafNode*& leaf, unsigned& pos);
+    template<typename... Args>
+    iterator emplaceAt(LeafNode* leaf, unsigned pos, Args&&... args);
+
+    // Restructuring, each on the children of inner around position i
+    void splitChild(InnerNode* inner, unsigned i);
+    unsigned fillChild(InnerNode* inner, unsigned i);
+    void borrowFromLeft(InnerNode* inner, unsigned i);
+    void borrowFromRight(InnerNode* inner, unsigned i);
+    void mergeChildren(InnerNode* inner, unsigned i);
+
+    template<typename T>
+    static void relocate(T* dst, T* src, std::size_t n);
+    static bool isFull(NodeBase* node);
+
+    NodeBase* root_;
+    LeafNode* head_;
+    LeafNode* tail_;
+    std::size_t size_;
+    int height_;
+    Compare comp_;
+    std::shared_ptr<NodePool<Alloc> > pool_;
+};
+
+/*
+  -------------------------------------------------
+  Begin implementations for the BTree::iterator class.
+  -------------------------------------------------
+*/
+
+template<class Key, class Value, class Compare, class Alloc>
+BTree<Key, Value, Compare, Alloc>::iterator::iterator() :
+    leaf_(NULL),
+    index_(0),
+    tree_(NULL)
+{
+}
+
+/**
+* Explicit constructor for the item at index in leaf of the given tree.
+* A NULL leaf is the tree's end.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+BTree<Key, Value, Compare, Alloc>::iterator::iterator(LeafNode* leaf, unsigned index,
+                                                      const BTree<Key, Value, Compare, Alloc>* tree) :
+    leaf_(leaf),
+    index_(index),
+    tree_(tree)
+{
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+std::pair<const Key, Value>& BTree<Key, Value, Compare, Alloc>::iterator::operator*() const
+{
+    return leaf_->items()[index_];
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+std::pair<const Key, Value>* BTree<Key, Value, Compare, Alloc>::iterator::operator->() const
+{
+    return &(leaf_->items()[index_]);
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+bool BTree<Key, Value, Compare, Alloc>::iterator::operator==(const iterator& rhs) const
+{
+    return leaf_ == rhs.leaf_ && index_ == rhs.index_;
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+bool BTree<Key, Value, Compare, Alloc>::iterator::operator!=(const iterator& rhs) const
+{
+    return !(*this == rhs);
+}
+
+/**
+* Advances to the next item, moving to the next leaf at the end of one.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+typename BTree<Key, Value, Compare, Alloc>::iterator&
+BTree<Key, Value, Compare, Alloc>::iterator::operator++()
+{
+    if(++index_ == leaf_->count){
+        leaf_ = leaf_->next;
+        index_ = 0;
+    }
+    return *this;
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+typename BTree<Key, Value, Compare, Alloc>::iterator
+BTree<Key, Value, Compare, Alloc>::iterator::operator++(int)
+{
+    iterator old(*this);
+    ++(*this);
+    return old;
+}
+
+/**
+* Steps back to the previous item; from end() that is the largest item.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+typename BTree<Key, Value, Compare, Alloc>::iterator&
+BTree<Key, Value, Compare, Alloc>::iterator::operator--()
+{
+    if(leaf_ == NULL){
+        leaf_ = tree_->tail_;
+        index_ = leaf_->count;
+    }
+    else if(index_ == 0){
+        leaf_ = leaf_->prev;
+        index_ = leaf_->count;
+    }
+    --index_;
+    return *this;
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+typename BTree<Key, Value, Compare, Alloc>::iterator
+BTree<Key, Value, Compare, Alloc>::iterator::operator--(int)
+{
+    iterator old(*this);
+    --(*this);
+    return old;
+}
+
+/*
+  -----------------------------------------------
+  End implementations for the BTree::iterator class.
+  -----------------------------------------------
+*/
+
+/*
+  -------------------------------------------------------
+  Begin implementations for the BTree::const_iterator class.
+  -------------------------------------------------------
+*/
+
+template<class Key, class Value, class Compare, class Alloc>
+BTree<Key, Value, Compare, Alloc>::const_iterator::const_iterator()
+{
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+BTree<Key, Value, Compare, Alloc>::const_iterator::const_iterator(const iterator& it) :
+    it_(it)
+{
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+const std::pair<const Key, Value>& BTree<Key, Value, Compare, Alloc>::const_iterator::operator*() const
+{
+    return *it_;
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+const std::pair<const Key, Value>* BTree<Key, Value, Compare, Alloc>::const_iterator::operator->() const
+{
+    return it_.operator->();
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+bool BTree<Key, Value, Compare, Alloc>::const_iterator::operator==(const const_iterator& rhs) const
+{
+    return it_ == rhs.it_;
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+bool BTree<Key, Value, Compare, Alloc>::const_iterator::operator!=(const const_iterator& rhs) const
+{
+    return it_ != rhs.it_;
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+typename BTree<Key, Value, Compare, Alloc>::const_iterator&
+BTree<Key, Value, Compare, Alloc>::const_iterator::operator++()
+{
+    ++it_;
+    return *this;
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+typename BTree<Key, Value, Compare, Alloc>::const_iterator
+BTree<Key, Value, Compare, Alloc>::const_iterator::operator++(int)
+{
+    const_iterator old(*this);
+    ++it_;
+    return old;
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+typename BTree<Key, Value, Compare, Alloc>::const_iterator&
+BTree<Key, Value, Compare, Alloc>::const_iterator::operator--()
+{
+    --it_;
+    return *this;
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+typename BTree<Key, Value, Compare, Alloc>::const_iterator
+BTree<Key, Value, Compare, Alloc>::const_iterator::operator--(int)
+{
+    const_iterator old(*this);
+    --it_;
+    return old;
+}
+
+/*
+  -----------------------------------------------------
+  End implementations for the BTree::const_iterator class.
+  -----------------------------------------------------
+*/
+
+/*
+  -------------------------------------------
+  Begin implementations for the BTree::Range class.
+  -------------------------------------------
+*/
+
+template<class Key, class Value, class Compare, class Alloc>
+BTree<Key, Value, Compare, Alloc>::Range::Range(const iterator& first, const iterator& last) :
+    first_(first),
+    last_(last)
+{
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+typename BTree<Key, Value, Compare, Alloc>::iterator
+BTree<Key, Value, Compare, Alloc>::Range::begin() const
+{
+    return first_;
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+typename BTree<Key, Value, Compare, Alloc>::iterator
+BTree<Key, Value, Compare, Alloc>::Range::end() const
+{
+    return last_;
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+bool BTree<Key, Value, Compare, Alloc>::Range::empty() const
+{
+    return first_ == last_;
+}
+
+/*
+  -----------------------------------------
+  End implementations for the BTree::Range class.
+  -----------------------------------------
+*/
+
+/*
+  -------------------------------------------
+  Begin implementations for the BTree class.
+  -------------------------------------------
+*/
+
+/**
+* Default constructor for an empty tree. Keys are ordered by comp and
+* nodes are allocated from blocks obtained through alloc.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+BTree<Key, Value, Compare, Alloc>::BTree(const Compare& comp, const Alloc& alloc) :
+    root_(NULL),
+    head_(NULL),
+    tail_(NULL),
+    size_(0),
+    height_(0),
+    comp_(comp),
+    pool_(std::allocate_shared<NodePool<Alloc> >(alloc,
+                                                 std::max(sizeof(LeafNode), sizeof(InnerNode)),
+                                                 std::max(alignof(LeafNode), alignof(InnerNode)),
+                                                 alloc))
+{
+}
+
+/**
+* Constructor taking only an allocator, with a default Compare.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+BTree<Key, Value, Compare, Alloc>::BTree(const Alloc& alloc) :
+    BTree(Compare(), alloc)
+{
+}
+
+/**
+* Move constructor. The nodes move over with the root and the node pool;
+* other is given a new empty pool, so it stays usable and shares nothing
+* with this tree.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+BTree<Key, Value, Compare, Alloc>::BTree(BTree&& other) :
+    root_(other.root_),
+    head_(other.head_),
+    tail_(other.tail_),
+    size_(other.size_),
+    height_(other.height_),
+    comp_(other.comp_),
+    pool_(NodePool<Alloc>::emptyLike(other.pool_))
+{
+    pool_.swap(other.pool_);
+    other.root_ = NULL;
+    other.head_ = NULL;
+    other.tail_ = NULL;
+    other.size_ = 0;
+    other.height_ = 0;
+}
+
+/**
+* Move assignment, which clears this tree and then takes other's nodes and
+* node pool, leaving other a new empty pool as the move constructor does.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+BTree<Key, Value, Compare, Alloc>& BTree<Key, Value, Compare, Alloc>::operator=(BTree&& other)
+{
+    if(this != &other){
+        std::shared_ptr<NodePool<Alloc> > fresh = NodePool<Alloc>::emptyLike(other.pool_);
+        clear();
+        root_ = other.root_;
+        head_ = other.head_;
+        tail_ = other.tail_;
+        size_ = other.size_;
+        height_ = other.height_;
+        comp_ = other.comp_;
+        pool_ = std::move(other.pool_);
+        other.pool_ = std::move(fresh);
+        other.root_ = NULL;
+        other.head_ = NULL;
+        other.tail_ = NULL;
+        other.size_ = 0;
+        other.height_ = 0;
+    }
+    return *this;
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+BTree<Key, Value, Compare, Alloc>::~BTree()
+{
+    clear();
+}
+
+/**
+* Inserts the item, overwriting the value if the key is already there.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+void BTree<Key, Value, Compare, Alloc>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    LeafNode* leaf;
+    unsigned pos;
+    Item* existing = findSlot(keyValuePair.first, leaf, pos);
+    if(existing != NULL){
+        existing->second = keyValuePair.second;
+        return;
+    }
+    emplaceAt(leaf, pos, keyValuePair);
+}
+
+/**
+* Inserts an rvalue pair, moving its key and value into the tree. As with
+* insert(), an existing key has its value overwritten, here by move.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+template<typename P, typename>
+std::pair<typename BTree<Key, Value, Compare, Alloc>::iterator, bool>
+BTree<Key, Value, Compare, Alloc>::insert(P&& keyValuePair)
+{
+    Key key(std::forward<P>(keyValuePair).first);
+    LeafNode* leaf;
+    unsigned pos;
+    Item* existing = findSlot(key, leaf, pos);
+    if(existing != NULL){
+        existing->second = std::forward<P>(keyValuePair).second;
+        return std::make_pair(iterator(leaf, pos, this), false);
+    }
+    return std::make_pair(emplaceAt(leaf, pos, std::move(key), Value(std::forward<P>(keyValuePair).second)), true);
+}
+
+/**
+* Builds a key/value pair from args and inserts it if the key is new.
+* Like std::map::emplace, an existing value is left alone.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+template<typename... Args>
+std::pair<typename BTree<Key, Value, Compare, Alloc>::iterator, bool>
+BTree<Key, Value, Compare, Alloc>::emplace(Args&&... args)
+{
+    std::pair<Key, Value> item(std::forward<Args>(args)...);
+    LeafNode* leaf;
+    unsigned pos;
+    if(findSlot(item.first, leaf, pos) != NULL){
+        return std::make_pair(iterator(leaf, pos, this), false);
+    }
+    return std::make_pair(emplaceAt(leaf, pos, std::move(item.first), std::move(item.second)), true);
+}
+
+/**
+* Inserts key with a value built from args if key is not in the tree.
+* Nothing is built or moved from if the key already exists.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+template<typename... Args>
+std::pair<typename BTree<Key, Value, Compare, Alloc>::iterator, bool>
+BTree<Key, Value, Compare, Alloc>::try_emplace(const Key& key, Args&&... args)
+{
+    LeafNode* leaf;
+    unsigned pos;
+    if(findSlot(key, leaf, pos) != NULL){
+        return std::make_pair(iterator(leaf, pos, this), false);
+    }
+    return std::make_pair(emplaceAt(leaf, pos, key, Value(std::forward<Args>(args)...)), true);
+}
+
+/**
+* As above, moving key into the tree if it is new.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+template<typename... Args>
+std::pair<typename BTree<Key, Value, Compare, Alloc>::iterator, bool>
+BTree<Key, Value, Compare, Alloc>::try_emplace(Key&& key, Args&&... args)
+{
+    LeafNode* leaf;
+    unsigned pos;
+    if(findSlot(key, leaf, pos) != NULL){
+        return std::make_pair(iterator(leaf, pos, this), false);
+    }
+    return std::make_pair(emplaceAt(leaf, pos, std::move(key), Value(std::forward<Args>(args)...)), true);
+}
+
+/**
+* Assigns value to key, forwarding (and so moving, for rvalues) it into
+* the existing item, or inserts key if it is new.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+template<typename M>
+std::pair<typename BTree<Key, Value, Compare, Alloc>::iterator, bool>
+BTree<Key, Value, Compare, Alloc>::insert_or_assign(const Key& key, M&& value)
+{
+    LeafNode* leaf;
+    unsigned pos;
+    Item* existing = findSlot(key, leaf, pos);
+    if(existing != NULL){
+        existing->second = std::forward<M>(value);
+        return std::make_pair(iterator(leaf, pos, this), false);
+    }
+    return std::make_pair(emplaceAt(leaf, pos, key, Value(std::forward<M>(value))), true);
+}
+
+/**
+* As above, moving key into the tree if it is new.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+template<typename M>
+std::pair<typename BTree<Key, Value, Compare, Alloc>::iterator, bool>
+BTree<Key, Value, Compare, Alloc>::insert_or_assign(Key&& key, M&& value)
+{
+    LeafNode* leaf;
+    unsigned pos;
+    Item* existing = findSlot(key, leaf, pos);
+    if(existing != NULL){
+        existing->second = std::forward<M>(value);
+        return std::make_pair(iterator(leaf, pos, this), false);
+    }
+    return std::make_pair(emplaceAt(leaf, pos, std::move(key), Value(std::forward<M>(value))), true);
+}
+
+/**
+* Removes the item with the given key, if any. A node at its minimum is
+* refilled from a sibling before the walk enters it, so the removal never
+* has to walk back up.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+void BTree<Key, Value, Compare, Alloc>::remove(const Key& key)
+{
+    if(root_ == NULL){
+        return;
+    }
+    NodeBase* node = root_;
+    while(!node->leaf){
+        InnerNode* inner = static_cast<InnerNode*>(node);
+        unsigned i = fillChild(inner, childIndex(inner, key));
+        node = inner->children[i];
+        if(inner == root_ && inner->count == 0){
+            // the root's last two children merged
+            root_ = node;
+            --height_;
+            freeNode(inner);
+        }
+    }
+
+    LeafNode* leaf = static_cast<LeafNode*>(node);
+    Item* items = leaf->items();
+    unsigned pos = leafLowerBound(leaf, key);
+    if(pos == leaf->count || comp_(key, items[pos].first)){
+        return;
+    }
+    items[pos].~Item();
+    relocate(items + pos, items + pos + 1, leaf->count - pos - 1);
+    --leaf->count;
+    --size_;
+    if(leaf->count == 0){
+        // only the root leaf may empty out
+        freeNode(leaf);
+        root_ = NULL;
+        head_ = tail_ = NULL;
+        height_ = 0;
+    }
+}
+
+/**
+* Deletes the contents of the tree. A pool no other tree shares gives
+* back all its blocks at once, and the walk is skipped when items and keys
+* have nothing to destroy.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+void BTree<Key, Value, Compare, Alloc>::clear()
+{
+    bool ownsPool = NodePool<Alloc>::soleOwner(pool_);
+    bool trivial = std::is_trivially_destructible<Item>::value && std::is_trivially_destructible<Key>::value;
+    if(root_ != NULL && !(ownsPool && trivial)){
+        destroyAll(root_);
+    }
+    root_ = NULL;
+    head_ = tail_ = NULL;
+    size_ = 0;
+    height_ = 0;
+    if(ownsPool){
+        pool_->release();
+    }
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+bool BTree<Key, Value, Compare, Alloc>::empty() const
+{
+    return root_ == NULL;
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+std::size_t BTree<Key, Value, Compare, Alloc>::size() const
+{
+    return size_;
+}
+
+/**
+* Returns the number of levels; an empty tree has height 0.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+int BTree<Key, Value, Compare, Alloc>::height() const
+{
+    return height_;
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+typename BTree<Key, Value, Compare, Alloc>::iterator
+BTree<Key, Value, Compare, Alloc>::begin() const
+{
+    return iterator(head_, 0, this);
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+typename BTree<Key, Value, Compare, Alloc>::iterator
+BTree<Key, Value, Compare, Alloc>::end() const
+{
+    return iterator(NULL, 0, this);
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+typename BTree<Key, Value, Compare, Alloc>::const_iterator
+BTree<Key, Value, Compare, Alloc>::cbegin() const
+{
+    return begin();
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+typename BTree<Key, Value, Compare, Alloc>::const_iterator
+BTree<Key, Value, Compare, Alloc>::cend() const
+{
+    return end();
+}
+
+/**
+* Reverse iterators; rbegin() is the largest item, reached through --end().
+*/
+template<class Key, class Value, class Compare, class Alloc>
+typename BTree<Key, Value, Compare, Alloc>::reverse_iterator
+BTree<Key, Value, Compare, Alloc>::rbegin() const
+{
+    return reverse_iterator(end());
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+typename BTree<Key, Value, Compare, Alloc>::reverse_iterator
+BTree<Key, Value, Compare, Alloc>::rend() const
+{
+    return reverse_iterator(begin());
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+typename BTree<Key, Value, Compare, Alloc>::const_reverse_iterator
+BTree<Key, Value, Compare, Alloc>::crbegin() const
+{
+    return const_reverse_iterator(cend());
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+typename BTree<Key, Value, Compare, Alloc>::const_reverse_iterator
+BTree<Key, Value, Compare, Alloc>::crend() const
+{
+    return const_reverse_iterator(cbegin());
+}
+
+/**
+* Returns an iterator to the item with the given key, or end().
+*/
+template<class Key, class Value, class Compare, class Alloc>
+typename BTree<Key, Value, Compare, Alloc>::iterator
+BTree<Key, Value, Compare, Alloc>::find(const Key& key) const
+{
+    return internalFind(key);
+}
+
+/**
+* Returns an iterator to the first item whose key is not less than key.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+typename BTree<Key, Value, Compare, Alloc>::iterator
+BTree<Key, Value, Compare, Alloc>::lower_bound(const Key& key) const
+{
+    return internalLowerBound(key);
+}
+
+/**
+* Returns an iterator to the first item whose key is greater than key.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+typename BTree<Key, Value, Compare, Alloc>::iterator
+BTree<Key, Value, Compare, Alloc>::upper_bound(const Key& key) const
+{
+    return internalUpperBound(key);
+}
+
+/**
+* Returns the range of items whose key is key: both iterators are equal
+* if key is not in the tree.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+std::pair<typename BTree<Key, Value, Compare, Alloc>::iterator,
+          typename BTree<Key, Value, Compare, Alloc>::iterator>
+BTree<Key, Value, Compare, Alloc>::equal_range(const Key& key) const
+{
+    return internalEqualRange(key);
+}
+
+/**
+* Returns a view of the items with keys in [lo, hi). Finding the first
+* item costs one walk down; each further step is an iterator increment,
+* mostly within a leaf.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+typename BTree<Key, Value, Compare, Alloc>::Range
+BTree<Key, Value, Compare, Alloc>::range(const Key& lo, const Key& hi) const
+{
+    if(!comp_(lo, hi)){
+        return Range(end(), end());
+    }
+    return Range(lower_bound(lo), lower_bound(hi));
+}
+
+/**
+* Heterogeneous find: like find(), but key may be any type that the
+* transparent Compare orders against Key.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+template<typename K, typename C, typename>
+typename BTree<Key, Value, Compare, Alloc>::iterator
+BTree<Key, Value, Compare, Alloc>::find(const K& key) const
+{
+    return internalFind(key);
+}
+
+/**
+* Heterogeneous lower_bound.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+template<typename K, typename C, typename>
+typename BTree<Key, Value, Compare, Alloc>::iterator
+BTree<Key, Value, Compare, Alloc>::lower_bound(const K& key) const
+{
+    return internalLowerBound(key);
+}
+
+/**
+* Heterogeneous upper_bound.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+template<typename K, typename C, typename>
+typename BTree<Key, Value, Compare, Alloc>::iterator
+BTree<Key, Value, Compare, Alloc>::upper_bound(const K& key) const
+{
+    return internalUpperBound(key);
+}
+
+/**
+* Heterogeneous equal_range.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+template<typename K, typename C, typename>
+std::pair<typename BTree<Key, Value, Compare, Alloc>::iterator,
+          typename BTree<Key, Value, Compare, Alloc>::iterator>
+BTree<Key, Value, Compare, Alloc>::equal_range(const K& key) const
+{
+    return internalEqualRange(key);
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+Value& BTree<Key, Value, Compare, Alloc>::operator[](const Key& key)
+{
+    iterator it = find(key);
+    if(it == end()) throw std::out_of_range("Invalid key");
+    return it->second;
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+Value const & BTree<Key, Value, Compare, Alloc>::operator[](const Key& key) const
+{
+    iterator it = find(key);
+    if(it == end()) throw std::out_of_range("Invalid key");
+    return it->second;
+}
+
+/**
+* Returns a copy of the key comparison object.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+typename BTree<Key, Value, Compare, Alloc>::key_compare
+BTree<Key, Value, Compare, Alloc>::key_comp() const
+{
+    return comp_;
+}
+
+/**
+* Returns a copy of the allocator the node pool draws from.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+typename BTree<Key, Value, Compare, Alloc>::allocator_type
+BTree<Key, Value, Compare, Alloc>::get_allocator() const
+{
+    return pool_->get_allocator();
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+typename BTree<Key, Value, Compare, Alloc>::LeafNode*
+BTree<Key, Value, Compare, Alloc>::createLeaf()
+{
+    LeafNode* leaf = static_cast<LeafNode*>(pool_->allocate());
+    leaf->count = 0;
+    leaf->leaf = true;
+    leaf->prev = NULL;
+    leaf->next = NULL;
+    return leaf;
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+typename BTree<Key, Value, Compare, Alloc>::InnerNode*
+BTree<Key, Value, Compare, Alloc>::createInner()
+{
+    InnerNode* inner = static_cast<InnerNode*>(pool_->allocate());
+    inner->count = 0;
+    inner->leaf = false;
+    return inner;
+}
+
+/**
+* Returns an emptied node's slot to the pool.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+void BTree<Key, Value, Compare, Alloc>::freeNode(NodeBase* node)
+{
+    pool_->deallocate(node);
+}
+
+/**
+* Destroys every item and key under node and frees the nodes.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+void BTree<Key, Value, Compare, Alloc>::destroyAll(NodeBase* node)
+{
+    if(node->leaf){
+        LeafNode* leaf = static_cast<LeafNode*>(node);
+        for(unsigned i = 0; i < leaf->count; ++i){
+            leaf->items()[i].~Item();
+        }
+    }
+    else {
+        InnerNode* inner = static_cast<InnerNode*>(node);
+        for(unsigned i = 0; i <= inner->count; ++i){
+            destroyAll(inner->children[i]);
+        }
+        for(unsigned i = 0; i < inner->count; ++i){
+            inner->keys()[i].~Key();
+        }
+    }
+    freeNode(node);
+}
+
+/**
+* Returns the index of the child of inner that may hold key: the number
+* of separators not greater than key. The scan counts instead of
+* branching, so it costs no mispredictions and reads the node front to
+* back, which is cheaper than a binary search at these node sizes; for
+* integer keys KeyBlockSearch compares a vector of keys at a time.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+unsigned BTree<Key, Value, Compare, Alloc>::childIndex(InnerNode* inner, const Key& key) const
+{
+    return InnerSearch::countNotGreater(inner->keys(), inner->count, key, comp_);
+}
+
+/**
+* Returns the index of the first item in leaf whose key is not less than key.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+unsigned BTree<Key, Value, Compare, Alloc>::leafLowerBound(LeafNode* leaf, const Key& key) const
+{
+    const Item* items = leaf->items();
+    if(LeafSearch::kVectorized){
+        return LeafSearch::countLess(&items[0].first, leaf->count, key, comp_);
+    }
+    unsigned index = 0;
+    for(unsigned i = 0; i < leaf->count; ++i){
+        index += comp_(items[i].first, key);
+    }
+    return index;
+}
+
+/**
+* Returns the index of the first item in leaf whose key is greater than key.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+unsigned BTree<Key, Value, Compare, Alloc>::leafUpperBound(LeafNode* leaf, const Key& key) const
+{
+    const Item* items = leaf->items();
+    if(LeafSearch::kVectorized){
+        return LeafSearch::countNotGreater(&items[0].first, leaf->count, key, comp_);
+    }
+    unsigned index = 0;
+    for(unsigned i = 0; i < leaf->count; ++i){
+        index += !comp_(key, items[i].first);
+    }
+    return index;
+}
+
+/**
+* Scalar versions of the scans above for keys of another type, which
+* KeyBlockSearch cannot take.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+template<typename K>
+unsigned BTree<Key, Value, Compare, Alloc>::childIndex(InnerNode* inner, const K& key) const
+{
+    const Key* keys = inner->keys();
+    unsigned index = 0;
+    for(unsigned i = 0; i < inner->count; ++i){
+        index += !comp_(key, keys[i]);
+    }
+    return index;
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+template<typename K>
+unsigned BTree<Key, Value, Compare, Alloc>::leafLowerBound(LeafNode* leaf, const K& key) const
+{
+    const Item* items = leaf->items();
+    unsigned index = 0;
+    for(unsigned i = 0; i < leaf->count; ++i){
+        index += comp_(items[i].first, key);
+    }
+    return index;
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+template<typename K>
+unsigned BTree<Key, Value, Compare, Alloc>::leafUpperBound(LeafNode* leaf, const K& key) const
+{
+    const Item* items = leaf->items();
+    unsigned index = 0;
+    for(unsigned i = 0; i < leaf->count; ++i){
+        index += !comp_(key, items[i].first);
+    }
+    return index;
+}
+
+/**
+* Returns the leaf that holds key if the tree has it, or NULL when the
+* tree is empty.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+template<typename K>
+typename BTree<Key, Value, Compare, Alloc>::LeafNode*
+BTree<Key, Value, Compare, Alloc>::findLeaf(const K& key) const
+{
+    NodeBase* node = root_;
+    if(node == NULL){
+        return NULL;
+    }
+    while(!node->leaf){
+        InnerNode* inner = static_cast<InnerNode*>(node);
+        node = inner->children[childIndex(inner, key)];
+    }
+    return static_cast<LeafNode*>(node);
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+template<typename K>
+typename BTree<Key, Value, Compare, Alloc>::iterator
+BTree<Key, Value, Compare, Alloc>::internalFind(const K& key) const
+{
+    LeafNode* leaf = findLeaf(key);
+    if(leaf == NULL){
+        return end();
+    }
+    unsigned pos = leafLowerBound(leaf, key);
+    if(pos == leaf->count || comp_(key, leaf->items()[pos].first)){
+        return end();
+    }
+    return iterator(leaf, pos, this);
+}
+
+/**
+* A key past the end of its leaf bounds from the next leaf's first item.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+template<typename K>
+typename BTree<Key, Value, Compare, Alloc>::iterator
+BTree<Key, Value, Compare, Alloc>::internalLowerBound(const K& key) const
+{
+    LeafNode* leaf = findLeaf(key);
+    if(leaf == NULL){
+        return end();
+    }
+    unsigned pos = leafLowerBound(leaf, key);
+    if(pos == leaf->count){
+        return iterator(leaf->next, 0, this);
+    }
+    return iterator(leaf, pos, this);
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+template<typename K>
+typename BTree<Key, Value, Compare, Alloc>::iterator
+BTree<Key, Value, Compare, Alloc>::internalUpperBound(const K& key) const
+{
+    LeafNode* leaf = findLeaf(key);
+    if(leaf == NULL){
+        return end();
+    }
+    unsigned pos = leafUpperBound(leaf, key);
+    if(pos == leaf->count){
+        return iterator(leaf->next, 0, this);
+    }
+    return iterator(leaf, pos, this);
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+template<typename K>
+std::pair<typename BTree<Key, Value, Compare, Alloc>::iterator,
+          typename BTree<Key, Value, Compare, Alloc>::iterator>
+BTree<Key, Value, Compare, Alloc>::internalEqualRange(const K& key) const
+{
+    iterator first = internalLowerBound(key);
+    iterator last(first);
+    // keys are unique, so the range holds at most one item
+    if(last != end() && !comp_(key, last->first)){
+        ++last;
+    }
+    return std::make_pair(first, last);
+}
+
+/**
+* Walks down to the leaf for key, splitting each full node before it
+* enters it, so there is always room for the separator a split sends up
+* and for one more item in the leaf. Returns the item with key if there
+* is one; either way leaf and pos are where key is or belongs.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+typename BTree<Key, Value, Compare, Alloc>::Item*
+BTree<Key, Value, Compare, Alloc>::findSlot(const Key& key, LeafNode*& leaf, unsigned& pos)
+{
+    if(root_ == NULL){
+        LeafNode* first = createLeaf();
+        root_ = head_ = tail_ = first;
+        height_ = 1;
+    }
+    else if(isFull(root_)){
+        InnerNode* root = createInner();
+        root->children[0] = root_;
+        root_ = root;
+        ++height_;
+        splitChild(root, 0);
+    }
+
+    NodeBase* node = root_;
+    while(!node->leaf){
+        InnerNode* inner = static_cast<InnerNode*>(node);
+        unsigned i = childIndex(inner, key);
+        if(isFull(inner->children[i])){
+            splitChild(inner, i);
+            if(!comp_(key, inner->keys()[i])){
+                ++i;
+            }
+        }
+        node = inner->children[i];
+    }
+
+    leaf = static_cast<LeafNode*>(node);
+    pos = leafLowerBound(leaf, key);
+    Item* items = leaf->items();
+    if(pos < leaf->count && !comp_(key, items[pos].first)){
+        return items + pos;
+    }
+    return NULL;
+}
+
+/**
+* Builds an item from args at pos in leaf, which findSlot() left with
+* room, and returns an iterator to it. If building it throws, the leaf is
+* put back, and a root leaf that findSlot() just created is freed again.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+template<typename... Args>
+typename BTree<Key, Value, Compare, Alloc>::iterator
+BTree<Key, Value, Compare, Alloc>::emplaceAt(LeafNode* leaf, unsigned pos, Args&&... args)
+{
+    Item* items = leaf->items();
+    relocate(items + pos + 1, items + pos, leaf->count - pos);
+    try {
+        new (items + pos) Item(std::forward<Args>(args)...);
+    }
+    catch(...) {
+        relocate(items + pos, items + pos + 1, leaf->count - pos);
+        if(leaf->count == 0){
+            freeNode(leaf);
+            root_ = NULL;
+            head_ = tail_ = NULL;
+            height_ = 0;
+        }
+        throw;
+    }
+    ++leaf->count;
+    ++size_;
+    return iterator(leaf, pos, this);
+}
+
+/**
+* Splits the full child i of inner in two. A leaf keeps its lower half and
+* its new right sibling's first key is copied up; an inner node moves its
+* middle key up.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+void BTree<Key, Value, Compare, Alloc>::splitChild(InnerNode* inner, unsigned i)
+{
+    NodeBase* child = inner->children[i];
+    NodeBase* sibling;
+    Key* up = inner->keys() + i;
+    relocate(up + 1, up, inner->count - i);
+    if(child->leaf){
+        LeafNode* left = static_cast<LeafNode*>(child);
+        LeafNode* right = createLeaf();
+        unsigned keep = kLeafSlots / 2;
+        relocate(right->items(), left->items() + keep, left->count - keep);
+        right->count = left->count - keep;
+        left->count = keep;
+        right->prev = left;
+        right->next = left->next;
+        if(left->next != NULL){
+            left->next->prev = right;
+        }
+        else {
+            tail_ = right;
+        }
+        left->next = right;
+        new (up) Key(right->items()[0].first);
+        sibling = right;
+    }
+    else {
+        InnerNode* left = static_cast<InnerNode*>(child);
+        InnerNode* right = createInner();
+        unsigned keep = kInnerSlots / 2;
+        unsigned moved = left->count - keep - 1;
+        relocate(right->keys(), left->keys() + keep + 1, moved);
+        std::copy(left->children + keep + 1, left->children + left->count + 1, right->children);
+        right->count = moved;
+        relocate(up, left->keys() + keep, 1);
+        left->count = keep;
+        sibling = right;
+    }
+    std::copy_backward(inner->children + i + 1, inner->children + inner->count + 1,
+                       inner->children + inner->count + 2);
+    inner->children[i + 1] = sibling;
+    ++inner->count;
+}
+
+/**
+* Makes sure child i of inner holds more than its minimum, by borrowing
+* from a sibling or merging with one, and returns the index of the child
+* that now covers the same keys.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+unsigned BTree<Key, Value, Compare, Alloc>::fillChild(InnerNode* inner, unsigned i)
+{
+    NodeBase* child = inner->children[i];
+    std::size_t minimum = kMinInner;
+    if(child->leaf){
+        minimum = kMinLeaf;
+    }
+    if(child->count > minimum){
+        return i;
+    }
+    if(i > 0 && inner->children[i - 1]->count > minimum){
+        borrowFromLeft(inner, i);
+        return i;
+    }
+    if(i < inner->count && inner->children[i + 1]->count > minimum){
+        borrowFromRight(inner, i);
+        return i;
+    }
+    if(i > 0){
+        mergeChildren(inner, i - 1);
+        return i - 1;
+    }
+    mergeChildren(inner, i);
+    return i;
+}
+
+/**
+* Moves the last entry of child i - 1 of inner to the front of child i.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+void BTree<Key, Value, Compare, Alloc>::borrowFromLeft(InnerNode* inner, unsigned i)
+{
+    Key* separator = inner->keys() + i - 1;
+    if(inner->children[i]->leaf){
+        LeafNode* left = static_cast<LeafNode*>(inner->children[i - 1]);
+        LeafNode* child = static_cast<LeafNode*>(inner->children[i]);
+        relocate(child->items() + 1, child->items(), child->count);
+        relocate(child->items(), left->items() + left->count - 1, 1);
+        --left->count;
+        ++child->count;
+        separator->~Key();
+        new (separator) Key(child->items()[0].first);
+    }
+    else {
+        InnerNode* left = static_cast<InnerNode*>(inner->children[i - 1]);
+        InnerNode* child = static_cast<InnerNode*>(inner->children[i]);
+        relocate(child->keys() + 1, child->keys(), child->count);
+        std::copy_backward(child->children, child->children + child->count + 1,
+                           child->children + child->count + 2);
+        relocate(child->keys(), separator, 1);
+        child->children[0] = left->children[left->count];
+        relocate(separator, left->keys() + left->count - 1, 1);
+        --left->count;
+        ++child->count;
+    }
+}
+
+/**
+* Moves the first entry of child i + 1 of inner to the end of child i.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+void BTree<Key, Value, Compare, Alloc>::borrowFromRight(InnerNode* inner, unsigned i)
+{
+    Key* separator = inner->keys() + i;
+    if(inner->children[i]->leaf){
+        LeafNode* child = static_cast<LeafNode*>(inner->children[i]);
+        LeafNode* right = static_cast<LeafNode*>(inner->children[i + 1]);
+        relocate(child->items() + child->count, right->items(), 1);
+        relocate(right->items(), right->items() + 1, right->count - 1);
+        ++child->count;
+        --right->count;
+        separator->~Key();
+        new (separator) Key(right->items()[0].first);
+    }
+    else {
+        InnerNode* child = static_cast<InnerNode*>(inner->children[i]);
+        InnerNode* right = static_cast<InnerNode*>(inner->children[i + 1]);
+        relocate(child->keys() + child->count, separator, 1);
+        child->children[child->count + 1] = right->children[0];
+        relocate(separator, right->keys(), 1);
+        relocate(right->keys(), right->keys() + 1, right->count - 1);
+        std::copy(right->children + 1, right->children + right->count + 1, right->children);
+        ++child->count;
+        --right->count;
+    }
+}
+
+/**
+* Merges child i + 1 of inner into child i, along with the separator
+* between them when they are inner nodes, and frees the emptied node.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+void BTree<Key, Value, Compare, Alloc>::mergeChildren(InnerNode* inner, unsigned i)
+{
+    Key* separator = inner->keys() + i;
+    NodeBase* right = inner->children[i + 1];
+    if(right->leaf){
+        LeafNode* leftLeaf = static_cast<LeafNode*>(inner->children[i]);
+        LeafNode* rightLeaf = static_cast<LeafNode*>(right);
+        relocate(leftLeaf->items() + leftLeaf->count, rightLeaf->items(), rightLeaf->count);
+        leftLeaf->count += rightLeaf->count;
+        leftLeaf->next = rightLeaf->next;
+        if(rightLeaf->next != NULL){
+            rightLeaf->next->prev = leftLeaf;
+        }
+        else {
+            tail_ = leftLeaf;
+        }
+        separator->~Key();
+    }
+    else {
+        InnerNode* leftInner = static_cast<InnerNode*>(inner->children[i]);
+        InnerNode* rightInner = static_cast<InnerNode*>(right);
+        relocate(leftInner->keys() + leftInner->count, separator, 1);
+        relocate(leftInner->keys() + leftInner->count + 1, rightInner->keys(), rightInner->count);
+        std::copy(rightInner->children, rightInner->children + rightInner->count + 1,
+                  leftInner->children + leftInner->count + 1);
+        leftInner->count += rightInner->count + 1;
+    }
+    freeNode(right);
+    relocate(separator, separator + 1, inner->count - i - 1);
+    std::copy(inner->children + i + 2, inner->children + inner->count + 1, inner->children + i + 1);
+    --inner->count;
+}
+
+/**
+* Moves n objects from src to dst, which may overlap, leaving src's slots
+* that dst does not cover unconstructed.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+template<typename T>
+void BTree<Key, Value, Compare, Alloc>::relocate(T* dst, T* src, std::size_t n)
+{
+    if(dst < src){
+        for(std::size_t i = 0; i < n; ++i){
+            new (dst + i) T(std::move(src[i]));
+            src[i].~T();
+        }
+    }
+    else if(dst > src){
+        for(std::size_t i = n; i > 0; --i){
+            new (dst + i - 1) T(std::move(src[i - 1]));
+            src[i - 1].~T();
+        }
+    }
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+bool BTree<Key, Value, Compare, Alloc>::isFull(NodeBase* node)
+{
+    if(node->leaf){
+        return node->count == kLeafSlots;
+    }
+    return node->count == kInnerSlots;
+}
+
+/*
+  -----------------------------------------
+  End implementations for the BTree class.
+  -----------------------------------------
+*/
+
+#endif
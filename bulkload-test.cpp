@@ -0,0 +1,238 @@
+#include <iostream>
+#include <algorithm>
+#include <cstdlib>
+#include <forward_list>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#include "avlbst.h"
+
+using namespace std;
+
+// Checked test for AVLTree::bulkLoad() and bulkLoadUnsorted() against
+// std::map. Sorted runs of every small size and a few large ones are
+// loaded into empty trees and over trees that already hold items, from
+// random-access and from forward-only iterators; repeated keys must keep
+// their last value, and the tree must come out perfectly balanced, as
+// tall as a complete tree of its size, and, for RankedAVLTree, with the
+// subtree sizes select() relies on. An unsorted run must throw
+// std::invalid_argument and leave the tree as it was. Unsorted batches,
+// some large enough to be sorted on several threads, are loaded with one
+// thread and with four. It exits with status 1 if any check fails.
+
+typedef AVLTree<long, long> Tree;
+typedef CompactAVLTree<long, long> CompactTree;
+typedef RankedAVLTree<long, long> RankedTree;
+
+static int failures = 0;
+
+static void check(bool ok, const string& what)
+{
+    if(!ok && ++failures <= 20) {
+        cerr << "FAIL " << what << endl;
+    }
+}
+
+// Subtree sizes, checked through select(); only trees whose nodes keep
+// them have these
+static bool ranksMatch(const Tree&, const map<long, long>&) { return true; }
+static bool ranksMatch(const CompactTree&, const map<long, long>&) { return true; }
+
+static bool ranksMatch(const RankedTree& tree, const map<long, long>& expected)
+{
+    size_t k = 0;
+    for(map<long, long>::const_iterator want = expected.begin(); want != expected.end(); ++want, ++k) {
+        RankedTree::iterator got = tree.select(k);
+        if(got == tree.end() || got->first != want->first) {
+            return false;
+        }
+    }
+    return tree.select(expected.size()) == tree.end();
+}
+
+template<typename T>
+static bool matches(const T& tree, const map<long, long>& expected)
+{
+    if(tree.size() != expected.size() || !tree.isBalanced()) {
+        return false;
+    }
+    typename T::BalanceInfo info = tree.checkBalance();
+    if(!info.balanced || info.height != tree.height()) {
+        return false;
+    }
+    typename T::const_iterator it = tree.cbegin();
+    for(map<long, long>::const_iterator want = expected.begin(); want != expected.end(); ++want, ++it) {
+        if(it == tree.cend() || it->first != want->first || it->second != want->second) {
+            return false;
+        }
+    }
+    return it == tree.cend() && ranksMatch(tree, expected);
+}
+
+// The height of a complete tree of n items
+static int completeHeight(size_t n)
+{
+    int height = 0;
+    for(; n != 0; n >>= 1) {
+        ++height;
+    }
+    return height;
+}
+
+// n sorted items with keys from [0, range); when range < n keys repeat,
+// and every value is distinct so the one kept shows which repeat won
+static vector<pair<long, long> > sortedItems(size_t n, long range, mt19937_64& rng)
+{
+    vector<long> keys;
+    for(size_t i = 0; i < n; ++i) {
+        keys.push_back(static_cast<long>(rng() % static_cast<unsigned long>(range)));
+    }
+    sort(keys.begin(), keys.end());
+    vector<pair<long, long> > items;
+    for(size_t i = 0; i < n; ++i) {
+        items.push_back(make_pair(keys[i], static_cast<long>(i)));
+    }
+    return items;
+}
+
+static map<long, long> lastWins(const vector<pair<long, long> >& items)
+{
+    map<long, long> result;
+    for(size_t i = 0; i < items.size(); ++i) {
+        result[items[i].first] = items[i].second;
+    }
+    return result;
+}
+
+template<typename T>
+static void checkLoaded(T& tree, const map<long, long>& expected, const string& where)
+{
+    check(matches(tree, expected), where + ": tree differs");
+    check(tree.height() == completeHeight(expected.size()), where + ": tree is not perfectly balanced");
+
+    // the tree keeps working one item at a time
+    map<long, long> changed(expected);
+    for(long key = -3; key < 3; ++key) {
+        tree.insert(make_pair(key, key));
+        changed[key] = key;
+    }
+    tree.remove(-3);
+    changed.erase(-3);
+    check(matches(tree, changed), where + ": tree differs after changes");
+}
+
+template<typename T>
+static void testSorted(const string& name)
+{
+    mt19937_64 rng(5);
+    vector<size_t> sizes;
+    for(size_t n = 0; n <= 70; ++n) {
+        sizes.push_back(n);
+    }
+    sizes.push_back(1023);
+    sizes.push_back(1024);
+    sizes.push_back(1025);
+    sizes.push_back(50000);
+
+    for(size_t s = 0; s < sizes.size(); ++s) {
+        size_t n = sizes[s];
+        string where = name + " bulkLoad of " + to_string(n) + " items";
+        // distinct keys, then keys that repeat
+        vector<pair<long, long> > distinct = sortedItems(n, static_cast<long>(4 * n + 1), rng);
+        vector<pair<long, long> > repeated = sortedItems(n, static_cast<long>(n / 3 + 1), rng);
+
+        T empty;
+        empty.bulkLoad(distinct.begin(), distinct.end());
+        checkLoaded(empty, lastWins(distinct), where + " into an empty tree");
+
+        T full;
+        for(long key = 0; key < 100; ++key) {
+            full.insert(make_pair(key * 7, key));
+        }
+        full.bulkLoad(repeated.begin(), repeated.end());
+        checkLoaded(full, lastWins(repeated), where + " with repeated keys over a full tree");
+
+        forward_list<pair<long, long> > list(repeated.begin(), repeated.end());
+        T fromList;
+        fromList.insert(make_pair(-100L, 0L));
+        fromList.bulkLoad(list.begin(), list.end());
+        checkLoaded(fromList, lastWins(repeated), where + " from a forward_list");
+    }
+}
+
+// A run that is out of order anywhere, including only at its very end,
+// must be refused before the tree is touched.
+template<typename T>
+static void testUnsortedRefused(const string& name)
+{
+    mt19937_64 rng(6);
+    vector<pair<long, long> > items = sortedItems(1000, 5000, rng);
+    const size_t swaps[] = { 0, 1, 500, 998 };
+    for(size_t s = 0; s < sizeof(swaps) / sizeof(swaps[0]); ++s) {
+        vector<pair<long, long> > bad(items);
+        bad[swaps[s]].first = bad[swaps[s] + 1].first + 1;
+        string where = name + " bulkLoad of a run out of order at " + to_string(swaps[s]);
+
+        T tree;
+        map<long, long> expected;
+        for(long key = 0; key < 300; ++key) {
+            tree.insert(make_pair(key * 3, key));
+            expected[key * 3] = key;
+        }
+        bool threw = false;
+        try {
+            tree.bulkLoad(bad.begin(), bad.end());
+        }
+        catch(const invalid_argument&) {
+            threw = true;
+        }
+        check(threw, where + ": did not throw");
+        check(matches(tree, expected), where + ": tree changed");
+    }
+}
+
+template<typename T>
+static void testUnsorted(const string& name)
+{
+    mt19937_64 rng(7);
+    // the sort splits a batch between threads once each gets 16384 items
+    const size_t sizes[] = { 0, 1, 2, 100, 5000, 40000, 65536, 100001 };
+    const unsigned threadCounts[] = { 1, 4 };
+    for(size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+        vector<pair<long, long> > items;
+        long range = static_cast<long>(sizes[s] / 2 + 1);
+        for(size_t i = 0; i < sizes[s]; ++i) {
+            items.push_back(make_pair(static_cast<long>(rng() % static_cast<unsigned long>(range)), static_cast<long>(i)));
+        }
+        map<long, long> expected = lastWins(items);
+        for(size_t t = 0; t < sizeof(threadCounts) / sizeof(threadCounts[0]); ++t) {
+            T tree;
+            tree.insert(make_pair(-50L, 1L));
+            tree.bulkLoadUnsorted(items, threadCounts[t]);
+            checkLoaded(tree, expected, name + " bulkLoadUnsorted of " + to_string(sizes[s]) + " items on "
+                                        + to_string(threadCounts[t]) + " threads");
+        }
+    }
+}
+
+template<typename T>
+static void testTree(const string& name)
+{
+    testSorted<T>(name);
+    testUnsortedRefused<T>(name);
+    testUnsorted<T>(name);
+}
+
+int main(int argc, char *argv[])
+{
+    testTree<Tree>("AVLTree");
+    testTree<CompactTree>("CompactAVLTree");
+    testTree<RankedTree>("RankedAVLTree");
+
+    cout << (failures == 0 ? "All bulk load checks passed" : "Bulk load checks FAILED")
+         << " (" << failures << " failures)" << endl;
+    return failures == 0 ? 0 : 1;
+}
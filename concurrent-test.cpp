@@ -0,0 +1,201 @@
+#include <iostream>
+#include <cstdlib>
+#include <cmath>
+#include <atomic>
+#include <random>
+#include <set>
+#include <thread>
+#include <vector>
+#include "concurrent_avlbst.h"
+
+using namespace std;
+
+// Checked stress test for ConcurrentAVLTree. Reader threads run finds,
+// lookups, bounds and full iterations while writer threads insert and
+// remove, and every result is checked against what the tree must hold
+// at that moment. It exits with status 1 if any check fails; "make tsan"
+// builds and runs it under ThreadSanitizer.
+//
+// The keys are split so readers know the truth without locking:
+//  - multiples of 4 are loaded up front and never removed, though
+//    writers keep overwriting them (each overwrite links a new node in
+//    place of the old one), so a reader must always find them;
+//  - writer t inserts and removes only keys equal to 2t + 1 mod 4, and
+//    checks the tree against its own copy of them when all threads stop;
+//  - every value is 10 times its key, plus 1 for a writer's key, so a
+//    reader can tell an item from a freed or torn node.
+
+typedef ConcurrentAVLTree<long, long> Tree;
+
+static const long kStableKeys = 4096;
+static const long kRange = 4 * kStableKeys;
+static const unsigned kReaders = 3;
+static const unsigned kWriters = 2;
+static const unsigned kScanEvery = 256;
+
+static atomic<int> failures(0);
+static atomic<bool> writing(true);
+
+static void fail(const char* what, long key)
+{
+    if(failures.fetch_add(1) < 20) {
+        cerr << "FAIL " << what << ", key " << key << endl;
+    }
+}
+
+static bool isStable(long key)
+{
+    return key % 4 == 0;
+}
+
+static long valueOf(long key)
+{
+    return 10 * key + (isStable(key) ? 0 : 1);
+}
+
+// Walks the whole tree: keys must rise strictly, values must match their
+// keys, and every stable key must turn up.
+static void checkScan(const Tree& tree)
+{
+    long last = -1;
+    long stable = 0;
+    for(Tree::const_iterator it = tree.begin(); it != tree.end(); ++it) {
+        if(it->first <= last) {
+            fail("iteration out of order", it->first);
+        }
+        if(it->second != valueOf(it->first)) {
+            fail("iteration value does not match its key", it->first);
+        }
+        stable += isStable(it->first);
+        last = it->first;
+    }
+    if(stable != kStableKeys) {
+        fail("iteration missed stable keys", stable);
+    }
+}
+
+static void reader(const Tree* tree, unsigned seed)
+{
+    mt19937_64 rng(seed);
+    for(unsigned i = 0; writing.load(); ++i) {
+        long key = static_cast<long>(rng() % kRange);
+        Tree::const_iterator it = tree->find(key);
+        if(it != tree->end()) {
+            if(it->first != key || it->second != valueOf(key)) {
+                fail("find returned a wrong item", key);
+            }
+        }
+        else if(isStable(key)) {
+            fail("find missed a stable key", key);
+        }
+
+        long value = 0;
+        if(tree->get(key, value) ? value != valueOf(key) : isStable(key)) {
+            fail("get disagrees", key);
+        }
+        if(isStable(key) && !tree->contains(key)) {
+            fail("contains missed a stable key", key);
+        }
+
+        // the next stable key bounds the answer from above
+        Tree::const_iterator bound = tree->lower_bound(key);
+        long limit = (key + 3) / 4 * 4;
+        if(limit < kRange && (bound == tree->end() || bound->first < key || bound->first > limit)) {
+            fail("lower_bound outside [key, next stable key]", key);
+        }
+        bound = tree->upper_bound(key);
+        limit = key / 4 * 4 + 4;
+        if(limit < kRange && (bound == tree->end() || bound->first <= key || bound->first > limit)) {
+            fail("upper_bound outside (key, next stable key]", key);
+        }
+
+        if(i % kScanEvery == 0) {
+            checkScan(*tree);
+        }
+    }
+}
+
+static void writer(Tree* tree, unsigned index, size_t ops, set<long>* owned)
+{
+    mt19937_64 rng(100 + index);
+    for(size_t i = 0; i < ops; ++i) {
+        long key = static_cast<long>(rng() % kStableKeys) * 4;
+        switch(rng() % 4) {
+        case 0:
+            tree->insert(make_pair(key, valueOf(key)));
+            break;
+        case 1: {
+            key += 2 * index + 1;
+            bool removed = tree->remove(key);
+            if(removed != (owned->erase(key) == 1)) {
+                fail("remove disagrees with the writer's copy", key);
+            }
+            break;
+        }
+        default:
+            key += 2 * index + 1;
+            tree->insert(make_pair(key, valueOf(key)));
+            owned->insert(key);
+            break;
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    size_t ops = (argc > 1) ? strtoul(argv[1], NULL, 10) : 200000;
+    if(ops == 0) {
+        cerr << "usage: concurrent-test [writes per writer thread, at least 1]" << endl;
+        return 2;
+    }
+
+    Tree tree;
+    for(long key = 0; key < kRange; key += 4) {
+        tree.insert(make_pair(key, valueOf(key)));
+    }
+
+    vector<set<long> > owned(kWriters);
+    vector<thread> readers;
+    for(unsigned r = 0; r < kReaders; ++r) {
+        readers.push_back(thread(reader, &tree, 7 + r));
+    }
+    vector<thread> writers;
+    for(unsigned w = 0; w < kWriters; ++w) {
+        writers.push_back(thread(writer, &tree, w, ops, &owned[w]));
+    }
+    for(size_t w = 0; w < writers.size(); ++w) {
+        writers[w].join();
+    }
+    writing.store(false);
+    for(size_t r = 0; r < readers.size(); ++r) {
+        readers[r].join();
+    }
+
+    // with every thread stopped the tree must be exactly the stable keys
+    // plus what each writer last left in
+    set<long> expected;
+    for(long key = 0; key < kRange; key += 4) {
+        expected.insert(key);
+    }
+    for(size_t w = 0; w < owned.size(); ++w) {
+        expected.insert(owned[w].begin(), owned[w].end());
+    }
+    set<long>::const_iterator want = expected.begin();
+    for(Tree::const_iterator it = tree.begin(); it != tree.end(); ++it, ++want) {
+        if(want == expected.end() || it->first != *want) {
+            fail("final contents differ", it->first);
+            break;
+        }
+    }
+    if(want != expected.end() || tree.size() != expected.size()) {
+        fail("final size differs", static_cast<long>(tree.size()));
+    }
+    double bound = 1.4405 * log2(double(expected.size()) + 2) - 0.3277;
+    if(tree.height() > bound) {
+        fail("final height exceeds the AVL bound", tree.height());
+    }
+
+    cout << (failures == 0 ? "All concurrent checks passed" : "Concurrent checks FAILED")
+         << " (" << failures << " failures, " << expected.size() << " items)" << endl;
+    return failures == 0 ? 0 : 1;
+}
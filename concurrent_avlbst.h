@@ -0,0 +1,1054 @@
+#ifndef CONCURRENT_AVLBST_H
+#define CONCURRENT_AVLBST_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "bst.h"
+#include "epoch.h"
+#include "node_pool.h"
+
+/**
+* A node of a ConcurrentAVLTree. The links are atomic so readers may
+* follow them while a writer relinks the tree; the item never changes once
+* the node is linked in, so readers may use it without synchronization.
+* The height is only touched by writers.
+*/
+template <typename Key, typename Value>
+class ConcurrentAVLNode
+{
+public:
+    ConcurrentAVLNode(const Key& key, const Value& value, ConcurrentAVLNode<Key, Value>* parent);
+
+    const std::pair<const Key, Value>& getItem() const;
+    const Key& getKey() const;
+    const Value& getValue() const;
+
+    ConcurrentAVLNode<Key, Value>* getParent() const;
+    ConcurrentAVLNode<Key, Value>* getLeft() const;
+    ConcurrentAVLNode<Key, Value>* getRight() const;
+    void setParent(ConcurrentAVLNode<Key, Value>* parent);
+    void setLeft(ConcurrentAVLNode<Key, Value>* left);
+    void setRight(ConcurrentAVLNode<Key, Value>* right);
+
+    int getHeight() const;
+    void setHeight(int height);
+
+protected:
+    std::pair<const Key, Value> item_;
+    std::atomic<ConcurrentAVLNode<Key, Value>*> parent_;
+    std::atomic<ConcurrentAVLNode<Key, Value>*> left_;
+    std::atomic<ConcurrentAVLNode<Key, Value>*> right_;
+    int8_t height_;
+};
+
+/*
+  -------------------------------------------------
+  Begin implementations for the ConcurrentAVLNode class.
+  -------------------------------------------------
+*/
+
+/**
+* Constructor for a leaf of height 1.
+*/
+template<class Key, class Value>
+ConcurrentAVLNode<Key, Value>::ConcurrentAVLNode(const Key& key, const Value& value,
+                                                 ConcurrentAVLNode<Key, Value>* parent) :
+    item_(key, value),
+    parent_(parent),
+    left_(NULL),
+    right_(NULL),
+    height_(1)
+{
+}
+
+template<class Key, class Value>
+const std::pair<const Key, Value>& ConcurrentAVLNode<Key, Value>::getItem() const
+{
+    return item_;
+}
+
+template<class Key, class Value>
+const Key& ConcurrentAVLNode<Key, Value>::getKey() const
+{
+    return item_.first;
+}
+
+template<class Key, class Value>
+const Value& ConcurrentAVLNode<Key, Value>::getValue() const
+{
+    return item_.second;
+}
+
+/**
+* Link getters and setters. Stores publish everything the writer did to
+* the node before, so a reader that loads the link sees the node whole.
+*/
+template<class Key, class Value>
+ConcurrentAVLNode<Key, Value>* ConcurrentAVLNode<Key, Value>::getParent() const
+{
+    return parent_.load(std::memory_order_acquire);
+}
+
+template<class Key, class Value>
+ConcurrentAVLNode<Key, Value>* ConcurrentAVLNode<Key, Value>::getLeft() const
+{
+    return left_.load(std::memory_order_acquire);
+}
+
+template<class Key, class Value>
+ConcurrentAVLNode<Key, Value>* ConcurrentAVLNode<Key, Value>::getRight() const
+{
+    return right_.load(std::memory_order_acquire);
+}
+
+template<class Key, class Value>
+void ConcurrentAVLNode<Key, Value>::setParent(ConcurrentAVLNode<Key, Value>* parent)
+{
+    parent_.store(parent, std::memory_order_release);
+}
+
+template<class Key, class Value>
+void ConcurrentAVLNode<Key, Value>::setLeft(ConcurrentAVLNode<Key, Value>* left)
+{
+    left_.store(left, std::memory_order_release);
+}
+
+template<class Key, class Value>
+void ConcurrentAVLNode<Key, Value>::setRight(ConcurrentAVLNode<Key, Value>* right)
+{
+    right_.store(right, std::memory_order_release);
+}
+
+template<class Key, class Value>
+int ConcurrentAVLNode<Key, Value>::getHeight() const
+{
+    return height_;
+}
+
+template<class Key, class Value>
+void ConcurrentAVLNode<Key, Value>::setHeight(int height)
+{
+    height_ = static_cast<int8_t>(height);
+}
+
+/*
+  -----------------------------------------------
+  End implementations for the ConcurrentAVLNode class.
+  -----------------------------------------------
+*/
+
+
+/**
+* An AVL tree that may be read from any number of threads while other
+* threads insert and remove.
+*
+* Readers take no lock. A writer holds the tree's mutex and bumps a version
+* counter to odd before it relinks anything and back to even after, which
+* it does only once it has found its spot and allocated its node. A reader
+* notes the version, walks the tree, and keeps the result only if the
+* version is still the same even number; otherwise it walks again. After a
+* few failed walks it takes the mutex, so readers always finish. While a
+* writer is relinking, a reader may see a torn tree, so walks are cut off
+* after kMaxDepth steps.
+*
+* Items are never changed in place: inserting a key that is already there
+* links in a new node in place of the old one. Nodes that are unlinked are
+* retired and only freed once EpochDomain says no pinned reader can still
+* hold them, so readers and iterators pin the epoch while they hold nodes.
+*
+* Writers are serialized, so this scales with readers, not with writers.
+*/
+template <class Key, class Value,
+          class Compare = std::less<Key>,
+          class Alloc = std::allocator<std::pair<const Key, Value> > >
+class ConcurrentAVLTree
+{
+protected:
+    typedef ConcurrentAVLNode<Key, Value> NodeT;
+
+public:
+    typedef Compare key_compare;
+    typedef Alloc allocator_type;
+
+    explicit ConcurrentAVLTree(const Compare& comp = Compare(), const Alloc& alloc = Alloc());
+    ~ConcurrentAVLTree();
+
+    // Writers; these take the tree's mutex
+    void insert(const std::pair<const Key, Value>& keyValuePair);
+    bool remove(const Key& key);
+    void clear();
+
+    std::size_t size() const;
+    bool empty() const;
+    int height() const;
+
+    /**
+    * A forward iterator over the items in key order. It may be used while
+    * writers change the tree: every item it yields was in the tree when
+    * it was reached, keys only increase, and items inserted or removed
+    * ahead of it may or may not be seen. It pins the epoch while it points
+    * at an item, so it must stay on the thread that made it and should not
+    * be kept around for long.
+    */
+    class const_iterator
+    {
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef std::pair<const Key, Value> value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const std::pair<const Key, Value>* pointer;
+        typedef const std::pair<const Key, Value>& reference;
+
+        const_iterator();
+        reference operator*() const;
+        pointer operator->() const;
+        bool operator==(const const_iterator& rhs) const;
+        bool operator!=(const const_iterator& rhs) const;
+        const_iterator& operator++();
+        const_iterator operator++(int);
+
+    protected:
+        friend class ConcurrentAVLTree<Key, Value, Compare, Alloc>;
+        const_iterator(const ConcurrentAVLTree* tree, NodeT* node, std::uint64_t stamp);
+
+        const ConcurrentAVLTree* tree_;
+        NodeT* node_;
+        std::uint64_t stamp_;   // version the position was read at
+        EpochGuard guard_;
+    };
+
+    // Readers; these take no lock unless writers keep getting in the way
+    const_iterator find(const Key& key) const;
+    bool contains(const Key& key) const;
+    bool get(const Key& key, Value& value) const;
+    const_iterator lower_bound(const Key& key) const;
+    const_iterator upper_bound(const Key& key) const;
+    const_iterator begin() const;
+    const_iterator end() const;
+
+protected:
+    // Longest walk a reader makes before assuming the tree is torn; an
+    // AVL tree of 2^64 items is less than 93 levels deep.
+    static const int kMaxDepth = 128;
+    static const int kOptimisticAttempts = 8;
+    static const std::size_t kReclaimBatch = 64;
+
+    // Trees own their nodes and cannot be copied.
+    ConcurrentAVLTree(const ConcurrentAVLTree&);
+    ConcurrentAVLTree& operator=(const ConcurrentAVLTree&);
+
+    // Reader helpers
+    template<typename Walk>
+    NodeT* optimisticRead(Walk walk, std::uint64_t& stamp) const;
+    NodeT* walkFind(const Key& key, bool& complete) const;
+    NodeT* walkBound(const Key& key, bool strict, bool& complete) const;
+    NodeT* walkFirst(bool& complete) const;
+    static NodeT* walkSuccessor(NodeT* node, bool& complete);
+    const_iterator makeIterator(NodeT* node, std::uint64_t stamp) const;
+
+    // Writer helpers; these run with writeMutex_ held
+    NodeT* createNode(const std::pair<const Key, Value>& keyValuePair, NodeT* parent);
+    void destroyNode(NodeT* node);
+    void beginWrite();
+    void endWrite();
+    void replaceChild(NodeT* parent, NodeT* oldChild, NodeT* newChild);
+    static int heightOf(NodeT* node);
+    static void updateHeight(NodeT* node);
+    NodeT* rotateLeft(NodeT* node);
+    NodeT* rotateRight(NodeT* node);
+    void rebalance(NodeT* node);
+    void unlinkNode(NodeT* node);
+    void retire(NodeT* node);
+    void reclaim(bool force);
+    void destroySubtree(NodeT* node);
+
+    std::atomic<NodeT*> root_;
+    std::atomic<std::uint64_t> version_;
+    std::atomic<std::size_t> size_;
+    mutable std::mutex writeMutex_;
+    Compare comp_;
+    NodePool<Alloc> pool_;
+    std::deque<std::pair<NodeT*, std::uint64_t> > retired_;
+};
+
+/*
+  -----------------------------------------------------------------
+  Begin implementations for the ConcurrentAVLTree::const_iterator class.
+  -----------------------------------------------------------------
+*/
+
+/**
+* Default constructor, giving an end iterator that pins nothing.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+ConcurrentAVLTree<Key, Value, Compare, Alloc>::const_iterator::const_iterator() :
+    tree_(NULL),
+    node_(NULL),
+    stamp_(0),
+    guard_(false)
+{
+}
+
+/**
+* Initializing constructor; pins the epoch if node is an item.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+ConcurrentAVLTree<Key, Value, Compare, Alloc>::const_iterator::const_iterator(const ConcurrentAVLTree* tree,
+                                                                               NodeT* node, std::uint64_t stamp) :
+    tree_(tree),
+    node_(node),
+    stamp_(stamp),
+    guard_(node != NULL)
+{
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+typename ConcurrentAVLTree<Key, Value, Compare, Alloc>::const_iterator::reference
+ConcurrentAVLTree<Key, Value, Compare, Alloc>::const_iterator::operator*() const
+{
+    return node_->getItem();
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+typename ConcurrentAVLTree<Key, Value, Compare, Alloc>::const_iterator::pointer
+ConcurrentAVLTree<Key, Value, Compare, Alloc>::const_iterator::operator->() const
+{
+    return &(node_->getItem());
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+bool ConcurrentAVLTree<Key, Value, Compare, Alloc>::const_iterator::operator==(const const_iterator& rhs) const
+{
+    return node_ == rhs.node_;
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+bool ConcurrentAVLTree<Key, Value, Compare, Alloc>::const_iterator::operator!=(const const_iterator& rhs) const
+{
+    return node_ != rhs.node_;
+}
+
+/**
+* Advances to the next item. If nothing was written since the position was
+* read, the next item is found through the links in amortized O(1);
+* otherwise the node may have moved or left the tree, so the next key is
+* searched for from the root.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+typename ConcurrentAVLTree<Key, Value, Compare, Alloc>::const_iterator&
+ConcurrentAVLTree<Key, Value, Compare, Alloc>::const_iterator::operator++()
+{
+    NodeT* node = node_;
+    std::uint64_t stamp = stamp_;
+    const ConcurrentAVLTree* tree = tree_;
+    std::uint64_t next;
+    node_ = tree->optimisticRead([node, stamp, tree](std::uint64_t version, bool& complete) -> NodeT* {
+        if(version == stamp){
+            return ConcurrentAVLTree::walkSuccessor(node, complete);
+        }
+        return tree->walkBound(node->getKey(), true, complete);
+    }, next);
+    stamp_ = next;
+    if(node_ == NULL){
+        guard_ = EpochGuard(false);
+    }
+    return *this;
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+typename ConcurrentAVLTree<Key, Value, Compare, Alloc>::const_iterator
+ConcurrentAVLTree<Key, Value, Compare, Alloc>::const_iterator::operator++(int)
+{
+    const_iterator old(*this);
+    ++(*this);
+    return old;
+}
+
+/*
+  ---------------------------------------------------------------
+  End implementations for the ConcurrentAVLTree::const_iterator class.
+  ---------------------------------------------------------------
+*/
+
+/*
+  ---------------------------------------------------
+  Begin implementations for the ConcurrentAVLTree class.
+  ---------------------------------------------------
+*/
+
+/**
+* Default constructor.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+ConcurrentAVLTree<Key, Value, Compare, Alloc>::ConcurrentAVLTree(const Compare& comp, const Alloc& alloc) :
+    root_(NULL),
+    version_(0),
+    size_(0),
+    comp_(comp),
+    pool_(sizeof(NodeT), alignof(NodeT), alloc)
+{
+}
+
+/**
+* Destructor. No other thread may be using the tree.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+ConcurrentAVLTree<Key, Value, Compare, Alloc>::~ConcurrentAVLTree()
+{
+    destroySubtree(root_.load());
+    reclaim(true);
+}
+
+/**
+* Inserts the item, replacing the item with the same key if there is one.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+void ConcurrentAVLTree<Key, Value, Compare, Alloc>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    std::lock_guard<std::mutex> lock(writeMutex_);
+    NodeT* parent = NULL;
+    NodeT* current = root_.load(std::memory_order_relaxed);
+    while(current != NULL){
+        KeyOrder order = ThreeWayCompare<Compare>::order(comp_, keyValuePair.first, current->getKey());
+        if(!(order.less | order.greater)){
+            break;
+        }
+        parent = current;
+        current = order.less ? current->getLeft() : current->getRight();
+    }
+    NodeT* node = createNode(keyValuePair, parent);
+
+    beginWrite();
+    if(current != NULL){
+        // the new node takes the old one's place; readers never see an item change
+        node->setLeft(current->getLeft());
+        node->setRight(current->getRight());
+        node->setHeight(current->getHeight());
+        if(node->getLeft() != NULL){
+            node->getLeft()->setParent(node);
+        }
+        if(node->getRight() != NULL){
+            node->getRight()->setParent(node);
+        }
+        replaceChild(parent, current, node);
+    }
+    else {
+        if(parent == NULL){
+            root_.store(node, std::memory_order_release);
+        }
+        else if(comp_(keyValuePair.first, parent->getKey())){
+            parent->setLeft(node);
+        }
+        else {
+            parent->setRight(node);
+        }
+        rebalance(parent);
+    }
+    endWrite();
+
+    if(current != NULL){
+        retire(current);
+    }
+    else {
+        size_.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+/**
+* Removes the item with the given key, if any, and reports whether there
+* was one.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+bool ConcurrentAVLTree<Key, Value, Compare, Alloc>::remove(const Key& key)
+{
+    std::lock_guard<std::mutex> lock(writeMutex_);
+    NodeT* current = root_.load(std::memory_order_relaxed);
+    while(current != NULL){
+        KeyOrder order = ThreeWayCompare<Compare>::order(comp_, key, current->getKey());
+        if(!(order.less | order.greater)){
+            break;
+        }
+        current = order.less ? current->getLeft() : current->getRight();
+    }
+    if(current == NULL){
+        return false;
+    }
+
+    beginWrite();
+    unlinkNode(current);
+    endWrite();
+
+    retire(current);
+    size_.fetch_sub(1, std::memory_order_relaxed);
+    return true;
+}
+
+/**
+* Removes every item. Readers still walking the old tree keep seeing it
+* until they finish.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+void ConcurrentAVLTree<Key, Value, Compare, Alloc>::clear()
+{
+    std::lock_guard<std::mutex> lock(writeMutex_);
+    NodeT* root = root_.load(std::memory_order_relaxed);
+    beginWrite();
+    root_.store(NULL, std::memory_order_release);
+    endWrite();
+    size_.store(0, std::memory_order_relaxed);
+
+    // retire the old nodes in key order
+    std::vector<NodeT*> stack;
+    for(NodeT* node = root; node != NULL || !stack.empty(); ){
+        if(node != NULL){
+            stack.push_back(node);
+            node = node->getLeft();
+        }
+        else {
+            node = stack.back();
+            stack.pop_back();
+            NodeT* right = node->getRight();
+            retire(node);
+            node = right;
+        }
+    }
+}
+
+/**
+* Returns the number of items. With writers running, this is a snapshot.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+std::size_t ConcurrentAVLTree<Key, Value, Compare, Alloc>::size() const
+{
+    return size_.load(std::memory_order_relaxed);
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+bool ConcurrentAVLTree<Key, Value, Compare, Alloc>::empty() const
+{
+    return root_.load(std::memory_order_acquire) == NULL;
+}
+
+/**
+* Returns the height of the tree; an empty tree has height 0. Heights are
+* kept by writers, so this takes the mutex.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+int ConcurrentAVLTree<Key, Value, Compare, Alloc>::height() const
+{
+    std::lock_guard<std::mutex> lock(writeMutex_);
+    return heightOf(root_.load(std::memory_order_relaxed));
+}
+
+/**
+* Returns an iterator to the item with the given key, or end().
+*/
+template<class Key, class Value, class Compare, class Alloc>
+typename ConcurrentAVLTree<Key, Value, Compare, Alloc>::const_iterator
+ConcurrentAVLTree<Key, Value, Compare, Alloc>::find(const Key& key) const
+{
+    EpochGuard guard;
+    std::uint64_t stamp;
+    NodeT* node = optimisticRead([this, &key](std::uint64_t, bool& complete) {
+        return walkFind(key, complete);
+    }, stamp);
+    return makeIterator(node, stamp);
+}
+
+/**
+* Returns true if the key is in the tree.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+bool ConcurrentAVLTree<Key, Value, Compare, Alloc>::contains(const Key& key) const
+{
+    EpochGuard guard;
+    std::uint64_t stamp;
+    return optimisticRead([this, &key](std::uint64_t, bool& complete) {
+        return walkFind(key, complete);
+    }, stamp) != NULL;
+}
+
+/**
+* Copies the value stored under key into value and returns true, or
+* returns false if the key is not in the tree.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+bool ConcurrentAVLTree<Key, Value, Compare, Alloc>::get(const Key& key, Value& value) const
+{
+    EpochGuard guard;
+    std::uint64_t stamp;
+    NodeT* node = optimisticRead([this, &key](std::uint64_t, bool& complete) {
+        return walkFind(key, complete);
+    }, stamp);
+    if(node == NULL){
+        return false;
+    }
+    value = node->getValue();
+    return true;
+}
+
+/**
+* Returns an iterator to the first item whose key is not less than key.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+typename ConcurrentAVLTree<Key, Value, Compare, Alloc>::const_iterator
+ConcurrentAVLTree<Key, Value, Compare, Alloc>::lower_bound(const Key& key) const
+{
+    EpochGuard guard;
+    std::uint64_t stamp;
+    NodeT* node = optimisticRead([this, &key](std::uint64_t, bool& complete) {
+        return walkBound(key, false, complete);
+    }, stamp);
+    return makeIterator(node, stamp);
+}
+
+/**
+* Returns an iterator to the first item whose key is greater than key.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+typename ConcurrentAVLTree<Key, Value, Compare, Alloc>::const_iterator
+ConcurrentAVLTree<Key, Value, Compare, Alloc>::upper_bound(const Key& key) const
+{
+    EpochGuard guard;
+    std::uint64_t stamp;
+    NodeT* node = optimisticRead([this, &key](std::uint64_t, bool& complete) {
+        return walkBound(key, true, complete);
+    }, stamp);
+    return makeIterator(node, stamp);
+}
+
+/**
+* Returns an iterator to the smallest item.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+typename ConcurrentAVLTree<Key, Value, Compare, Alloc>::const_iterator
+ConcurrentAVLTree<Key, Value, Compare, Alloc>::begin() const
+{
+    EpochGuard guard;
+    std::uint64_t stamp;
+    NodeT* node = optimisticRead([this](std::uint64_t, bool& complete) {
+        return walkFirst(complete);
+    }, stamp);
+    return makeIterator(node, stamp);
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+typename ConcurrentAVLTree<Key, Value, Compare, Alloc>::const_iterator
+ConcurrentAVLTree<Key, Value, Compare, Alloc>::end() const
+{
+    return const_iterator();
+}
+
+/**
+* Runs walk(version, complete) until it gets through while the version
+* stays the same even number, and returns its result with that version in
+* stamp. walk sets complete to false if it gave up on a torn tree. After
+* kOptimisticAttempts tries the walk runs once more under the mutex. The
+* caller must have the epoch pinned.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+template<typename Walk>
+typename ConcurrentAVLTree<Key, Value, Compare, Alloc>::NodeT*
+ConcurrentAVLTree<Key, Value, Compare, Alloc>::optimisticRead(Walk walk, std::uint64_t& stamp) const
+{
+    for(int attempt = 0; attempt < kOptimisticAttempts; ++attempt){
+        std::uint64_t version = version_.load(std::memory_order_acquire);
+        if(version & 1){
+            std::this_thread::yield();
+            continue;
+        }
+        bool complete = true;
+        NodeT* result = walk(version, complete);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if(complete && version_.load(std::memory_order_relaxed) == version){
+            stamp = version;
+            return result;
+        }
+    }
+    std::lock_guard<std::mutex> lock(writeMutex_);
+    bool complete = true;
+    stamp = version_.load(std::memory_order_relaxed);
+    return walk(stamp, complete);
+}
+
+/**
+* Returns the node with the given key, or NULL.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+typename ConcurrentAVLTree<Key, Value, Compare, Alloc>::NodeT*
+ConcurrentAVLTree<Key, Value, Compare, Alloc>::walkFind(const Key& key, bool& complete) const
+{
+    NodeT* current = root_.load(std::memory_order_acquire);
+    for(int depth = 0; current != NULL; ++depth){
+        if(depth == kMaxDepth){
+            complete = false;
+            return NULL;
+        }
+        KeyOrder order = ThreeWayCompare<Compare>::order(comp_, key, current->getKey());
+        if(!(order.less | order.greater)){
+            return current;
+        }
+        current = order.less ? current->getLeft() : current->getRight();
+    }
+    return NULL;
+}
+
+/**
+* Returns the node with the smallest key not less than key, or with
+* strict set, greater than key; NULL if there is none.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+typename ConcurrentAVLTree<Key, Value, Compare, Alloc>::NodeT*
+ConcurrentAVLTree<Key, Value, Compare, Alloc>::walkBound(const Key& key, bool strict, bool& complete) const
+{
+    NodeT* bound = NULL;
+    NodeT* current = root_.load(std::memory_order_acquire);
+    for(int depth = 0; current != NULL; ++depth){
+        if(depth == kMaxDepth){
+            complete = false;
+            return NULL;
+        }
+        bool goesLeft = strict ? comp_(key, current->getKey()) : !comp_(current->getKey(), key);
+        if(goesLeft){
+            bound = current;
+            current = current->getLeft();
+        }
+        else {
+            current = current->getRight();
+        }
+    }
+    return bound;
+}
+
+/**
+* Returns the node with the smallest key, or NULL.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+typename ConcurrentAVLTree<Key, Value, Compare, Alloc>::NodeT*
+ConcurrentAVLTree<Key, Value, Compare, Alloc>::walkFirst(bool& complete) const
+{
+    NodeT* current = root_.load(std::memory_order_acquire);
+    if(current == NULL){
+        return NULL;
+    }
+    // each link is loaded once, since a writer may clear it between loads
+    for(int depth = 0; ; ++depth){
+        NodeT* left = current->getLeft();
+        if(left == NULL){
+            return current;
+        }
+        if(depth == kMaxDepth){
+            complete = false;
+            return NULL;
+        }
+        current = left;
+    }
+}
+
+/**
+* Returns the in-order successor of node through the links, or NULL.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+typename ConcurrentAVLTree<Key, Value, Compare, Alloc>::NodeT*
+ConcurrentAVLTree<Key, Value, Compare, Alloc>::walkSuccessor(NodeT* node, bool& complete)
+{
+    NodeT* current = node->getRight();
+    if(current != NULL){
+        for(int depth = 0; ; ++depth){
+            NodeT* left = current->getLeft();
+            if(left == NULL){
+                return current;
+            }
+            if(depth == kMaxDepth){
+                complete = false;
+                return NULL;
+            }
+            current = left;
+        }
+    }
+    current = node;
+    NodeT* parent = current->getParent();
+    for(int depth = 0; parent != NULL && parent->getRight() == current; ++depth){
+        if(depth == kMaxDepth){
+            complete = false;
+            return NULL;
+        }
+        current = parent;
+        parent = current->getParent();
+    }
+    return parent;
+}
+
+/**
+* Wraps a node found at version stamp in an iterator.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+typename ConcurrentAVLTree<Key, Value, Compare, Alloc>::const_iterator
+ConcurrentAVLTree<Key, Value, Compare, Alloc>::makeIterator(NodeT* node, std::uint64_t stamp) const
+{
+    return const_iterator(this, node, stamp);
+}
+
+/**
+* Builds a node for the item from the pool.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+typename ConcurrentAVLTree<Key, Value, Compare, Alloc>::NodeT*
+ConcurrentAVLTree<Key, Value, Compare, Alloc>::createNode(const std::pair<const Key, Value>& keyValuePair, NodeT* parent)
+{
+    void* slot = pool_.allocate();
+    try {
+        return new (slot) NodeT(keyValuePair.first, keyValuePair.second, parent);
+    }
+    catch(...) {
+        pool_.deallocate(slot);
+        throw;
+    }
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+void ConcurrentAVLTree<Key, Value, Compare, Alloc>::destroyNode(NodeT* node)
+{
+    node->~NodeT();
+    pool_.deallocate(node);
+}
+
+/**
+* Marks the start of a relink: readers that overlap it will retry. The
+* fence keeps the relinking stores from being seen before the odd version.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+void ConcurrentAVLTree<Key, Value, Compare, Alloc>::beginWrite()
+{
+    version_.store(version_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+/**
+* Marks the end of a relink.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+void ConcurrentAVLTree<Key, Value, Compare, Alloc>::endWrite()
+{
+    version_.store(version_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+/**
+* Points the link that led to oldChild, from parent or the root, at
+* newChild. newChild's own parent link is left to the caller.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+void ConcurrentAVLTree<Key, Value, Compare, Alloc>::replaceChild(NodeT* parent, NodeT* oldChild, NodeT* newChild)
+{
+    if(parent == NULL){
+        root_.store(newChild, std::memory_order_release);
+    }
+    else if(parent->getLeft() == oldChild){
+        parent->setLeft(newChild);
+    }
+    else {
+        parent->setRight(newChild);
+    }
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+int ConcurrentAVLTree<Key, Value, Compare, Alloc>::heightOf(NodeT* node)
+{
+    return (node == NULL) ? 0 : node->getHeight();
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+void ConcurrentAVLTree<Key, Value, Compare, Alloc>::updateHeight(NodeT* node)
+{
+    node->setHeight(1 + std::max(heightOf(node->getLeft()), heightOf(node->getRight())));
+}
+
+/**
+* Rotates node's right child up into node's place and returns it. The
+* links are written so that every node stays reachable from the root
+* along one path at a time; a reader never walks into a cycle.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+typename ConcurrentAVLTree<Key, Value, Compare, Alloc>::NodeT*
+ConcurrentAVLTree<Key, Value, Compare, Alloc>::rotateLeft(NodeT* node)
+{
+    NodeT* parent = node->getParent();
+    NodeT* child = node->getRight();
+    NodeT* inner = child->getLeft();
+    node->setRight(inner);
+    if(inner != NULL){
+        inner->setParent(node);
+    }
+    child->setLeft(node);
+    child->setParent(parent);
+    replaceChild(parent, node, child);
+    node->setParent(child);
+    updateHeight(node);
+    updateHeight(child);
+    return child;
+}
+
+/**
+* Mirror image of rotateLeft().
+*/
+template<class Key, class Value, class Compare, class Alloc>
+typename ConcurrentAVLTree<Key, Value, Compare, Alloc>::NodeT*
+ConcurrentAVLTree<Key, Value, Compare, Alloc>::rotateRight(NodeT* node)
+{
+    NodeT* parent = node->getParent();
+    NodeT* child = node->getLeft();
+    NodeT* inner = child->getRight();
+    node->setLeft(inner);
+    if(inner != NULL){
+        inner->setParent(node);
+    }
+    child->setRight(node);
+    child->setParent(parent);
+    replaceChild(parent, node, child);
+    node->setParent(child);
+    updateHeight(node);
+    updateHeight(child);
+    return child;
+}
+
+/**
+* Walks up from node, whose subtree just gained or lost a level, fixing
+* heights and rotating where the children differ by two. Stops at the
+* first subtree whose height came out unchanged, since nothing above it
+* can have changed either.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+void ConcurrentAVLTree<Key, Value, Compare, Alloc>::rebalance(NodeT* node)
+{
+    while(node != NULL){
+        int oldHeight = node->getHeight();
+        int balance = heightOf(node->getRight()) - heightOf(node->getLeft());
+        if(balance > 1){
+            NodeT* right = node->getRight();
+            if(heightOf(right->getLeft()) > heightOf(right->getRight())){
+                rotateRight(right);
+            }
+            node = rotateLeft(node);
+        }
+        else if(balance < -1){
+            NodeT* left = node->getLeft();
+            if(heightOf(left->getRight()) > heightOf(left->getLeft())){
+                rotateLeft(left);
+            }
+            node = rotateRight(node);
+        }
+        else {
+            updateHeight(node);
+        }
+        if(node->getHeight() == oldHeight){
+            return;
+        }
+        node = node->getParent();
+    }
+}
+
+/**
+* Takes node out of the tree and rebalances. A node with two children is
+* replaced by its successor, which is first cut out of its own spot and
+* then linked into node's, so the successor is never reachable twice.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+void ConcurrentAVLTree<Key, Value, Compare, Alloc>::unlinkNode(NodeT* node)
+{
+    NodeT* parent = node->getParent();
+    NodeT* left = node->getLeft();
+    NodeT* right = node->getRight();
+    if(left == NULL || right == NULL){
+        NodeT* child = (left != NULL) ? left : right;
+        replaceChild(parent, node, child);
+        if(child != NULL){
+            child->setParent(parent);
+        }
+        rebalance(parent);
+        return;
+    }
+
+    NodeT* successor = right;
+    while(successor->getLeft() != NULL){
+        successor = successor->getLeft();
+    }
+    NodeT* successorParent = successor->getParent();
+    NodeT* successorRight = successor->getRight();
+    replaceChild(successorParent, successor, successorRight);
+    if(successorRight != NULL){
+        successorRight->setParent(successorParent);
+    }
+
+    successor->setLeft(node->getLeft());
+    successor->setRight(node->getRight());
+    successor->setHeight(node->getHeight());
+    successor->getLeft()->setParent(successor);
+    if(successor->getRight() != NULL){
+        successor->getRight()->setParent(successor);
+    }
+    successor->setParent(parent);
+    replaceChild(parent, node, successor);
+    rebalance(successorParent == node ? successor : successorParent);
+}
+
+/**
+* Queues an unlinked node to be freed once no reader can reach it, and
+* frees what has become safe every kReclaimBatch retirements.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+void ConcurrentAVLTree<Key, Value, Compare, Alloc>::retire(NodeT* node)
+{
+    retired_.push_back(std::make_pair(node, EpochDomain::epoch()));
+    if(retired_.size() % kReclaimBatch == 0){
+        reclaim(false);
+    }
+}
+
+/**
+* Frees retired nodes that no reader can reach any more, or all of them if
+* force is set.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+void ConcurrentAVLTree<Key, Value, Compare, Alloc>::reclaim(bool force)
+{
+    if(!force){
+        EpochDomain::tryAdvance();
+    }
+    while(!retired_.empty() && (force || EpochDomain::reclaimable(retired_.front().second))){
+        destroyNode(retired_.front().first);
+        retired_.pop_front();
+    }
+}
+
+/**
+* Destroys every node under node.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+void ConcurrentAVLTree<Key, Value, Compare, Alloc>::destroySubtree(NodeT* node)
+{
+    while(node != NULL){
+        destroySubtree(node->getLeft());
+        NodeT* right = node->getRight();
+        destroyNode(node);
+        node = right;
+    }
+}
+
+/*
+  -------------------------------------------------
+  End implementations for the ConcurrentAVLTree class.
+  -------------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,262 @@
+#ifndef EPOCH_H
+#define EPOCH_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+/**
+* Epoch-based reclamation for data structures whose readers run without
+* locks.
+*
+* A reader pins the current epoch for as long as it may hold pointers into
+* the structure. A writer that unlinks a node does not free it right away
+* but retires it, tagged with the epoch of the moment it was unlinked. The
+* global epoch only moves forward once every pinned thread has seen the
+* current one, so once it is two steps past a node's tag no reader can
+* still reach that node and it may be freed.
+*
+* There is one domain per process. Each thread gets a record on its first
+* pin; records are recycled when their thread exits and are never freed.
+* Pins nest, so a thread that already holds one may pin again.
+*/
+class EpochDomain
+{
+public:
+    static void pin();
+    static void unpin();
+    static std::uint64_t epoch();
+    static bool tryAdvance();
+
+    // An item retired at epoch tag may be freed once this returns true.
+    static bool reclaimable(std::uint64_t tag);
+
+private:
+    // One per thread: the epoch it pinned (0 when not pinned) and how deep.
+    struct Record
+    {
+        std::atomic<std::uint64_t> active;
+        std::atomic<bool> taken;
+        unsigned depth;
+        Record* next;
+    };
+
+    // Returns this thread's record when the thread exits.
+    struct LocalRecord
+    {
+        Record* record;
+        LocalRecord();
+        ~LocalRecord();
+    };
+
+    static std::atomic<std::uint64_t>& globalEpoch();
+    static std::atomic<Record*>& records();
+    static Record* localRecord();
+    static Record* acquireRecord();
+};
+
+/**
+* Keeps the calling thread pinned for its lifetime. A guard built with
+* active = false pins nothing, which end iterators use. Copies pin again,
+* on the copying thread, so a guard must stay on the thread it was made on.
+*/
+class EpochGuard
+{
+public:
+    explicit EpochGuard(bool active = true);
+    EpochGuard(const EpochGuard& other);
+    EpochGuard& operator=(const EpochGuard& other);
+    ~EpochGuard();
+
+private:
+    bool active_;
+};
+
+/*
+  -------------------------------------------
+  Begin implementations for the EpochDomain class.
+  -------------------------------------------
+*/
+
+/**
+* Pins the current epoch on the calling thread, or deepens its pin.
+* The epoch is announced and then read again until the two agree, so an
+* advance that missed the announcement is seen here.
+*/
+inline void EpochDomain::pin()
+{
+    Record* record = localRecord();
+    if(record->depth++ != 0){
+        return;
+    }
+    std::uint64_t epoch = globalEpoch().load();
+    for(;;){
+        record->active.store(epoch);
+        std::uint64_t now = globalEpoch().load();
+        if(now == epoch){
+            break;
+        }
+        epoch = now;
+    }
+}
+
+/**
+* Drops one level of the calling thread's pin.
+*/
+inline void EpochDomain::unpin()
+{
+    Record* record = localRecord();
+    if(--record->depth == 0){
+        record->active.store(0, std::memory_order_release);
+    }
+}
+
+/**
+* Returns the current global epoch, which starts at 1.
+*/
+inline std::uint64_t EpochDomain::epoch()
+{
+    return globalEpoch().load();
+}
+
+/**
+* Moves the global epoch forward by one if every pinned thread has
+* announced the current epoch, and reports whether it did. Costs one step
+* per thread that ever pinned.
+*/
+inline bool EpochDomain::tryAdvance()
+{
+    std::uint64_t epoch = globalEpoch().load();
+    for(Record* record = records().load(); record != NULL; record = record->next){
+        std::uint64_t active = record->active.load();
+        if(active != 0 && active != epoch){
+            return false;
+        }
+    }
+    globalEpoch().compare_exchange_strong(epoch, epoch + 1);
+    return true;
+}
+
+/**
+* Returns true once an item retired at epoch tag can no longer be reached
+* by any pinned reader.
+*/
+inline bool EpochDomain::reclaimable(std::uint64_t tag)
+{
+    return globalEpoch().load() >= tag + 2;
+}
+
+inline std::atomic<std::uint64_t>& EpochDomain::globalEpoch()
+{
+    static std::atomic<std::uint64_t> epoch(1);
+    return epoch;
+}
+
+inline std::atomic<EpochDomain::Record*>& EpochDomain::records()
+{
+    static std::atomic<Record*> head(NULL);
+    return head;
+}
+
+inline EpochDomain::LocalRecord::LocalRecord() :
+    record(NULL)
+{
+}
+
+inline EpochDomain::LocalRecord::~LocalRecord()
+{
+    if(record != NULL){
+        record->taken.store(false, std::memory_order_release);
+    }
+}
+
+/**
+* Returns the calling thread's record, claiming one on first use.
+*/
+inline EpochDomain::Record* EpochDomain::localRecord()
+{
+    static thread_local LocalRecord local;
+    if(local.record == NULL){
+        local.record = acquireRecord();
+    }
+    return local.record;
+}
+
+/**
+* Claims a record left behind by an exited thread, or pushes a new one
+* onto the list.
+*/
+inline EpochDomain::Record* EpochDomain::acquireRecord()
+{
+    for(Record* record = records().load(); record != NULL; record = record->next){
+        bool expected = false;
+        if(!record->taken.load(std::memory_order_relaxed) &&
+           record->taken.compare_exchange_strong(expected, true)){
+            record->depth = 0;
+            return record;
+        }
+    }
+    Record* record = new Record;
+    record->active.store(0, std::memory_order_relaxed);
+    record->taken.store(true, std::memory_order_relaxed);
+    record->depth = 0;
+    record->next = records().load();
+    while(!records().compare_exchange_weak(record->next, record)){
+    }
+    return record;
+}
+
+/*
+  -----------------------------------------
+  End implementations for the EpochDomain class.
+  -----------------------------------------
+*/
+
+/*
+  -------------------------------------------
+  Begin implementations for the EpochGuard class.
+  -------------------------------------------
+*/
+
+inline EpochGuard::EpochGuard(bool active) :
+    active_(active)
+{
+    if(active_){
+        EpochDomain::pin();
+    }
+}
+
+inline EpochGuard::EpochGuard(const EpochGuard& other) :
+    active_(other.active_)
+{
+    if(active_){
+        EpochDomain::pin();
+    }
+}
+
+inline EpochGuard& EpochGuard::operator=(const EpochGuard& other)
+{
+    if(other.active_ && !active_){
+        EpochDomain::pin();
+    }
+    else if(!other.active_ && active_){
+        EpochDomain::unpin();
+    }
+    active_ = other.active_;
+    return *this;
+}
+
+inline EpochGuard::~EpochGuard()
+{
+    if(active_){
+        EpochDomain::unpin();
+    }
+}
+
+/*
+  -----------------------------------------
+  End implementations for the EpochGuard class.
+  -----------------------------------------
+*/
+
+#endif
@@ -0,0 +1,261 @@
+#include <iostream>
+#include <cstdlib>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#include "avlbst.h"
+#include "frozen_bst.h"
+
+using namespace std;
+
+// Checked test for the implicit layouts in frozen_bst.h and the
+// FrozenTree built on them. For trees of 0 to 8 items and around powers
+// of two (2^k - 1, 2^k and 2^k + 1), EytzingerLayout's begin(), next(),
+// prev() and lowerBound() must follow the in-order walk of the heap
+// numbering, and VanEmdeBoasLayout must put every rank in the slot a
+// plain recursive van Emde Boas layout gives it and find lower bounds
+// without reading the slots past the last item. Frozen copies made with
+// both layouts must then answer find(), lower_bound(), upper_bound() and
+// operator[] like a std::map for keys in the tree, between them and past
+// both ends, and iterate forward and backward in the same order. It exits
+// with status 1 if any check fails.
+
+static int failures = 0;
+
+static void check(bool ok, const string& what)
+{
+    if(!ok && ++failures <= 20) {
+        cerr << "FAIL " << what << endl;
+    }
+}
+
+static vector<size_t> testSizes()
+{
+    vector<size_t> sizes;
+    for(size_t n = 0; n <= 8; ++n) {
+        sizes.push_back(n);
+    }
+    const size_t more[] = { 15, 16, 17, 31, 33, 1000, 4097 };
+    sizes.insert(sizes.end(), more, more + sizeof(more) / sizeof(more[0]));
+    return sizes;
+}
+
+// Heap numbers 1..count in in-order, the order EytzingerLayout's cursors
+// must visit
+static void heapInOrder(size_t node, size_t count, vector<size_t>& order)
+{
+    if(node > count) {
+        return;
+    }
+    heapInOrder(2 * node, count, order);
+    order.push_back(node);
+    heapInOrder(2 * node + 1, count, order);
+}
+
+// Where the van Emde Boas layout puts each node of a perfect tree, by
+// breadth-first number: the subtree rooted at node spanning depths
+// [top, bottom) is cut with the taller half on top, the top tree is laid
+// out first and then each bottom tree from left to right.
+static void vebPositions(size_t node, int top, int bottom, size_t& next, vector<size_t>& positions)
+{
+    if(bottom - top == 1) {
+        positions[node] = next++;
+        return;
+    }
+    int cut = top + (bottom - top + 1) / 2;
+    vebPositions(node, top, cut, next, positions);
+    size_t first = node << (cut - top);
+    for(size_t i = 0; i < (static_cast<size_t>(1) << (cut - top)); ++i) {
+        vebPositions(first + i, cut, bottom, next, positions);
+    }
+}
+
+// The keys of a layout of count items, 2 * rank by slot, with the unused
+// slots set to a key that would steer any search that read it wrong
+static vector<long> layoutKeys(size_t slots, const vector<size_t>& slotOfRank)
+{
+    vector<long> keys(slots, -1000000);
+    for(size_t rank = 0; rank < slotOfRank.size(); ++rank) {
+        keys[slotOfRank[rank]] = 2 * static_cast<long>(rank);
+    }
+    return keys;
+}
+
+// lowerBound() must give the cursor of the first rank whose key is not
+// less than the one searched for, for every key in and around the tree
+template<typename Layout>
+static void checkLowerBound(const Layout& layout, const vector<size_t>& cursorOfRank, const vector<long>& keys,
+                            const string& where)
+{
+    size_t count = cursorOfRank.size();
+    bool ok = true;
+    for(long key = -2; key <= 2 * static_cast<long>(count) + 1; ++key) {
+        size_t want = key <= 0 ? 0 : static_cast<size_t>((key + 1) / 2);
+        size_t wantCursor = want < count ? cursorOfRank[want] : layout.end();
+        const long* data = keys.empty() ? NULL : keys.data();
+        size_t got = layout.lowerBound(data, [data, key](size_t slot) { return data[slot] < key; });
+        ok = ok && got == wantCursor;
+    }
+    check(ok, where + ": lowerBound() differs");
+}
+
+static void testEytzinger(size_t n)
+{
+    string where = "EytzingerLayout of " + to_string(n);
+    EytzingerLayout layout;
+    layout.build(n);
+    check(layout.slots() == n, where + ": wrong slot count");
+
+    vector<size_t> order;
+    heapInOrder(1, n, order);
+    // forward from begin(), then back from end()
+    bool forward = true;
+    size_t cursor = layout.begin();
+    for(size_t i = 0; i < n; ++i, cursor = layout.next(cursor)) {
+        forward = forward && cursor == order[i] && layout.slot(cursor) == order[i] - 1;
+    }
+    check(forward && cursor == layout.end(), where + ": next() walk differs");
+    bool backward = true;
+    cursor = layout.end();
+    for(size_t i = n; i > 0; --i) {
+        cursor = layout.prev(cursor);
+        backward = backward && cursor == order[i - 1];
+    }
+    check(backward, where + ": prev() walk differs");
+
+    vector<size_t> slotOfRank;
+    for(size_t i = 0; i < n; ++i) {
+        slotOfRank.push_back(order[i] - 1);
+    }
+    checkLowerBound(layout, order, layoutKeys(n, slotOfRank), where);
+}
+
+static void testVanEmdeBoas(size_t n)
+{
+    string where = "VanEmdeBoasLayout of " + to_string(n);
+    VanEmdeBoasLayout layout;
+    layout.build(n);
+    int height = 0;
+    while((static_cast<size_t>(1) << height) - 1 < n) {
+        ++height;
+    }
+    size_t slots = (static_cast<size_t>(1) << height) - 1;
+    check(layout.slots() == slots, where + ": wrong slot count");
+
+    // in-order ranks of the perfect tree, and their slots worked out the
+    // slow way
+    vector<size_t> order;
+    heapInOrder(1, slots, order);
+    vector<size_t> positions(slots + 1);
+    size_t next = 0;
+    if(height > 0) {
+        vebPositions(1, 0, height, next, positions);
+    }
+
+    bool slotsOk = true;
+    vector<size_t> slotOfRank;
+    vector<size_t> cursorOfRank;
+    size_t cursor = layout.begin();
+    for(size_t rank = 0; rank < n; ++rank, cursor = layout.next(cursor)) {
+        slotsOk = slotsOk && cursor == rank && layout.slot(cursor) == positions[order[rank]]
+                          && layout.prev(layout.next(cursor)) == cursor;
+        slotOfRank.push_back(layout.slot(cursor));
+        cursorOfRank.push_back(cursor);
+    }
+    check(slotsOk, where + ": slot() differs from the recursive layout");
+    check(cursor == layout.end(), where + ": walk does not end at end()");
+    checkLowerBound(layout, cursorOfRank, layoutKeys(slots, slotOfRank), where);
+}
+
+template<typename Frozen>
+static void checkFrozen(const Frozen& frozen, const map<long, long>& expected, const string& where)
+{
+    check(frozen.size() == expected.size() && frozen.empty() == expected.empty(), where + ": wrong size");
+
+    bool forward = true;
+    typename Frozen::const_iterator it = frozen.begin();
+    for(map<long, long>::const_iterator want = expected.begin(); want != expected.end(); ++want, ++it) {
+        forward = forward && it != frozen.end() && it->first == want->first && it->second == want->second;
+    }
+    check(forward && it == frozen.end(), where + ": forward iteration differs");
+    bool backward = true;
+    it = frozen.end();
+    for(map<long, long>::const_reverse_iterator want = expected.rbegin(); want != expected.rend(); ++want) {
+        --it;
+        backward = backward && it->first == want->first && (*it).second == want->second;
+    }
+    check(backward && it == frozen.begin(), where + ": backward iteration differs");
+
+    // every key in the tree, between keys and past both ends
+    long last = expected.empty() ? 0 : expected.rbegin()->first;
+    bool findOk = true;
+    bool lowerOk = true;
+    bool upperOk = true;
+    bool indexOk = true;
+    for(long key = -3; key <= last + 3; ++key) {
+        map<long, long>::const_iterator want = expected.find(key);
+        typename Frozen::const_iterator got = frozen.find(key);
+        findOk = findOk && (want == expected.end() ? got == frozen.end() : got != frozen.end() && got->second == want->second);
+
+        want = expected.lower_bound(key);
+        got = frozen.lower_bound(key);
+        lowerOk = lowerOk && (want == expected.end() ? got == frozen.end() : got != frozen.end() && got->first == want->first);
+
+        want = expected.upper_bound(key);
+        got = frozen.upper_bound(key);
+        upperOk = upperOk && (want == expected.end() ? got == frozen.end() : got != frozen.end() && got->first == want->first);
+
+        bool threw = false;
+        long value = 0;
+        try {
+            value = frozen[key];
+        }
+        catch(const out_of_range&) {
+            threw = true;
+        }
+        indexOk = indexOk && (expected.count(key) ? !threw && value == expected.at(key) : threw);
+    }
+    check(findOk, where + ": find() differs");
+    check(lowerOk, where + ": lower_bound() differs");
+    check(upperOk, where + ": upper_bound() differs");
+    check(indexOk, where + ": operator[] differs");
+}
+
+static void testFrozen(size_t n)
+{
+    // odd keys, so every even key falls between two of them
+    AVLTree<long, long> tree;
+    map<long, long> expected;
+    for(size_t i = 0; i < n; ++i) {
+        long key = 2 * static_cast<long>(i) + 1;
+        tree.insert(make_pair(key, key * 10));
+        expected[key] = key * 10;
+    }
+    string of = " of " + to_string(n);
+    checkFrozen(tree.freeze<EytzingerLayout>(), expected, "Eytzinger FrozenTree" + of);
+    checkFrozen(tree.freeze<VanEmdeBoasLayout>(), expected, "van Emde Boas FrozenTree" + of);
+
+    // built straight from a std::map, and moved
+    FrozenTree<long, long, std::less<long>, std::allocator<std::pair<const long, long> >, VanEmdeBoasLayout>
+        built(expected.begin(), expected.end(), expected.size());
+    FrozenTree<long, long, std::less<long>, std::allocator<std::pair<const long, long> >, VanEmdeBoasLayout>
+        moved(std::move(built));
+    checkFrozen(moved, expected, "moved van Emde Boas FrozenTree" + of);
+    checkFrozen(built, map<long, long>(), "moved-from van Emde Boas FrozenTree" + of);
+}
+
+int main(int argc, char *argv[])
+{
+    vector<size_t> sizes = testSizes();
+    for(size_t i = 0; i < sizes.size(); ++i) {
+        testEytzinger(sizes[i]);
+        testVanEmdeBoas(sizes[i]);
+        testFrozen(sizes[i]);
+    }
+
+    cout << (failures == 0 ? "All frozen tree checks passed" : "Frozen tree checks FAILED")
+         << " (" << failures << " failures)" << endl;
+    return failures == 0 ? 0 : 1;
+}
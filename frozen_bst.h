@@ -0,0 +1,755 @@
+#ifndef FROZEN_BST_H
+#define FROZEN_BST_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <utility>
+
+/**
+* Helpers for the implicit layouts below: trailing zero count and a
+* prefetch hint, using the compiler builtins where there are any.
+*/
+inline unsigned frozenTrailingZeros(std::size_t x)
+{
+#if defined(__GNUC__)
+    return static_cast<unsigned>(__builtin_ctzll(static_cast<unsigned long long>(x)));
+#else
+    unsigned count = 0;
+    for(; (x & 1) == 0; x >>= 1){
+        ++count;
+    }
+    return count;
+#endif
+}
+
+inline void frozenPrefetch(const void* address)
+{
+#if defined(__GNUC__)
+    __builtin_prefetch(address);
+#else
+    (void)address;
+#endif
+}
+
+/**
+* The Eytzinger (breadth-first) layout: the root is in slot 0 and the
+* children of the node numbered k (counting from 1) are 2k and 2k + 1, so
+* the first levels of the tree share a few cache lines and a search can
+* prefetch the 16 great-great-grandchildren of the node it is at, which
+* sit next to each other. Takes exactly one slot per item.
+*
+* A cursor is a node number, with 0 past the end.
+*/
+class EytzingerLayout
+{
+public:
+    EytzingerLayout();
+
+    void build(std::size_t count);
+    std::size_t slots() const;
+
+    std::size_t begin() const;
+    std::size_t end() const;
+    std::size_t next(std::size_t cursor) const;
+    std::size_t prev(std::size_t cursor) const;
+    std::size_t slot(std::size_t cursor) const;
+
+    // First cursor whose slot goRight rejects; goRight(slot) means the
+    // item in slot orders before the one searched for.
+    template<typename Key, typename GoRight>
+    std::size_t lowerBound(const Key* keys, GoRight goRight) const;
+
+private:
+    std::size_t count_;
+};
+
+/**
+* The van Emde Boas layout: the tree is cut at half its height, the top
+* half is laid out recursively and then each bottom tree after it, so any
+* root-to-leaf walk touches O(log_B n) blocks for every block size B at
+* once. Navigation uses per-depth tables (Brodal, Fagerberg and Jacob):
+* the top tree a depth belongs to starts at the position of an ancestor
+* already visited, which keeps the search pointer-free.
+*
+* The tree is completed to a perfect one, whose missing items (the last
+* in key order) take slots that are never constructed, so up to twice the
+* slots are allocated. A cursor is a rank in key order.
+*/
+class VanEmdeBoasLayout
+{
+public:
+    VanEmdeBoasLayout();
+
+    void build(std::size_t count);
+    std::size_t slots() const;
+
+    std::size_t begin() const;
+    std::size_t end() const;
+    std::size_t next(std::size_t cursor) const;
+    std::size_t prev(std::size_t cursor) const;
+    std::size_t slot(std::size_t cursor) const;
+
+    template<typename Key, typename GoRight>
+    std::size_t lowerBound(const Key* keys, GoRight goRight) const;
+
+private:
+    static const int kMaxHeight = 64;
+
+    void split(int top, int bottom);
+    std::size_t position(std::size_t node, int depth) const;
+    std::size_t rankOf(std::size_t node, int depth) const;
+
+    std::size_t count_;
+    int height_;
+    // per depth: where the top tree holding that depth's bottom trees is
+    // rooted, and the sizes of that top tree and of those bottom trees
+    int topDepth_[kMaxHeight];
+    std::size_t topSize_[kMaxHeight];
+    std::size_t bottomSize_[kMaxHeight];
+};
+
+/**
+* A read-only, pointer-free copy of a search tree, made by
+* BinarySearchTree::freeze(). Keys and values sit in two arrays ordered
+* by Layout, so a search reads nothing but keys and a tree of n items
+* takes n keys and n values (up to twice that with VanEmdeBoasLayout).
+*
+* Iterators are bidirectional and yield pairs of references to the key
+* and value, so it->first and it->second read as with the linked trees.
+*/
+template <typename Key, typename Value,
+          typename Compare = std::less<Key>,
+          typename Alloc = std::allocator<std::pair<const Key, Value> >,
+          typename Layout = EytzingerLayout>
+class FrozenTree
+{
+public:
+    typedef Compare key_compare;
+    typedef Alloc allocator_type;
+    typedef std::pair<const Key&, const Value&> reference;
+
+    template<typename InputIt>
+    FrozenTree(InputIt first, InputIt last, std::size_t count,
+               const Compare& comp = Compare(), const Alloc& alloc = Alloc());
+    FrozenTree(FrozenTree&& other);
+    ~FrozenTree();
+
+    std::size_t size() const;
+    bool empty() const;
+    std::size_t memoryUsage() const;
+
+    /**
+    * A bidirectional iterator over the items in key order.
+    */
+    class const_iterator
+    {
+    public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef std::pair<const Key, Value> value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef std::pair<const Key&, const Value&> reference;
+
+        // What operator-> points into
+        struct pointer
+        {
+            reference item;
+            const reference* operator->() const { return &item; }
+        };
+
+        const_iterator();
+
+        reference operator*() const;
+        pointer operator->() const;
+
+        bool operator==(const const_iterator& rhs) const;
+        bool operator!=(const const_iterator& rhs) const;
+
+        const_iterator& operator++();
+        const_iterator operator++(int);
+        const_iterator& operator--();
+        const_iterator operator--(int);
+
+    protected:
+        friend class FrozenTree<Key, Value, Compare, Alloc, Layout>;
+        const_iterator(std::size_t cursor, const FrozenTree<Key, Value, Compare, Alloc, Layout>* tree);
+        std::size_t cursor_;
+        const FrozenTree<Key, Value, Compare, Alloc, Layout>* tree_;
+    };
+
+    const_iterator begin() const;
+    const_iterator end() const;
+    const_iterator find(const Key& key) const;
+    const_iterator lower_bound(const Key& key) const;
+    const_iterator upper_bound(const Key& key) const;
+    Value const & operator[](const Key& key) const;
+    key_compare key_comp() const;
+
+protected:
+    typedef typename std::allocator_traits<Alloc>::template rebind_alloc<Key> KeyAlloc;
+    typedef typename std::allocator_traits<Alloc>::template rebind_alloc<Value> ValueAlloc;
+    typedef std::allocator_traits<KeyAlloc> KeyTraits;
+    typedef std::allocator_traits<ValueAlloc> ValueTraits;
+
+    // Frozen trees own their arrays and cannot be copied.
+    FrozenTree(const FrozenTree&);
+    FrozenTree& operator=(const FrozenTree&);
+
+    void destroyItems(std::size_t count);
+
+    Layout layout_;
+    std::size_t size_;
+    Compare comp_;
+    KeyAlloc keyAlloc_;
+    ValueAlloc valueAlloc_;
+    Key* keys_;
+    Value* values_;
+};
+
+/*
+  ---------------------------------------------------
+  Begin implementations for the EytzingerLayout class.
+  ---------------------------------------------------
+*/
+
+inline EytzingerLayout::EytzingerLayout() :
+    count_(0)
+{
+}
+
+inline void EytzingerLayout::build(std::size_t count)
+{
+    count_ = count;
+}
+
+inline std::size_t EytzingerLayout::slots() const
+{
+    return count_;
+}
+
+/**
+* Returns the leftmost node, the smallest item.
+*/
+inline std::size_t EytzingerLayout::begin() const
+{
+    if(count_ == 0){
+        return 0;
+    }
+    std::size_t node = 1;
+    while(2 * node <= count_){
+        node *= 2;
+    }
+    return node;
+}
+
+inline std::size_t EytzingerLayout::end() const
+{
+    return 0;
+}
+
+/**
+* Returns the in-order successor: the leftmost node of the right subtree,
+* or else the parent of the nearest ancestor reached from the left.
+*/
+inline std::size_t EytzingerLayout::next(std::size_t cursor) const
+{
+    if(2 * cursor + 1 <= count_){
+        cursor = 2 * cursor + 1;
+        while(2 * cursor <= count_){
+            cursor *= 2;
+        }
+        return cursor;
+    }
+    return cursor >> (frozenTrailingZeros(~cursor) + 1);
+}
+
+/**
+* Returns the in-order predecessor; from end() that is the rightmost node.
+*/
+inline std::size_t EytzingerLayout::prev(std::size_t cursor) const
+{
+    if(cursor == 0){
+        cursor = 1;
+        while(2 * cursor + 1 <= count_){
+            cursor = 2 * cursor + 1;
+        }
+        return cursor;
+    }
+    if(2 * cursor <= count_){
+        cursor = 2 * cursor;
+        while(2 * cursor + 1 <= count_){
+            cursor = 2 * cursor + 1;
+        }
+        return cursor;
+    }
+    return cursor >> (frozenTrailingZeros(cursor) + 1);
+}
+
+inline std::size_t EytzingerLayout::slot(std::size_t cursor) const
+{
+    return cursor - 1;
+}
+
+/**
+* Walks down without branching on the comparison, prefetching four levels
+* ahead, then backs up to the last node where the walk turned left.
+*/
+template<typename Key, typename GoRight>
+std::size_t EytzingerLayout::lowerBound(const Key* keys, GoRight goRight) const
+{
+    std::size_t node = 1;
+    while(node <= count_){
+        const char* block = reinterpret_cast<const char*>(keys + 16 * node - 1);
+        for(std::size_t offset = 0; offset < 16 * sizeof(Key); offset += 64){
+            frozenPrefetch(block + offset);
+        }
+        node = 2 * node + (goRight(node - 1) ? 1 : 0);
+    }
+    return node >> (frozenTrailingZeros(~node) + 1);
+}
+
+/*
+  -------------------------------------------------
+  End implementations for the EytzingerLayout class.
+  -------------------------------------------------
+*/
+
+/*
+  -----------------------------------------------------
+  Begin implementations for the VanEmdeBoasLayout class.
+  -----------------------------------------------------
+*/
+
+inline VanEmdeBoasLayout::VanEmdeBoasLayout() :
+    count_(0),
+    height_(0)
+{
+}
+
+/**
+* Sizes the perfect tree for count items and fills the per-depth tables.
+*/
+inline void VanEmdeBoasLayout::build(std::size_t count)
+{
+    count_ = count;
+    height_ = 0;
+    while((static_cast<std::size_t>(1) << height_) - 1 < count){
+        ++height_;
+    }
+    split(0, height_);
+}
+
+inline std::size_t VanEmdeBoasLayout::slots() const
+{
+    return (static_cast<std::size_t>(1) << height_) - 1;
+}
+
+inline std::size_t VanEmdeBoasLayout::begin() const
+{
+    return 0;
+}
+
+inline std::size_t VanEmdeBoasLayout::end() const
+{
+    return count_;
+}
+
+inline std::size_t VanEmdeBoasLayout::next(std::size_t cursor) const
+{
+    return cursor + 1;
+}
+
+inline std::size_t VanEmdeBoasLayout::prev(std::size_t cursor) const
+{
+    return cursor - 1;
+}
+
+/**
+* Returns the slot of the item of the given rank: the rank gives the
+* node's depth and number in the perfect tree, and the tables its slot.
+* Costs O(log log n).
+*/
+inline std::size_t VanEmdeBoasLayout::slot(std::size_t cursor) const
+{
+    unsigned zeros = frozenTrailingZeros(cursor + 1);
+    int depth = height_ - 1 - static_cast<int>(zeros);
+    std::size_t node = ((cursor + 1) >> (zeros + 1)) + (static_cast<std::size_t>(1) << depth);
+    return position(node, depth);
+}
+
+/**
+* Walks down the perfect tree keeping the slot of every node on the path,
+* so each step's slot comes from an ancestor's in O(1). Slots past the
+* last item count as larger than any key.
+*/
+template<typename Key, typename GoRight>
+std::size_t VanEmdeBoasLayout::lowerBound(const Key* keys, GoRight goRight) const
+{
+    (void)keys;
+    std::size_t path[kMaxHeight];
+    std::size_t node = 1;
+    for(int depth = 0; depth < height_; ++depth){
+        std::size_t slot = 0;
+        if(depth > 0){
+            slot = path[topDepth_[depth]] + topSize_[depth] + (node & topSize_[depth]) * bottomSize_[depth];
+        }
+        path[depth] = slot;
+        bool right = rankOf(node, depth) < count_ && goRight(slot);
+        node = 2 * node + (right ? 1 : 0);
+    }
+    unsigned shift = frozenTrailingZeros(~node) + 1;
+    node >>= shift;
+    if(node == 0){
+        return count_;
+    }
+    return rankOf(node, height_ - static_cast<int>(shift));
+}
+
+/**
+* Fills the tables for the subtree spanning depths [top, bottom): the cut
+* goes at half its height, rounded so the top half is the taller.
+*/
+inline void VanEmdeBoasLayout::split(int top, int bottom)
+{
+    if(bottom - top <= 1){
+        return;
+    }
+    int cut = top + (bottom - top + 1) / 2;
+    topDepth_[cut] = top;
+    topSize_[cut] = (static_cast<std::size_t>(1) << (cut - top)) - 1;
+    bottomSize_[cut] = (static_cast<std::size_t>(1) << (bottom - cut)) - 1;
+    split(top, cut);
+    split(cut, bottom);
+}
+
+/**
+* Returns the slot of the node with breadth-first number node at depth.
+*/
+inline std::size_t VanEmdeBoasLayout::position(std::size_t node, int depth) const
+{
+    if(depth == 0){
+        return 0;
+    }
+    int top = topDepth_[depth];
+    return position(node >> (depth - top), top) + topSize_[depth] + (node & topSize_[depth]) * bottomSize_[depth];
+}
+
+/**
+* Returns the in-order rank of the node with breadth-first number node.
+*/
+inline std::size_t VanEmdeBoasLayout::rankOf(std::size_t node, int depth) const
+{
+    std::size_t offset = node - (static_cast<std::size_t>(1) << depth);
+    return ((2 * offset + 1) << (height_ - 1 - depth)) - 1;
+}
+
+/*
+  ---------------------------------------------------
+  End implementations for the VanEmdeBoasLayout class.
+  ---------------------------------------------------
+*/
+
+/*
+  ------------------------------------------------------------
+  Begin implementations for the FrozenTree::const_iterator class.
+  ------------------------------------------------------------
+*/
+
+template<class Key, class Value, class Compare, class Alloc, class Layout>
+FrozenTree<Key, Value, Compare, Alloc, Layout>::const_iterator::const_iterator() :
+    cursor_(0),
+    tree_(NULL)
+{
+}
+
+template<class Key, class Value, class Compare, class Alloc, class Layout>
+FrozenTree<Key, Value, Compare, Alloc, Layout>::const_iterator::const_iterator(
+    std::size_t cursor, const FrozenTree<Key, Value, Compare, Alloc, Layout>* tree) :
+    cursor_(cursor),
+    tree_(tree)
+{
+}
+
+template<class Key, class Value, class Compare, class Alloc, class Layout>
+typename FrozenTree<Key, Value, Compare, Alloc, Layout>::const_iterator::reference
+FrozenTree<Key, Value, Compare, Alloc, Layout>::const_iterator::operator*() const
+{
+    std::size_t slot = tree_->layout_.slot(cursor_);
+    return reference(tree_->keys_[slot], tree_->values_[slot]);
+}
+
+template<class Key, class Value, class Compare, class Alloc, class Layout>
+typename FrozenTree<Key, Value, Compare, Alloc, Layout>::const_iterator::pointer
+FrozenTree<Key, Value, Compare, Alloc, Layout>::const_iterator::operator->() const
+{
+    pointer result = { **this };
+    return result;
+}
+
+template<class Key, class Value, class Compare, class Alloc, class Layout>
+bool FrozenTree<Key, Value, Compare, Alloc, Layout>::const_iterator::operator==(const const_iterator& rhs) const
+{
+    return cursor_ == rhs.cursor_;
+}
+
+template<class Key, class Value, class Compare, class Alloc, class Layout>
+bool FrozenTree<Key, Value, Compare, Alloc, Layout>::const_iterator::operator!=(const const_iterator& rhs) const
+{
+    return cursor_ != rhs.cursor_;
+}
+
+template<class Key, class Value, class Compare, class Alloc, class Layout>
+typename FrozenTree<Key, Value, Compare, Alloc, Layout>::const_iterator&
+FrozenTree<Key, Value, Compare, Alloc, Layout>::const_iterator::operator++()
+{
+    cursor_ = tree_->layout_.next(cursor_);
+    return *this;
+}
+
+template<class Key, class Value, class Compare, class Alloc, class Layout>
+typename FrozenTree<Key, Value, Compare, Alloc, Layout>::const_iterator
+FrozenTree<Key, Value, Compare, Alloc, Layout>::const_iterator::operator++(int)
+{
+    const_iterator old(*this);
+    ++(*this);
+    return old;
+}
+
+template<class Key, class Value, class Compare, class Alloc, class Layout>
+typename FrozenTree<Key, Value, Compare, Alloc, Layout>::const_iterator&
+FrozenTree<Key, Value, Compare, Alloc, Layout>::const_iterator::operator--()
+{
+    cursor_ = tree_->layout_.prev(cursor_);
+    return *this;
+}
+
+template<class Key, class Value, class Compare, class Alloc, class Layout>
+typename FrozenTree<Key, Value, Compare, Alloc, Layout>::const_iterator
+FrozenTree<Key, Value, Compare, Alloc, Layout>::const_iterator::operator--(int)
+{
+    const_iterator old(*this);
+    --(*this);
+    return old;
+}
+
+/*
+  ----------------------------------------------------------
+  End implementations for the FrozenTree::const_iterator class.
+  ----------------------------------------------------------
+*/
+
+/*
+  ----------------------------------------------
+  Begin implementations for the FrozenTree class.
+  ----------------------------------------------
+*/
+
+/**
+* Builds the layout from count items given in strictly increasing key
+* order, copying each key and value once.
+*/
+template<class Key, class Value, class Compare, class Alloc, class Layout>
+template<typename InputIt>
+FrozenTree<Key, Value, Compare, Alloc, Layout>::FrozenTree(InputIt first, InputIt last, std::size_t count,
+                                                           const Compare& comp, const Alloc& alloc) :
+    size_(count),
+    comp_(comp),
+    keyAlloc_(alloc),
+    valueAlloc_(alloc),
+    keys_(NULL),
+    values_(NULL)
+{
+    layout_.build(count);
+    std::size_t slots = layout_.slots();
+    if(slots == 0){
+        return;
+    }
+    keys_ = KeyTraits::allocate(keyAlloc_, slots);
+    try {
+        values_ = ValueTraits::allocate(valueAlloc_, slots);
+    }
+    catch(...) {
+        KeyTraits::deallocate(keyAlloc_, keys_, slots);
+        throw;
+    }
+
+    std::size_t built = 0;
+    try {
+        std::size_t cursor = layout_.begin();
+        for(; first != last && built < count; ++first, ++built){
+            std::size_t slot = layout_.slot(cursor);
+            KeyTraits::construct(keyAlloc_, keys_ + slot, first->first);
+            try {
+                ValueTraits::construct(valueAlloc_, values_ + slot, first->second);
+            }
+            catch(...) {
+                KeyTraits::destroy(keyAlloc_, keys_ + slot);
+                throw;
+            }
+            cursor = layout_.next(cursor);
+        }
+        if(built != count){
+            throw std::invalid_argument("fewer items than count");
+        }
+    }
+    catch(...) {
+        destroyItems(built);
+        KeyTraits::deallocate(keyAlloc_, keys_, slots);
+        ValueTraits::deallocate(valueAlloc_, values_, slots);
+        throw;
+    }
+}
+
+/**
+* Move constructor, which leaves other empty.
+*/
+template<class Key, class Value, class Compare, class Alloc, class Layout>
+FrozenTree<Key, Value, Compare, Alloc, Layout>::FrozenTree(FrozenTree&& other) :
+    layout_(other.layout_),
+    size_(other.size_),
+    comp_(other.comp_),
+    keyAlloc_(other.keyAlloc_),
+    valueAlloc_(other.valueAlloc_),
+    keys_(other.keys_),
+    values_(other.values_)
+{
+    other.layout_.build(0);
+    other.size_ = 0;
+    other.keys_ = NULL;
+    other.values_ = NULL;
+}
+
+template<class Key, class Value, class Compare, class Alloc, class Layout>
+FrozenTree<Key, Value, Compare, Alloc, Layout>::~FrozenTree()
+{
+    if(keys_ != NULL){
+        std::size_t slots = layout_.slots();
+        destroyItems(size_);
+        KeyTraits::deallocate(keyAlloc_, keys_, slots);
+        ValueTraits::deallocate(valueAlloc_, values_, slots);
+    }
+}
+
+template<class Key, class Value, class Compare, class Alloc, class Layout>
+std::size_t FrozenTree<Key, Value, Compare, Alloc, Layout>::size() const
+{
+    return size_;
+}
+
+template<class Key, class Value, class Compare, class Alloc, class Layout>
+bool FrozenTree<Key, Value, Compare, Alloc, Layout>::empty() const
+{
+    return size_ == 0;
+}
+
+/**
+* Returns the bytes held by the key and value arrays.
+*/
+template<class Key, class Value, class Compare, class Alloc, class Layout>
+std::size_t FrozenTree<Key, Value, Compare, Alloc, Layout>::memoryUsage() const
+{
+    return layout_.slots() * (sizeof(Key) + sizeof(Value));
+}
+
+template<class Key, class Value, class Compare, class Alloc, class Layout>
+typename FrozenTree<Key, Value, Compare, Alloc, Layout>::const_iterator
+FrozenTree<Key, Value, Compare, Alloc, Layout>::begin() const
+{
+    return const_iterator(layout_.begin(), this);
+}
+
+template<class Key, class Value, class Compare, class Alloc, class Layout>
+typename FrozenTree<Key, Value, Compare, Alloc, Layout>::const_iterator
+FrozenTree<Key, Value, Compare, Alloc, Layout>::end() const
+{
+    return const_iterator(layout_.end(), this);
+}
+
+/**
+* Returns an iterator to the item with the given key, or end().
+*/
+template<class Key, class Value, class Compare, class Alloc, class Layout>
+typename FrozenTree<Key, Value, Compare, Alloc, Layout>::const_iterator
+FrozenTree<Key, Value, Compare, Alloc, Layout>::find(const Key& key) const
+{
+    const_iterator it = lower_bound(key);
+    if(it.cursor_ == layout_.end() || comp_(key, keys_[layout_.slot(it.cursor_)])){
+        return end();
+    }
+    return it;
+}
+
+/**
+* Returns an iterator to the first item whose key is not less than key.
+*/
+template<class Key, class Value, class Compare, class Alloc, class Layout>
+typename FrozenTree<Key, Value, Compare, Alloc, Layout>::const_iterator
+FrozenTree<Key, Value, Compare, Alloc, Layout>::lower_bound(const Key& key) const
+{
+    const Key* keys = keys_;
+    const Compare& comp = comp_;
+    std::size_t cursor = layout_.lowerBound(keys, [keys, &comp, &key](std::size_t slot) {
+        return comp(keys[slot], key);
+    });
+    return const_iterator(cursor, this);
+}
+
+/**
+* Returns an iterator to the first item whose key is greater than key.
+*/
+template<class Key, class Value, class Compare, class Alloc, class Layout>
+typename FrozenTree<Key, Value, Compare, Alloc, Layout>::const_iterator
+FrozenTree<Key, Value, Compare, Alloc, Layout>::upper_bound(const Key& key) const
+{
+    const Key* keys = keys_;
+    const Compare& comp = comp_;
+    std::size_t cursor = layout_.lowerBound(keys, [keys, &comp, &key](std::size_t slot) {
+        return !comp(key, keys[slot]);
+    });
+    return const_iterator(cursor, this);
+}
+
+template<class Key, class Value, class Compare, class Alloc, class Layout>
+Value const & FrozenTree<Key, Value, Compare, Alloc, Layout>::operator[](const Key& key) const
+{
+    const_iterator it = find(key);
+    if(it == end()) throw std::out_of_range("Invalid key");
+    return values_[layout_.slot(it.cursor_)];
+}
+
+/**
+* Returns a copy of the key comparison object.
+*/
+template<class Key, class Value, class Compare, class Alloc, class Layout>
+typename FrozenTree<Key, Value, Compare, Alloc, Layout>::key_compare
+FrozenTree<Key, Value, Compare, Alloc, Layout>::key_comp() const
+{
+    return comp_;
+}
+
+/**
+* Destroys the first count items in key order.
+*/
+template<class Key, class Value, class Compare, class Alloc, class Layout>
+void FrozenTree<Key, Value, Compare, Alloc, Layout>::destroyItems(std::size_t count)
+{
+    std::size_t cursor = layout_.begin();
+    for(std::size_t i = 0; i < count; ++i){
+        std::size_t slot = layout_.slot(cursor);
+        KeyTraits::destroy(keyAlloc_, keys_ + slot);
+        ValueTraits::destroy(valueAlloc_, values_ + slot);
+        cursor = layout_.next(cursor);
+    }
+}
+
+/*
+  --------------------------------------------
+  End implementations for the FrozenTree class.
+  --------------------------------------------
+*/
+
+#endif
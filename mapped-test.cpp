@@ -0,0 +1,219 @@
+#include <iostream>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include "mapped_avlbst.h"
+
+using namespace std;
+
+// Checked test for MappedAVLTree files. A tree is built over several
+// sessions of random inserts and removes, closed and reopened between
+// them, and must match a std::map each time it is opened. The dirty flag
+// must reach the file before the first change and be cleared by sync()
+// and close, and a copy of a file taken while it was dirty must be
+// refused. Files with a link, free list or count patched to point past
+// the header's bounds must be refused too. It exits with status 1 if any
+// check fails.
+
+typedef MappedAVLTree<long, long> Tree;
+typedef MappedAVLNode<long, long> NodeT;
+
+static int failures = 0;
+
+static void check(bool ok, const string& what)
+{
+    if(!ok && ++failures <= 20) {
+        cerr << "FAIL " << what << endl;
+    }
+}
+
+// A scratch file in the temporary directory, removed when done
+class TempFile
+{
+public:
+    explicit TempFile(const char* name)
+    {
+        const char* dir = getenv("TMPDIR");
+        path_ = string(dir != NULL ? dir : "/tmp") + "/" + name + "-" + to_string(getpid());
+        remove(path_.c_str());
+    }
+    ~TempFile() { remove(path_.c_str()); }
+    const string& path() const { return path_; }
+
+private:
+    string path_;
+};
+
+static void copyFile(const string& from, const string& to)
+{
+    FILE* in = fopen(from.c_str(), "rb");
+    FILE* out = fopen(to.c_str(), "wb");
+    for(int c = fgetc(in); c != EOF; c = fgetc(in)) {
+        fputc(c, out);
+    }
+    fclose(in);
+    fclose(out);
+}
+
+static MappedTreeHeader readHeader(const string& path)
+{
+    MappedTreeHeader header = MappedTreeHeader();
+    FILE* file = fopen(path.c_str(), "rb");
+    if(file != NULL) {
+        check(fread(&header, sizeof(header), 1, file) == 1, path + ": header cannot be read");
+        fclose(file);
+    }
+    return header;
+}
+
+static void patch(const string& path, size_t offset, uint32_t value)
+{
+    FILE* file = fopen(path.c_str(), "r+b");
+    fseek(file, static_cast<long>(offset), SEEK_SET);
+    fwrite(&value, sizeof(value), 1, file);
+    fclose(file);
+}
+
+// Where node index's field at fieldOffset sits in the file
+static size_t nodeField(uint32_t index, size_t fieldOffset)
+{
+    size_t nodes = (sizeof(MappedTreeHeader) + 63) / 64 * 64;
+    return nodes + index * sizeof(NodeT) + fieldOffset;
+}
+
+static bool matches(const Tree& tree, const map<long, long>& expected)
+{
+    if(tree.size() != expected.size()) {
+        return false;
+    }
+    Tree::iterator it = tree.begin();
+    for(map<long, long>::const_iterator want = expected.begin(); want != expected.end(); ++want, ++it) {
+        if(it == tree.end() || it->first != want->first || it->second != want->second) {
+            return false;
+        }
+    }
+    return it == tree.end();
+}
+
+static bool opens(const string& path)
+{
+    try {
+        Tree tree(path);
+        return true;
+    }
+    catch(const runtime_error&) {
+        return false;
+    }
+}
+
+// Builds the tree over several sessions, reopening it between them
+static void testReopen(const string& path)
+{
+    mt19937_64 rng(24);
+    map<long, long> expected;
+    for(int session = 0; session < 6; ++session) {
+        Tree tree(path);
+        check(matches(tree, expected), "session " + to_string(session) + ": reopened tree differs");
+        for(int i = 0; i < 20000; ++i) {
+            long key = static_cast<long>(rng() % 30000);
+            if(rng() % 3) {
+                long value = static_cast<long>(rng() % 1000000);
+                tree.insert(make_pair(key, value));
+                expected[key] = value;
+            }
+            else {
+                tree.remove(key);
+                expected.erase(key);
+            }
+        }
+        if(session == 3) {
+            tree.clear();
+            expected.clear();
+            tree.insert(make_pair(5L, 50L));
+            expected[5] = 50;
+        }
+        check(matches(tree, expected), "session " + to_string(session) + ": tree differs before close");
+    }
+    Tree tree(path);
+    check(matches(tree, expected), "tree differs after the last reopen");
+}
+
+// The flag on disk follows changes, sync() and close
+static void testDirtyFlag(const string& path)
+{
+    TempFile copy("mapped-test-copy");
+    {
+        Tree tree(path);
+        check(!(readHeader(path).flags & kMappedTreeDirty), "file dirty right after opening");
+        tree.insert(make_pair(-1L, 1L));
+        check(readHeader(path).flags & kMappedTreeDirty, "file not dirty on disk after an insert");
+
+        // a crash now would leave this on disk
+        copyFile(path, copy.path());
+        check(!opens(copy.path()), "a file copied while dirty was opened");
+
+        tree.sync();
+        check(!(readHeader(path).flags & kMappedTreeDirty), "file still dirty after sync()");
+        tree[-1] = 2;
+        check(!(readHeader(path).flags & kMappedTreeDirty), "changing a value marked the file dirty");
+        tree.remove(-1);
+        check(readHeader(path).flags & kMappedTreeDirty, "file not dirty on disk after a remove");
+    }
+    check(!(readHeader(path).flags & kMappedTreeDirty), "file still dirty after close");
+    check(opens(path), "a cleanly closed file was refused");
+
+    // a new file is dirty until its first sync or close
+    TempFile fresh("mapped-test-fresh");
+    {
+        Tree tree(fresh.path());
+        tree.insert(make_pair(1L, 1L));
+        check(readHeader(fresh.path()).flags & kMappedTreeDirty, "new file not dirty before close");
+    }
+    check(opens(fresh.path()), "a new file was refused after close");
+}
+
+// One patched copy of a good file, which must be refused
+static void checkCorrupt(const string& good, size_t offset, uint32_t value, const string& what)
+{
+    TempFile bad("mapped-test-bad");
+    copyFile(good, bad.path());
+    patch(bad.path(), offset, value);
+    check(!opens(bad.path()), what + " was opened");
+}
+
+static void testBrokenLinks(const string& path)
+{
+    MappedTreeHeader h = readHeader(path);
+    check(h.used > 3 && h.freeList != 0, "test file has no free list to break");
+
+    checkCorrupt(path, offsetof(MappedTreeHeader, root), h.used, "a root past used");
+    checkCorrupt(path, offsetof(MappedTreeHeader, freeList), h.used + 7, "a free list head past used");
+    checkCorrupt(path, offsetof(MappedTreeHeader, used), h.capacity + 1, "used past capacity");
+    checkCorrupt(path, offsetof(MappedTreeHeader, used), h.used - 1, "used below the highest link");
+    checkCorrupt(path, offsetof(MappedTreeHeader, size), static_cast<uint32_t>(h.size + 1), "a size too large");
+    checkCorrupt(path, offsetof(MappedTreeHeader, height), static_cast<uint32_t>(h.height + 1), "a wrong height");
+    checkCorrupt(path, offsetof(MappedTreeHeader, flags), kMappedTreeDirty, "a dirty flag");
+    checkCorrupt(path, nodeField(h.root, offsetof(NodeT, left)), h.used, "a left link past used");
+    checkCorrupt(path, nodeField(h.root, offsetof(NodeT, right)), h.used + 100, "a right link past used");
+    checkCorrupt(path, nodeField(h.root, offsetof(NodeT, parent)), h.root, "a root with a parent");
+    checkCorrupt(path, nodeField(h.freeList, offsetof(NodeT, left)), h.freeList, "a free list cycle");
+    checkCorrupt(path, nodeField(h.root, offsetof(NodeT, left)), h.root, "a tree cycle");
+    check(opens(path), "the unpatched file was refused");
+}
+
+int main(int argc, char *argv[])
+{
+    TempFile file("mapped-test");
+    testReopen(file.path());
+    testDirtyFlag(file.path());
+    testBrokenLinks(file.path());
+
+    cout << (failures == 0 ? "All mapped checks passed" : "Mapped checks FAILED")
+         << " (" << failures << " failures)" << endl;
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,1154 @@
+#ifndef MAPPED_AVLBST_H
+#define MAPPED_AVLBST_H
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+* One contiguous run of memory mapped with mmap: anonymous memory, or a
+* file mapped shared so whatever is written to the memory ends up in the
+* file. resize() grows the region, which may move it to another address,
+* so whatever lives in it must not hold pointers into it.
+*
+* Throws std::runtime_error when the file cannot be opened, grown or
+* mapped.
+*/
+class MappedRegion
+{
+public:
+    MappedRegion();
+    explicit MappedRegion(const std::string& path);
+    ~MappedRegion();
+
+    char* data() const { return data_; }
+    std::size_t size() const { return size_; }
+    bool isFile() const { return fd_ >= 0; }
+
+    void resize(std::size_t bytes);
+    // Writes the dirty pages of a file region out to the file
+    void sync();
+
+private:
+    MappedRegion(const MappedRegion& other);
+    MappedRegion& operator=(const MappedRegion& other);
+    void fail(const char* what) const;
+
+    int fd_;
+    std::string path_;
+    char* data_;
+    std::size_t size_;
+};
+
+/**
+* An empty anonymous region; the first resize() maps it.
+*/
+inline MappedRegion::MappedRegion() :
+    fd_(-1),
+    path_(),
+    data_(NULL),
+    size_(0)
+{
+}
+
+/**
+* Maps the whole of the file at path, creating it empty if it does not
+* exist.
+*/
+inline MappedRegion::MappedRegion(const std::string& path) :
+    fd_(::open(path.c_str(), O_RDWR | O_CREAT, 0644)),
+    path_(path),
+    data_(NULL),
+    size_(0)
+{
+    if(fd_ < 0){
+        fail("Cannot open ");
+    }
+    struct stat info;
+    if(::fstat(fd_, &info) != 0){
+        ::close(fd_);
+        fail("Cannot read the size of ");
+    }
+    if(info.st_size != 0){
+        void* data = ::mmap(NULL, static_cast<std::size_t>(info.st_size), PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+        if(data == MAP_FAILED){
+            ::close(fd_);
+            fail("Cannot map ");
+        }
+        data_ = static_cast<char*>(data);
+        size_ = static_cast<std::size_t>(info.st_size);
+    }
+}
+
+inline MappedRegion::~MappedRegion()
+{
+    if(data_ != NULL){
+        ::munmap(data_, size_);
+    }
+    if(fd_ >= 0){
+        ::close(fd_);
+    }
+}
+
+inline void MappedRegion::fail(const char* what) const
+{
+    throw std::runtime_error(std::string(what) + (path_.empty() ? "anonymous memory" : path_) +
+                             ": " + std::strerror(errno));
+}
+
+/**
+* Grows the region to bytes, keeping its contents; a file grows along
+* with it, and the new bytes read as zero. Linux moves the mapping with
+* mremap, without copying; elsewhere the region is mapped afresh (and an
+* anonymous one copied over).
+*/
+inline void MappedRegion::resize(std::size_t bytes)
+{
+    if(bytes <= size_){
+        return;
+    }
+    if(fd_ >= 0 && ::ftruncate(fd_, static_cast<off_t>(bytes)) != 0){
+        fail("Cannot grow ");
+    }
+    int flags = (fd_ >= 0) ? MAP_SHARED : (MAP_PRIVATE | MAP_ANONYMOUS);
+    void* data = MAP_FAILED;
+    if(data_ == NULL){
+        data = ::mmap(NULL, bytes, PROT_READ | PROT_WRITE, flags, fd_, 0);
+    }
+    else {
+#if defined(MREMAP_MAYMOVE)
+        data = ::mremap(data_, size_, bytes, MREMAP_MAYMOVE);
+#else
+        data = ::mmap(NULL, bytes, PROT_READ | PROT_WRITE, flags, fd_, 0);
+        if(data != MAP_FAILED){
+            if(fd_ < 0){
+                std::memcpy(data, data_, size_);
+            }
+            ::munmap(data_, size_);
+        }
+#endif
+    }
+    if(data == MAP_FAILED){
+        fail("Cannot map ");
+    }
+    data_ = static_cast<char*>(data);
+    size_ = bytes;
+}
+
+inline void MappedRegion::sync()
+{
+    if(fd_ >= 0 && data_ != NULL && ::msync(data_, size_, MS_SYNC) != 0){
+        fail("Cannot write ");
+    }
+}
+
+/**
+* The start of a MappedAVLTree's region, followed by the node array. All
+* links are node numbers, not addresses, so the region means the same
+* wherever it is mapped. The sizes let a file written for other key or
+* value types be told apart, and the dirty flag one whose last changes
+* never reached the disk.
+*/
+struct MappedTreeHeader
+{
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t nodeBytes;
+    std::uint32_t keyBytes;
+    std::uint32_t valueBytes;
+    std::uint32_t root;
+    std::uint32_t freeList;     // removed nodes, chained through their left links
+    std::uint32_t used;         // nodes 1 .. used - 1 have been handed out at some time
+    std::uint32_t capacity;     // node slots the region has room for
+    std::uint64_t size;
+    std::int32_t height;
+    std::uint32_t flags;
+};
+
+static const char kMappedTreeMagic[8] = { 'B', 'S', 'T', 'M', 'A', 'P', '\0', '\0' };
+static const std::uint32_t kMappedTreeVersion = 1;
+// Set from the first change to the links after a sync() until the next
+// sync() or close; a file still marked was left half written
+static const std::uint32_t kMappedTreeDirty = 1;
+
+/**
+* A node of a MappedAVLTree: the item, then its links as 32-bit node
+* numbers (0 for none) and the balance, right height minus left height.
+* For 8-byte keys and values that is 32 bytes against the 48 of an
+* AVLNode with its three pointers.
+*/
+template <typename Key, typename Value>
+struct MappedAVLNode
+{
+    std::pair<const Key, Value> item;
+    std::uint32_t parent;
+    std::uint32_t left;
+    std::uint32_t right;
+    std::int8_t balance;
+};
+
+/**
+* An AVL tree whose nodes all live in one MappedRegion and point at one
+* another by node number. Mapped from a file, the tree is the file: the
+* constructor that takes a path opens a tree saved there and can use it at
+* once, with no loading step and no pointers to fix up, and every change
+* lands in the file (call sync() to wait for the disk). Without a path it
+* is an ordinary in-memory tree with half-size links.
+*
+* Keys and values are kept as raw bytes, so both must be trivially
+* copyable, and a file must be opened with the types it was written with
+* (the constructor checks their sizes). The region is grown by doubling,
+* and removed nodes are reused before it grows.
+*
+* A file is marked dirty on disk before the first insert, remove or clear
+* that changes its links, and marked clean again by sync() and on close
+* once every change has been written, so a file left by a crash is
+* refused when opened rather than walked with broken links. Opening also
+* checks every link against the header, which reads each node once.
+* Values changed through operator[] or an iterator leave the links alone
+* and do not mark the file.
+*
+* The iterators, find, insert and remove behave like BinarySearchTree's.
+* An iterator names a node by number, so growing the region does not
+* invalidate it; removing its item does.
+*/
+template <typename Key, typename Value, typename Compare = std::less<Key> >
+class MappedAVLTree
+{
+    static_assert(std::is_trivially_copyable<Key>::value && std::is_trivially_copyable<Value>::value,
+                  "MappedAVLTree stores keys and values as raw bytes");
+
+public:
+    typedef MappedAVLNode<Key, Value> NodeT;
+
+    explicit MappedAVLTree(const Compare& comp = Compare());
+    explicit MappedAVLTree(const std::string& path, const Compare& comp = Compare());
+    ~MappedAVLTree();
+
+    void insert(const std::pair<const Key, Value>& keyValuePair);
+    void remove(const Key& key);
+    void clear();
+    bool empty() const;
+    std::size_t size() const;
+    int height() const;
+    // Node slots the region has room for before it grows
+    std::size_t capacity() const;
+    void sync();
+
+    /**
+    * A bidirectional iterator over the items in key order; --end()
+    * reaches the largest item.
+    */
+    class iterator
+    {
+    public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef std::pair<const Key, Value> value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef std::pair<const Key, Value>* pointer;
+        typedef std::pair<const Key, Value>& reference;
+
+        iterator();
+
+        std::pair<const Key, Value>& operator*() const;
+        std::pair<const Key, Value>* operator->() const;
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+        iterator& operator++();
+        iterator operator++(int);
+        iterator& operator--();
+        iterator operator--(int);
+
+    protected:
+        friend class MappedAVLTree<Key, Value, Compare>;
+        iterator(std::uint32_t index, const MappedAVLTree<Key, Value, Compare>* tree);
+        std::uint32_t index_;
+        const MappedAVLTree<Key, Value, Compare>* tree_;
+    };
+
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key& key) const;
+    iterator lower_bound(const Key& key) const;
+    iterator upper_bound(const Key& key) const;
+    Value& operator[](const Key& key);
+    Value const & operator[](const Key& key) const;
+
+private:
+    MappedAVLTree(const MappedAVLTree& other);
+    MappedAVLTree& operator=(const MappedAVLTree& other);
+
+    static const std::uint32_t kNull = 0;
+    static std::size_t nodeOffset();
+
+    MappedTreeHeader& header() const;
+    NodeT& node(std::uint32_t index) const;
+    void format();
+    void checkFormat() const;
+    void checkLinks() const;
+    void markDirty();
+    void grow();
+    std::uint32_t createNode(const std::pair<const Key, Value>& keyValuePair, std::uint32_t parent);
+    void destroyNode(std::uint32_t index);
+
+    std::uint32_t findNode(const Key& key) const;
+    std::uint32_t minimum(std::uint32_t index) const;
+    std::uint32_t maximum(std::uint32_t index) const;
+    std::uint32_t successor(std::uint32_t index) const;
+    std::uint32_t predecessor(std::uint32_t index) const;
+
+    void replaceChild(std::uint32_t parent, std::uint32_t oldChild, std::uint32_t newChild);
+    void rotateLeft(std::uint32_t index);
+    void rotateRight(std::uint32_t index);
+    void insertFix(std::uint32_t parent, std::uint32_t child);
+    void removeFix(std::uint32_t index, int diff);
+
+    MappedRegion region_;
+    Compare comp_;
+};
+
+/*
+  ----------------------------------------------------------
+  Begin implementations for the MappedAVLTree::iterator class.
+  ----------------------------------------------------------
+*/
+
+template<class Key, class Value, class Compare>
+MappedAVLTree<Key, Value, Compare>::iterator::iterator() :
+    index_(kNull),
+    tree_(NULL)
+{
+}
+
+template<class Key, class Value, class Compare>
+MappedAVLTree<Key, Value, Compare>::iterator::iterator(std::uint32_t index, const MappedAVLTree<Key, Value, Compare>* tree) :
+    index_(index),
+    tree_(tree)
+{
+}
+
+template<class Key, class Value, class Compare>
+std::pair<const Key, Value>& MappedAVLTree<Key, Value, Compare>::iterator::operator*() const
+{
+    return tree_->node(index_).item;
+}
+
+template<class Key, class Value, class Compare>
+std::pair<const Key, Value>* MappedAVLTree<Key, Value, Compare>::iterator::operator->() const
+{
+    return &(tree_->node(index_).item);
+}
+
+template<class Key, class Value, class Compare>
+bool MappedAVLTree<Key, Value, Compare>::iterator::operator==(const iterator& rhs) const
+{
+    return index_ == rhs.index_;
+}
+
+template<class Key, class Value, class Compare>
+bool MappedAVLTree<Key, Value, Compare>::iterator::operator!=(const iterator& rhs) const
+{
+    return index_ != rhs.index_;
+}
+
+template<class Key, class Value, class Compare>
+typename MappedAVLTree<Key, Value, Compare>::iterator&
+MappedAVLTree<Key, Value, Compare>::iterator::operator++()
+{
+    index_ = tree_->successor(index_);
+    return *this;
+}
+
+template<class Key, class Value, class Compare>
+typename MappedAVLTree<Key, Value, Compare>::iterator
+MappedAVLTree<Key, Value, Compare>::iterator::operator++(int)
+{
+    iterator old(*this);
+    ++(*this);
+    return old;
+}
+
+/**
+* Steps back; from end() to the largest item.
+*/
+template<class Key, class Value, class Compare>
+typename MappedAVLTree<Key, Value, Compare>::iterator&
+MappedAVLTree<Key, Value, Compare>::iterator::operator--()
+{
+    if(index_ == kNull){
+        index_ = tree_->maximum(tree_->header().root);
+    }
+    else {
+        index_ = tree_->predecessor(index_);
+    }
+    return *this;
+}
+
+template<class Key, class Value, class Compare>
+typename MappedAVLTree<Key, Value, Compare>::iterator
+MappedAVLTree<Key, Value, Compare>::iterator::operator--(int)
+{
+    iterator old(*this);
+    --(*this);
+    return old;
+}
+
+/*
+  ----------------------------------------------------------
+  End implementations for the MappedAVLTree::iterator class.
+  ----------------------------------------------------------
+*/
+
+/*
+  ------------------------------------------------
+  Begin implementations for the MappedAVLTree class.
+  ------------------------------------------------
+*/
+
+/**
+* Constructor for an empty tree in anonymous memory.
+*/
+template<class Key, class Value, class Compare>
+MappedAVLTree<Key, Value, Compare>::MappedAVLTree(const Compare& comp) :
+    region_(),
+    comp_(comp)
+{
+    format();
+}
+
+/**
+* Opens the tree kept in the file at path, or starts an empty one there if
+* the file is new or empty. Throws std::runtime_error if the file holds
+* something else, a tree of other key or value types, a tree that was not
+* synced or closed after its last change, or links that do not hold
+* together.
+*/
+template<class Key, class Value, class Compare>
+MappedAVLTree<Key, Value, Compare>::MappedAVLTree(const std::string& path, const Compare& comp) :
+    region_(path),
+    comp_(comp)
+{
+    if(region_.size() == 0){
+        format();
+    }
+    else {
+        checkFormat();
+    }
+}
+
+/**
+* Writes out a file's changes and marks it clean. A failure here cannot
+* be reported, and leaves the file marked dirty.
+*/
+template<class Key, class Value, class Compare>
+MappedAVLTree<Key, Value, Compare>::~MappedAVLTree()
+{
+    try {
+        sync();
+    }
+    catch(const std::runtime_error&) {
+    }
+}
+
+/**
+* Where the node array starts: past the header, on a cache line.
+*/
+template<class Key, class Value, class Compare>
+std::size_t MappedAVLTree<Key, Value, Compare>::nodeOffset()
+{
+    return (sizeof(MappedTreeHeader) + 63) / 64 * 64;
+}
+
+template<class Key, class Value, class Compare>
+MappedTreeHeader& MappedAVLTree<Key, Value, Compare>::header() const
+{
+    return *reinterpret_cast<MappedTreeHeader*>(region_.data());
+}
+
+/**
+* The node numbered index. Slot 0 is never used, so that 0 can mean none.
+*/
+template<class Key, class Value, class Compare>
+typename MappedAVLTree<Key, Value, Compare>::NodeT&
+MappedAVLTree<Key, Value, Compare>::node(std::uint32_t index) const
+{
+    return reinterpret_cast<NodeT*>(region_.data() + nodeOffset())[index];
+}
+
+/**
+* Maps room for a first few nodes and writes the header of an empty tree.
+*/
+template<class Key, class Value, class Compare>
+void MappedAVLTree<Key, Value, Compare>::format()
+{
+    const std::uint32_t kInitialCapacity = 64;
+    region_.resize(nodeOffset() + kInitialCapacity * sizeof(NodeT));
+    MappedTreeHeader& h = header();
+    std::memcpy(h.magic, kMappedTreeMagic, sizeof(h.magic));
+    h.version = kMappedTreeVersion;
+    h.nodeBytes = sizeof(NodeT);
+    h.keyBytes = sizeof(Key);
+    h.valueBytes = sizeof(Value);
+    h.capacity = kInitialCapacity;
+    h.flags = 0;
+    clear();
+}
+
+/**
+* Checks that an existing region holds a tree of this type, written out
+* in full, whose links all hold together.
+*/
+template<class Key, class Value, class Compare>
+void MappedAVLTree<Key, Value, Compare>::checkFormat() const
+{
+    const MappedTreeHeader& h = header();
+    if(region_.size() < nodeOffset() ||
+       std::memcmp(h.magic, kMappedTreeMagic, sizeof(h.magic)) != 0 || h.version != kMappedTreeVersion){
+        throw std::runtime_error("Not a mapped tree file");
+    }
+    if(h.nodeBytes != sizeof(NodeT) || h.keyBytes != sizeof(Key) || h.valueBytes != sizeof(Value)){
+        throw std::runtime_error("Mapped tree file holds other key or value types");
+    }
+    if(region_.size() < nodeOffset() + std::size_t(h.capacity) * sizeof(NodeT) || h.used > h.capacity){
+        throw std::runtime_error("Mapped tree file is truncated");
+    }
+    if(h.flags & kMappedTreeDirty){
+        throw std::runtime_error("Mapped tree file was not synced or closed after its last change");
+    }
+    checkLinks();
+}
+
+/**
+* Checks every link of the region: each must name a slot below used, the
+* free list must end within used steps, the tree must reach exactly size
+* nodes with matching parent links, balances and height, and those nodes
+* and the free list together must account for every slot handed out.
+*/
+template<class Key, class Value, class Compare>
+void MappedAVLTree<Key, Value, Compare>::checkLinks() const
+{
+    const MappedTreeHeader& h = header();
+    const char* bad = "Mapped tree file has broken links";
+    if(h.used == 0 || h.root >= h.used || h.freeList >= h.used || h.size >= h.used){
+        throw std::runtime_error(bad);
+    }
+    for(std::uint32_t i = 1; i < h.used; ++i){
+        const NodeT& n = node(i);
+        if(n.parent >= h.used || n.left >= h.used || n.right >= h.used){
+            throw std::runtime_error(bad);
+        }
+    }
+
+    std::uint64_t free = 0;
+    for(std::uint32_t i = h.freeList; i != kNull; i = node(i).left){
+        if(++free >= h.used){
+            throw std::runtime_error(bad);
+        }
+    }
+    if(free + h.size != h.used - 1){
+        throw std::runtime_error(bad);
+    }
+
+    // depth first, bounded by size so a cycle cannot keep it going
+    std::uint64_t reached = 0;
+    int height = 0;
+    std::vector<std::pair<std::uint32_t, int> > stack;
+    if(h.root != kNull){
+        if(node(h.root).parent != kNull){
+            throw std::runtime_error(bad);
+        }
+        stack.push_back(std::make_pair(h.root, 1));
+    }
+    while(!stack.empty()){
+        std::uint32_t index = stack.back().first;
+        int depth = stack.back().second;
+        stack.pop_back();
+        const NodeT& n = node(index);
+        if(++reached > h.size || n.balance < -1 || n.balance > 1 ||
+           (n.left != kNull && node(n.left).parent != index) ||
+           (n.right != kNull && node(n.right).parent != index)){
+            throw std::runtime_error(bad);
+        }
+        if(depth > height){
+            height = depth;
+        }
+        if(n.left != kNull){
+            stack.push_back(std::make_pair(n.left, depth + 1));
+        }
+        if(n.right != kNull){
+            stack.push_back(std::make_pair(n.right, depth + 1));
+        }
+    }
+    if(reached != h.size || height != h.height){
+        throw std::runtime_error(bad);
+    }
+}
+
+/**
+* Marks a file dirty, and waits for the mark to reach the disk, before the
+* first change to its links since it was last synced.
+*/
+template<class Key, class Value, class Compare>
+void MappedAVLTree<Key, Value, Compare>::markDirty()
+{
+    if(!(header().flags & kMappedTreeDirty)){
+        header().flags |= kMappedTreeDirty;
+        region_.sync();
+    }
+}
+
+/**
+* Doubles the node capacity. Node numbers stay the same but the region
+* may move, so no NodeT reference may be held across a call.
+*/
+template<class Key, class Value, class Compare>
+void MappedAVLTree<Key, Value, Compare>::grow()
+{
+    std::uint64_t capacity = std::uint64_t(header().capacity) * 2;
+    if(capacity > 0xffffffffu){
+        capacity = 0xffffffffu;
+        if(header().capacity == capacity){
+            throw std::length_error("MappedAVLTree is limited to 2^32 - 1 nodes");
+        }
+    }
+    region_.resize(nodeOffset() + std::size_t(capacity) * sizeof(NodeT));
+    header().capacity = static_cast<std::uint32_t>(capacity);
+}
+
+/**
+* Takes a node from the free list, or else the next unused slot, and
+* fills it in as a leaf under parent.
+*/
+template<class Key, class Value, class Compare>
+std::uint32_t MappedAVLTree<Key, Value, Compare>::createNode(const std::pair<const Key, Value>& keyValuePair,
+                                                             std::uint32_t parent)
+{
+    // copied first, since it may be an item of this tree and growing moves them
+    std::pair<const Key, Value> item(keyValuePair);
+    std::uint32_t index = header().freeList;
+    if(index != kNull){
+        header().freeList = node(index).left;
+    }
+    else {
+        if(header().used == header().capacity){
+            grow();
+        }
+        index = header().used++;
+    }
+    NodeT& n = node(index);
+    new (&n.item) std::pair<const Key, Value>(item);
+    n.parent = parent;
+    n.left = kNull;
+    n.right = kNull;
+    n.balance = 0;
+    return index;
+}
+
+template<class Key, class Value, class Compare>
+void MappedAVLTree<Key, Value, Compare>::destroyNode(std::uint32_t index)
+{
+    node(index).left = header().freeList;
+    header().freeList = index;
+}
+
+/**
+* Inserts the item, or overwrites the value if the key is already there.
+*/
+template<class Key, class Value, class Compare>
+void MappedAVLTree<Key, Value, Compare>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    std::uint32_t parent = kNull;
+    bool goLeft = false;
+    for(std::uint32_t curr = header().root; curr != kNull; ){
+        NodeT& n = node(curr);
+        if(comp_(keyValuePair.first, n.item.first)){
+            goLeft = true;
+        }
+        else if(comp_(n.item.first, keyValuePair.first)){
+            goLeft = false;
+        }
+        else {
+            n.item.second = keyValuePair.second;
+            return;
+        }
+        parent = curr;
+        curr = goLeft ? n.left : n.right;
+    }
+
+    markDirty();
+    std::uint32_t index = createNode(keyValuePair, parent);
+    ++header().size;
+    if(parent == kNull){
+        header().root = index;
+        header().height = 1;
+        return;
+    }
+    if(goLeft){
+        node(parent).left = index;
+    }
+    else {
+        node(parent).right = index;
+    }
+    insertFix(parent, index);
+}
+
+/**
+* Walks up from a child whose subtree just grew by one level, fixing
+* balances, until a subtree stops growing or one rotation (single or
+* double) restores its height.
+*/
+template<class Key, class Value, class Compare>
+void MappedAVLTree<Key, Value, Compare>::insertFix(std::uint32_t parent, std::uint32_t child)
+{
+    for(; parent != kNull; child = parent, parent = node(parent).parent){
+        NodeT& p = node(parent);
+        int balance = p.balance + ((p.left == child) ? -1 : 1);
+        if(balance == 0){
+            p.balance = 0;
+            return;
+        }
+        if(balance == 1 || balance == -1){
+            p.balance = static_cast<std::int8_t>(balance);
+            continue;
+        }
+
+        NodeT& c = node(child);
+        if(balance == -2){
+            if(c.balance == -1){
+                rotateRight(parent);
+                p.balance = 0;
+                c.balance = 0;
+            }
+            else {
+                std::uint32_t grandchild = c.right;
+                NodeT& g = node(grandchild);
+                rotateLeft(child);
+                rotateRight(parent);
+                p.balance = (g.balance == -1) ? 1 : 0;
+                c.balance = (g.balance == 1) ? -1 : 0;
+                g.balance = 0;
+            }
+        }
+        else {
+            if(c.balance == 1){
+                rotateLeft(parent);
+                p.balance = 0;
+                c.balance = 0;
+            }
+            else {
+                std::uint32_t grandchild = c.left;
+                NodeT& g = node(grandchild);
+                rotateRight(child);
+                rotateLeft(parent);
+                p.balance = (g.balance == 1) ? -1 : 0;
+                c.balance = (g.balance == -1) ? 1 : 0;
+                g.balance = 0;
+            }
+        }
+        return;
+    }
+    ++header().height;
+}
+
+/**
+* Removes the item with the given key, if there is one. A node with two
+* children is replaced by its predecessor node, moved rather than copied,
+* so iterators to other items stay valid.
+*/
+template<class Key, class Value, class Compare>
+void MappedAVLTree<Key, Value, Compare>::remove(const Key& key)
+{
+    std::uint32_t index = findNode(key);
+    if(index == kNull){
+        return;
+    }
+    markDirty();
+    NodeT& n = node(index);
+    std::uint32_t fixFrom;
+    int diff;
+    if(n.left != kNull && n.right != kNull){
+        std::uint32_t pred = maximum(n.left);
+        NodeT& p = node(pred);
+        if(p.parent == index){
+            // the predecessor keeps its left subtree, which is one shorter
+            fixFrom = pred;
+            diff = 1;
+        }
+        else {
+            fixFrom = p.parent;
+            diff = -1;
+            node(p.parent).right = p.left;
+            if(p.left != kNull){
+                node(p.left).parent = p.parent;
+            }
+            p.left = n.left;
+            node(n.left).parent = pred;
+        }
+        p.right = n.right;
+        node(n.right).parent = pred;
+        p.parent = n.parent;
+        p.balance = n.balance;
+        replaceChild(n.parent, index, pred);
+    }
+    else {
+        std::uint32_t child = (n.left != kNull) ? n.left : n.right;
+        fixFrom = n.parent;
+        diff = (fixFrom != kNull && node(fixFrom).left == index) ? 1 : -1;
+        if(child != kNull){
+            node(child).parent = n.parent;
+        }
+        replaceChild(n.parent, index, child);
+    }
+    destroyNode(index);
+    --header().size;
+    removeFix(fixFrom, diff);
+}
+
+/**
+* Walks up from a node one of whose subtrees just got one level shorter
+* (the left one if diff is 1, the right one if -1), fixing balances and
+* rotating, until a subtree keeps its height.
+*/
+template<class Key, class Value, class Compare>
+void MappedAVLTree<Key, Value, Compare>::removeFix(std::uint32_t index, int diff)
+{
+    while(index != kNull){
+        NodeT& n = node(index);
+        std::uint32_t parent = n.parent;
+        int parentDiff = (parent != kNull && node(parent).left == index) ? 1 : -1;
+        int balance = n.balance + diff;
+
+        if(balance == 1 || balance == -1){
+            n.balance = static_cast<std::int8_t>(balance);
+            return;
+        }
+        if(balance == 2){
+            std::uint32_t child = n.right;
+            NodeT& c = node(child);
+            if(c.balance >= 0){
+                rotateLeft(index);
+                if(c.balance == 0){
+                    n.balance = 1;
+                    c.balance = -1;
+                    return;
+                }
+                n.balance = 0;
+                c.balance = 0;
+            }
+            else {
+                std::uint32_t grandchild = c.left;
+                NodeT& g = node(grandchild);
+                rotateRight(child);
+                rotateLeft(index);
+                n.balance = (g.balance == 1) ? -1 : 0;
+                c.balance = (g.balance == -1) ? 1 : 0;
+                g.balance = 0;
+            }
+        }
+        else if(balance == -2){
+            std::uint32_t child = n.left;
+            NodeT& c = node(child);
+            if(c.balance <= 0){
+                rotateRight(index);
+                if(c.balance == 0){
+                    n.balance = -1;
+                    c.balance = 1;
+                    return;
+                }
+                n.balance = 0;
+                c.balance = 0;
+            }
+            else {
+                std::uint32_t grandchild = c.right;
+                NodeT& g = node(grandchild);
+                rotateLeft(child);
+                rotateRight(index);
+                n.balance = (g.balance == -1) ? 1 : 0;
+                c.balance = (g.balance == 1) ? -1 : 0;
+                g.balance = 0;
+            }
+        }
+        else {
+            n.balance = 0;
+        }
+        // this subtree is one shorter: carry on with its parent
+        index = parent;
+        diff = parentDiff;
+    }
+    --header().height;
+}
+
+/**
+* Makes newChild take oldChild's place under parent, or as the root.
+*/
+template<class Key, class Value, class Compare>
+void MappedAVLTree<Key, Value, Compare>::replaceChild(std::uint32_t parent, std::uint32_t oldChild,
+                                                      std::uint32_t newChild)
+{
+    if(parent == kNull){
+        header().root = newChild;
+    }
+    else if(node(parent).left == oldChild){
+        node(parent).left = newChild;
+    }
+    else {
+        node(parent).right = newChild;
+    }
+}
+
+template<class Key, class Value, class Compare>
+void MappedAVLTree<Key, Value, Compare>::rotateLeft(std::uint32_t index)
+{
+    NodeT& n = node(index);
+    std::uint32_t child = n.right;
+    NodeT& c = node(child);
+    n.right = c.left;
+    if(c.left != kNull){
+        node(c.left).parent = index;
+    }
+    c.parent = n.parent;
+    replaceChild(n.parent, index, child);
+    c.left = index;
+    n.parent = child;
+}
+
+template<class Key, class Value, class Compare>
+void MappedAVLTree<Key, Value, Compare>::rotateRight(std::uint32_t index)
+{
+    NodeT& n = node(index);
+    std::uint32_t child = n.left;
+    NodeT& c = node(child);
+    n.left = c.right;
+    if(c.right != kNull){
+        node(c.right).parent = index;
+    }
+    c.parent = n.parent;
+    replaceChild(n.parent, index, child);
+    c.right = index;
+    n.parent = child;
+}
+
+/**
+* Empties the tree, keeping the region at its size for reuse.
+*/
+template<class Key, class Value, class Compare>
+void MappedAVLTree<Key, Value, Compare>::clear()
+{
+    markDirty();
+    MappedTreeHeader& h = header();
+    h.root = kNull;
+    h.freeList = kNull;
+    h.used = 1;
+    h.size = 0;
+    h.height = 0;
+}
+
+template<class Key, class Value, class Compare>
+bool MappedAVLTree<Key, Value, Compare>::empty() const
+{
+    return header().root == kNull;
+}
+
+template<class Key, class Value, class Compare>
+std::size_t MappedAVLTree<Key, Value, Compare>::size() const
+{
+    return static_cast<std::size_t>(header().size);
+}
+
+template<class Key, class Value, class Compare>
+int MappedAVLTree<Key, Value, Compare>::height() const
+{
+    return header().height;
+}
+
+template<class Key, class Value, class Compare>
+std::size_t MappedAVLTree<Key, Value, Compare>::capacity() const
+{
+    return header().capacity - 1;
+}
+
+/**
+* Waits until every change has reached the file, then marks it clean;
+* does nothing for a tree in anonymous memory.
+*/
+template<class Key, class Value, class Compare>
+void MappedAVLTree<Key, Value, Compare>::sync()
+{
+    region_.sync();
+    if(header().flags & kMappedTreeDirty){
+        // the mark is cleared only once the changes it covers are written
+        header().flags &= ~kMappedTreeDirty;
+        region_.sync();
+    }
+}
+
+template<class Key, class Value, class Compare>
+typename MappedAVLTree<Key, Value, Compare>::iterator
+MappedAVLTree<Key, Value, Compare>::begin() const
+{
+    return iterator(minimum(header().root), this);
+}
+
+template<class Key, class Value, class Compare>
+typename MappedAVLTree<Key, Value, Compare>::iterator
+MappedAVLTree<Key, Value, Compare>::end() const
+{
+    return iterator(kNull, this);
+}
+
+template<class Key, class Value, class Compare>
+typename MappedAVLTree<Key, Value, Compare>::iterator
+MappedAVLTree<Key, Value, Compare>::find(const Key& key) const
+{
+    return iterator(findNode(key), this);
+}
+
+/**
+* The first item whose key is not less than key.
+*/
+template<class Key, class Value, class Compare>
+typename MappedAVLTree<Key, Value, Compare>::iterator
+MappedAVLTree<Key, Value, Compare>::lower_bound(const Key& key) const
+{
+    std::uint32_t result = kNull;
+    for(std::uint32_t curr = header().root; curr != kNull; ){
+        const NodeT& n = node(curr);
+        if(comp_(n.item.first, key)){
+            curr = n.right;
+        }
+        else {
+            result = curr;
+            curr = n.left;
+        }
+    }
+    return iterator(result, this);
+}
+
+/**
+* The first item whose key is greater than key.
+*/
+template<class Key, class Value, class Compare>
+typename MappedAVLTree<Key, Value, Compare>::iterator
+MappedAVLTree<Key, Value, Compare>::upper_bound(const Key& key) const
+{
+    std::uint32_t result = kNull;
+    for(std::uint32_t curr = header().root; curr != kNull; ){
+        const NodeT& n = node(curr);
+        if(comp_(key, n.item.first)){
+            result = curr;
+            curr = n.left;
+        }
+        else {
+            curr = n.right;
+        }
+    }
+    return iterator(result, this);
+}
+
+template<class Key, class Value, class Compare>
+Value& MappedAVLTree<Key, Value, Compare>::operator[](const Key& key)
+{
+    std::uint32_t index = findNode(key);
+    if(index == kNull) throw std::out_of_range("Invalid key");
+    return node(index).item.second;
+}
+
+template<class Key, class Value, class Compare>
+Value const & MappedAVLTree<Key, Value, Compare>::operator[](const Key& key) const
+{
+    std::uint32_t index = findNode(key);
+    if(index == kNull) throw std::out_of_range("Invalid key");
+    return node(index).item.second;
+}
+
+template<class Key, class Value, class Compare>
+std::uint32_t MappedAVLTree<Key, Value, Compare>::findNode(const Key& key) const
+{
+    std::uint32_t curr = header().root;
+    while(curr != kNull){
+        const NodeT& n = node(curr);
+        if(comp_(key, n.item.first)){
+            curr = n.left;
+        }
+        else if(comp_(n.item.first, key)){
+            curr = n.right;
+        }
+        else {
+            break;
+        }
+    }
+    return curr;
+}
+
+template<class Key, class Value, class Compare>
+std::uint32_t MappedAVLTree<Key, Value, Compare>::minimum(std::uint32_t index) const
+{
+    if(index != kNull){
+        while(node(index).left != kNull){
+            index = node(index).left;
+        }
+    }
+    return index;
+}
+
+template<class Key, class Value, class Compare>
+std::uint32_t MappedAVLTree<Key, Value, Compare>::maximum(std::uint32_t index) const
+{
+    if(index != kNull){
+        while(node(index).right != kNull){
+            index = node(index).right;
+        }
+    }
+    return index;
+}
+
+template<class Key, class Value, class Compare>
+std::uint32_t MappedAVLTree<Key, Value, Compare>::successor(std::uint32_t index) const
+{
+    if(node(index).right != kNull){
+        return minimum(node(index).right);
+    }
+    std::uint32_t parent = node(index).parent;
+    while(parent != kNull && node(parent).right == index){
+        index = parent;
+        parent = node(parent).parent;
+    }
+    return parent;
+}
+
+template<class Key, class Value, class Compare>
+std::uint32_t MappedAVLTree<Key, Value, Compare>::predecessor(std::uint32_t index) const
+{
+    if(node(index).left != kNull){
+        return maximum(node(index).left);
+    }
+    std::uint32_t parent = node(index).parent;
+    while(parent != kNull && node(parent).left == index){
+        index = parent;
+        parent = node(parent).parent;
+    }
+    return parent;
+}
+
+/*
+  ----------------------------------------------
+  End implementations for the MappedAVLTree class.
+  ----------------------------------------------
+*/
+
+#endif
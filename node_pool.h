@@ -0,0 +1,421 @@
+#ifndef NODE_POOL_H
+#define NODE_POOL_H
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+
+/**
+* A slab allocator for the fixed-size nodes of a search tree.
+*
+* Slots are carved out of large blocks obtained from the upstream
+* allocator, so an insert only reaches the global allocator once per
+* block. Slots given back with deallocate() go on a free list that the
+* next allocate() reuses, and release() hands every block back at once.
+* Slots handed out one after another sit next to each other in the same
+* block, so nodes that were inserted together share cache lines.
+*
+* The upstream allocator may be any standard allocator (it is rebound
+* internally), including std::pmr::polymorphic_allocator for per-request
+* arenas.
+*
+* Each tree has a pool of its own, and nothing in allocate() or
+* deallocate() is shared or locked. Trees that hand nodes to each other
+* (split and join) may end up holding slots from each other's blocks, so
+* unite() puts the blocks of two pools into one set that both keep alive:
+* a node from anywhere in the set may be freed into either pool, and the
+* blocks go back upstream only when the last pool using the set lets go.
+* The trees can then be used from different threads. Only adding a block
+* to a set and merging sets take its lock. Merged sets forward to the
+* larger one, so they form a shallow forest and never keep each other
+* alive in a cycle.
+*/
+template <typename Alloc = std::allocator<char> >
+class NodePool
+{
+public:
+    explicit NodePool(std::size_t slotSize,
+                      std::size_t slotAlign = alignof(std::max_align_t),
+                      const Alloc& alloc = Alloc());
+    ~NodePool();
+
+    void* allocate();
+    void deallocate(void* slot);
+    void release();
+
+    std::size_t slotSize() const;
+    std::size_t blockCount() const;
+    Alloc get_allocator() const;
+
+    // Sharing between trees
+    static void unite(std::shared_ptr<NodePool>& a, std::shared_ptr<NodePool>& b);
+    static bool soleOwner(const std::shared_ptr<NodePool>& pool);
+    static std::shared_ptr<NodePool> emptyLike(const std::shared_ptr<NodePool>& pool);
+
+private:
+    // The unit blocks are requested in, so every block is maximally aligned.
+    struct Chunk
+    {
+        alignas(std::max_align_t) unsigned char bytes[alignof(std::max_align_t)];
+    };
+
+    // Header stored at the start of every block.
+    struct Block
+    {
+        Block* next;
+        std::size_t chunks;
+    };
+
+    // A released slot, linked through its own storage.
+    struct FreeSlot
+    {
+        FreeSlot* next;
+    };
+
+    typedef typename std::allocator_traits<Alloc>::template rebind_alloc<Chunk> ChunkAlloc;
+    typedef std::allocator_traits<ChunkAlloc> ChunkTraits;
+
+    /**
+    * The blocks behind one or more pools. Once merged into another set,
+    * a set holds no blocks and keeps the one it forwards to alive.
+    */
+    struct BlockSet
+    {
+        explicit BlockSet(const ChunkAlloc& alloc);
+        ~BlockSet();
+
+        std::mutex lock;
+        ChunkAlloc alloc;
+        Block* blocks;
+        std::size_t blockCount;
+        std::shared_ptr<BlockSet> forward;
+    };
+
+    // Pools own their blocks and cannot be copied.
+    NodePool(const NodePool&);
+    NodePool& operator=(const NodePool&);
+
+    void grow();
+    const std::shared_ptr<BlockSet>& blockSet();
+    static std::shared_ptr<BlockSet> rootSet(std::shared_ptr<BlockSet> set);
+
+    static const std::size_t kFirstBlockSlots = 32;
+    static const std::size_t kMaxBlockSlots = 8192;
+
+    ChunkAlloc alloc_;
+    std::size_t slotSize_;
+    std::size_t slotAlign_;
+    std::size_t nextBlockSlots_;
+    FreeSlot* freeList_;
+    unsigned char* bump_;
+    unsigned char* bumpEnd_;
+    std::shared_ptr<BlockSet> blocks_;
+};
+
+/*
+  -------------------------------------------
+  Begin implementations for the NodePool class.
+  -------------------------------------------
+*/
+
+/**
+* Creates an empty pool for slots of slotSize bytes aligned to slotAlign.
+* No memory is requested until the first allocation.
+*/
+template<typename Alloc>
+NodePool<Alloc>::NodePool(std::size_t slotSize, std::size_t slotAlign, const Alloc& alloc) :
+    alloc_(alloc),
+    slotSize_(0),
+    slotAlign_(0),
+    nextBlockSlots_(kFirstBlockSlots),
+    freeList_(NULL),
+    bump_(NULL),
+    bumpEnd_(NULL),
+    blocks_()
+{
+    if(slotAlign < alignof(FreeSlot)) {
+        slotAlign = alignof(FreeSlot);
+    }
+    if(slotSize < sizeof(FreeSlot)) {
+        slotSize = sizeof(FreeSlot);
+    }
+    // round the slot up so consecutive slots stay aligned
+    slotSize_ = (slotSize + slotAlign - 1) / slotAlign * slotAlign;
+    slotAlign_ = slotAlign;
+}
+
+/**
+* Destructor, which lets go of the pool's blocks: they return to the
+* upstream allocator unless another pool still shares them. Objects still
+* living in the slots are not destroyed.
+*/
+template<typename Alloc>
+NodePool<Alloc>::~NodePool()
+{
+    release();
+}
+
+/**
+* Returns uninitialized storage for one slot, reusing a released slot
+* if one is available.
+*/
+template<typename Alloc>
+void* NodePool<Alloc>::allocate()
+{
+    if(freeList_ != NULL) {
+        FreeSlot* slot = freeList_;
+        freeList_ = slot->next;
+        return slot;
+    }
+    if(bump_ == bumpEnd_) {
+        grow();
+    }
+    void* slot = bump_;
+    bump_ += slotSize_;
+    return slot;
+}
+
+/**
+* Gives a slot back to the pool. The object in it must already have been
+* destroyed. The memory stays in the pool and is reused by allocate().
+* The slot may come from any pool sharing this one's blocks.
+*/
+template<typename Alloc>
+void NodePool<Alloc>::deallocate(void* slot)
+{
+    if(slot == NULL) {
+        return;
+    }
+    FreeSlot* freed = static_cast<FreeSlot*>(slot);
+    freed->next = freeList_;
+    freeList_ = freed;
+}
+
+/**
+* Lets go of the pool's blocks and empties it. If no other pool shares
+* them, as soleOwner() tells, every block returns to the upstream
+* allocator in one pass and all slots handed out become invalid;
+* otherwise they stay with the pools still sharing them.
+*/
+template<typename Alloc>
+void NodePool<Alloc>::release()
+{
+    blocks_.reset();
+    nextBlockSlots_ = kFirstBlockSlots;
+    freeList_ = NULL;
+    bump_ = NULL;
+    bumpEnd_ = NULL;
+}
+
+/**
+* Returns the (rounded up) size of one slot in bytes.
+*/
+template<typename Alloc>
+std::size_t NodePool<Alloc>::slotSize() const
+{
+    return slotSize_;
+}
+
+/**
+* Returns how many blocks the pool's set holds, counting those of other
+* pools it shares them with.
+*/
+template<typename Alloc>
+std::size_t NodePool<Alloc>::blockCount() const
+{
+    if(!blocks_) {
+        return 0;
+    }
+    std::shared_ptr<BlockSet> root = rootSet(blocks_);
+    std::lock_guard<std::mutex> guard(root->lock);
+    return root->blockCount;
+}
+
+/**
+* Returns a copy of the upstream allocator.
+*/
+template<typename Alloc>
+Alloc NodePool<Alloc>::get_allocator() const
+{
+    return Alloc(alloc_);
+}
+
+/**
+* Puts the blocks of the pools a and b into one set, so nodes from either
+* may be freed into both. The pools themselves stay separate. Throws
+* std::invalid_argument if the pools have different slot sizes or
+* allocators that cannot free each other's blocks.
+*/
+template<typename Alloc>
+void NodePool<Alloc>::unite(std::shared_ptr<NodePool>& a, std::shared_ptr<NodePool>& b)
+{
+    if(a->slotSize_ != b->slotSize_ || !(a->alloc_ == b->alloc_)) {
+        throw std::invalid_argument("node pools cannot be merged");
+    }
+    for(;;) {
+        std::shared_ptr<BlockSet> ra = rootSet(a->blockSet());
+        std::shared_ptr<BlockSet> rb = rootSet(b->blockSet());
+        if(ra == rb) {
+            return;
+        }
+        // lock in address order, and start over if either was merged meanwhile
+        std::unique_lock<std::mutex> first((ra < rb ? ra : rb)->lock);
+        std::unique_lock<std::mutex> second((ra < rb ? rb : ra)->lock);
+        if(ra->forward || rb->forward) {
+            continue;
+        }
+        // the smaller set forwards to the larger, which keeps paths short
+        if(ra->blockCount < rb->blockCount) {
+            std::swap(ra, rb);
+        }
+        if(rb->blocks != NULL) {
+            Block* last = rb->blocks;
+            while(last->next != NULL) {
+                last = last->next;
+            }
+            last->next = ra->blocks;
+            ra->blocks = rb->blocks;
+        }
+        ra->blockCount += rb->blockCount;
+        rb->blocks = NULL;
+        rb->blockCount = 0;
+        rb->forward = ra;
+        return;
+    }
+}
+
+/**
+* Returns true if the handle pool is the only way to reach its blocks,
+* so releasing them cannot pull nodes out from under another tree.
+*/
+template<typename Alloc>
+bool NodePool<Alloc>::soleOwner(const std::shared_ptr<NodePool>& pool)
+{
+    if(pool.use_count() != 1) {
+        return false;
+    }
+    std::shared_ptr<BlockSet> set = pool->blocks_;
+    while(set) {
+        // one count for the link that led here, one for the local copy
+        if(set.use_count() != 2) {
+            return false;
+        }
+        std::lock_guard<std::mutex> guard(set->lock);
+        set = set->forward;
+    }
+    return true;
+}
+
+/**
+* Returns a new empty pool with pool's slot size, alignment and allocator
+* that shares nothing with it, for a tree whose nodes have moved away.
+*/
+template<typename Alloc>
+std::shared_ptr<NodePool<Alloc> > NodePool<Alloc>::emptyLike(const std::shared_ptr<NodePool>& pool)
+{
+    Alloc alloc(pool->get_allocator());
+    return std::allocate_shared<NodePool>(alloc, pool->slotSize_, pool->slotAlign_, alloc);
+}
+
+/**
+* Returns the pool's block set, creating an empty one on first use.
+*/
+template<typename Alloc>
+const std::shared_ptr<typename NodePool<Alloc>::BlockSet>& NodePool<Alloc>::blockSet()
+{
+    if(!blocks_) {
+        blocks_ = std::allocate_shared<BlockSet>(alloc_, alloc_);
+    }
+    return blocks_;
+}
+
+/**
+* Returns the set that set forwards to, following the chain to its end.
+*/
+template<typename Alloc>
+std::shared_ptr<typename NodePool<Alloc>::BlockSet> NodePool<Alloc>::rootSet(std::shared_ptr<BlockSet> set)
+{
+    for(;;) {
+        std::shared_ptr<BlockSet> next;
+        {
+            std::lock_guard<std::mutex> guard(set->lock);
+            if(!set->forward) {
+                return set;
+            }
+            next = set->forward;
+        }
+        set = next;
+    }
+}
+
+/**
+* Requests a new block from the upstream allocator and adds it to the
+* pool's set. Blocks double in size up to kMaxBlockSlots slots, so small
+* trees stay small and large trees make few upstream calls.
+*/
+template<typename Alloc>
+void NodePool<Alloc>::grow()
+{
+    const std::size_t headerChunks = (sizeof(Block) + sizeof(Chunk) - 1) / sizeof(Chunk);
+    const std::size_t slotBytes = nextBlockSlots_ * slotSize_;
+    const std::size_t chunks = headerChunks + (slotBytes + sizeof(Chunk) - 1) / sizeof(Chunk);
+
+    blockSet();
+    Chunk* raw = ChunkTraits::allocate(alloc_, chunks);
+    Block* block = new (raw) Block;
+    block->chunks = chunks;
+    for(;;) {
+        std::shared_ptr<BlockSet> root = rootSet(blocks_);
+        std::lock_guard<std::mutex> guard(root->lock);
+        if(!root->forward) {
+            block->next = root->blocks;
+            root->blocks = block;
+            ++root->blockCount;
+            // later lookups start from the root
+            blocks_ = root;
+            break;
+        }
+    }
+
+    bump_ = reinterpret_cast<unsigned char*>(raw + headerChunks);
+    bumpEnd_ = bump_ + slotBytes;
+
+    if(nextBlockSlots_ < kMaxBlockSlots) {
+        nextBlockSlots_ *= 2;
+    }
+}
+
+/**
+* An empty set of blocks, freed through alloc.
+*/
+template<typename Alloc>
+NodePool<Alloc>::BlockSet::BlockSet(const ChunkAlloc& alloc) :
+    alloc(alloc),
+    blocks(NULL),
+    blockCount(0),
+    forward()
+{
+}
+
+/**
+* Returns every block to the upstream allocator in one pass.
+*/
+template<typename Alloc>
+NodePool<Alloc>::BlockSet::~BlockSet()
+{
+    while(blocks != NULL) {
+        Block* next = blocks->next;
+        ChunkTraits::deallocate(alloc, reinterpret_cast<Chunk*>(blocks), blocks->chunks);
+        blocks = next;
+    }
+}
+
+/*
+  -----------------------------------------
+  End implementations for the NodePool class.
+  -----------------------------------------
+*/
+
+#endif
@@ -0,0 +1,86 @@
+#ifndef PARALLEL_SORT_H
+#define PARALLEL_SORT_H
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <thread>
+#include <vector>
+
+/**
+* Returns how many worker threads to use when the caller asked for
+* "threads" (0 meaning one per hardware thread).
+*/
+inline unsigned sortThreadCount(unsigned threads)
+{
+    if(threads == 0) {
+        threads = std::thread::hardware_concurrency();
+    }
+    return threads == 0 ? 1 : threads;
+}
+
+/**
+* Stable sort of [first, last) using up to "threads" threads (0 picks one
+* per hardware thread). The range is cut into one run per thread, the runs
+* are sorted concurrently, and neighbouring runs are then merged pairwise,
+* again concurrently, until one run is left. Small ranges are sorted on the
+* calling thread.
+*/
+template<typename RandomIt, typename Compare>
+void parallelStableSort(RandomIt first, RandomIt last, Compare comp, unsigned threads = 0)
+{
+    typedef typename std::iterator_traits<RandomIt>::difference_type Diff;
+    const Diff minRun = 1 << 14;
+
+    Diff n = last - first;
+    Diff runs = static_cast<Diff>(sortThreadCount(threads));
+    if(runs > n / minRun) {
+        runs = n / minRun;
+    }
+    if(runs <= 1) {
+        std::stable_sort(first, last, comp);
+        return;
+    }
+
+    // run boundaries: bounds[i] .. bounds[i + 1]
+    std::vector<RandomIt> bounds;
+    for(Diff i = 0; i < runs; ++i) {
+        bounds.push_back(first + n * i / runs);
+    }
+    bounds.push_back(last);
+
+    std::vector<std::thread> workers;
+    for(Diff i = 0; i < runs; ++i) {
+        RandomIt lo = bounds[i];
+        RandomIt hi = bounds[i + 1];
+        workers.push_back(std::thread([lo, hi, comp]() { std::stable_sort(lo, hi, comp); }));
+    }
+    for(std::size_t i = 0; i < workers.size(); ++i) {
+        workers[i].join();
+    }
+
+    // merge neighbouring runs until only one is left
+    while(bounds.size() > 2) {
+        std::vector<RandomIt> merged;
+        workers.clear();
+        std::size_t i = 0;
+        for(; i + 2 < bounds.size(); i += 2) {
+            RandomIt lo = bounds[i];
+            RandomIt mid = bounds[i + 1];
+            RandomIt hi = bounds[i + 2];
+            workers.push_back(std::thread([lo, mid, hi, comp]() { std::inplace_merge(lo, mid, hi, comp); }));
+            merged.push_back(lo);
+        }
+        // an odd run out is carried over unchanged
+        if(i + 1 < bounds.size()) {
+            merged.push_back(bounds[i]);
+        }
+        merged.push_back(last);
+        for(std::size_t w = 0; w < workers.size(); ++w) {
+            workers[w].join();
+        }
+        bounds.swap(merged);
+    }
+}
+
+#endif
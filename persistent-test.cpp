@@ -0,0 +1,179 @@
+#include <iostream>
+#include <cstdlib>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <condition_variable>
+#include <random>
+#include <thread>
+#include <utility>
+#include "persistent_avlbst.h"
+
+using namespace std;
+
+// Checked test for PersistentAVLTree snapshots. Snapshots taken along a
+// run of random inserts, overwrites and removes must keep showing the
+// items of the moment they were taken, and snapshots handed to another
+// thread must read back intact and free their nodes there while the tree
+// keeps taking writes. It exits with status 1 if any check fails; build
+// it with -fsanitize=address or thread ("make tsan") to catch a node freed
+// too early or counted without synchronization.
+
+typedef PersistentAVLTree<long, long> Tree;
+typedef Tree::Snapshot Snapshot;
+
+static const long kRange = 20000;
+
+static int failures = 0;
+
+static void check(bool ok, const char* what)
+{
+    if(!ok) {
+        if(++failures <= 20) {
+            cerr << "FAIL " << what << endl;
+        }
+    }
+}
+
+// Compares every item, the size and a sample of lookups with expected.
+static bool matches(const Snapshot& snapshot, const map<long, long>& expected)
+{
+    if(snapshot.size() != expected.size()) {
+        return false;
+    }
+    Snapshot::const_iterator it = snapshot.begin();
+    for(map<long, long>::const_iterator want = expected.begin(); want != expected.end(); ++want, ++it) {
+        if(it == snapshot.end() || it->first != want->first || it->second != want->second) {
+            return false;
+        }
+    }
+    if(it != snapshot.end()) {
+        return false;
+    }
+    for(long key = 0; key < kRange; key += 97) {
+        map<long, long>::const_iterator want = expected.find(key);
+        Snapshot::const_iterator found = snapshot.find(key);
+        if(want == expected.end() ? found != snapshot.end()
+                                  : found == snapshot.end() || found->second != want->second) {
+            return false;
+        }
+        want = expected.lower_bound(key);
+        found = snapshot.lower_bound(key);
+        if(want == expected.end() ? found != snapshot.end()
+                                  : found == snapshot.end() || found->first != want->first) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Makes ops random writes to both tree and expected: overwrites and new
+// keys half the time, removes the rest.
+static void randomWrites(Tree& tree, map<long, long>& expected, mt19937_64& rng, size_t ops)
+{
+    for(size_t i = 0; i < ops; ++i) {
+        long key = static_cast<long>(rng() % kRange);
+        if(rng() % 2) {
+            long value = static_cast<long>(rng() % 1000000);
+            tree.insert(make_pair(key, value));
+            expected[key] = value;
+        }
+        else {
+            check(tree.remove(key) == (expected.erase(key) == 1), "remove disagrees with std::map");
+        }
+    }
+}
+
+// Snapshots taken one after another stay as they were while the tree and
+// the snapshots taken after them change.
+static void testSnapshotsStayUnchanged()
+{
+    mt19937_64 rng(1);
+    Tree tree;
+    map<long, long> expected;
+    randomWrites(tree, expected, rng, 10000);
+
+    vector<pair<Snapshot, map<long, long> > > taken;
+    for(int round = 0; round < 8; ++round) {
+        taken.push_back(make_pair(tree.snapshot(), expected));
+        randomWrites(tree, expected, rng, 2000);
+    }
+    check(matches(tree, expected), "tree differs from std::map after writes");
+    for(size_t i = 0; i < taken.size(); ++i) {
+        check(matches(taken[i].first, taken[i].second), "snapshot changed after later writes");
+    }
+
+    // a tree started from a snapshot writes without touching it
+    Tree branch(taken[0].first);
+    map<long, long> branchExpected = taken[0].second;
+    randomWrites(branch, branchExpected, rng, 5000);
+    check(matches(branch, branchExpected), "branch differs from std::map after writes");
+    check(matches(taken[0].first, taken[0].second), "snapshot changed by writes to a tree started from it");
+
+    // dropping the older snapshots leaves the newer ones whole
+    taken.erase(taken.begin(), taken.begin() + 4);
+    tree.clear();
+    for(size_t i = 0; i < taken.size(); ++i) {
+        check(matches(taken[i].first, taken[i].second), "snapshot changed after older ones were dropped");
+    }
+}
+
+// Hands snapshots to a second thread, which checks them and drops them
+// while this thread keeps writing to the tree they came from.
+static void testDropOnAnotherThread()
+{
+    mutex lock;
+    condition_variable ready;
+    deque<pair<Snapshot, map<long, long> > > queue;
+    bool done = false;
+    int bad = 0;
+
+    thread dropper([&]() {
+        unique_lock<mutex> guard(lock);
+        for(;;) {
+            ready.wait(guard, [&]() { return done || !queue.empty(); });
+            if(queue.empty()) {
+                return;
+            }
+            {
+                pair<Snapshot, map<long, long> > item = queue.front();
+                queue.pop_front();
+                guard.unlock();
+                bad += !matches(item.first, item.second);
+                // item is often the last view of its nodes and frees them here
+            }
+            guard.lock();
+        }
+    });
+
+    mt19937_64 rng(2);
+    Tree tree;
+    map<long, long> expected;
+    for(int round = 0; round < 200; ++round) {
+        randomWrites(tree, expected, rng, 500);
+        {
+            lock_guard<mutex> guard(lock);
+            queue.push_back(make_pair(tree.snapshot(), expected));
+        }
+        ready.notify_one();
+    }
+    {
+        lock_guard<mutex> guard(lock);
+        done = true;
+    }
+    ready.notify_one();
+    dropper.join();
+
+    check(bad == 0, "snapshot read on another thread differs from its moment");
+    check(matches(tree, expected), "tree differs from std::map after snapshots were dropped");
+}
+
+int main(int argc, char *argv[])
+{
+    testSnapshotsStayUnchanged();
+    testDropOnAnotherThread();
+
+    cout << (failures == 0 ? "All persistent checks passed" : "Persistent checks FAILED")
+         << " (" << failures << " failures)" << endl;
+    return failures == 0 ? 0 : 1;
+}
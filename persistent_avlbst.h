@@ -0,0 +1,905 @@
+#ifndef PERSISTENT_AVLBST_H
+#define PERSISTENT_AVLBST_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <utility>
+#include "bst.h"
+
+/**
+* A node of a persistent AVL tree. Nodes are shared between a tree and its
+* snapshots and counted: a node reachable from one place only (refs == 1)
+* may be changed in place by the tree that owns it, while a shared node is
+* never changed again. There are no parent links, since a shared node has
+* more than one parent.
+*/
+template <typename Key, typename Value>
+class PersistentAVLNode
+{
+public:
+    PersistentAVLNode(const Key& key, const Value& value);
+    PersistentAVLNode(const PersistentAVLNode<Key, Value>& other);
+
+    const std::pair<const Key, Value>& getItem() const;
+    const Key& getKey() const;
+    const Value& getValue() const;
+    void setValue(const Value& value);
+
+    PersistentAVLNode<Key, Value>* getLeft() const;
+    PersistentAVLNode<Key, Value>* getRight() const;
+    void setLeft(PersistentAVLNode<Key, Value>* left);
+    void setRight(PersistentAVLNode<Key, Value>* right);
+
+    int getHeight() const;
+    void setHeight(int height);
+
+    // Reference counting; release() returns true when the last reference went
+    void retain();
+    bool release();
+    bool isShared() const;
+
+protected:
+    std::pair<const Key, Value> item_;
+    PersistentAVLNode<Key, Value>* left_;
+    PersistentAVLNode<Key, Value>* right_;
+    std::atomic<std::uint32_t> refs_;
+    int8_t height_;
+};
+
+/*
+  -------------------------------------------------
+  Begin implementations for the PersistentAVLNode class.
+  -------------------------------------------------
+*/
+
+/**
+* Constructor for an unshared leaf.
+*/
+template<class Key, class Value>
+PersistentAVLNode<Key, Value>::PersistentAVLNode(const Key& key, const Value& value) :
+    item_(key, value),
+    left_(NULL),
+    right_(NULL),
+    refs_(1),
+    height_(1)
+{
+}
+
+/**
+* Copy constructor, giving an unshared copy with the same item and
+* children. The caller takes the extra references to the children.
+*/
+template<class Key, class Value>
+PersistentAVLNode<Key, Value>::PersistentAVLNode(const PersistentAVLNode<Key, Value>& other) :
+    item_(other.item_),
+    left_(other.left_),
+    right_(other.right_),
+    refs_(1),
+    height_(other.height_)
+{
+}
+
+template<class Key, class Value>
+const std::pair<const Key, Value>& PersistentAVLNode<Key, Value>::getItem() const
+{
+    return item_;
+}
+
+template<class Key, class Value>
+const Key& PersistentAVLNode<Key, Value>::getKey() const
+{
+    return item_.first;
+}
+
+template<class Key, class Value>
+const Value& PersistentAVLNode<Key, Value>::getValue() const
+{
+    return item_.second;
+}
+
+template<class Key, class Value>
+void PersistentAVLNode<Key, Value>::setValue(const Value& value)
+{
+    item_.second = value;
+}
+
+template<class Key, class Value>
+PersistentAVLNode<Key, Value>* PersistentAVLNode<Key, Value>::getLeft() const
+{
+    return left_;
+}
+
+template<class Key, class Value>
+PersistentAVLNode<Key, Value>* PersistentAVLNode<Key, Value>::getRight() const
+{
+    return right_;
+}
+
+template<class Key, class Value>
+void PersistentAVLNode<Key, Value>::setLeft(PersistentAVLNode<Key, Value>* left)
+{
+    left_ = left;
+}
+
+template<class Key, class Value>
+void PersistentAVLNode<Key, Value>::setRight(PersistentAVLNode<Key, Value>* right)
+{
+    right_ = right;
+}
+
+template<class Key, class Value>
+int PersistentAVLNode<Key, Value>::getHeight() const
+{
+    return height_;
+}
+
+template<class Key, class Value>
+void PersistentAVLNode<Key, Value>::setHeight(int height)
+{
+    height_ = static_cast<int8_t>(height);
+}
+
+template<class Key, class Value>
+void PersistentAVLNode<Key, Value>::retain()
+{
+    refs_.fetch_add(1, std::memory_order_relaxed);
+}
+
+/**
+* Drops a reference. Everything the dropping thread did with the node
+* happens before whoever frees it or finds it unshared.
+*/
+template<class Key, class Value>
+bool PersistentAVLNode<Key, Value>::release()
+{
+    return refs_.fetch_sub(1, std::memory_order_acq_rel) == 1;
+}
+
+template<class Key, class Value>
+bool PersistentAVLNode<Key, Value>::isShared() const
+{
+    return refs_.load(std::memory_order_acquire) != 1;
+}
+
+/*
+  -----------------------------------------------
+  End implementations for the PersistentAVLNode class.
+  -----------------------------------------------
+*/
+
+
+/**
+* A read-only, reference-counted view of a persistent AVL tree at one
+* moment. Copying one is O(1) and shares every node; the nodes are freed
+* when the last view or tree that reaches them goes away. Different views
+* of the same nodes may be used and dropped on different threads, but one
+* view object is not itself safe to share without a lock. Iterators stay
+* valid as long as the view they came from.
+*/
+template <class Key, class Value,
+          class Compare = std::less<Key>,
+          class Alloc = std::allocator<std::pair<const Key, Value> > >
+class PersistentAVLSnapshot
+{
+protected:
+    typedef PersistentAVLNode<Key, Value> NodeT;
+
+public:
+    typedef Compare key_compare;
+    typedef Alloc allocator_type;
+
+    PersistentAVLSnapshot(const PersistentAVLSnapshot& other);
+    PersistentAVLSnapshot& operator=(const PersistentAVLSnapshot& other);
+    ~PersistentAVLSnapshot();
+
+    std::size_t size() const;
+    bool empty() const;
+    int height() const;
+
+    /**
+    * A forward iterator over the items in key order. It keeps the path of
+    * nodes still to be visited, so it needs no parent links.
+    */
+    class const_iterator
+    {
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef std::pair<const Key, Value> value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const std::pair<const Key, Value>* pointer;
+        typedef const std::pair<const Key, Value>& reference;
+
+        const_iterator();
+        const_iterator(const const_iterator& other);
+        const_iterator& operator=(const const_iterator& other);
+        reference operator*() const;
+        pointer operator->() const;
+        bool operator==(const const_iterator& rhs) const;
+        bool operator!=(const const_iterator& rhs) const;
+        const_iterator& operator++();
+        const_iterator operator++(int);
+
+    protected:
+        friend class PersistentAVLSnapshot<Key, Value, Compare, Alloc>;
+        void push(NodeT* node);
+        void pushLeftSpine(NodeT* node);
+
+        // An AVL tree of height 96 would hold more than 2^64 items.
+        static const int kMaxDepth = 96;
+
+        // ancestors still to be visited; the current node is on top
+        NodeT* pending_[kMaxDepth];
+        int depth_;
+    };
+
+    const_iterator begin() const;
+    const_iterator end() const;
+    const_iterator find(const Key& key) const;
+    const_iterator lower_bound(const Key& key) const;
+    const_iterator upper_bound(const Key& key) const;
+
+protected:
+    typedef typename std::allocator_traits<Alloc>::template rebind_alloc<NodeT> NodeAlloc;
+    typedef std::allocator_traits<NodeAlloc> NodeTraits;
+
+    PersistentAVLSnapshot(const Compare& comp, const Alloc& alloc);
+
+    const_iterator bound(const Key& key, bool strict) const;
+    static void retain(NodeT* node);
+    void release(NodeT* node);
+
+    NodeT* root_;
+    std::size_t size_;
+    Compare comp_;
+    NodeAlloc alloc_;
+};
+
+/*
+  ------------------------------------------------------------------
+  Begin implementations for the PersistentAVLSnapshot::const_iterator class.
+  ------------------------------------------------------------------
+*/
+
+/**
+* Default constructor, giving an end iterator.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+PersistentAVLSnapshot<Key, Value, Compare, Alloc>::const_iterator::const_iterator() :
+    depth_(0)
+{
+}
+
+/**
+* Copy constructor, copying only the part of the path in use.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+PersistentAVLSnapshot<Key, Value, Compare, Alloc>::const_iterator::const_iterator(const const_iterator& other) :
+    depth_(other.depth_)
+{
+    std::copy(other.pending_, other.pending_ + depth_, pending_);
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+typename PersistentAVLSnapshot<Key, Value, Compare, Alloc>::const_iterator&
+PersistentAVLSnapshot<Key, Value, Compare, Alloc>::const_iterator::operator=(const const_iterator& other)
+{
+    depth_ = other.depth_;
+    std::copy(other.pending_, other.pending_ + depth_, pending_);
+    return *this;
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+typename PersistentAVLSnapshot<Key, Value, Compare, Alloc>::const_iterator::reference
+PersistentAVLSnapshot<Key, Value, Compare, Alloc>::const_iterator::operator*() const
+{
+    return pending_[depth_ - 1]->getItem();
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+typename PersistentAVLSnapshot<Key, Value, Compare, Alloc>::const_iterator::pointer
+PersistentAVLSnapshot<Key, Value, Compare, Alloc>::const_iterator::operator->() const
+{
+    return &(pending_[depth_ - 1]->getItem());
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+bool PersistentAVLSnapshot<Key, Value, Compare, Alloc>::const_iterator::operator==(const const_iterator& rhs) const
+{
+    if(depth_ == 0 || rhs.depth_ == 0){
+        return depth_ == rhs.depth_;
+    }
+    return pending_[depth_ - 1] == rhs.pending_[rhs.depth_ - 1];
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+bool PersistentAVLSnapshot<Key, Value, Compare, Alloc>::const_iterator::operator!=(const const_iterator& rhs) const
+{
+    return !(*this == rhs);
+}
+
+/**
+* Advances to the next item in amortized O(1).
+*/
+template<class Key, class Value, class Compare, class Alloc>
+typename PersistentAVLSnapshot<Key, Value, Compare, Alloc>::const_iterator&
+PersistentAVLSnapshot<Key, Value, Compare, Alloc>::const_iterator::operator++()
+{
+    NodeT* node = pending_[--depth_];
+    pushLeftSpine(node->getRight());
+    return *this;
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+typename PersistentAVLSnapshot<Key, Value, Compare, Alloc>::const_iterator
+PersistentAVLSnapshot<Key, Value, Compare, Alloc>::const_iterator::operator++(int)
+{
+    const_iterator old(*this);
+    ++(*this);
+    return old;
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+void PersistentAVLSnapshot<Key, Value, Compare, Alloc>::const_iterator::push(NodeT* node)
+{
+    pending_[depth_++] = node;
+}
+
+/**
+* Pushes node and its chain of left children, so the smallest item under
+* node ends up on top.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+void PersistentAVLSnapshot<Key, Value, Compare, Alloc>::const_iterator::pushLeftSpine(NodeT* node)
+{
+    for(; node != NULL; node = node->getLeft()){
+        push(node);
+    }
+}
+
+/*
+  ----------------------------------------------------------------
+  End implementations for the PersistentAVLSnapshot::const_iterator class.
+  ----------------------------------------------------------------
+*/
+
+/*
+  -----------------------------------------------------
+  Begin implementations for the PersistentAVLSnapshot class.
+  -----------------------------------------------------
+*/
+
+/**
+* Constructor for an empty view, used by PersistentAVLTree.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+PersistentAVLSnapshot<Key, Value, Compare, Alloc>::PersistentAVLSnapshot(const Compare& comp, const Alloc& alloc) :
+    root_(NULL),
+    size_(0),
+    comp_(comp),
+    alloc_(alloc)
+{
+}
+
+/**
+* Copy constructor; O(1), sharing every node with other.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+PersistentAVLSnapshot<Key, Value, Compare, Alloc>::PersistentAVLSnapshot(const PersistentAVLSnapshot& other) :
+    root_(other.root_),
+    size_(other.size_),
+    comp_(other.comp_),
+    alloc_(other.alloc_)
+{
+    retain(root_);
+}
+
+/**
+* Assignment; O(1) apart from freeing nodes only this view still reached.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+PersistentAVLSnapshot<Key, Value, Compare, Alloc>&
+PersistentAVLSnapshot<Key, Value, Compare, Alloc>::operator=(const PersistentAVLSnapshot& other)
+{
+    retain(other.root_);
+    release(root_);
+    root_ = other.root_;
+    size_ = other.size_;
+    comp_ = other.comp_;
+    return *this;
+}
+
+/**
+* Destructor, which frees the nodes no other view or tree reaches.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+PersistentAVLSnapshot<Key, Value, Compare, Alloc>::~PersistentAVLSnapshot()
+{
+    release(root_);
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+std::size_t PersistentAVLSnapshot<Key, Value, Compare, Alloc>::size() const
+{
+    return size_;
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+bool PersistentAVLSnapshot<Key, Value, Compare, Alloc>::empty() const
+{
+    return root_ == NULL;
+}
+
+/**
+* Returns the height; an empty tree has height 0.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+int PersistentAVLSnapshot<Key, Value, Compare, Alloc>::height() const
+{
+    return (root_ == NULL) ? 0 : root_->getHeight();
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+typename PersistentAVLSnapshot<Key, Value, Compare, Alloc>::const_iterator
+PersistentAVLSnapshot<Key, Value, Compare, Alloc>::begin() const
+{
+    const_iterator it;
+    it.pushLeftSpine(root_);
+    return it;
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+typename PersistentAVLSnapshot<Key, Value, Compare, Alloc>::const_iterator
+PersistentAVLSnapshot<Key, Value, Compare, Alloc>::end() const
+{
+    return const_iterator();
+}
+
+/**
+* Returns an iterator to the item with the given key, or end(). The walk
+* stops at the match; the match's right subtree is what ++ visits next.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+typename PersistentAVLSnapshot<Key, Value, Compare, Alloc>::const_iterator
+PersistentAVLSnapshot<Key, Value, Compare, Alloc>::find(const Key& key) const
+{
+    const_iterator it;
+    NodeT* current = root_;
+    while(current != NULL){
+        KeyOrder order = ThreeWayCompare<Compare>::order(comp_, key, current->getKey());
+        if(!(order.less | order.greater)){
+            it.push(current);
+            return it;
+        }
+        if(order.less){
+            it.push(current);
+            current = current->getLeft();
+        }
+        else {
+            current = current->getRight();
+        }
+    }
+    return end();
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+typename PersistentAVLSnapshot<Key, Value, Compare, Alloc>::const_iterator
+PersistentAVLSnapshot<Key, Value, Compare, Alloc>::lower_bound(const Key& key) const
+{
+    return bound(key, false);
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+typename PersistentAVLSnapshot<Key, Value, Compare, Alloc>::const_iterator
+PersistentAVLSnapshot<Key, Value, Compare, Alloc>::upper_bound(const Key& key) const
+{
+    return bound(key, true);
+}
+
+/**
+* Returns an iterator to the first item whose key is not less than key,
+* or with strict set, greater than key. The nodes passed on the way down
+* where the walk went left are exactly the ones still to be visited.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+typename PersistentAVLSnapshot<Key, Value, Compare, Alloc>::const_iterator
+PersistentAVLSnapshot<Key, Value, Compare, Alloc>::bound(const Key& key, bool strict) const
+{
+    const_iterator it;
+    NodeT* current = root_;
+    while(current != NULL){
+        bool goesLeft = strict ? comp_(key, current->getKey()) : !comp_(current->getKey(), key);
+        if(goesLeft){
+            it.push(current);
+            current = current->getLeft();
+        }
+        else {
+            current = current->getRight();
+        }
+    }
+    return it;
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+void PersistentAVLSnapshot<Key, Value, Compare, Alloc>::retain(NodeT* node)
+{
+    if(node != NULL){
+        node->retain();
+    }
+}
+
+/**
+* Drops one reference to node, freeing it and, in turn, dropping its
+* references to its children if it was the last.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+void PersistentAVLSnapshot<Key, Value, Compare, Alloc>::release(NodeT* node)
+{
+    while(node != NULL && node->release()){
+        NodeT* left = node->getLeft();
+        NodeT* right = node->getRight();
+        NodeTraits::destroy(alloc_, node);
+        NodeTraits::deallocate(alloc_, node, 1);
+        release(left);
+        node = right;
+    }
+}
+
+/*
+  ---------------------------------------------------
+  End implementations for the PersistentAVLSnapshot class.
+  ---------------------------------------------------
+*/
+
+
+/**
+* An AVL tree with O(1) snapshots. snapshot() hands out a view that keeps
+* seeing the tree as it is now however the tree changes afterwards.
+*
+* Updates copy on write: a node that a snapshot still shares is copied
+* before it is changed, and the copy's parent, then its parent, and so on
+* up to the root, are changed (so copied, if shared) in turn. Nodes that
+* nothing else shares are changed in place, so with no snapshots alive an
+* update allocates no more than an ordinary AVL tree, and the memory kept
+* alive by a snapshot is O(log n) nodes per update made since it was taken.
+*
+* The tree itself is a view, so it can be copied in O(1) too, and a tree
+* can be started from a snapshot. Snapshots may be read on other threads
+* while the tree is updated; Alloc must then be safe to call from several
+* threads, since whoever drops the last reference frees the nodes.
+*/
+template <class Key, class Value,
+          class Compare = std::less<Key>,
+          class Alloc = std::allocator<std::pair<const Key, Value> > >
+class PersistentAVLTree : public PersistentAVLSnapshot<Key, Value, Compare, Alloc>
+{
+public:
+    typedef PersistentAVLSnapshot<Key, Value, Compare, Alloc> Snapshot;
+
+    explicit PersistentAVLTree(const Compare& comp = Compare(), const Alloc& alloc = Alloc());
+    explicit PersistentAVLTree(const Snapshot& snapshot);
+
+    void insert(const std::pair<const Key, Value>& keyValuePair);
+    bool remove(const Key& key);
+    void clear();
+    Snapshot snapshot() const;
+
+protected:
+    typedef typename Snapshot::NodeT NodeT;
+    typedef typename Snapshot::NodeTraits NodeTraits;
+
+    NodeT* createNode(const std::pair<const Key, Value>& keyValuePair);
+    void makeUnique(NodeT*& slot);
+    void insertAt(NodeT*& slot, const std::pair<const Key, Value>& keyValuePair, bool& added);
+    void removeAt(NodeT*& slot, const Key& key);
+    NodeT* takeMin(NodeT*& slot);
+    void rebalance(NodeT*& slot);
+    void rotateLeft(NodeT*& slot);
+    void rotateRight(NodeT*& slot);
+    static int heightOf(NodeT* node);
+    static void updateHeight(NodeT* node);
+};
+
+/*
+  -------------------------------------------------
+  Begin implementations for the PersistentAVLTree class.
+  -------------------------------------------------
+*/
+
+/**
+* Default constructor.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+PersistentAVLTree<Key, Value, Compare, Alloc>::PersistentAVLTree(const Compare& comp, const Alloc& alloc) :
+    Snapshot(comp, alloc)
+{
+}
+
+/**
+* Starts a tree from a snapshot in O(1). Changes to the tree do not show
+* in the snapshot.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+PersistentAVLTree<Key, Value, Compare, Alloc>::PersistentAVLTree(const Snapshot& snapshot) :
+    Snapshot(snapshot)
+{
+}
+
+/**
+* Inserts the item, overwriting the value if the key is already there.
+* O(log n); copies the shared nodes on the path.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+void PersistentAVLTree<Key, Value, Compare, Alloc>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    bool added = false;
+    insertAt(this->root_, keyValuePair, added);
+    if(added){
+        ++this->size_;
+    }
+}
+
+/**
+* Removes the item with the given key, if any, and reports whether there
+* was one. O(log n); copies the shared nodes on the path.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+bool PersistentAVLTree<Key, Value, Compare, Alloc>::remove(const Key& key)
+{
+    // look first, so a missing key copies nothing
+    if(this->find(key) == this->end()){
+        return false;
+    }
+    removeAt(this->root_, key);
+    --this->size_;
+    return true;
+}
+
+/**
+* Removes every item; nodes a snapshot still reaches stay alive.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+void PersistentAVLTree<Key, Value, Compare, Alloc>::clear()
+{
+    this->release(this->root_);
+    this->root_ = NULL;
+    this->size_ = 0;
+}
+
+/**
+* Returns a view of the tree as it is now, in O(1).
+*/
+template<class Key, class Value, class Compare, class Alloc>
+typename PersistentAVLTree<Key, Value, Compare, Alloc>::Snapshot
+PersistentAVLTree<Key, Value, Compare, Alloc>::snapshot() const
+{
+    return Snapshot(*this);
+}
+
+/**
+* Builds an unshared leaf for the item.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+typename PersistentAVLTree<Key, Value, Compare, Alloc>::NodeT*
+PersistentAVLTree<Key, Value, Compare, Alloc>::createNode(const std::pair<const Key, Value>& keyValuePair)
+{
+    NodeT* node = NodeTraits::allocate(this->alloc_, 1);
+    try {
+        NodeTraits::construct(this->alloc_, node, keyValuePair.first, keyValuePair.second);
+    }
+    catch(...) {
+        NodeTraits::deallocate(this->alloc_, node, 1);
+        throw;
+    }
+    return node;
+}
+
+/**
+* Makes the node in slot safe to change: if anything else shares it, slot
+* is pointed at a private copy that shares the children instead.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+void PersistentAVLTree<Key, Value, Compare, Alloc>::makeUnique(NodeT*& slot)
+{
+    if(!slot->isShared()){
+        return;
+    }
+    NodeT* copy = NodeTraits::allocate(this->alloc_, 1);
+    try {
+        NodeTraits::construct(this->alloc_, copy, *slot);
+    }
+    catch(...) {
+        NodeTraits::deallocate(this->alloc_, copy, 1);
+        throw;
+    }
+    this->retain(copy->getLeft());
+    this->retain(copy->getRight());
+    this->release(slot);
+    slot = copy;
+}
+
+/**
+* Inserts below slot, making each node on the way down unique first.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+void PersistentAVLTree<Key, Value, Compare, Alloc>::insertAt(NodeT*& slot, const std::pair<const Key, Value>& keyValuePair,
+                                                             bool& added)
+{
+    if(slot == NULL){
+        slot = createNode(keyValuePair);
+        added = true;
+        return;
+    }
+    makeUnique(slot);
+    NodeT* node = slot;
+    KeyOrder order = ThreeWayCompare<Compare>::order(this->comp_, keyValuePair.first, node->getKey());
+    if(!(order.less | order.greater)){
+        node->setValue(keyValuePair.second);
+        return;
+    }
+    if(order.less){
+        NodeT* left = node->getLeft();
+        insertAt(left, keyValuePair, added);
+        node->setLeft(left);
+    }
+    else {
+        NodeT* right = node->getRight();
+        insertAt(right, keyValuePair, added);
+        node->setRight(right);
+    }
+    rebalance(slot);
+}
+
+/**
+* Removes key, which must be present, from below slot. A node with two
+* children is replaced by the smallest node of its right subtree.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+void PersistentAVLTree<Key, Value, Compare, Alloc>::removeAt(NodeT*& slot, const Key& key)
+{
+    makeUnique(slot);
+    NodeT* node = slot;
+    KeyOrder order = ThreeWayCompare<Compare>::order(this->comp_, key, node->getKey());
+    if(order.less){
+        NodeT* left = node->getLeft();
+        removeAt(left, key);
+        node->setLeft(left);
+    }
+    else if(order.greater){
+        NodeT* right = node->getRight();
+        removeAt(right, key);
+        node->setRight(right);
+    }
+    else {
+        NodeT* left = node->getLeft();
+        NodeT* right = node->getRight();
+        if(left == NULL || right == NULL){
+            slot = (left != NULL) ? left : right;
+        }
+        else {
+            NodeT* successor = takeMin(right);
+            successor->setLeft(left);
+            successor->setRight(right);
+            slot = successor;
+        }
+        // the children's references moved to slot or the successor
+        node->setLeft(NULL);
+        node->setRight(NULL);
+        this->release(node);
+        if(slot == NULL){
+            return;
+        }
+    }
+    rebalance(slot);
+}
+
+/**
+* Unlinks the smallest node below slot and returns it, unshared and with
+* no children.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+typename PersistentAVLTree<Key, Value, Compare, Alloc>::NodeT*
+PersistentAVLTree<Key, Value, Compare, Alloc>::takeMin(NodeT*& slot)
+{
+    makeUnique(slot);
+    NodeT* node = slot;
+    if(node->getLeft() == NULL){
+        slot = node->getRight();
+        node->setRight(NULL);
+        return node;
+    }
+    NodeT* left = node->getLeft();
+    NodeT* min = takeMin(left);
+    node->setLeft(left);
+    rebalance(slot);
+    return min;
+}
+
+/**
+* Fixes the height of the unique node in slot, whose children may differ
+* in height by two, rotating if they do.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+void PersistentAVLTree<Key, Value, Compare, Alloc>::rebalance(NodeT*& slot)
+{
+    NodeT* node = slot;
+    int balance = heightOf(node->getRight()) - heightOf(node->getLeft());
+    if(balance > 1){
+        NodeT* right = node->getRight();
+        if(heightOf(right->getLeft()) > heightOf(right->getRight())){
+            makeUnique(right);
+            rotateRight(right);
+            node->setRight(right);
+        }
+        rotateLeft(slot);
+    }
+    else if(balance < -1){
+        NodeT* left = node->getLeft();
+        if(heightOf(left->getRight()) > heightOf(left->getLeft())){
+            makeUnique(left);
+            rotateLeft(left);
+            node->setLeft(left);
+        }
+        rotateRight(slot);
+    }
+    else {
+        updateHeight(node);
+    }
+}
+
+/**
+* Rotates the right child of the unique node in slot up into its place,
+* copying the child first if it is shared.
+*/
+template<class Key, class Value, class Compare, class Alloc>
+void PersistentAVLTree<Key, Value, Compare, Alloc>::rotateLeft(NodeT*& slot)
+{
+    NodeT* node = slot;
+    NodeT* child = node->getRight();
+    makeUnique(child);
+    node->setRight(child->getLeft());
+    child->setLeft(node);
+    updateHeight(node);
+    updateHeight(child);
+    slot = child;
+}
+
+/**
+* Mirror image of rotateLeft().
+*/
+template<class Key, class Value, class Compare, class Alloc>
+void PersistentAVLTree<Key, Value, Compare, Alloc>::rotateRight(NodeT*& slot)
+{
+    NodeT* node = slot;
+    NodeT* child = node->getLeft();
+    makeUnique(child);
+    node->setLeft(child->getRight());
+    child->setRight(node);
+    updateHeight(node);
+    updateHeight(child);
+    slot = child;
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+int PersistentAVLTree<Key, Value, Compare, Alloc>::heightOf(NodeT* node)
+{
+    return (node == NULL) ? 0 : node->getHeight();
+}
+
+template<class Key, class Value, class Compare, class Alloc>
+void PersistentAVLTree<Key, Value, Compare, Alloc>::updateHeight(NodeT* node)
+{
+    node->setHeight(1 + std::max(heightOf(node->getLeft()), heightOf(node->getRight())));
+}
+
+/*
+  -----------------------------------------------
+  End implementations for the PersistentAVLTree class.
+  -----------------------------------------------
+*/
+
+#endif
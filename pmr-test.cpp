@@ -0,0 +1,192 @@
+#include <iostream>
+#include <cstddef>
+#include <cstdlib>
+#include <map>
+#include <memory_resource>
+#include <random>
+#include <string>
+#include <utility>
+#include "bst.h"
+#include "avlbst.h"
+#include "rbbst.h"
+
+using namespace std;
+
+// Checked test for trees whose nodes come from a std::pmr memory
+// resource through std::pmr::polymorphic_allocator. Trees run on a
+// monotonic_buffer_resource over a fixed buffer, backed by
+// null_memory_resource so any allocation past the arena throws, and every
+// node must sit inside the buffer. On a counting upstream resource, a
+// remove must give its slot to the next insert without asking upstream
+// for more, clear() must hand back exactly the blocks the inserts took,
+// and destroying the tree must leave nothing outstanding. Needs C++17,
+// which is why the Makefile builds this test with -std=c++17. It exits
+// with status 1 if any check fails.
+
+typedef std::pmr::polymorphic_allocator<std::pair<const long, long> > Alloc;
+typedef BinarySearchTree<long, long, std::less<long>, Alloc> PlainTree;
+typedef AVLTree<long, long, std::less<long>, Alloc> BalancedTree;
+typedef RedBlackTree<long, long, std::less<long>, Alloc> RedBlack;
+
+static int failures = 0;
+
+static void check(bool ok, const string& what)
+{
+    if(!ok && ++failures <= 20) {
+        cerr << "FAIL " << what << endl;
+    }
+}
+
+// Passes every request on to the default resource and counts them
+class CountingResource : public std::pmr::memory_resource
+{
+public:
+    CountingResource() : allocations(0), deallocations(0), outstanding(0) {}
+
+    size_t allocations;
+    size_t deallocations;
+    size_t outstanding;
+
+private:
+    void* do_allocate(size_t bytes, size_t alignment) override
+    {
+        ++allocations;
+        outstanding += bytes;
+        return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+    }
+
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override
+    {
+        ++deallocations;
+        outstanding -= bytes;
+        std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+    {
+        return this == &other;
+    }
+};
+
+template<typename Tree>
+static bool matches(const Tree& tree, const map<long, long>& expected)
+{
+    if(tree.size() != expected.size()) {
+        return false;
+    }
+    typename Tree::iterator it = tree.begin();
+    for(map<long, long>::const_iterator want = expected.begin(); want != expected.end(); ++want, ++it) {
+        if(it == tree.end() || it->first != want->first || it->second != want->second) {
+            return false;
+        }
+    }
+    return it == tree.end();
+}
+
+// Every node in a fixed arena that cannot grow
+template<typename Tree>
+static void testArena(const string& name)
+{
+    static unsigned char buffer[1 << 20];
+    std::pmr::monotonic_buffer_resource arena(buffer, sizeof(buffer), std::pmr::null_memory_resource());
+    mt19937_64 rng(1);
+    map<long, long> expected;
+    bool threw = false;
+    try {
+        Tree tree{Alloc(&arena)};
+        for(int i = 0; i < 5000; ++i) {
+            long key = static_cast<long>(rng() % 20000);
+            if(rng() % 4) {
+                tree.insert(make_pair(key, key * 2));
+                expected[key] = key * 2;
+            }
+            else {
+                tree.remove(key);
+                expected.erase(key);
+            }
+        }
+        check(matches(tree, expected), name + ": tree on the arena differs");
+        check(tree.get_allocator().resource() == &arena, name + ": tree does not report the arena");
+
+        bool inside = true;
+        for(typename Tree::iterator it = tree.begin(); it != tree.end(); ++it) {
+            const unsigned char* item = reinterpret_cast<const unsigned char*>(&*it);
+            inside = inside && item >= buffer && item < buffer + sizeof(buffer);
+        }
+        check(inside, name + ": a node lies outside the arena");
+    }
+    catch(const std::bad_alloc&) {
+        threw = true;
+    }
+    check(!threw, name + ": the tree allocated past the arena");
+}
+
+// Upstream traffic: blocks while growing, none for inserts after removes,
+// all of them back on clear()
+template<typename Tree>
+static void testBlocks(const string& name)
+{
+    CountingResource upstream;
+    {
+        Tree tree{Alloc(&upstream)};
+        size_t emptyBytes = upstream.outstanding;
+        map<long, long> expected;
+        const long n = 20000;
+
+        size_t before = upstream.allocations;
+        // keys in a scrambled order, so the plain tree stays shallow
+        for(long i = 0; i < n; ++i) {
+            long key = i * 7919 % n;
+            tree.insert(make_pair(key, key));
+            expected[key] = key;
+        }
+        size_t grown = upstream.allocations - before;
+        check(grown > 0 && grown * 100 < static_cast<size_t>(n),
+              name + ": " + to_string(grown) + " upstream allocations for " + to_string(n) + " inserts");
+
+        // every other key out, then as many new keys in: the freed slots
+        // must be enough
+        for(long key = 0; key < n; key += 2) {
+            tree.remove(key);
+            expected.erase(key);
+        }
+        before = upstream.allocations;
+        for(long i = 0; i < n / 2; ++i) {
+            long key = n + i * 7919 % (n / 2);
+            tree.insert(make_pair(key, key));
+            expected[key] = key;
+        }
+        check(upstream.allocations == before, name + ": inserts after removes asked upstream for memory");
+        check(matches(tree, expected), name + ": tree differs after removes and inserts");
+
+        before = upstream.deallocations;
+        tree.clear();
+        check(upstream.deallocations - before == grown,
+              name + ": clear() handed back " + to_string(upstream.deallocations - before) + " blocks, not "
+              + to_string(grown));
+        check(upstream.outstanding == emptyBytes, name + ": clear() left blocks outstanding");
+
+        // and the tree grows again from nothing
+        tree.insert(make_pair(1L, 1L));
+        check(tree.size() == 1 && tree.find(1) != tree.end(), name + ": tree not usable after clear()");
+    }
+    check(upstream.outstanding == 0, name + ": memory outstanding after the tree is gone");
+}
+
+template<typename Tree>
+static void testTree(const string& name)
+{
+    testArena<Tree>(name);
+    testBlocks<Tree>(name);
+}
+
+int main(int argc, char *argv[])
+{
+    testTree<PlainTree>("BinarySearchTree");
+    testTree<BalancedTree>("AVLTree");
+    testTree<RedBlack>("RedBlackTree");
+
+    cout << (failures == 0 ? "All pmr checks passed" : "Pmr checks FAILED")
+         << " (" << failures << " failures)" << endl;
+    return failures == 0 ? 0 : 1;
+}
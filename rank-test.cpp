@@ -0,0 +1,137 @@
+#include <iostream>
+#include <cstdlib>
+#include <functional>
+#include <iterator>
+#include <map>
+#include <random>
+#include <string>
+#include <utility>
+#include "avlbst.h"
+
+using namespace std;
+
+// Checked test for RankedAVLTree::select(), rank() and count() against
+// std::map. A tree is changed by rounds of random inserts and removes,
+// and after each round select() must find every position and give end()
+// at size() and past it, rank() must be right for keys in the tree,
+// between them and outside both ends, and count() must be right for
+// bounds that are in the tree or not, equal, reversed or out of range.
+// A tree ordered by std::greater is checked the same way. It exits with
+// status 1 if any check fails.
+
+static int failures = 0;
+
+static void check(bool ok, const string& what)
+{
+    if(!ok && ++failures <= 20) {
+        cerr << "FAIL " << what << endl;
+    }
+}
+
+// The answers select(), rank() and count() should give, worked out on
+// the map, which is ordered the same way as the tree
+template<typename Map>
+static size_t expectRank(const Map& expected, long key)
+{
+    return static_cast<size_t>(distance(expected.begin(), expected.lower_bound(key)));
+}
+
+template<typename Map>
+static size_t expectCount(const Map& expected, long lo, long hi)
+{
+    if(!expected.key_comp()(lo, hi)) {
+        return 0;
+    }
+    return static_cast<size_t>(distance(expected.lower_bound(lo), expected.lower_bound(hi)));
+}
+
+template<typename T, typename Map>
+static void checkQueries(const T& tree, const Map& expected, long lo, long hi, mt19937_64& rng,
+                         const string& where)
+{
+    check(tree.size() == expected.size() && tree.isBalanced(), where + ": tree differs in size or is not balanced");
+
+    size_t k = 0;
+    bool selectOk = true;
+    bool rankOk = true;
+    for(typename Map::const_iterator want = expected.begin(); want != expected.end(); ++want, ++k) {
+        typename T::iterator got = tree.select(k);
+        selectOk = selectOk && got != tree.end() && got->first == want->first && got->second == want->second;
+        rankOk = rankOk && tree.rank(want->first) == k;
+    }
+    check(selectOk, where + ": select() differs");
+    check(rankOk, where + ": rank() of a key in the tree differs");
+    check(tree.select(expected.size()) == tree.end(), where + ": select(size()) is not end()");
+    check(tree.select(expected.size() + 1) == tree.end() && tree.select(static_cast<size_t>(-1)) == tree.end(),
+          where + ": select() past size() is not end()");
+
+    // keys from a range past both ends of the tree's, so some are absent
+    // and some are below or above every key
+    long span = hi - lo + 20;
+    bool absentOk = true;
+    bool countOk = true;
+    for(int i = 0; i < 200; ++i) {
+        long key = lo - 10 + static_cast<long>(rng() % static_cast<unsigned long>(span));
+        absentOk = absentOk && tree.rank(key) == expectRank(expected, key);
+        long other = lo - 10 + static_cast<long>(rng() % static_cast<unsigned long>(span));
+        countOk = countOk && tree.count(key, other) == expectCount(expected, key, other)
+                          && tree.count(other, key) == expectCount(expected, other, key)
+                          && tree.count(key, key) == 0;
+    }
+    check(absentOk, where + ": rank() of a random key differs");
+    check(countOk, where + ": count() differs");
+    check(tree.rank(lo - 1000) == expectRank(expected, lo - 1000) && tree.rank(hi + 1000) == expectRank(expected, hi + 1000),
+          where + ": rank() past the ends differs");
+    check(tree.count(lo - 1000, hi + 1000) == expectCount(expected, lo - 1000, hi + 1000)
+          && tree.count(hi + 1000, lo - 1000) == expectCount(expected, hi + 1000, lo - 1000),
+          where + ": count() over everything differs");
+}
+
+template<typename Compare>
+static void testTree(const string& name)
+{
+    typedef RankedAVLTree<long, long, Compare> Tree;
+    typedef map<long, long, Compare> Map;
+    mt19937_64 rng(7);
+    Tree tree;
+    Map expected;
+    const long lo = 0;
+    const long hi = 3000;
+
+    checkQueries(tree, expected, lo, hi, rng, name + ", empty");
+    for(int round = 0; round < 40; ++round) {
+        // grow for the first half, then shrink, so both sides of the rank
+        // bookkeeping run on trees of every size
+        int ops = 1 + round * 7;
+        for(int i = 0; i < ops; ++i) {
+            long key = lo + static_cast<long>(rng() % static_cast<unsigned long>(hi - lo));
+            if(rng() % 4 < (round < 20 ? 3u : 1u)) {
+                long value = static_cast<long>(rng() % 1000);
+                tree.insert(make_pair(key, value));
+                expected[key] = value;
+            }
+            else {
+                tree.remove(key);
+                expected.erase(key);
+            }
+        }
+        checkQueries(tree, expected, lo, hi, rng, name + ", round " + to_string(round));
+    }
+
+    tree.clear();
+    expected.clear();
+    checkQueries(tree, expected, lo, hi, rng, name + ", cleared");
+    tree.insert(make_pair(5L, 50L));
+    expected[5] = 50;
+    checkQueries(tree, expected, lo, hi, rng, name + ", one item");
+}
+
+int main(int argc, char *argv[])
+{
+    testTree<std::less<long> >("RankedAVLTree");
+    testTree<std::greater<long> >("RankedAVLTree ordered by std::greater");
+
+    cout << (failures == 0 ? "All rank checks passed" : "Rank checks FAILED")
+         << " (" << failures << " failures)" << endl;
+    return failures == 0 ? 0 : 1;
+}
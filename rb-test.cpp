@@ -0,0 +1,206 @@
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <random>
+#include <string>
+#include <unistd.h>
+#include <utility>
+#include "rbbst.h"
+
+using namespace std;
+
+// Checked test for RedBlackTree. Runs of random inserts, overwrites and
+// removes, some filling the tree and some draining it, are checked after
+// every batch by walking the whole tree: the root must be black and have
+// no parent, no red node may have a red child, every path from the root
+// down to a NULL child must pass the same number of black nodes (and
+// blackHeight() must report it), every child must link back to its
+// parent, and the keys must be in order and match a std::map. Trees of
+// sizes around powers of two must also come back from saveTo() and
+// loadFrom() with the same items and valid colors, and stay valid under
+// further changes. It exits with status 1 if any check fails.
+
+static int failures = 0;
+
+static void check(bool ok, const string& what)
+{
+    if(!ok && ++failures <= 20) {
+        cerr << "FAIL " << what << endl;
+    }
+}
+
+// A scratch file in the temporary directory, removed when done
+class TempFile
+{
+public:
+    explicit TempFile(const char* name)
+    {
+        const char* dir = getenv("TMPDIR");
+        path_ = string(dir != NULL ? dir : "/tmp") + "/" + name + "-" + to_string(getpid());
+    }
+    ~TempFile() { remove(path_.c_str()); }
+    const string& path() const { return path_; }
+
+private:
+    string path_;
+};
+
+// A RedBlackTree that lets the test walk its nodes
+class CheckedTree : public RedBlackTree<long, long>
+{
+public:
+    const NodeT* root() const { return static_cast<const NodeT*>(this->root_); }
+};
+
+typedef CheckedTree::NodeT NodeT;
+
+// Checks the subtree at node and returns the number of black nodes on
+// each path from node down to a NULL child, or -1 with what set to the
+// first broken rule
+static int blackHeightOf(const NodeT* node, const NodeT* parent, const long* low, const long* high, string& what)
+{
+    if(node == NULL) {
+        return 0;
+    }
+    if(node->getParent() != parent) {
+        what = "parent link of " + to_string(node->getKey()) + " is wrong";
+        return -1;
+    }
+    if((low != NULL && node->getKey() <= *low) || (high != NULL && node->getKey() >= *high)) {
+        what = "key " + to_string(node->getKey()) + " is out of order";
+        return -1;
+    }
+    if(node->isRed() && ((node->getLeft() != NULL && node->getLeft()->isRed())
+                         || (node->getRight() != NULL && node->getRight()->isRed()))) {
+        what = "red node " + to_string(node->getKey()) + " has a red child";
+        return -1;
+    }
+    int left = blackHeightOf(node->getLeft(), node, low, &node->getKey(), what);
+    if(left < 0) {
+        return -1;
+    }
+    int right = blackHeightOf(node->getRight(), node, &node->getKey(), high, what);
+    if(right < 0) {
+        return -1;
+    }
+    if(left != right) {
+        what = "paths below " + to_string(node->getKey()) + " have different black counts";
+        return -1;
+    }
+    return left + (node->isRed() ? 0 : 1);
+}
+
+static void checkTree(const CheckedTree& tree, const map<long, long>& expected, const string& where)
+{
+    const NodeT* root = tree.root();
+    check(root == NULL || (!root->isRed() && root->getParent() == NULL), where + ": root is red or has a parent");
+    string what;
+    int height = blackHeightOf(root, NULL, NULL, NULL, what);
+    check(height >= 0, where + ": " + what);
+    check(height < 0 || tree.blackHeight() == height, where + ": blackHeight() differs from the walk");
+
+    bool same = tree.size() == expected.size();
+    CheckedTree::iterator it = tree.begin();
+    for(map<long, long>::const_iterator want = expected.begin(); same && want != expected.end(); ++want, ++it) {
+        same = it != tree.end() && it->first == want->first && it->second == want->second;
+    }
+    check(same && it == tree.end(), where + ": items differ");
+}
+
+// Random changes in batches, checked after each
+static void testRandom(int runs, int opsPerRun, long keyRange)
+{
+    mt19937_64 rng(25);
+    for(int run = 0; run < runs; ++run) {
+        CheckedTree tree;
+        map<long, long> expected;
+        for(int op = 0; op < opsPerRun; ++op) {
+            long key = static_cast<long>(rng() % static_cast<unsigned long>(keyRange));
+            // fill for the first half of a run, then mostly drain
+            unsigned insertOdds = op < opsPerRun / 2 ? 3 : 1;
+            if(rng() % 4 < insertOdds) {
+                long value = static_cast<long>(rng() % 1000000);
+                tree.insert(make_pair(key, value));
+                expected[key] = value;
+            }
+            else {
+                tree.remove(key);
+                expected.erase(key);
+            }
+            if((op + 1) % 500 == 0) {
+                checkTree(tree, expected, "run " + to_string(run) + " after " + to_string(op + 1) + " changes");
+            }
+        }
+        // and down to nothing
+        while(!expected.empty()) {
+            long key = expected.begin()->first;
+            if(rng() % 2) {
+                key = expected.rbegin()->first;
+            }
+            tree.remove(key);
+            expected.erase(key);
+        }
+        checkTree(tree, expected, "run " + to_string(run) + " emptied");
+    }
+}
+
+// saveTo() then loadFrom(), into an empty tree and over a full one
+static void testLoad()
+{
+    mt19937_64 rng(26);
+    const size_t sizes[] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 15, 16, 17, 31, 32, 33, 1000, 1023, 1024, 1025, 4097 };
+    TempFile file("rb-test");
+    for(size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+        string where = "loadFrom of " + to_string(sizes[s]) + " items";
+        CheckedTree source;
+        map<long, long> expected;
+        while(expected.size() < sizes[s]) {
+            long key = static_cast<long>(rng() % (4 * sizes[s] + 1));
+            source.insert(make_pair(key, key * 3));
+            expected[key] = key * 3;
+        }
+        source.saveTo(file.path());
+
+        CheckedTree loaded;
+        loaded.loadFrom(file.path());
+        checkTree(loaded, expected, where);
+        CheckedTree replaced;
+        replaced.insert(make_pair(-7L, 1L));
+        replaced.loadFrom(file.path());
+        checkTree(replaced, expected, where + " over a full tree");
+
+        // the built colors must hold up under changes
+        for(int op = 0; op < 300; ++op) {
+            long key = static_cast<long>(rng() % (4 * sizes[s] + 10));
+            if(rng() % 2) {
+                loaded.insert(make_pair(key, key));
+                expected[key] = key;
+            }
+            else {
+                loaded.remove(key);
+                expected.erase(key);
+            }
+        }
+        checkTree(loaded, expected, where + " after changes");
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int runs = 50;
+    int ops = 20000;
+    if(argc > 1) {
+        runs = atoi(argv[1]);
+        if(runs <= 0) {
+            cerr << "Usage: " << argv[0] << " [runs]" << endl;
+            return 2;
+        }
+    }
+    testRandom(runs, ops, 5000);
+    testLoad();
+
+    cout << (failures == 0 ? "All red-black checks passed" : "Red-black checks FAILED")
+         << " (" << failures << " failures)" << endl;
+    return failures == 0 ? 0 : 1;
+}
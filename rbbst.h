@@ -0,0 +1,605 @@
+#ifndef RBBST_H
+#define RBBST_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+#include "bst.h"
+
+/**
+* A node for a red-black tree. The color lives in the low bits of the
+* parent link, as CompactAVLNode keeps its balance there, so a
+* RedBlackNode is no larger than a plain Node.
+*/
+template <typename Key, typename Value>
+class RedBlackNode : public Node<Key, Value>
+{
+public:
+    // New nodes are red
+    RedBlackNode(const Key& key, const Value& value, RedBlackNode<Key, Value>* parent);
+    RedBlackNode(Key&& key, Value&& value, RedBlackNode<Key, Value>* parent);
+    ~RedBlackNode();
+
+    bool isRed() const;
+    void setRed(bool red);
+
+    // Getters that hide the Node versions, as in AVLNode
+    RedBlackNode<Key, Value>* getParent() const;
+    RedBlackNode<Key, Value>* getLeft() const;
+    RedBlackNode<Key, Value>* getRight() const;
+};
+
+/*
+  -------------------------------------------------
+  Begin implementations for the RedBlackNode class.
+  -------------------------------------------------
+*/
+
+/**
+* An explicit constructor for a new red leaf.
+*/
+template<class Key, class Value>
+RedBlackNode<Key, Value>::RedBlackNode(const Key& key, const Value& value, RedBlackNode<Key, Value> *parent) :
+    Node<Key, Value>(key, value, parent)
+{
+    static_assert(alignof(Node<Key, Value>) >= 2, "the color needs a free bit in the parent link");
+    setRed(true);
+}
+
+/**
+* A constructor that moves the key and value into the node.
+*/
+template<class Key, class Value>
+RedBlackNode<Key, Value>::RedBlackNode(Key&& key, Value&& value, RedBlackNode<Key, Value> *parent) :
+    Node<Key, Value>(std::move(key), std::move(value), parent)
+{
+    setRed(true);
+}
+
+/**
+* A destructor which does nothing.
+*/
+template<class Key, class Value>
+RedBlackNode<Key, Value>::~RedBlackNode()
+{
+
+}
+
+/**
+* A getter for the color, decoded from the parent link.
+*/
+template<class Key, class Value>
+bool RedBlackNode<Key, Value>::isRed() const
+{
+    return this->getParentTag() != 0;
+}
+
+/**
+* A setter for the color, encoded into the parent link.
+*/
+template<class Key, class Value>
+void RedBlackNode<Key, Value>::setRed(bool red)
+{
+    this->setParentTag(red ? 1 : 0);
+}
+
+/**
+* Hidden for the same reasons as in AVLNode.
+*/
+template<class Key, class Value>
+RedBlackNode<Key, Value> *RedBlackNode<Key, Value>::getParent() const
+{
+    return static_cast<RedBlackNode<Key, Value>*>(Node<Key, Value>::getParent());
+}
+
+/**
+* Hidden for the same reasons as in AVLNode.
+*/
+template<class Key, class Value>
+RedBlackNode<Key, Value> *RedBlackNode<Key, Value>::getLeft() const
+{
+    return static_cast<RedBlackNode<Key, Value>*>(this->left_);
+}
+
+/**
+* Hidden for the same reasons as in AVLNode.
+*/
+template<class Key, class Value>
+RedBlackNode<Key, Value> *RedBlackNode<Key, Value>::getRight() const
+{
+    return static_cast<RedBlackNode<Key, Value>*>(this->right_);
+}
+
+/*
+  -----------------------------------------------
+  End implementations for the RedBlackNode class.
+  -----------------------------------------------
+*/
+
+/**
+* A red-black tree. It balances less strictly than AVLTree (a path may be
+* up to twice as long as another, against 1.44 times), and in exchange
+* every insert or remove makes at most three rotations; the rest of the
+* fix-up only recolors. That suits write-heavy workloads, where AVLTree's
+* remove may rotate at every level on its way to the root.
+*
+* insert, remove and the iterators behave exactly as in BinarySearchTree,
+* and remove swaps a node with two children with its predecessor by
+* nodeSwap, so iterators to other items stay valid.
+*/
+template <class Key, class Value,
+          class Compare = std::less<Key>,
+          class Alloc = std::allocator<std::pair<const Key, Value> >,
+          class Stats = NoTreeStats>
+class RedBlackTree : public BinarySearchTree<Key, Value, Compare, Alloc, Stats>
+{
+public:
+    typedef RedBlackNode<Key, Value> NodeT;
+
+    explicit RedBlackTree(const Compare& comp = Compare(), const Alloc& alloc = Alloc());
+    explicit RedBlackTree(const Alloc& alloc);
+    RedBlackTree(RedBlackTree&& other);
+    RedBlackTree& operator=(RedBlackTree&& other);
+    virtual ~RedBlackTree();
+    using BinarySearchTree<Key, Value, Compare, Alloc, Stats>::insert;
+    virtual void insert(const std::pair<const Key, Value>& keyValuePair);
+    virtual void remove(const Key& key);
+
+    // Number of black nodes on every path from the root down to a NULL child
+    int blackHeight() const;
+
+protected:
+    virtual void nodeSwap(NodeT* n1, NodeT* n2);
+    virtual void destroyNode(Node<Key, Value>* node);
+    virtual Node<Key, Value>* linkNewNode(Node<Key, Value>* parent, Key&& key, Value&& value);
+    virtual void buildFromSnapshot(SnapshotSource<Key, Value>& source, std::size_t count);
+
+    void attachNewNode(NodeT* node);
+    void insertFix(NodeT* node);
+    void removeFix(NodeT* node, NodeT* parent);
+    void rotateLeft(NodeT* node);
+    void rotateRight(NodeT* node);
+    NodeT* buildSnapshotNodes(SnapshotSource<Key, Value>& source, std::size_t count, NodeT* parent,
+                              int depth, int redDepth, const NodeT*& last);
+    static bool isRed(const NodeT* node);
+};
+
+/*
+  -------------------------------------------------
+  Begin implementations for the RedBlackTree class.
+  -------------------------------------------------
+*/
+
+/**
+* Default constructor, which sizes the node pool for RedBlackNode.
+*/
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+RedBlackTree<Key, Value, Compare, Alloc, Stats>::RedBlackTree(const Compare& comp, const Alloc& alloc) :
+    BinarySearchTree<Key, Value, Compare, Alloc, Stats>(sizeof(NodeT), alignof(NodeT), comp, alloc)
+{
+}
+
+/**
+* Constructor taking only an allocator, with a default Compare.
+*/
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+RedBlackTree<Key, Value, Compare, Alloc, Stats>::RedBlackTree(const Alloc& alloc) :
+    BinarySearchTree<Key, Value, Compare, Alloc, Stats>(sizeof(NodeT), alignof(NodeT), Compare(), alloc)
+{
+}
+
+/**
+* Move constructor, which takes other's nodes.
+*/
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+RedBlackTree<Key, Value, Compare, Alloc, Stats>::RedBlackTree(RedBlackTree&& other) :
+    BinarySearchTree<Key, Value, Compare, Alloc, Stats>(std::move(other))
+{
+}
+
+/**
+* Move assignment, which clears this tree and then takes other's nodes.
+*/
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+RedBlackTree<Key, Value, Compare, Alloc, Stats>&
+RedBlackTree<Key, Value, Compare, Alloc, Stats>::operator=(RedBlackTree&& other)
+{
+    if(this != &other){
+        BinarySearchTree<Key, Value, Compare, Alloc, Stats>::operator=(std::move(other));
+    }
+    return *this;
+}
+
+/**
+* Destructor, which clears the tree while destroyNode() still
+* dispatches to RedBlackTree.
+*/
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+RedBlackTree<Key, Value, Compare, Alloc, Stats>::~RedBlackTree()
+{
+    this->clear();
+}
+
+/**
+* Inserts the item, or overwrites the value if the key is already there.
+*/
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+void RedBlackTree<Key, Value, Compare, Alloc, Stats>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    Node<Key, Value>* parent = NULL;
+    Node<Key, Value>* current = this->internalFindSlot(keyValuePair.first, parent);
+    if(current != NULL){
+        current->setValue(keyValuePair.second);
+        return;
+    }
+    attachNewNode(this->template createNode<NodeT>(keyValuePair.first, keyValuePair.second,
+                                                   static_cast<NodeT*>(parent)));
+}
+
+/**
+* Creates a red-black node for a new key, moving the key and value in,
+* and links and rebalances it like insert().
+*/
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+Node<Key, Value>* RedBlackTree<Key, Value, Compare, Alloc, Stats>::linkNewNode(Node<Key, Value>* parent, Key&& key, Value&& value)
+{
+    NodeT* node = this->template createNode<NodeT>(std::move(key), std::move(value), static_cast<NodeT*>(parent));
+    attachNewNode(node);
+    return node;
+}
+
+/**
+* Links a freshly created red leaf below its parent and restores the
+* red-black properties above it.
+*/
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+void RedBlackTree<Key, Value, Compare, Alloc, Stats>::attachNewNode(NodeT* node)
+{
+    this->linkChild(node->getParent(), node);
+    this->addSize(1);
+    insertFix(node);
+}
+
+/**
+* Walks up from a red node that may have a red parent. While the uncle
+* is red too, recoloring pushes the problem two levels up; otherwise one
+* single or double rotation ends it.
+*/
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+void RedBlackTree<Key, Value, Compare, Alloc, Stats>::insertFix(NodeT* node)
+{
+    for(;;){
+        this->countFixStep();
+        NodeT* parent = node->getParent();
+        if(parent == NULL){
+            node->setRed(false);
+            return;
+        }
+        if(!parent->isRed()){
+            return;
+        }
+        // a red parent is never the root, so there is a grandparent
+        NodeT* grandparent = parent->getParent();
+        bool parentIsLeft = (grandparent->getLeft() == parent);
+        NodeT* uncle = parentIsLeft ? grandparent->getRight() : grandparent->getLeft();
+        if(isRed(uncle)){
+            parent->setRed(false);
+            uncle->setRed(false);
+            grandparent->setRed(true);
+            node = grandparent;
+            continue;
+        }
+
+        if(parentIsLeft){
+            // zigzag: turn it into a zigzig first
+            if(node == parent->getRight()){
+                rotateLeft(parent);
+                parent = node;
+            }
+            rotateRight(grandparent);
+        }
+        else {
+            if(node == parent->getLeft()){
+                rotateRight(parent);
+                parent = node;
+            }
+            rotateLeft(grandparent);
+        }
+        parent->setRed(false);
+        grandparent->setRed(true);
+        return;
+    }
+}
+
+/**
+* Removes the item with the given key, if there is one. A node with two
+* children first trades places with its predecessor, so the node that
+* is unlinked has at most one child.
+*/
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+void RedBlackTree<Key, Value, Compare, Alloc, Stats>::remove(const Key& key)
+{
+    NodeT* n = static_cast<NodeT*>(this->internalFind(key));
+    if(n == NULL){
+        return;
+    }
+    if(n->getLeft() != NULL && n->getRight() != NULL){
+        NodeT* pred = static_cast<NodeT*>(BinarySearchTree<Key, Value, Compare, Alloc, Stats>::predecessor(n));
+        nodeSwap(n, pred);
+    }
+
+    NodeT* child = (n->getLeft() != NULL) ? n->getLeft() : n->getRight();
+    NodeT* parent = n->getParent();
+    if(child != NULL){
+        child->setParent(parent);
+    }
+    if(parent == NULL){
+        this->root_ = child;
+    }
+    else if(parent->getLeft() == n){
+        parent->setLeft(child);
+    }
+    else {
+        parent->setRight(child);
+    }
+
+    // a red node takes no black off any path; a black one with a red
+    // child is replaced by that child turned black
+    if(!n->isRed()){
+        if(isRed(child)){
+            child->setRed(false);
+        }
+        else {
+            removeFix(child, parent);
+        }
+    }
+    this->destroyNode(n);
+    this->addSize(-1);
+}
+
+/**
+* Restores the black height after a black node was unlinked, leaving
+* node (possibly NULL) below parent one black short. Recoloring may move
+* the shortage up the tree; every case that rotates ends the walk, so
+* there are at most three rotations.
+*/
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+void RedBlackTree<Key, Value, Compare, Alloc, Stats>::removeFix(NodeT* node, NodeT* parent)
+{
+    while(parent != NULL && !isRed(node)){
+        this->countFixStep();
+        if(node == parent->getLeft()){
+            NodeT* sibling = parent->getRight();
+            if(sibling->isRed()){
+                sibling->setRed(false);
+                parent->setRed(true);
+                rotateLeft(parent);
+                sibling = parent->getRight();
+            }
+            if(!isRed(sibling->getLeft()) && !isRed(sibling->getRight())){
+                sibling->setRed(true);
+                node = parent;
+                parent = node->getParent();
+                continue;
+            }
+            if(!isRed(sibling->getRight())){
+                sibling->getLeft()->setRed(false);
+                sibling->setRed(true);
+                rotateRight(sibling);
+                sibling = parent->getRight();
+            }
+            sibling->setRed(parent->isRed());
+            parent->setRed(false);
+            sibling->getRight()->setRed(false);
+            rotateLeft(parent);
+        }
+        else {
+            NodeT* sibling = parent->getLeft();
+            if(sibling->isRed()){
+                sibling->setRed(false);
+                parent->setRed(true);
+                rotateRight(parent);
+                sibling = parent->getLeft();
+            }
+            if(!isRed(sibling->getLeft()) && !isRed(sibling->getRight())){
+                sibling->setRed(true);
+                node = parent;
+                parent = node->getParent();
+                continue;
+            }
+            if(!isRed(sibling->getLeft())){
+                sibling->getRight()->setRed(false);
+                sibling->setRed(true);
+                rotateLeft(sibling);
+                sibling = parent->getLeft();
+            }
+            sibling->setRed(parent->isRed());
+            parent->setRed(false);
+            sibling->getLeft()->setRed(false);
+            rotateRight(parent);
+        }
+        return;
+    }
+    if(node != NULL){
+        node->setRed(false);
+    }
+}
+
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+void RedBlackTree<Key, Value, Compare, Alloc, Stats>::rotateLeft(NodeT* node)
+{
+    this->countRotation();
+    NodeT* parent = node->getParent();
+    NodeT* pivot = node->getRight();
+    NodeT* inner = pivot->getLeft();
+
+    if(parent == NULL){
+        this->root_ = pivot;
+    }
+    else if(parent->getLeft() == node){
+        parent->setLeft(pivot);
+    }
+    else {
+        parent->setRight(pivot);
+    }
+    pivot->setParent(parent);
+    pivot->setLeft(node);
+    node->setParent(pivot);
+    node->setRight(inner);
+    if(inner != NULL){
+        inner->setParent(node);
+    }
+}
+
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+void RedBlackTree<Key, Value, Compare, Alloc, Stats>::rotateRight(NodeT* node)
+{
+    this->countRotation();
+    NodeT* parent = node->getParent();
+    NodeT* pivot = node->getLeft();
+    NodeT* inner = pivot->getRight();
+
+    if(parent == NULL){
+        this->root_ = pivot;
+    }
+    else if(parent->getLeft() == node){
+        parent->setLeft(pivot);
+    }
+    else {
+        parent->setRight(pivot);
+    }
+    pivot->setParent(parent);
+    pivot->setRight(node);
+    node->setParent(pivot);
+    node->setLeft(inner);
+    if(inner != NULL){
+        inner->setParent(node);
+    }
+}
+
+/**
+* True for a red node; NULL children count as black.
+*/
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+bool RedBlackTree<Key, Value, Compare, Alloc, Stats>::isRed(const NodeT* node)
+{
+    return node != NULL && node->isRed();
+}
+
+/**
+* Returns the black height in O(log n) by following the leftmost path,
+* which has as many black nodes as any other; an empty tree has 0.
+*/
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+int RedBlackTree<Key, Value, Compare, Alloc, Stats>::blackHeight() const
+{
+    int height = 0;
+    for(const NodeT* node = static_cast<const NodeT*>(this->root_); node != NULL; node = node->getLeft()){
+        height += !node->isRed();
+    }
+    return height;
+}
+
+/**
+* Links count items read from a snapshot into the empty tree. The tree
+* is built as AVLTree builds it, with every level full but the last,
+* so coloring the last level red (unless it is the root) and the rest
+* black gives every path the same black height.
+*/
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+void RedBlackTree<Key, Value, Compare, Alloc, Stats>::buildFromSnapshot(SnapshotSource<Key, Value>& source, std::size_t count)
+{
+    int levels = 0;
+    for(std::size_t c = count; c != 0; c >>= 1){
+        ++levels;
+    }
+    const NodeT* last = NULL;
+    this->root_ = buildSnapshotNodes(source, count, static_cast<NodeT*>(NULL), 0, levels - 1, last);
+    this->size_ = count;
+}
+
+/**
+* Builds a balanced subtree from the next count items of the snapshot,
+* with the left side getting the extra node when count is even. Each item
+* is checked to follow last, the node built before it. On a failure the
+* subtree's nodes are destroyed before it rethrows.
+*/
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+typename RedBlackTree<Key, Value, Compare, Alloc, Stats>::NodeT*
+RedBlackTree<Key, Value, Compare, Alloc, Stats>::buildSnapshotNodes(
+    SnapshotSource<Key, Value>& source, std::size_t count, NodeT* parent, int depth, int redDepth, const NodeT*& last)
+{
+    if(count == 0){
+        return NULL;
+    }
+    std::size_t leftCount = count / 2;
+    std::size_t rightCount = count - 1 - leftCount;
+
+    NodeT* left = buildSnapshotNodes(source, leftCount, static_cast<NodeT*>(NULL), depth + 1, redDepth, last);
+
+    // nodes built so far are not in the tree yet, so a failure frees them here
+    NodeT* node;
+    try {
+        std::pair<Key, Value> item;
+        source.read(item.first, item.second);
+        if(last != NULL && !this->comp_(last->getKey(), item.first)){
+            throw std::runtime_error("Snapshot keys are not in increasing order");
+        }
+        node = this->template createNode<NodeT>(std::move(item.first), std::move(item.second), parent);
+    }
+    catch(...) {
+        this->destroySubtree(left);
+        throw;
+    }
+    last = node;
+
+    node->setLeft(left);
+    if(left != NULL){
+        left->setParent(node);
+    }
+    try {
+        node->setRight(buildSnapshotNodes(source, rightCount, node, depth + 1, redDepth, last));
+    }
+    catch(...) {
+        this->destroySubtree(node);
+        throw;
+    }
+    node->setRed(depth == redDepth && depth != 0);
+    return node;
+}
+
+/**
+* Swaps two nodes' positions; colors belong to positions, so they are
+* swapped back.
+*/
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+void RedBlackTree<Key, Value, Compare, Alloc, Stats>::nodeSwap(NodeT* n1, NodeT* n2)
+{
+    bool red1 = n1->isRed();
+    bool red2 = n2->isRed();
+    BinarySearchTree<Key, Value, Compare, Alloc, Stats>::nodeSwap(n1, n2);
+    n1->setRed(red2);
+    n2->setRed(red1);
+}
+
+/**
+* Destroys a node as the RedBlackNode it really is and returns its slot
+* to the pool.
+*/
+template<class Key, class Value, class Compare, class Alloc, class Stats>
+void RedBlackTree<Key, Value, Compare, Alloc, Stats>::destroyNode(Node<Key, Value>* node)
+{
+    static_cast<NodeT*>(node)->~NodeT();
+    this->pool_->deallocate(node);
+}
+
+/*
+  -----------------------------------------------
+  End implementations for the RedBlackTree class.
+  -----------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,260 @@
+#include <iostream>
+#include <algorithm>
+#include <cstdlib>
+#include <map>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+#include "avlbst.h"
+
+using namespace std;
+
+// Checked test for AVLTree::setUnion(), setIntersection() and
+// setDifference() against std::map. Pairs of trees that are empty, tiny,
+// of very different sizes, disjoint, interleaved, overlapping and equal
+// are combined on one thread and on four, with the default combine and
+// with one that keeps both values; the result must hold the right items,
+// be balanced, report its true height and, for RankedAVLTree, keep the
+// subtree sizes select() relies on, and both inputs must be left empty.
+// The largest pairs are tall enough for the set operations to fork, and
+// "make tsan" runs them under ThreadSanitizer. It exits with status 1 if
+// any check fails.
+
+typedef AVLTree<long, long> Tree;
+typedef CompactAVLTree<long, long> CompactTree;
+typedef RankedAVLTree<long, long> RankedTree;
+
+static int failures = 0;
+
+static void check(bool ok, const string& what)
+{
+    if(!ok && ++failures <= 20) {
+        cerr << "FAIL " << what << endl;
+    }
+}
+
+// Keeps both values, so a test can tell which tree each came from and in
+// which order they were passed
+struct BothValues
+{
+    long operator()(long first, long second) const
+    {
+        return first * 1000 + second;
+    }
+};
+
+// Subtree sizes, checked through select(); only trees whose nodes keep
+// them have these
+static bool ranksMatch(const Tree&, const map<long, long>&) { return true; }
+static bool ranksMatch(const CompactTree&, const map<long, long>&) { return true; }
+
+static bool ranksMatch(const RankedTree& tree, const map<long, long>& expected)
+{
+    size_t k = 0;
+    for(map<long, long>::const_iterator want = expected.begin(); want != expected.end(); ++want, ++k) {
+        RankedTree::iterator got = tree.select(k);
+        if(got == tree.end() || got->first != want->first) {
+            return false;
+        }
+    }
+    return tree.select(expected.size()) == tree.end();
+}
+
+template<typename T>
+static bool matches(const T& tree, const map<long, long>& expected)
+{
+    if(tree.size() != expected.size() || !tree.isBalanced()) {
+        return false;
+    }
+    typename T::BalanceInfo info = tree.checkBalance();
+    if(!info.balanced || info.height != tree.height()) {
+        return false;
+    }
+    typename T::const_iterator it = tree.cbegin();
+    for(map<long, long>::const_iterator want = expected.begin(); want != expected.end(); ++want, ++it) {
+        if(it == tree.cend() || it->first != want->first || it->second != want->second) {
+            return false;
+        }
+    }
+    return it == tree.cend() && ranksMatch(tree, expected);
+}
+
+// n distinct keys from [lo, hi), each with a value below 1000
+static map<long, long> randomItems(size_t n, long lo, long hi, mt19937_64& rng)
+{
+    map<long, long> items;
+    while(items.size() < n) {
+        long key = lo + static_cast<long>(rng() % static_cast<unsigned long>(hi - lo));
+        items[key] = static_cast<long>(rng() % 1000);
+    }
+    return items;
+}
+
+// Inserts the items in a shuffled order, so the tree's shape is not the
+// one a sorted build would give
+template<typename T>
+static void build(T& tree, const map<long, long>& items, mt19937_64& rng)
+{
+    vector<pair<long, long> > order(items.begin(), items.end());
+    shuffle(order.begin(), order.end(), rng);
+    for(size_t i = 0; i < order.size(); ++i) {
+        tree.insert(order[i]);
+    }
+}
+
+// What each operation should give, worked out on the maps
+static map<long, long> expectUnion(const map<long, long>& a, const map<long, long>& b, bool both)
+{
+    map<long, long> result(b);
+    for(map<long, long>::const_iterator it = a.begin(); it != a.end(); ++it) {
+        map<long, long>::const_iterator other = b.find(it->first);
+        result[it->first] = both && other != b.end() ? BothValues()(it->second, other->second) : it->second;
+    }
+    return result;
+}
+
+static map<long, long> expectIntersection(const map<long, long>& a, const map<long, long>& b, bool both)
+{
+    map<long, long> result;
+    for(map<long, long>::const_iterator it = a.begin(); it != a.end(); ++it) {
+        map<long, long>::const_iterator other = b.find(it->first);
+        if(other != b.end()) {
+            result[it->first] = both ? BothValues()(it->second, other->second) : it->second;
+        }
+    }
+    return result;
+}
+
+static map<long, long> expectDifference(const map<long, long>& a, const map<long, long>& b)
+{
+    map<long, long> result;
+    for(map<long, long>::const_iterator it = a.begin(); it != a.end(); ++it) {
+        if(b.find(it->first) == b.end()) {
+            result.insert(*it);
+        }
+    }
+    return result;
+}
+
+enum Operation { kUnion, kUnionBoth, kIntersection, kIntersectionBoth, kDifference };
+
+static const char* const kOperationNames[] = {
+    "setUnion", "setUnion with BothValues", "setIntersection", "setIntersection with BothValues", "setDifference"
+};
+
+template<typename T>
+static T apply(Operation op, T& a, T& b, unsigned threads)
+{
+    switch(op) {
+    case kUnion:
+        return T::setUnion(std::move(a), std::move(b), KeepFirstValue(), threads);
+    case kUnionBoth:
+        return T::setUnion(std::move(a), std::move(b), BothValues(), threads);
+    case kIntersection:
+        return T::setIntersection(std::move(a), std::move(b), KeepFirstValue(), threads);
+    case kIntersectionBoth:
+        return T::setIntersection(std::move(a), std::move(b), BothValues(), threads);
+    default:
+        return T::setDifference(std::move(a), std::move(b), threads);
+    }
+}
+
+static map<long, long> expect(Operation op, const map<long, long>& a, const map<long, long>& b)
+{
+    switch(op) {
+    case kUnion:
+        return expectUnion(a, b, false);
+    case kUnionBoth:
+        return expectUnion(a, b, true);
+    case kIntersection:
+        return expectIntersection(a, b, false);
+    case kIntersectionBoth:
+        return expectIntersection(a, b, true);
+    default:
+        return expectDifference(a, b);
+    }
+}
+
+// One pair of key sets: how many keys each tree has and the range they
+// are drawn from, which sets how much the trees overlap
+struct Case
+{
+    const char* name;
+    size_t aSize;
+    long aLo;
+    long aHi;
+    size_t bSize;
+    long bLo;
+    long bHi;
+};
+
+static const Case kCases[] = {
+    { "both empty", 0, 0, 1, 0, 0, 1 },
+    { "first empty", 0, 0, 1, 300, 0, 1000 },
+    { "second empty", 300, 0, 1000, 0, 0, 1 },
+    { "one item each, same key", 1, 5, 6, 1, 5, 6 },
+    { "one item each, different keys", 1, 5, 6, 1, 6, 7 },
+    { "one item and many", 1, 0, 1000, 500, 0, 1000 },
+    { "many and one item", 500, 0, 1000, 1, 0, 1000 },
+    { "small, overlapping", 40, 0, 100, 60, 0, 100 },
+    { "disjoint, first below", 2000, 0, 10000, 3000, 10000, 20000 },
+    { "disjoint, first above", 3000, 10000, 20000, 2000, 0, 10000 },
+    { "half overlapping", 5000, 0, 10000, 5000, 5000, 15000 },
+    { "small into large", 20, 0, 100000, 40000, 0, 100000 },
+    { "large into small", 40000, 0, 100000, 20, 0, 100000 },
+    { "large, heavily overlapping", 40000, 0, 60000, 40000, 0, 60000 },
+    { "large, same keys", 40000, 0, 40000, 40000, 0, 40000 },
+};
+
+template<typename T>
+static void testTree(const string& name)
+{
+    mt19937_64 rng(13);
+    const unsigned threadCounts[] = { 1, 4 };
+    for(size_t c = 0; c < sizeof(kCases) / sizeof(kCases[0]); ++c) {
+        const Case& input = kCases[c];
+        map<long, long> a = randomItems(input.aSize, input.aLo, input.aHi, rng);
+        map<long, long> b = randomItems(input.bSize, input.bLo, input.bHi, rng);
+        for(int op = kUnion; op <= kDifference; ++op) {
+            map<long, long> expected = expect(Operation(op), a, b);
+            for(size_t t = 0; t < sizeof(threadCounts) / sizeof(threadCounts[0]); ++t) {
+                string where = name + " " + kOperationNames[op] + ", " + input.name + ", "
+                             + to_string(threadCounts[t]) + (threadCounts[t] == 1 ? " thread" : " threads");
+                T first;
+                T second;
+                build(first, a, rng);
+                build(second, b, rng);
+                T result = apply(Operation(op), first, second, threadCounts[t]);
+                check(matches(result, expected), where + ": result differs");
+                check(first.empty() && first.begin() == first.end() && second.empty(),
+                      where + ": inputs not left empty");
+
+                // the result and the emptied inputs keep working as trees
+                map<long, long> changed(expected);
+                for(long key = -3; key < 3; ++key) {
+                    result.insert(make_pair(key, key));
+                    changed[key] = key;
+                }
+                result.remove(-3);
+                changed.erase(-3);
+                check(matches(result, changed), where + ": result differs after changes");
+                first.insert(make_pair(1L, 1L));
+                second.insert(make_pair(2L, 2L));
+                check(first.size() == 1 && second.size() == 1 && first.find(1) != first.end(),
+                      where + ": emptied inputs not usable");
+            }
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    testTree<Tree>("AVLTree");
+    testTree<CompactTree>("CompactAVLTree");
+    testTree<RankedTree>("RankedAVLTree");
+
+    cout << (failures == 0 ? "All set operation checks passed" : "Set operation checks FAILED")
+         << " (" << failures << " failures)" << endl;
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,123 @@
+#include <iostream>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <limits>
+#include <random>
+#include <vector>
+#include "simd_search.h"
+
+using namespace std;
+
+// Checks KeyBlockSearch::countLess and countNotGreater against a plain
+// loop for signed and unsigned 32- and 64-bit keys, strides 1, 2 and 4,
+// and every block length up to a few vectors, so full vectors, partial
+// tails and blocks shorter than one vector are all covered. The lanes
+// between strided keys hold junk, which the kernels must mask off. Built
+// once with -msse4.2 and once with -mavx2 ("make check" runs both), since
+// the kernels are compiled only for the instruction set the build targets.
+
+static int failures = 0;
+
+static const char* target()
+{
+#if defined(__AVX2__)
+    return "AVX2";
+#elif defined(__SSE4_2__)
+    return "SSE4.2";
+#else
+    return "scalar";
+#endif
+}
+
+// Random keys drawn mostly from the edges of the type's range and around
+// zero, where a missing sign flip or a wrong compare shows up.
+template<typename Key>
+static Key randomKey(mt19937_64& rng)
+{
+    static const Key edges[] = {
+        numeric_limits<Key>::min(), static_cast<Key>(numeric_limits<Key>::min() + 1),
+        static_cast<Key>(-1), 0, 1,
+        static_cast<Key>(numeric_limits<Key>::max() - 1), numeric_limits<Key>::max(),
+        static_cast<Key>(Key(1) << (sizeof(Key) * 8 - 2)),
+        static_cast<Key>(numeric_limits<Key>::max() / 2 + 1)
+    };
+    switch(rng() % 3) {
+    case 0:
+        return edges[rng() % (sizeof(edges) / sizeof(edges[0]))];
+    case 1:
+        return static_cast<Key>(static_cast<long>(rng() % 16) - 8);
+    default:
+        return static_cast<Key>(rng());
+    }
+}
+
+template<typename Key, size_t Stride>
+static void checkKernel(const char* name, mt19937_64& rng)
+{
+    typedef KeyBlockSearch<Key, std::less<Key>, Stride> Search;
+    const unsigned maxCount = 40;
+    int before = failures;
+
+    for(int round = 0; round < 2000; ++round) {
+        unsigned count = static_cast<unsigned>(rng() % (maxCount + 1));
+        // junk fills the lanes between keys and one stride past the end
+        vector<Key> block((count + 1) * Stride);
+        for(size_t i = 0; i < block.size(); ++i) {
+            block[i] = randomKey<Key>(rng);
+        }
+        // the probe is often one of the keys, so ties are tested
+        Key probe = (count > 0 && rng() % 2) ? block[(rng() % count) * Stride] : randomKey<Key>(rng);
+
+        unsigned less = 0;
+        unsigned notGreater = 0;
+        for(unsigned i = 0; i < count; ++i) {
+            less += block[i * Stride] < probe;
+            notGreater += !(probe < block[i * Stride]);
+        }
+        unsigned gotLess = Search::countLess(block.data(), count, probe, std::less<Key>());
+        unsigned gotNotGreater = Search::countNotGreater(block.data(), count, probe, std::less<Key>());
+        if((gotLess != less || gotNotGreater != notGreater) && ++failures <= 20) {
+            cerr << "FAIL " << name << ": " << count << " keys, probe " << +probe
+                 << ": countLess " << gotLess << " (want " << less << "), countNotGreater "
+                 << gotNotGreater << " (want " << notGreater << ")" << endl;
+        }
+    }
+    cout << name << (Search::kVectorized ? " vectorized" : " scalar")
+         << (failures == before ? ": ok" : ": FAILED") << endl;
+}
+
+template<typename Key>
+static void checkStrides(const char* name, mt19937_64& rng)
+{
+    string label(name);
+    checkKernel<Key, 1>((label + ", stride 1").c_str(), rng);
+    checkKernel<Key, 2>((label + ", stride 2").c_str(), rng);
+    checkKernel<Key, 4>((label + ", stride 4").c_str(), rng);
+}
+
+int main(int argc, char *argv[])
+{
+#if defined(__AVX2__) && defined(__GNUC__)
+    if(!__builtin_cpu_supports("avx2")) {
+        cout << "simd-test: this CPU has no AVX2, skipped" << endl;
+        return 0;
+    }
+#elif defined(__SSE4_2__) && defined(__GNUC__)
+    if(!__builtin_cpu_supports("sse4.2")) {
+        cout << "simd-test: this CPU has no SSE4.2, skipped" << endl;
+        return 0;
+    }
+#endif
+    cout << "simd-test built for " << target() << endl;
+
+    mt19937_64 rng(18);
+    checkStrides<int32_t>("int32_t", rng);
+    checkStrides<uint32_t>("uint32_t", rng);
+    checkStrides<int64_t>("int64_t", rng);
+    checkStrides<uint64_t>("uint64_t", rng);
+
+    cout << (failures == 0 ? "All SIMD checks passed" : "SIMD checks FAILED")
+         << " (" << failures << " failures)" << endl;
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,202 @@
+#ifndef SIMD_SEARCH_H
+#define SIMD_SEARCH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <type_traits>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE4_2__)
+#include <nmmintrin.h>
+#endif
+
+/**
+* Counting searches over a block of keys, for nodes that keep many keys
+* side by side. Keys are Stride keys apart (1 for a plain key array, 2
+* for the pair<const long, long> items of a B-tree leaf), and a search
+* counts how many of them order before the probe (countLess) or not after
+* it (countNotGreater), which is the child index or the insertion point.
+*
+* This generic version compares one key at a time with Compare, without
+* branching on the result. KeyBlockSearch is specialized below for 32- and
+* 64-bit integer keys ordered by std::less when the compiler targets AVX2
+* or SSE4.2, comparing a whole vector of keys per instruction.
+*/
+template <typename Key, typename Compare, std::size_t Stride, typename Enable = void>
+struct KeyBlockSearch
+{
+    static const bool kVectorized = false;
+
+    static unsigned countLess(const Key* keys, unsigned count, const Key& key, const Compare& comp)
+    {
+        unsigned index = 0;
+        for(unsigned i = 0; i < count; ++i){
+            index += comp(keys[i * Stride], key);
+        }
+        return index;
+    }
+
+    static unsigned countNotGreater(const Key* keys, unsigned count, const Key& key, const Compare& comp)
+    {
+        unsigned index = 0;
+        for(unsigned i = 0; i < count; ++i){
+            index += !comp(key, keys[i * Stride]);
+        }
+        return index;
+    }
+};
+
+#if defined(__AVX2__) || defined(__SSE4_2__)
+
+/**
+* The vector operations the kernels need, for lanes of LaneBytes bytes:
+* 256-bit AVX2 registers, or else 128-bit SSE registers (whose 64-bit
+* compare needs SSE4.2).
+*/
+template <std::size_t LaneBytes>
+struct SimdLanes;
+
+#if defined(__AVX2__)
+
+template <>
+struct SimdLanes<8>
+{
+    typedef __m256i Vector;
+    static const unsigned kLanes = 4;
+    static Vector load(const void* p) { return _mm256_loadu_si256(static_cast<const __m256i*>(p)); }
+    static Vector broadcast(std::int64_t x) { return _mm256_set1_epi64x(x); }
+    static Vector flip(Vector v) { return _mm256_xor_si256(v, broadcast(INT64_MIN)); }
+    static Vector greater(Vector a, Vector b) { return _mm256_cmpgt_epi64(a, b); }
+    static unsigned mask(Vector v) { return static_cast<unsigned>(_mm256_movemask_pd(_mm256_castsi256_pd(v))); }
+};
+
+template <>
+struct SimdLanes<4>
+{
+    typedef __m256i Vector;
+    static const unsigned kLanes = 8;
+    static Vector load(const void* p) { return _mm256_loadu_si256(static_cast<const __m256i*>(p)); }
+    static Vector broadcast(std::int32_t x) { return _mm256_set1_epi32(x); }
+    static Vector flip(Vector v) { return _mm256_xor_si256(v, broadcast(INT32_MIN)); }
+    static Vector greater(Vector a, Vector b) { return _mm256_cmpgt_epi32(a, b); }
+    static unsigned mask(Vector v) { return static_cast<unsigned>(_mm256_movemask_ps(_mm256_castsi256_ps(v))); }
+};
+
+#else
+
+template <>
+struct SimdLanes<8>
+{
+    typedef __m128i Vector;
+    static const unsigned kLanes = 2;
+    static Vector load(const void* p) { return _mm_loadu_si128(static_cast<const __m128i*>(p)); }
+    static Vector broadcast(std::int64_t x) { return _mm_set1_epi64x(x); }
+    static Vector flip(Vector v) { return _mm_xor_si128(v, broadcast(INT64_MIN)); }
+    static Vector greater(Vector a, Vector b) { return _mm_cmpgt_epi64(a, b); }
+    static unsigned mask(Vector v) { return static_cast<unsigned>(_mm_movemask_pd(_mm_castsi128_pd(v))); }
+};
+
+template <>
+struct SimdLanes<4>
+{
+    typedef __m128i Vector;
+    static const unsigned kLanes = 4;
+    static Vector load(const void* p) { return _mm_loadu_si128(static_cast<const __m128i*>(p)); }
+    static Vector broadcast(std::int32_t x) { return _mm_set1_epi32(x); }
+    static Vector flip(Vector v) { return _mm_xor_si128(v, broadcast(INT32_MIN)); }
+    static Vector greater(Vector a, Vector b) { return _mm_cmpgt_epi32(a, b); }
+    static unsigned mask(Vector v) { return static_cast<unsigned>(_mm_movemask_ps(_mm_castsi128_ps(v))); }
+};
+
+#endif
+
+/**
+* True for the key types and orders the kernels handle: 32- and 64-bit
+* integers under std::less, with keys spaced so a whole number of them
+* fills a vector.
+*/
+template <typename Key, typename Compare, std::size_t Stride>
+struct SimdSearchable
+{
+    static const bool value =
+        std::is_integral<Key>::value && (sizeof(Key) == 4 || sizeof(Key) == 8) &&
+        (std::is_same<Compare, std::less<Key> >::value || std::is_same<Compare, std::less<void> >::value) &&
+        Stride != 0 && Stride <= 4 && (Stride & (Stride - 1)) == 0 &&
+        SimdLanes<(sizeof(Key) == 8 ? 8 : 4)>::kLanes % Stride == 0;
+};
+
+/**
+* The vector kernels. Each full vector holds kLanes / Stride keys and the
+* lanes in between are masked off; unsigned keys have their sign bit
+* flipped so the signed compare orders them. The few keys past the last
+* full vector are compared one at a time, so nothing past the block is
+* read.
+*/
+template <typename Key, typename Compare, std::size_t Stride>
+struct KeyBlockSearch<Key, Compare, Stride,
+                      typename std::enable_if<SimdSearchable<Key, Compare, Stride>::value>::type>
+{
+    static const bool kVectorized = true;
+
+    static unsigned countLess(const Key* keys, unsigned count, const Key& key, const Compare&)
+    {
+        typename Lanes::Vector probe = prepare(Lanes::broadcast(key));
+        unsigned index = 0;
+        unsigned i = 0;
+        for(; i + kKeysPerVector <= count; i += kKeysPerVector){
+            typename Lanes::Vector block = prepare(Lanes::load(keys + i * Stride));
+            index += popcount(Lanes::mask(Lanes::greater(probe, block)) & kKeyLanes);
+        }
+        for(; i < count; ++i){
+            index += keys[i * Stride] < key;
+        }
+        return index;
+    }
+
+    static unsigned countNotGreater(const Key* keys, unsigned count, const Key& key, const Compare&)
+    {
+        typename Lanes::Vector probe = prepare(Lanes::broadcast(key));
+        unsigned greater = 0;
+        unsigned i = 0;
+        for(; i + kKeysPerVector <= count; i += kKeysPerVector){
+            typename Lanes::Vector block = prepare(Lanes::load(keys + i * Stride));
+            greater += popcount(Lanes::mask(Lanes::greater(block, probe)) & kKeyLanes);
+        }
+        for(; i < count; ++i){
+            greater += key < keys[i * Stride];
+        }
+        return count - greater;
+    }
+
+private:
+    typedef SimdLanes<(sizeof(Key) == 8 ? 8 : 4)> Lanes;
+    static const unsigned kKeysPerVector = Lanes::kLanes / Stride;
+
+    // the mask bits of the lanes that hold keys: every Stride-th one
+    static const unsigned kKeyLanes =
+        (Stride == 1) ? 0xffu : (Stride == 2) ? 0x55u : 0x11u;
+
+    static typename Lanes::Vector prepare(typename Lanes::Vector v)
+    {
+        return std::is_signed<Key>::value ? v : Lanes::flip(v);
+    }
+
+    static unsigned popcount(unsigned x)
+    {
+#if defined(__GNUC__)
+        return static_cast<unsigned>(__builtin_popcount(x));
+#else
+        unsigned count = 0;
+        for(; x != 0; x &= x - 1){
+            ++count;
+        }
+        return count;
+#endif
+    }
+};
+
+#endif
+
+#endif
@@ -0,0 +1,234 @@
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <iterator>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include "bst.h"
+#include "avlbst.h"
+#include "rbbst.h"
+
+using namespace std;
+
+// Checked test for saveTo() and loadFrom() on every tree that builds its
+// own nodes from a snapshot: a round trip must give back the same items
+// in a balanced tree, and a truncated file, a file with keys out of order
+// and a file with bytes past its last item must each throw and leave the
+// tree usable: unchanged if the header is cut short, otherwise empty with
+// every node built before the failure freed.
+// "make asan" runs it under AddressSanitizer, whose leak check catches a
+// node left behind. It exits with status 1 if any check fails.
+
+static int failures = 0;
+
+static void check(bool ok, const string& what)
+{
+    if(!ok && ++failures <= 20) {
+        cerr << "FAIL " << what << endl;
+    }
+}
+
+// A scratch file in the temporary directory, removed when done
+class TempFile
+{
+public:
+    explicit TempFile(const char* name)
+    {
+        const char* dir = getenv("TMPDIR");
+        path_ = string(dir != NULL ? dir : "/tmp") + "/" + name + "-" + to_string(getpid());
+    }
+    ~TempFile() { remove(path_.c_str()); }
+    const string& path() const { return path_; }
+
+private:
+    string path_;
+};
+
+static long fileSize(const string& path)
+{
+    FILE* file = fopen(path.c_str(), "rb");
+    if(file == NULL) {
+        return -1;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fclose(file);
+    return size;
+}
+
+// Copies the first length bytes of from into to, then appends extra.
+static void copyPrefix(const string& from, const string& to, long length, const string& extra = "")
+{
+    FILE* in = fopen(from.c_str(), "rb");
+    FILE* out = fopen(to.c_str(), "wb");
+    for(long i = 0; i < length; ++i) {
+        fputc(fgetc(in), out);
+    }
+    fwrite(extra.data(), 1, extra.size(), out);
+    fclose(in);
+    fclose(out);
+}
+
+static long makeValue(long key, long*) { return key * 3; }
+// string values are past the short-string buffer, so a node never destroyed
+// leaks its value's heap block where the leak check can see it
+static string makeValue(long key, string*) { return string(20 + labs(key) % 7, 'v') + to_string(key); }
+
+template<typename Tree, typename Value>
+static bool matches(const Tree& tree, const map<long, Value>& expected)
+{
+    if(tree.size() != expected.size()) {
+        return false;
+    }
+    typename Tree::iterator it = tree.begin();
+    for(typename map<long, Value>::const_iterator want = expected.begin(); want != expected.end(); ++want, ++it) {
+        if(it == tree.end() || it->first != want->first || it->second != want->second) {
+            return false;
+        }
+    }
+    return it == tree.end();
+}
+
+// A load that must fail: it has to throw runtime_error and leave the
+// tree with keep items (0 or what it held before) and still usable.
+template<typename Tree>
+static void checkRejected(Tree& tree, const string& path, const string& what, size_t keep = 0)
+{
+    bool threw = false;
+    try {
+        tree.loadFrom(path);
+    }
+    catch(const runtime_error&) {
+        threw = true;
+    }
+    check(threw, what + ": load did not throw");
+    check(tree.size() == keep && size_t(distance(tree.begin(), tree.end())) == keep,
+          what + ": tree left with the wrong items");
+    typedef typename Tree::iterator::value_type::second_type Value;
+    tree.insert(make_pair(1L, makeValue(1, static_cast<Value*>(NULL))));
+    check(tree.size() == keep + 1 && tree.find(1) != tree.end(), what + ": tree not usable after the failed load");
+}
+
+template<typename Tree, typename Value>
+static void testTree(const string& name, size_t n)
+{
+    mt19937_64 rng(23);
+    map<long, Value> expected;
+    Tree tree;
+    while(expected.size() < n) {
+        long key = static_cast<long>(rng() % (4 * n));
+        Value value = makeValue(key, static_cast<Value*>(NULL));
+        tree.insert(make_pair(key, value));
+        expected[key] = value;
+    }
+
+    TempFile file("snapshot-test");
+    tree.saveTo(file.path());
+
+    // round trip, into an empty tree and over a tree that has items
+    Tree loaded;
+    loaded.loadFrom(file.path());
+    check(matches(loaded, expected), name + ": round trip differs");
+    check(loaded.isBalanced(), name + ": loaded tree is not balanced");
+    Tree replaced;
+    replaced.insert(make_pair(-5L, makeValue(-5, static_cast<Value*>(NULL))));
+    replaced.loadFrom(file.path());
+    check(matches(replaced, expected), name + ": load over a full tree differs");
+
+    // an empty snapshot loads as an empty tree
+    TempFile emptyFile("snapshot-test-empty");
+    Tree().saveTo(emptyFile.path());
+    replaced.loadFrom(emptyFile.path());
+    check(replaced.size() == 0 && replaced.begin() == replaced.end(), name + ": empty snapshot not empty");
+
+    // truncated inside the header, which leaves the tree alone, and at
+    // points through the items, so the failure comes at every depth of the
+    // build
+    TempFile cut("snapshot-test-cut");
+    long size = fileSize(file.path());
+    long cuts[] = { 4, long(sizeof(SnapshotHeader)), long(sizeof(SnapshotHeader)) + 3,
+                    size / 3, size / 2, size - 1 };
+    for(size_t i = 0; i < sizeof(cuts) / sizeof(cuts[0]); ++i) {
+        copyPrefix(file.path(), cut.path(), cuts[i]);
+        Tree target;
+        target.insert(make_pair(7L, makeValue(7, static_cast<Value*>(NULL))));
+        checkRejected(target, cut.path(), name + ": truncated to " + to_string(cuts[i]) + " bytes",
+                      cuts[i] < long(sizeof(SnapshotHeader)) ? 1 : 0);
+    }
+
+    // bytes past the last item
+    copyPrefix(file.path(), cut.path(), size, "junk");
+    Tree extra;
+    checkRejected(extra, cut.path(), name + ": trailing bytes");
+
+    // keys out of order: the same items saved by a tree ordered the other way
+    typedef BinarySearchTree<long, Value, std::greater<long> > Reversed;
+    Reversed reversed;
+    for(typename map<long, Value>::const_iterator it = expected.begin(); it != expected.end(); ++it) {
+        reversed.insert(*it);
+    }
+    TempFile backwards("snapshot-test-backwards");
+    reversed.saveTo(backwards.path());
+    Tree target;
+    checkRejected(target, backwards.path(), name + ": keys in decreasing order");
+
+    // one out-of-order key late in the file, after most nodes are built
+    Reversed tail;
+    tail.insert(make_pair(0L, makeValue(0, static_cast<Value*>(NULL))));
+    tail.insert(make_pair(1L, makeValue(1, static_cast<Value*>(NULL))));
+    BinarySearchTree<long, Value> ordered;
+    for(typename map<long, Value>::const_iterator it = expected.begin(); it != expected.end(); ++it) {
+        ordered.insert(make_pair(it->first + 10, it->second));
+    }
+    TempFile late("snapshot-test-late");
+    ordered.insert(make_pair(4 * long(n) + 20, makeValue(0, static_cast<Value*>(NULL))));
+    ordered.insert(make_pair(4 * long(n) + 21, makeValue(1, static_cast<Value*>(NULL))));
+    ordered.saveTo(late.path());
+    // swap the last two items for the reversed pair by rewriting the tail
+    TempFile lastTwo("snapshot-test-last-two");
+    tail.saveTo(lastTwo.path());
+    long tailBytes = fileSize(lastTwo.path()) - long(sizeof(SnapshotHeader));
+    TempFile spliced("snapshot-test-spliced");
+    {
+        FILE* in = fopen(late.path().c_str(), "rb");
+        FILE* pair = fopen(lastTwo.path().c_str(), "rb");
+        FILE* out = fopen(spliced.path().c_str(), "wb");
+        long keep = fileSize(late.path()) - tailBytes;
+        for(long i = 0; i < keep; ++i) {
+            fputc(fgetc(in), out);
+        }
+        fseek(pair, long(sizeof(SnapshotHeader)), SEEK_SET);
+        for(int c = fgetc(pair); c != EOF; c = fgetc(pair)) {
+            fputc(c, out);
+        }
+        fclose(in);
+        fclose(pair);
+        fclose(out);
+    }
+    Tree lateTarget;
+    checkRejected(lateTarget, spliced.path(), name + ": last keys out of order");
+}
+
+template<typename Value>
+static void testTrees(const string& valueName, size_t n)
+{
+    testTree<BinarySearchTree<long, Value>, Value>("BinarySearchTree<long, " + valueName + ">", n);
+    testTree<AVLTree<long, Value>, Value>("AVLTree<long, " + valueName + ">", n);
+    testTree<CompactAVLTree<long, Value>, Value>("CompactAVLTree<long, " + valueName + ">", n);
+    testTree<RankedAVLTree<long, Value>, Value>("RankedAVLTree<long, " + valueName + ">", n);
+    testTree<RedBlackTree<long, Value>, Value>("RedBlackTree<long, " + valueName + ">", n);
+}
+
+int main(int argc, char *argv[])
+{
+    testTrees<long>("long", 1000);
+    testTrees<string>("string", 1000);
+
+    cout << (failures == 0 ? "All snapshot checks passed" : "Snapshot checks FAILED")
+         << " (" << failures << " failures)" << endl;
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,331 @@
+#include <iostream>
+#include <algorithm>
+#include <cstdlib>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "avlbst.h"
+
+using namespace std;
+
+// Checked test for AVLTree split and join against std::map. Trees of many
+// sizes are split at every key, between keys and past both ends; both
+// parts are checked, changed, checked again and joined back, with and
+// without a pivot, and every tree on the way must hold the right items,
+// be balanced, report its true height and, for RankedAVLTree, keep the
+// subtree sizes select() and rank() rely on.
+//
+// The trees a split or a move produces must also be usable from
+// different threads: each half of a split, and a moved-from tree next to
+// the tree it moved into, is changed on a thread of its own and checked
+// against a std::map, then the parts are joined back and checked again. "make tsan" runs it under
+// ThreadSanitizer, which catches two trees still sharing a node pool. It
+// exits with status 1 if any check fails.
+
+typedef AVLTree<long, long> Tree;
+typedef CompactAVLTree<long, long> CompactTree;
+typedef RankedAVLTree<long, long> RankedTree;
+
+static int failures = 0;
+
+static void check(bool ok, const string& what)
+{
+    if(!ok && ++failures <= 20) {
+        cerr << "FAIL " << what << endl;
+    }
+}
+
+template<typename T>
+static bool matches(const T& tree, const map<long, long>& expected)
+{
+    if(tree.size() != expected.size() || !tree.isBalanced()) {
+        return false;
+    }
+    typename T::const_iterator it = tree.cbegin();
+    for(map<long, long>::const_iterator want = expected.begin(); want != expected.end(); ++want, ++it) {
+        if(it == tree.cend() || it->first != want->first || it->second != want->second) {
+            return false;
+        }
+    }
+    return it == tree.cend();
+}
+
+// Random inserts, overwrites and removes of keys in [lo, hi), applied to
+// both tree and expected; each thread calls this on trees of its own.
+template<typename T>
+static void churn(T& tree, map<long, long>& expected, long lo, long hi, unsigned seed, size_t ops)
+{
+    mt19937_64 rng(seed);
+    for(size_t i = 0; i < ops; ++i) {
+        long key = lo + static_cast<long>(rng() % static_cast<unsigned long>(hi - lo));
+        if(rng() % 3) {
+            long value = static_cast<long>(rng() % 1000000);
+            tree.insert(make_pair(key, value));
+            expected[key] = value;
+        }
+        else {
+            tree.remove(key);
+            expected.erase(key);
+        }
+    }
+}
+
+template<typename T>
+static void fill(T& tree, map<long, long>& expected, long n)
+{
+    for(long key = 0; key < n; ++key) {
+        tree.insert(make_pair(key, key * 10));
+        expected[key] = key * 10;
+    }
+}
+
+// Subtree sizes, checked through select() and rank(); only trees whose
+// nodes keep them have these
+static bool ranksMatch(const Tree&, const map<long, long>&) { return true; }
+static bool ranksMatch(const CompactTree&, const map<long, long>&) { return true; }
+
+static bool ranksMatch(const RankedTree& tree, const map<long, long>& expected)
+{
+    size_t k = 0;
+    for(map<long, long>::const_iterator want = expected.begin(); want != expected.end(); ++want, ++k) {
+        RankedTree::iterator got = tree.select(k);
+        if(got == tree.end() || got->first != want->first || tree.rank(want->first) != k) {
+            return false;
+        }
+    }
+    return tree.select(expected.size()) == tree.end();
+}
+
+// Everything matches() checks, plus the walk backward from end(), the
+// tracked height against the real one and the subtree sizes.
+template<typename T>
+static bool holds(const T& tree, const map<long, long>& expected)
+{
+    if(!matches(tree, expected)) {
+        return false;
+    }
+    typename T::BalanceInfo info = tree.checkBalance();
+    if(!info.balanced || info.height != tree.height()) {
+        return false;
+    }
+    typename T::const_reverse_iterator it = tree.crbegin();
+    for(map<long, long>::const_reverse_iterator want = expected.rbegin(); want != expected.rend(); ++want, ++it) {
+        if(it == tree.crend() || it->first != want->first) {
+            return false;
+        }
+    }
+    return it == tree.crend() && ranksMatch(tree, expected);
+}
+
+// Builds a tree of the given keys, inserted in a shuffled order
+template<typename T>
+static void build(T& tree, map<long, long>& expected, const vector<long>& keys, mt19937_64& rng)
+{
+    vector<long> order(keys);
+    shuffle(order.begin(), order.end(), rng);
+    for(size_t i = 0; i < order.size(); ++i) {
+        tree.insert(make_pair(order[i], order[i] * 10));
+        expected[order[i]] = order[i] * 10;
+    }
+}
+
+// Splits trees of n even keys 0, 2, ... at every key, between every two
+// keys and past both ends. Both parts are changed inside their own key
+// ranges, then joined back: around the cut as a pivot when the cut falls
+// between keys, and without a pivot when it is a key.
+template<typename T>
+static void testSplitEveryBoundary(const string& name)
+{
+    const long sizes[] = { 0, 1, 2, 3, 4, 7, 8, 9, 31, 64, 100, 257 };
+    mt19937_64 rng(12);
+    for(size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+        long n = sizes[s];
+        vector<long> keys;
+        for(long i = 0; i < n; ++i) {
+            keys.push_back(2 * i);
+        }
+        for(long cut = -1; cut <= 2 * n; ++cut) {
+            string where = name + ", " + to_string(n) + " keys split at " + to_string(cut);
+            T tree;
+            map<long, long> expected;
+            build(tree, expected, keys, rng);
+
+            pair<T, T> parts = tree.split(cut);
+            map<long, long> low(expected.begin(), expected.lower_bound(cut));
+            map<long, long> high(expected.lower_bound(cut), expected.end());
+            check(tree.empty() && tree.size() == 0, where + ": split tree not left empty");
+            check(holds(parts.first, low), where + ": lower part differs");
+            check(holds(parts.second, high), where + ": upper part differs");
+
+            // below the cut on one side, above it on the other, so the
+            // cut stays free for a pivot
+            bool pivot = cut % 2 != 0;
+            churn(parts.first, low, -8, cut, static_cast<unsigned>(n * 1000 + cut), 40);
+            churn(parts.second, high, cut + 1, 2 * n + 8, static_cast<unsigned>(n * 1000 + cut + 500), 40);
+            check(holds(parts.first, low), where + ": lower part differs after changes");
+            check(holds(parts.second, high), where + ": upper part differs after changes");
+
+            T joined;
+            if(pivot) {
+                joined = T::join(std::move(parts.first), make_pair(cut, -cut), std::move(parts.second));
+                low[cut] = -cut;
+            }
+            else {
+                joined = T::join(std::move(parts.first), std::move(parts.second));
+            }
+            low.insert(high.begin(), high.end());
+            check(holds(joined, low), where + (pivot ? ": join around the pivot differs" : ": join differs"));
+            check(parts.first.empty() && parts.second.empty(), where + ": joined parts not left empty");
+
+            // the joined tree keeps working as a tree
+            churn(joined, low, -8, 2 * n + 8, static_cast<unsigned>(n * 1000 + cut + 700), 40);
+            check(holds(joined, low), where + ": joined tree differs after changes");
+        }
+    }
+}
+
+// Joins whose keys overlap must throw and leave both trees as they were.
+template<typename T>
+static void testJoinOrderChecked(const string& name)
+{
+    mt19937_64 rng(13);
+    vector<long> lowKeys;
+    vector<long> highKeys;
+    for(long i = 0; i < 50; ++i) {
+        lowKeys.push_back(i);
+        highKeys.push_back(40 + i);
+    }
+    T left;
+    T right;
+    map<long, long> low;
+    map<long, long> high;
+    build(left, low, lowKeys, rng);
+    build(right, high, highKeys, rng);
+
+    bool threw = false;
+    try {
+        T::join(std::move(left), std::move(right));
+    }
+    catch(const invalid_argument&) {
+        threw = true;
+    }
+    check(threw, name + ": join of overlapping trees did not throw");
+    threw = false;
+    try {
+        T::join(std::move(left), make_pair(45L, 0L), std::move(right));
+    }
+    catch(const invalid_argument&) {
+        threw = true;
+    }
+    check(threw, name + ": join around a pivot inside a tree did not throw");
+    check(holds(left, low) && holds(right, high), name + ": a refused join changed its trees");
+}
+
+// Each half of a split is changed on its own thread while the tree it came
+// from takes new items on a third, then the halves are joined back.
+template<typename T>
+static void testSplitHalvesOnThreads(const string& name)
+{
+    const long n = 20000;
+    for(int round = 0; round < 4; ++round) {
+        T tree;
+        map<long, long> expected;
+        fill(tree, expected, n);
+
+        long cut = n / 2 + round * 1000;
+        pair<T, T> parts = tree.split(cut);
+        map<long, long> low(expected.begin(), expected.lower_bound(cut));
+        map<long, long> high(expected.lower_bound(cut), expected.end());
+        check(matches(parts.first, low) && matches(parts.second, high), name + ": split parts differ");
+        map<long, long> refill;
+
+        thread lower([&]() { churn(parts.first, low, 0, cut, 1 + round, 30000); });
+        thread upper([&]() { churn(parts.second, high, cut, n, 2 + round, 30000); });
+        thread source([&]() { churn(tree, refill, 0, n, 3 + round, 30000); });
+        lower.join();
+        upper.join();
+        source.join();
+
+        check(matches(parts.first, low), name + ": lower half differs after its thread");
+        check(matches(parts.second, high), name + ": upper half differs after its thread");
+        check(matches(tree, refill), name + ": split tree differs after refilling");
+
+        T joined = T::join(std::move(parts.first), std::move(parts.second));
+        low.insert(high.begin(), high.end());
+        check(matches(joined, low), name + ": halves joined back differ");
+        check(parts.first.empty() && parts.second.empty(), name + ": joined halves not left empty");
+
+        // the emptied halves and the joined tree go separate ways as well
+        map<long, long> lowAgain;
+        map<long, long> highAgain;
+        thread reuseLow([&]() { churn(parts.first, lowAgain, 0, n, 4 + round, 10000); });
+        thread reuseHigh([&]() { churn(parts.second, highAgain, 0, n, 5 + round, 10000); });
+        churn(joined, low, 0, n, 6 + round, 10000);
+        reuseLow.join();
+        reuseHigh.join();
+        check(matches(parts.first, lowAgain) && matches(parts.second, highAgain),
+              name + ": joined-away halves differ after reuse");
+        check(matches(joined, low), name + ": joined tree differs after changes");
+
+        // halves dropped on other threads give their nodes back there
+        thread dropLow([&]() { parts.first.clear(); });
+        thread dropHigh([&]() { T dropped(std::move(parts.second)); });
+        dropLow.join();
+        dropHigh.join();
+        check(matches(joined, low), name + ": joined tree differs after the halves were dropped");
+    }
+}
+
+// A moved-from tree is reused on one thread while the tree it moved into
+// changes on another, for both the move constructor and move assignment.
+template<typename T>
+static void testMovedFromOnThreads(const string& name)
+{
+    const long n = 20000;
+    T a;
+    map<long, long> aExpected;
+    fill(a, aExpected, n);
+
+    T b(std::move(a));
+    map<long, long> bExpected;
+    bExpected.swap(aExpected);
+    check(a.empty() && a.size() == 0, name + ": moved-from tree not empty");
+    thread reuse([&]() { churn(a, aExpected, 0, n, 7, 40000); });
+    churn(b, bExpected, 0, n, 8, 40000);
+    reuse.join();
+    check(matches(a, aExpected), name + ": moved-from tree differs after reuse");
+    check(matches(b, bExpected), name + ": moved-to tree differs");
+
+    T c;
+    c.insert(make_pair(-1L, -1L));
+    c = std::move(b);
+    map<long, long> cExpected;
+    cExpected.swap(bExpected);
+    thread reuseAssigned([&]() { churn(b, bExpected, 0, n, 9, 40000); });
+    churn(c, cExpected, 0, n, 10, 40000);
+    reuseAssigned.join();
+    check(matches(b, bExpected), name + ": move-assigned-from tree differs after reuse");
+    check(matches(c, cExpected), name + ": move-assigned tree differs");
+}
+
+int main(int argc, char *argv[])
+{
+    testSplitEveryBoundary<Tree>("AVLTree");
+    testSplitEveryBoundary<CompactTree>("CompactAVLTree");
+    testSplitEveryBoundary<RankedTree>("RankedAVLTree");
+    testJoinOrderChecked<Tree>("AVLTree");
+    testJoinOrderChecked<RankedTree>("RankedAVLTree");
+
+    testSplitHalvesOnThreads<Tree>("AVLTree");
+    testSplitHalvesOnThreads<RankedTree>("RankedAVLTree");
+    testMovedFromOnThreads<Tree>("AVLTree");
+    testMovedFromOnThreads<RankedTree>("RankedAVLTree");
+
+    cout << (failures == 0 ? "All split and join checks passed" : "Split and join checks FAILED")
+         << " (" << failures << " failures)" << endl;
+    return failures == 0 ? 0 : 1;
+}
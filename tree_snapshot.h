@@ -0,0 +1,301 @@
+#ifndef TREE_SNAPSHOT_H
+#define TREE_SNAPSHOT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+/**
+* The on-disk snapshot format written by BinarySearchTree::saveTo() and
+* read by loadFrom():
+*
+*   8 bytes   magic "BSTSNAP\0"
+*   4 bytes   format version (1)
+*   4 bytes   reserved, zero
+*   8 bytes   item count
+*   ...       every item in increasing key order: the key, then the value,
+*             each as its codec writes it
+*
+* Numbers are in the machine's byte order, so a snapshot is meant to be
+* read back on the machine, or at least the architecture, that wrote it.
+*/
+struct SnapshotHeader
+{
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t reserved;
+    std::uint64_t count;
+};
+
+static const char kSnapshotMagic[8] = { 'B', 'S', 'T', 'S', 'N', 'A', 'P', '\0' };
+static const std::uint32_t kSnapshotVersion = 1;
+
+/**
+* Buffered writing and reading of a snapshot file, 1 MB at a time. The
+* codecs call write() and read() for every field, so both copy straight
+* to or from the buffer when it has room and only go to the file when
+* it is full or empty. Both throw std::runtime_error when the file
+* cannot be opened, written or read, and close the file on destruction.
+*/
+class SnapshotWriter
+{
+public:
+    explicit SnapshotWriter(const std::string& path);
+    ~SnapshotWriter();
+
+    void write(const void* data, std::size_t size)
+    {
+        if(size <= buffer_.size() - used_){
+            std::memcpy(&buffer_[used_], data, size);
+            used_ += size;
+        }
+        else {
+            writeSlow(data, size);
+        }
+    }
+
+    // Writes out the rest of the buffer and closes the file
+    void finish();
+
+private:
+    SnapshotWriter(const SnapshotWriter& other);
+    SnapshotWriter& operator=(const SnapshotWriter& other);
+    void writeSlow(const void* data, std::size_t size);
+    void flush();
+
+    std::FILE* file_;
+    std::string path_;
+    std::vector<char> buffer_;
+    std::size_t used_;
+};
+
+class SnapshotReader
+{
+public:
+    explicit SnapshotReader(const std::string& path);
+    ~SnapshotReader();
+
+    void read(void* data, std::size_t size)
+    {
+        if(size <= end_ - pos_){
+            std::memcpy(data, &buffer_[pos_], size);
+            pos_ += size;
+        }
+        else {
+            readSlow(data, size);
+        }
+    }
+
+    // True once every byte of the file has been read
+    bool atEnd();
+
+private:
+    SnapshotReader(const SnapshotReader& other);
+    SnapshotReader& operator=(const SnapshotReader& other);
+    void readSlow(void* data, std::size_t size);
+    bool refill();
+
+    std::FILE* file_;
+    std::string path_;
+    std::vector<char> buffer_;
+    std::size_t pos_;
+    std::size_t end_;
+};
+
+static const std::size_t kSnapshotBufferBytes = 1 << 20;
+
+inline SnapshotWriter::SnapshotWriter(const std::string& path) :
+    file_(std::fopen(path.c_str(), "wb")),
+    path_(path),
+    buffer_(kSnapshotBufferBytes),
+    used_(0)
+{
+    if(file_ == NULL){
+        throw std::runtime_error("Cannot open " + path);
+    }
+}
+
+inline SnapshotWriter::~SnapshotWriter()
+{
+    if(file_ != NULL){
+        std::fclose(file_);
+    }
+}
+
+inline void SnapshotWriter::flush()
+{
+    if(used_ != 0 && std::fwrite(&buffer_[0], 1, used_, file_) != used_){
+        throw std::runtime_error("Cannot write " + path_);
+    }
+    used_ = 0;
+}
+
+inline void SnapshotWriter::writeSlow(const void* data, std::size_t size)
+{
+    const char* bytes = static_cast<const char*>(data);
+    while(size != 0){
+        if(used_ == buffer_.size()){
+            flush();
+        }
+        std::size_t n = std::min(size, buffer_.size() - used_);
+        std::memcpy(&buffer_[used_], bytes, n);
+        used_ += n;
+        bytes += n;
+        size -= n;
+    }
+}
+
+inline void SnapshotWriter::finish()
+{
+    flush();
+    std::FILE* file = file_;
+    file_ = NULL;
+    if(std::fclose(file) != 0){
+        throw std::runtime_error("Cannot write " + path_);
+    }
+}
+
+inline SnapshotReader::SnapshotReader(const std::string& path) :
+    file_(std::fopen(path.c_str(), "rb")),
+    path_(path),
+    buffer_(kSnapshotBufferBytes),
+    pos_(0),
+    end_(0)
+{
+    if(file_ == NULL){
+        throw std::runtime_error("Cannot open " + path);
+    }
+}
+
+inline SnapshotReader::~SnapshotReader()
+{
+    std::fclose(file_);
+}
+
+/**
+* Moves what is left of the buffer to its front and fills the rest from
+* the file. Returns false if nothing more could be read.
+*/
+inline bool SnapshotReader::refill()
+{
+    std::size_t left = end_ - pos_;
+    std::memmove(&buffer_[0], &buffer_[pos_], left);
+    pos_ = 0;
+    end_ = left + std::fread(&buffer_[left], 1, buffer_.size() - left, file_);
+    if(std::ferror(file_)){
+        throw std::runtime_error("Cannot read " + path_);
+    }
+    return end_ > left;
+}
+
+inline void SnapshotReader::readSlow(void* data, std::size_t size)
+{
+    char* bytes = static_cast<char*>(data);
+    while(size != 0){
+        if(pos_ == end_ && !refill()){
+            throw std::runtime_error(path_ + " is truncated");
+        }
+        std::size_t n = std::min(size, end_ - pos_);
+        std::memcpy(bytes, &buffer_[pos_], n);
+        pos_ += n;
+        bytes += n;
+        size -= n;
+    }
+}
+
+inline bool SnapshotReader::atEnd()
+{
+    return pos_ == end_ && !refill();
+}
+
+/**
+* The default codec for keys and values, which copies the bytes of a
+* trivially copyable type. Specialize it, or pass another class with the
+* same two static functions to saveTo() and loadFrom(), for other types;
+* the Enable parameter lets one specialization cover a family of types
+* through std::enable_if.
+*/
+template<typename T, typename Enable = void>
+struct SnapshotCodec
+{
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "SnapshotCodec needs a specialization for types that are not trivially copyable");
+
+    static void write(SnapshotWriter& out, const T& value)
+    {
+        out.write(&value, sizeof(T));
+    }
+
+    static void read(SnapshotReader& in, T& value)
+    {
+        in.read(&value, sizeof(T));
+    }
+};
+
+/**
+* Strings are written as a 64-bit length followed by their characters.
+*/
+template<typename CharT, typename Traits, typename StrAlloc>
+struct SnapshotCodec<std::basic_string<CharT, Traits, StrAlloc> >
+{
+    static void write(SnapshotWriter& out, const std::basic_string<CharT, Traits, StrAlloc>& value)
+    {
+        std::uint64_t length = value.size();
+        out.write(&length, sizeof(length));
+        out.write(value.data(), value.size() * sizeof(CharT));
+    }
+
+    static void read(SnapshotReader& in, std::basic_string<CharT, Traits, StrAlloc>& value)
+    {
+        std::uint64_t length = 0;
+        in.read(&length, sizeof(length));
+        // read in pieces, so a corrupt length cannot allocate unbounded memory
+        value.clear();
+        const std::size_t kPiece = 4096;
+        CharT piece[kPiece];
+        while(length != 0){
+            std::size_t n = (length < kPiece) ? static_cast<std::size_t>(length) : kPiece;
+            in.read(piece, n * sizeof(CharT));
+            value.append(piece, n);
+            length -= n;
+        }
+    }
+};
+
+/**
+* Where loadFrom() gets its items: reads the next key and value from the
+* snapshot with whatever codecs it was given. The trees build from it
+* through a virtual function, which cannot be a template on the codecs.
+*/
+template<typename Key, typename Value>
+class SnapshotSource
+{
+public:
+    virtual ~SnapshotSource() {}
+    virtual void read(Key& key, Value& value) = 0;
+};
+
+template<typename Key, typename Value, typename KeyCodec, typename ValueCodec>
+class CodecSnapshotSource : public SnapshotSource<Key, Value>
+{
+public:
+    explicit CodecSnapshotSource(SnapshotReader& in) : in_(in) {}
+
+    virtual void read(Key& key, Value& value)
+    {
+        KeyCodec::read(in_, key);
+        ValueCodec::read(in_, value);
+    }
+
+private:
+    SnapshotReader& in_;
+};
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef TREE_STATS_H
+#define TREE_STATS_H
+
+#include <cstdint>
+
+/**
+* Stats policies for BinarySearchTree and AVLTree, passed as their last
+* template parameter. The tree inherits from its policy and calls one hook
+* per event it counts:
+*
+*   countComparison(n)   Compare was called n times (once by default)
+*   countRotation()      a single left or right rotation
+*   countNodeSwap()      two nodes trade places before a remove
+*   countFixStep()       the rebalancing walk examines one ancestor
+*   countAllocation()    a node is created
+*   countIteratorStep()  an iterator moves by one item
+*
+* The hooks are const, since searches and iterators only hold a const
+* tree, and a policy must provide all of them along with reset().
+*/
+
+/**
+* The default policy. Its hooks are empty inline functions and the class
+* has no members, so it adds nothing to a tree's size or code.
+*/
+struct NoTreeStats
+{
+    void countComparison(unsigned = 1) const {}
+    void countRotation() const {}
+    void countNodeSwap() const {}
+    void countFixStep() const {}
+    void countAllocation() const {}
+    void countIteratorStep() const {}
+    void reset() {}
+};
+
+/**
+* A policy that keeps a 64-bit count of each event. The counters are
+* plain integers, so a tree that is read from several threads at once
+* must not use it. Trees moved from one another carry their counts along;
+* read them with the getters and start over with reset().
+*/
+class CountingTreeStats
+{
+public:
+    CountingTreeStats();
+
+    void countComparison(unsigned n = 1) const { comparisons_ += n; }
+    void countRotation() const { ++rotations_; }
+    void countNodeSwap() const { ++nodeSwaps_; }
+    void countFixStep() const { ++fixSteps_; }
+    void countAllocation() const { ++allocations_; }
+    void countIteratorStep() const { ++iteratorSteps_; }
+    void reset();
+
+    std::uint64_t comparisons() const { return comparisons_; }
+    std::uint64_t rotations() const { return rotations_; }
+    std::uint64_t nodeSwaps() const { return nodeSwaps_; }
+    std::uint64_t fixSteps() const { return fixSteps_; }
+    std::uint64_t allocations() const { return allocations_; }
+    std::uint64_t iteratorSteps() const { return iteratorSteps_; }
+
+private:
+    mutable std::uint64_t comparisons_;
+    mutable std::uint64_t rotations_;
+    mutable std::uint64_t nodeSwaps_;
+    mutable std::uint64_t fixSteps_;
+    mutable std::uint64_t allocations_;
+    mutable std::uint64_t iteratorSteps_;
+};
+
+/**
+* Starts every counter at zero.
+*/
+inline CountingTreeStats::CountingTreeStats()
+{
+    reset();
+}
+
+/**
+* Sets every counter back to zero.
+*/
+inline void CountingTreeStats::reset()
+{
+    comparisons_ = 0;
+    rotations_ = 0;
+    nodeSwaps_ = 0;
+    fixSteps_ = 0;
+    allocations_ = 0;
+    iteratorSteps_ = 0;
+}
+
+#endif